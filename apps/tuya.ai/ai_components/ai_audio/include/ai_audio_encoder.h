@@ -0,0 +1,165 @@
+/**
+ * @file ai_audio_encoder.h
+ * @brief Declares the encoder stage used to compress the uploaded audio.
+ *
+ * The stage takes 16-bit PCM from the audio input and cuts it into whole
+ * codec frames, so every packet handed to the AI biz layer carries complete
+ * frames. PCM passthrough and IMA-ADPCM are built in, other codecs (Opus) are
+ * plugged in by the platform with ai_audio_encoder_register().
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+#ifndef __AI_AUDIO_ENCODER_H__
+#define __AI_AUDIO_ENCODER_H__
+
+#include "tuya_cloud_types.h"
+#include "tuya_ai_protocol.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/***********************************************************
+************************macro define************************
+***********************************************************/
+// max number of encoders, built-in ones included
+#ifndef AI_AUDIO_ENCODER_MAX
+#define AI_AUDIO_ENCODER_MAX 4
+#endif
+
+// ima-adpcm frame: 4 bytes header (predictor, step index, reserved) + 4 bits per sample
+#define AI_AUDIO_ADPCM_FRAME_MS      20
+#define AI_AUDIO_ADPCM_HEAD_LEN      4
+#define AI_AUDIO_ADPCM_FRAME_LEN(sp) (AI_AUDIO_ADPCM_HEAD_LEN + ((sp) + 1) / 2)
+
+/***********************************************************
+***********************typedef define***********************
+***********************************************************/
+typedef struct {
+    AI_AUDIO_CODEC_TYPE codec_type;
+    const char *name;
+    uint32_t frame_ms; // duration of one frame, the pcm is encoded in frames of this length
+
+    /**
+     * @brief Creates an encoder instance.
+     * @param[in] sample_rate Sample rate of the pcm.
+     * @param[in] channels Number of interleaved channels of the pcm.
+     * @param[out] ctx Instance of the encoder.
+     * @param[out] frame_max Max encoded length of one frame.
+     */
+    OPERATE_RET (*create)(uint32_t sample_rate, uint8_t channels, void **ctx, uint32_t *frame_max);
+
+    /**
+     * @brief Encodes one frame, out has at least frame_max bytes.
+     * @param[in] samples Samples per channel in pcm, always one frame.
+     */
+    OPERATE_RET (*encode)(void *ctx, const int16_t *pcm, uint32_t samples, uint8_t *out, uint32_t *out_len);
+
+    // drops the state kept between frames, called at the start of each upload
+    void (*reset)(void *ctx);
+
+    void (*destroy)(void *ctx);
+} AI_AUDIO_ENCODER_T;
+
+typedef struct ai_audio_encoder *AI_AUDIO_ENC_HANDLE;
+
+/***********************************************************
+********************function declaration********************
+***********************************************************/
+/**
+ * @brief Registers an encoder, replacing the one of the same codec type.
+ *
+ * @param[in] encoder Encoder ops, must stay valid while registered.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_register(const AI_AUDIO_ENCODER_T *encoder);
+
+/**
+ * @brief Creates the encoder stage for a codec.
+ *
+ * @param[in] codec_type Codec of the output.
+ * @param[in] sample_rate Sample rate of the pcm.
+ * @param[in] channels Number of interleaved channels of the pcm.
+ * @param[out] handle Handle of the encoder stage.
+ *
+ * @return OPRT_NOT_FOUND if no encoder is registered for codec_type.
+ */
+OPERATE_RET ai_audio_encoder_create(AI_AUDIO_CODEC_TYPE codec_type, uint32_t sample_rate, uint8_t channels,
+                                    AI_AUDIO_ENC_HANDLE *handle);
+
+/**
+ * @brief Encodes pcm into whole frames.
+ *
+ * Frames are encoded while out has room for one more frame_max. The tail
+ * shorter than a frame is kept for the next call, so pcm of any length is
+ * taken. What did not fit in out is left in pcm, see used.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ * @param[in] pcm 16-bit pcm.
+ * @param[in] pcm_len Length of pcm in bytes.
+ * @param[out] used Bytes of pcm taken.
+ * @param[out] out Buffer of the encoded frames, at least frame_max bytes.
+ * @param[in] out_size Size of out.
+ * @param[out] out_len Length of the encoded frames in out.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if out
+ * cannot hold a frame, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_encode(AI_AUDIO_ENC_HANDLE handle, const uint8_t *pcm, uint32_t pcm_len, uint32_t *used,
+                                    uint8_t *out, uint32_t out_size, uint32_t *out_len);
+
+/**
+ * @brief Encodes the kept tail, padded with silence to a whole frame.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ * @param[out] out Buffer of the encoded frame, at least frame_max bytes.
+ * @param[in] out_size Size of out.
+ * @param[out] out_len Length of the encoded frame, 0 if no tail was kept.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_flush(AI_AUDIO_ENC_HANDLE handle, uint8_t *out, uint32_t out_size, uint32_t *out_len);
+
+/**
+ * @brief Drops the kept tail and the codec state.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return none
+ */
+void ai_audio_encoder_reset(AI_AUDIO_ENC_HANDLE handle);
+
+/**
+ * @brief Gets the codec type of the encoder stage.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return AI_AUDIO_CODEC_TYPE - codec of the output.
+ */
+AI_AUDIO_CODEC_TYPE ai_audio_encoder_get_codec(AI_AUDIO_ENC_HANDLE handle);
+
+/**
+ * @brief Gets the max encoded length of one frame.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return uint32_t - max length in bytes.
+ */
+uint32_t ai_audio_encoder_get_frame_max(AI_AUDIO_ENC_HANDLE handle);
+
+/**
+ * @brief Destroys the encoder stage.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_destroy(AI_AUDIO_ENC_HANDLE handle);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __AI_AUDIO_ENCODER_H__ */
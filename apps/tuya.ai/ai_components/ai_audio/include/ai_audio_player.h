@@ -36,6 +36,13 @@ typedef enum {
     AI_AUDIO_PLAYER_STAT_MAX,
 } AI_AUDIO_PLAYER_STATE_E;
 
+typedef struct {
+    uint32_t underrun;    // output found no decoded pcm in the middle of a stream
+    uint32_t overrun;     // writes that found the mp3 stream buffer full and waited
+    uint32_t periods;     // decoded periods played
+    uint32_t buffered_ms; // decoded pcm waiting to be played
+} AI_AUDIO_PLAYER_PIPE_STAT_T;
+
 /***********************************************************
 ********************function declaration********************
 ***********************************************************/
@@ -48,9 +55,21 @@ typedef enum {
  */
 OPERATE_RET ai_audio_player_init(void);
 
+/**
+ * @brief Stops the audio player and its threads, and releases the resources
+ *        set up by ai_audio_player_init.
+ *
+ * @param None
+ * @return OPERATE_RET - Returns OPRT_OK.
+ */
+OPERATE_RET ai_audio_player_deinit(void);
+
 /**
  * @brief Starts the audio player with the specified identifier.
  *
+ * If the player is already playing, the new stream is queued behind the
+ * current one and played without a gap, data of the old id is rejected from
+ * now on.
  *
  * @param id        The identifier for the current playback session.
  *                  If NULL, no specific ID is set.
@@ -87,6 +106,15 @@ OPERATE_RET ai_audio_player_stop(void);
  */
 uint8_t ai_audio_player_is_playing(void);
 
+/**
+ * @brief Gets the counters of the decode-ahead pipeline.
+ *
+ * @param stat      Pointer to the counters to fill.
+ *
+ * @return OPERATE_RET - Returns OPRT_OK on success, otherwise returns an error code.
+ */
+OPERATE_RET ai_audio_player_get_pipe_stat(AI_AUDIO_PLAYER_PIPE_STAT_T *stat);
+
 #ifdef __cplusplus
 }
 #endif
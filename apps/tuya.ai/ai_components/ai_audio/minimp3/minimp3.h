@@ -45,6 +45,11 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef MINIMP3_SCRATCH_MALLOC
+#define MINIMP3_SCRATCH_MALLOC(size) tkl_system_psram_malloc(size)
+#define MINIMP3_SCRATCH_FREE(ptr)    tkl_system_psram_free(ptr)
+#endif /* MINIMP3_SCRATCH_MALLOC */
+
 #define MAX_FREE_FORMAT_FRAME_SIZE 2304 /* more than ISO spec's */
 #ifndef MAX_FRAME_SYNC_MATCHES
 #define MAX_FRAME_SYNC_MATCHES 10
@@ -189,13 +194,20 @@ static int have_simd()
 #define HAVE_SIMD 0
 #endif /* !defined(MINIMP3_NO_SIMD) */
 
-#if defined(__ARM_ARCH) && (__ARM_ARCH >= 6) && !defined(__aarch64__) && !defined(_M_ARM64)
+/* ssat is there from armv6 and on armv7-m/armv8-m mainline (T5AI), not on armv8-m baseline */
+#if defined(__ARM_FEATURE_SAT) && !defined(__aarch64__) && !defined(_M_ARM64)
+#include <arm_acle.h>
 #define HAVE_ARMV6 1
 static __inline__ __attribute__((always_inline)) int32_t minimp3_clip_int16_arm(int32_t a)
 {
+#if defined(__ssat)
+    /* the intrinsic, unlike inline asm, lets the compiler schedule it with the float to int conversion */
+    return __ssat(a, 16);
+#else
     int32_t x = 0;
     __asm__("ssat %0, #16, %1" : "=r"(x) : "r"(a));
     return x;
+#endif
 }
 #else
 #define HAVE_ARMV6 0
@@ -232,6 +244,50 @@ typedef struct {
     float grbuf[2][576], scf[40], syn[18 + 15][2 * 32];
     uint8_t ist_pos[2][39];
 } mp3dec_scratch_t;
+
+/*
+ * MINIMP3_KEEP_SCRATCH keeps the scratch of the first frame for the next ones instead of allocating and
+ * clearing it for every frame. Only one thread may decode then. The scratch is not cleared, every field is
+ * written before it is read in a frame, as in upstream minimp3 where the scratch is on the stack.
+ * mp3d_scratch_release frees it once no more frames are decoded.
+ */
+#ifdef MINIMP3_KEEP_SCRATCH
+static mp3dec_scratch_t *s_scratch = NULL;
+
+static void mp3d_scratch_release(void)
+{
+    if (s_scratch) {
+        MINIMP3_SCRATCH_FREE(s_scratch);
+        s_scratch = NULL;
+    }
+}
+#endif /* MINIMP3_KEEP_SCRATCH */
+
+static mp3dec_scratch_t *mp3d_scratch_get(void)
+{
+    mp3dec_scratch_t *scratch = NULL;
+#ifdef MINIMP3_KEEP_SCRATCH
+    if (NULL == s_scratch) {
+        s_scratch = (mp3dec_scratch_t *)MINIMP3_SCRATCH_MALLOC(sizeof(mp3dec_scratch_t));
+    }
+    scratch = s_scratch;
+#else  /* MINIMP3_KEEP_SCRATCH */
+    scratch = (mp3dec_scratch_t *)MINIMP3_SCRATCH_MALLOC(sizeof(mp3dec_scratch_t));
+    if (scratch) {
+        memset(scratch, 0, sizeof(mp3dec_scratch_t));
+    }
+#endif /* MINIMP3_KEEP_SCRATCH */
+    return scratch;
+}
+
+static void mp3d_scratch_put(mp3dec_scratch_t *scratch)
+{
+#ifndef MINIMP3_KEEP_SCRATCH
+    MINIMP3_SCRATCH_FREE(scratch);
+#else  /* MINIMP3_KEEP_SCRATCH */
+    (void)scratch;
+#endif /* MINIMP3_KEEP_SCRATCH */
+}
 #pragma pack()
 static void bs_init(bs_t *bs, const uint8_t *data, int bytes)
 {
@@ -1863,21 +1919,16 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
         get_bits(bs_frame, 16);
     }
 
-    mp3dec_scratch_t *scratch = NULL;
-    scratch = (mp3dec_scratch_t *)tkl_system_psram_malloc(sizeof(mp3dec_scratch_t));
+    mp3dec_scratch_t *scratch = mp3d_scratch_get();
     if (scratch == NULL) {
         return 0;
     }
-    memset(scratch, 0, sizeof(mp3dec_scratch_t));
 
     if (info->layer == 3) {
         int main_data_begin = L3_read_side_info(bs_frame, scratch->gr_info, hdr);
         if (main_data_begin < 0 || bs_frame->pos > bs_frame->limit) {
             mp3dec_init(dec);
-            if (scratch) {
-                tkl_system_psram_free(scratch);
-                scratch = NULL;
-            }
+            mp3d_scratch_put(scratch);
             return 0;
         }
         success = L3_restore_reservoir(dec, bs_frame, scratch, main_data_begin);
@@ -1891,13 +1942,13 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
         L3_save_reservoir(dec, scratch);
     } else {
 #ifdef MINIMP3_ONLY_MP3
+        mp3d_scratch_put(scratch);
         return 0;
 #else  /* MINIMP3_ONLY_MP3 */
         // L12_scale_info sci[1];
-        L12_scale_info *sci = (L12_scale_info *)tkl_system_psram_malloc(sizeof(L12_scale_info));
+        L12_scale_info *sci = (L12_scale_info *)MINIMP3_SCRATCH_MALLOC(sizeof(L12_scale_info));
         if (sci == NULL) {
-            tkl_system_psram_free(scratch);
-            scratch = NULL;
+            mp3d_scratch_put(scratch);
             return 0;
         }
         memset(sci, 0, sizeof(L12_scale_info));
@@ -1915,30 +1966,17 @@ int mp3dec_decode_frame(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_s
             }
             if (bs_frame->pos > bs_frame->limit) {
                 mp3dec_init(dec);
-                if (sci) {
-                    tkl_system_psram_free(sci);
-                    sci = NULL;
-                }
-
-                if (scratch) {
-                    tkl_system_psram_free(scratch);
-                    scratch = NULL;
-                }
+                MINIMP3_SCRATCH_FREE(sci);
+                mp3d_scratch_put(scratch);
                 return 0;
             }
         }
 
-        if (sci) {
-            tkl_system_psram_free(sci);
-            sci = NULL;
-        }
+        MINIMP3_SCRATCH_FREE(sci);
 #endif /* MINIMP3_ONLY_MP3 */
     }
 
-    if (scratch) {
-        tkl_system_psram_free(scratch);
-        scratch = NULL;
-    }
+    mp3d_scratch_put(scratch);
     return success * hdr_frame_samples(dec->header);
 }
 
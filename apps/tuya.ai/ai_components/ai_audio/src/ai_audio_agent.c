@@ -25,11 +25,35 @@
 #endif
 
 #include "ai_audio.h"
+#include "ai_audio_encoder.h"
 
 /***********************************************************
 ************************macro define************************
 ***********************************************************/
 #define AI_AGENT_NLG_TEXT_MAX_LEN (4 * 1024)
+#define AI_AGENT_UPLOAD_WAIT_MS   100  // max wait for room in the ai biz send queue
+#define AI_AGENT_UPLOAD_FLUSH_MS  3000 // max wait for queued audio before the upload end events
+#define AI_AGENT_UPLOAD_RATE      16000
+#define AI_AGENT_UPLOAD_BITS      16
+
+// codec of the uploaded audio, adpcm is used when no encoder is registered for it
+#ifndef AI_AGENT_UPLOAD_CODEC
+#if defined(ENABLE_AI_UPLOAD_CODEC_OPUS) && (ENABLE_AI_UPLOAD_CODEC_OPUS == 1)
+#define AI_AGENT_UPLOAD_CODEC AUDIO_CODEC_OPUS
+#elif defined(ENABLE_AI_UPLOAD_CODEC_ADPCM) && (ENABLE_AI_UPLOAD_CODEC_ADPCM == 1)
+#define AI_AGENT_UPLOAD_CODEC AUDIO_CODEC_ADPCM
+#else
+#define AI_AGENT_UPLOAD_CODEC AUDIO_CODEC_PCM
+#endif
+#endif
+
+// max encoded audio in one biz packet, so a packet goes out as a single ai protocol fragment
+#ifndef AI_AGENT_UPLOAD_PKT_LEN
+#define AI_AGENT_UPLOAD_PKT_LEN 4096
+#endif
+#if AI_AGENT_UPLOAD_PKT_LEN > (AI_MAX_FRAGMENT_LENGTH - 512)
+#error "AI_AGENT_UPLOAD_PKT_LEN does not fit in one ai protocol fragment"
+#endif
 
 #define TY_BIZCODE_AI_CHAT     0x00010001 // 聊天场景可支持打断
 #define TY_AI_CHAT_ID_DS_CNT   4
@@ -53,6 +77,8 @@ typedef struct {
     AI_AGENT_CBS_T           cbs;
     AI_AGENT_CHAT_STREAM_E   stream_status;
     bool                     is_audio_upload_first_frame;
+    AI_AUDIO_ENC_HANDLE      enc;
+    uint8_t                 *enc_buf;
 } AI_AGENT_SESSION_T;
 // clang-format on
 /***********************************************************
@@ -456,6 +482,34 @@ static int __ai_agent_session_close(void *data)
     return OPRT_OK;
 }
 
+static OPERATE_RET __ai_agent_encoder_init(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    rt = ai_audio_encoder_create(AI_AGENT_UPLOAD_CODEC, AI_AGENT_UPLOAD_RATE, AUDIO_CHANNELS_MONO, &sg_ai.enc);
+    if (OPRT_NOT_FOUND == rt && AUDIO_CODEC_ADPCM != AI_AGENT_UPLOAD_CODEC) {
+        PR_WARN("no encoder for upload codec %d, use adpcm", AI_AGENT_UPLOAD_CODEC);
+        rt = ai_audio_encoder_create(AUDIO_CODEC_ADPCM, AI_AGENT_UPLOAD_RATE, AUDIO_CHANNELS_MONO, &sg_ai.enc);
+    }
+    TUYA_CALL_ERR_RETURN(rt);
+
+    if (ai_audio_encoder_get_frame_max(sg_ai.enc) > AI_AGENT_UPLOAD_PKT_LEN) {
+        PR_ERR("encoded frame larger than upload packet");
+        ai_audio_encoder_destroy(sg_ai.enc);
+        sg_ai.enc = NULL;
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    sg_ai.enc_buf = tal_malloc(AI_AGENT_UPLOAD_PKT_LEN);
+    if (NULL == sg_ai.enc_buf) {
+        ai_audio_encoder_destroy(sg_ai.enc);
+        sg_ai.enc = NULL;
+        return OPRT_MALLOC_FAILED;
+    }
+
+    return OPRT_OK;
+}
+
 static OPERATE_RET __ai_agent_init(void *data)
 {
     PR_DEBUG("%s...", __func__);
@@ -487,6 +541,8 @@ OPERATE_RET ai_audio_agent_init(AI_AGENT_CBS_T *cbs)
         memcpy(&sg_ai.cbs, cbs, sizeof(AI_AGENT_CBS_T));
     }
 
+    TUYA_CALL_ERR_RETURN(__ai_agent_encoder_init());
+
     PR_DEBUG("ai session wait for mqtt connected...");
 
     tal_event_subscribe(EVENT_MQTT_CONNECTED, "ai_agent_init", __ai_agent_init, SUBSCRIBE_TYPE_ONETIME);
@@ -537,31 +593,26 @@ OPERATE_RET ai_audio_agent_upload_start(uint8_t enable_vad)
     }
 
     sg_ai.is_audio_upload_first_frame = true;
+    ai_audio_encoder_reset(sg_ai.enc);
     PR_DEBUG("upload start event_id:%s", sg_ai.event_id);
 
     return rt;
 }
 
-/**
- * @brief Uploads audio data to the AI service.
- * @param data Pointer to the audio data buffer.
- * @param len Length of the audio data in bytes.
- * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
- */
-OPERATE_RET ai_audio_agent_upload_data(uint8_t *data, uint32_t len)
+static OPERATE_RET __ai_agent_upload_pkt(uint8_t *data, uint32_t len, bool is_end)
 {
     OPERATE_RET rt = OPRT_OK;
 
-    // send data use tuya_ai_send_biz_pkt, pcm
+    // queue data to the ai biz send thread
     AI_BIZ_ATTR_INFO_T attr = {
         .flag = AI_HAS_ATTR,
         .type = AI_PT_AUDIO,
         .value.audio =
             {
-                .base.codec_type = AUDIO_CODEC_PCM,
-                .base.sample_rate = 16000,
+                .base.codec_type = ai_audio_encoder_get_codec(sg_ai.enc),
+                .base.sample_rate = AI_AGENT_UPLOAD_RATE,
                 .base.channels = AUDIO_CHANNELS_MONO,
-                .base.bit_depth = 16,
+                .base.bit_depth = AI_AGENT_UPLOAD_BITS,
                 .option.user_len = 0,
                 .option.user_data = NULL,
                 .option.session_id_list = NULL,
@@ -579,7 +630,7 @@ OPERATE_RET ai_audio_agent_upload_data(uint8_t *data, uint32_t len)
     if (sg_ai.is_audio_upload_first_frame) {
         head.stream_flag = AI_STREAM_START;
         sg_ai.is_audio_upload_first_frame = false;
-    } else if (NULL == data) {
+    } else if (is_end) {
         head.stream_flag = AI_STREAM_END;
         sg_ai.is_audio_upload_first_frame = true;
     } else {
@@ -588,7 +639,41 @@ OPERATE_RET ai_audio_agent_upload_data(uint8_t *data, uint32_t len)
 
     PR_DEBUG("tuya ai upload data[%d][%d]...", head.stream_flag, len);
 
-    TUYA_CALL_ERR_RETURN(tuya_ai_send_biz_pkt(TY_AI_CHAT_ID_DS_AUDIO, &attr, AI_PT_AUDIO, &head, (char *)data));
+    TUYA_CALL_ERR_RETURN(tuya_ai_biz_send_enqueue(TY_AI_CHAT_ID_DS_AUDIO, &attr, AI_PT_AUDIO, &head,
+                                                  len ? (char *)data : NULL, AI_AGENT_UPLOAD_WAIT_MS));
+
+    return rt;
+}
+
+/**
+ * @brief Uploads audio data to the AI service.
+ * @param data Pointer to the audio data buffer.
+ * @param len Length of the audio data in bytes.
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_agent_upload_data(uint8_t *data, uint32_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t used = 0, enc_len = 0;
+
+    TUYA_CHECK_NULL_RETURN(sg_ai.enc, OPRT_RESOURCE_NOT_READY);
+
+    // end of the stream, send the tail of the encoder with it
+    if (NULL == data) {
+        TUYA_CALL_ERR_LOG(ai_audio_encoder_flush(sg_ai.enc, sg_ai.enc_buf, AI_AGENT_UPLOAD_PKT_LEN, &enc_len));
+        return __ai_agent_upload_pkt(sg_ai.enc_buf, enc_len, true);
+    }
+
+    // each packet carries whole frames and fits in one ai protocol fragment
+    while (len) {
+        TUYA_CALL_ERR_RETURN(
+            ai_audio_encoder_encode(sg_ai.enc, data, len, &used, sg_ai.enc_buf, AI_AGENT_UPLOAD_PKT_LEN, &enc_len));
+        data += used;
+        len -= used;
+        if (enc_len) {
+            TUYA_CALL_ERR_RETURN(__ai_agent_upload_pkt(sg_ai.enc_buf, enc_len, false));
+        }
+    }
 
     return rt;
 }
@@ -605,6 +690,8 @@ OPERATE_RET ai_audio_agent_upload_stop(void)
     PR_DEBUG("tuya ai upload stop...");
 
     TUYA_CALL_ERR_RETURN(ai_audio_agent_upload_data(NULL, 0));
+    // the end events are sent directly, let the queued audio go out first
+    TUYA_CALL_ERR_LOG(tuya_ai_biz_send_flush(AI_AGENT_UPLOAD_FLUSH_MS));
 
     AI_ATTRIBUTE_T attr[] = {{
         .type = 1002,
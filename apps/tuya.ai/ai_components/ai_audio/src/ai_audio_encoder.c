@@ -0,0 +1,499 @@
+/**
+ * @file ai_audio_encoder.c
+ * @brief Implements the encoder stage of the uploaded audio.
+ *
+ * The stage keeps the pcm tail shorter than a frame between calls and only
+ * hands whole frames to the encoder. PCM passthrough and IMA-ADPCM are built
+ * in. An ADPCM frame starts with the predictor (int16, little endian) and the
+ * step index the decoder starts from, all samples of the frame follow as
+ * 4-bit codes, low nibble first.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+#include "tal_api.h"
+
+#include "ai_audio_encoder.h"
+
+/***********************************************************
+************************macro define************************
+***********************************************************/
+#define AI_AUDIO_PCM_FRAME_MS 10
+
+/***********************************************************
+***********************typedef define***********************
+***********************************************************/
+struct ai_audio_encoder {
+    const AI_AUDIO_ENCODER_T *ops;
+    void *ctx;
+    uint32_t frame_max;
+    uint32_t frame_samples; // samples per channel of one frame
+    uint32_t frame_bytes;   // pcm bytes of one frame
+    uint32_t tail_len;
+    uint8_t *tail;          // pcm shorter than a frame, frame_bytes long
+};
+
+typedef struct {
+    uint32_t frame_bytes;
+} AI_AUDIO_PCM_ENC_T;
+
+typedef struct {
+    int32_t predictor;
+    int32_t index;
+} AI_AUDIO_ADPCM_ENC_T;
+
+/***********************************************************
+***********************const declaration********************
+***********************************************************/
+static const int8_t sg_adpcm_index_tbl[16] = {-1, -1, -1, -1, 2, 4, 6, 8, -1, -1, -1, -1, 2, 4, 6, 8};
+
+static const int16_t sg_adpcm_step_tbl[89] = {
+    7,     8,     9,     10,    11,    12,    13,    14,    16,    17,    19,    21,    23,    25,    28,
+    31,    34,    37,    41,    45,    50,    55,    60,    66,    73,    80,    88,    97,    107,   118,
+    130,   143,   157,   173,   190,   209,   230,   253,   279,   307,   337,   371,   408,   449,   494,
+    544,   598,   658,   724,   796,   876,   963,   1060,  1166,  1282,  1411,  1552,  1707,  1878,  2066,
+    2272,  2499,  2749,  3024,  3327,  3660,  4026,  4428,  4871,  5358,  5894,  6484,  7132,  7845,  8630,
+    9493,  10442, 11487, 12635, 13899, 15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767};
+
+/***********************************************************
+********************function declaration********************
+***********************************************************/
+static OPERATE_RET __pcm_enc_create(uint32_t sample_rate, uint8_t channels, void **ctx, uint32_t *frame_max);
+static OPERATE_RET __pcm_enc_encode(void *ctx, const int16_t *pcm, uint32_t samples, uint8_t *out,
+                                    uint32_t *out_len);
+static void __pcm_enc_destroy(void *ctx);
+static OPERATE_RET __adpcm_enc_create(uint32_t sample_rate, uint8_t channels, void **ctx, uint32_t *frame_max);
+static OPERATE_RET __adpcm_enc_encode(void *ctx, const int16_t *pcm, uint32_t samples, uint8_t *out,
+                                      uint32_t *out_len);
+static void __adpcm_enc_reset(void *ctx);
+static void __adpcm_enc_destroy(void *ctx);
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+static const AI_AUDIO_ENCODER_T sg_pcm_encoder = {
+    .codec_type = AUDIO_CODEC_PCM,
+    .name = "pcm",
+    .frame_ms = AI_AUDIO_PCM_FRAME_MS,
+    .create = __pcm_enc_create,
+    .encode = __pcm_enc_encode,
+    .reset = NULL,
+    .destroy = __pcm_enc_destroy,
+};
+
+static const AI_AUDIO_ENCODER_T sg_adpcm_encoder = {
+    .codec_type = AUDIO_CODEC_ADPCM,
+    .name = "ima-adpcm",
+    .frame_ms = AI_AUDIO_ADPCM_FRAME_MS,
+    .create = __adpcm_enc_create,
+    .encode = __adpcm_enc_encode,
+    .reset = __adpcm_enc_reset,
+    .destroy = __adpcm_enc_destroy,
+};
+
+static const AI_AUDIO_ENCODER_T *sg_encoder_tbl[AI_AUDIO_ENCODER_MAX] = {&sg_pcm_encoder, &sg_adpcm_encoder};
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+static OPERATE_RET __pcm_enc_create(uint32_t sample_rate, uint8_t channels, void **ctx, uint32_t *frame_max)
+{
+    AI_AUDIO_PCM_ENC_T *enc = NULL;
+
+    enc = tal_malloc(sizeof(AI_AUDIO_PCM_ENC_T));
+    TUYA_CHECK_NULL_RETURN(enc, OPRT_MALLOC_FAILED);
+
+    enc->frame_bytes = sample_rate * AI_AUDIO_PCM_FRAME_MS / 1000 * channels * sizeof(int16_t);
+
+    *ctx = enc;
+    *frame_max = enc->frame_bytes;
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET __pcm_enc_encode(void *ctx, const int16_t *pcm, uint32_t samples, uint8_t *out,
+                                    uint32_t *out_len)
+{
+    AI_AUDIO_PCM_ENC_T *enc = (AI_AUDIO_PCM_ENC_T *)ctx;
+
+    memcpy(out, pcm, enc->frame_bytes);
+    *out_len = enc->frame_bytes;
+
+    return OPRT_OK;
+}
+
+static void __pcm_enc_destroy(void *ctx)
+{
+    tal_free(ctx);
+}
+
+static OPERATE_RET __adpcm_enc_create(uint32_t sample_rate, uint8_t channels, void **ctx, uint32_t *frame_max)
+{
+    AI_AUDIO_ADPCM_ENC_T *enc = NULL;
+
+    if (channels != 1) {
+        PR_ERR("adpcm only encodes mono, channels:%d", channels);
+        return OPRT_NOT_SUPPORTED;
+    }
+
+    enc = tal_malloc(sizeof(AI_AUDIO_ADPCM_ENC_T));
+    TUYA_CHECK_NULL_RETURN(enc, OPRT_MALLOC_FAILED);
+    memset(enc, 0, sizeof(AI_AUDIO_ADPCM_ENC_T));
+
+    *ctx = enc;
+    *frame_max = AI_AUDIO_ADPCM_FRAME_LEN(sample_rate * AI_AUDIO_ADPCM_FRAME_MS / 1000);
+
+    return OPRT_OK;
+}
+
+static uint8_t __adpcm_enc_sample(AI_AUDIO_ADPCM_ENC_T *enc, int16_t sample)
+{
+    int32_t step = sg_adpcm_step_tbl[enc->index];
+    int32_t diff = sample - enc->predictor;
+    int32_t vpdiff = step >> 3;
+    uint8_t code = 0;
+
+    if (diff < 0) {
+        code = 8;
+        diff = -diff;
+    }
+    if (diff >= step) {
+        code |= 4;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 2;
+        diff -= step;
+        vpdiff += step;
+    }
+    step >>= 1;
+    if (diff >= step) {
+        code |= 1;
+        vpdiff += step;
+    }
+
+    enc->predictor += (code & 8) ? -vpdiff : vpdiff;
+    if (enc->predictor > 32767) {
+        enc->predictor = 32767;
+    } else if (enc->predictor < -32768) {
+        enc->predictor = -32768;
+    }
+
+    enc->index += sg_adpcm_index_tbl[code];
+    if (enc->index < 0) {
+        enc->index = 0;
+    } else if (enc->index > 88) {
+        enc->index = 88;
+    }
+
+    return code;
+}
+
+static OPERATE_RET __adpcm_enc_encode(void *ctx, const int16_t *pcm, uint32_t samples, uint8_t *out,
+                                      uint32_t *out_len)
+{
+    AI_AUDIO_ADPCM_ENC_T *enc = (AI_AUDIO_ADPCM_ENC_T *)ctx;
+    uint8_t *p = out + AI_AUDIO_ADPCM_HEAD_LEN;
+    uint32_t i;
+
+    out[0] = (uint8_t)(enc->predictor & 0xff);
+    out[1] = (uint8_t)((enc->predictor >> 8) & 0xff);
+    out[2] = (uint8_t)enc->index;
+    out[3] = 0;
+
+    for (i = 0; i + 1 < samples; i += 2) {
+        *p = __adpcm_enc_sample(enc, pcm[i]);
+        *p++ |= __adpcm_enc_sample(enc, pcm[i + 1]) << 4;
+    }
+    if (i < samples) {
+        *p++ = __adpcm_enc_sample(enc, pcm[i]);
+    }
+
+    *out_len = p - out;
+
+    return OPRT_OK;
+}
+
+static void __adpcm_enc_reset(void *ctx)
+{
+    memset(ctx, 0, sizeof(AI_AUDIO_ADPCM_ENC_T));
+}
+
+static void __adpcm_enc_destroy(void *ctx)
+{
+    tal_free(ctx);
+}
+
+static OPERATE_RET __ai_audio_encoder_frame(AI_AUDIO_ENC_HANDLE handle, const uint8_t *pcm, uint8_t *out,
+                                            uint32_t *out_len)
+{
+    // pcm from the input ringbuffer is not always 2-byte aligned
+    if ((uintptr_t)pcm & 1) {
+        memcpy(handle->tail, pcm, handle->frame_bytes);
+        pcm = handle->tail;
+    }
+
+    return handle->ops->encode(handle->ctx, (const int16_t *)pcm, handle->frame_samples, out, out_len);
+}
+
+/**
+ * @brief Registers an encoder, replacing the one of the same codec type.
+ *
+ * @param[in] encoder Encoder ops, must stay valid while registered.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_register(const AI_AUDIO_ENCODER_T *encoder)
+{
+    int i, idle = -1;
+
+    TUYA_CHECK_NULL_RETURN(encoder, OPRT_INVALID_PARM);
+    if (NULL == encoder->create || NULL == encoder->encode || NULL == encoder->destroy || 0 == encoder->frame_ms) {
+        return OPRT_INVALID_PARM;
+    }
+
+    for (i = 0; i < AI_AUDIO_ENCODER_MAX; i++) {
+        if (sg_encoder_tbl[i] && sg_encoder_tbl[i]->codec_type == encoder->codec_type) {
+            break;
+        }
+        if (NULL == sg_encoder_tbl[i] && idle < 0) {
+            idle = i;
+        }
+    }
+    if (i == AI_AUDIO_ENCODER_MAX) {
+        if (idle < 0) {
+            PR_ERR("encoder table is full");
+            return OPRT_EXCEED_UPPER_LIMIT;
+        }
+        i = idle;
+    }
+
+    sg_encoder_tbl[i] = encoder;
+    PR_DEBUG("audio encoder %s registered, codec:%d", encoder->name, encoder->codec_type);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Creates the encoder stage for a codec.
+ *
+ * @param[in] codec_type Codec of the output.
+ * @param[in] sample_rate Sample rate of the pcm.
+ * @param[in] channels Number of interleaved channels of the pcm.
+ * @param[out] handle Handle of the encoder stage.
+ *
+ * @return OPRT_NOT_FOUND if no encoder is registered for codec_type.
+ */
+OPERATE_RET ai_audio_encoder_create(AI_AUDIO_CODEC_TYPE codec_type, uint32_t sample_rate, uint8_t channels,
+                                    AI_AUDIO_ENC_HANDLE *handle)
+{
+    OPERATE_RET rt = OPRT_OK;
+    const AI_AUDIO_ENCODER_T *ops = NULL;
+    AI_AUDIO_ENC_HANDLE enc = NULL;
+    int i;
+
+    TUYA_CHECK_NULL_RETURN(handle, OPRT_INVALID_PARM);
+    if (0 == sample_rate || 0 == channels) {
+        return OPRT_INVALID_PARM;
+    }
+
+    for (i = 0; i < AI_AUDIO_ENCODER_MAX; i++) {
+        if (sg_encoder_tbl[i] && sg_encoder_tbl[i]->codec_type == codec_type) {
+            ops = sg_encoder_tbl[i];
+            break;
+        }
+    }
+    if (NULL == ops) {
+        return OPRT_NOT_FOUND;
+    }
+
+    enc = tal_malloc(sizeof(struct ai_audio_encoder));
+    TUYA_CHECK_NULL_RETURN(enc, OPRT_MALLOC_FAILED);
+    memset(enc, 0, sizeof(struct ai_audio_encoder));
+
+    enc->ops = ops;
+    enc->frame_samples = sample_rate * ops->frame_ms / 1000;
+    enc->frame_bytes = enc->frame_samples * channels * sizeof(int16_t);
+    enc->tail = tal_malloc(enc->frame_bytes);
+    TUYA_CHECK_NULL_GOTO(enc->tail, __ERR);
+
+    TUYA_CALL_ERR_GOTO(ops->create(sample_rate, channels, &enc->ctx, &enc->frame_max), __ERR);
+
+    PR_DEBUG("audio encoder %s, frame %d ms, max %d bytes", ops->name, ops->frame_ms, enc->frame_max);
+    *handle = enc;
+
+    return OPRT_OK;
+
+__ERR:
+    if (enc->tail) {
+        tal_free(enc->tail);
+    }
+    tal_free(enc);
+
+    return (OPRT_OK != rt) ? rt : OPRT_MALLOC_FAILED;
+}
+
+/**
+ * @brief Encodes pcm into whole frames.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ * @param[in] pcm 16-bit pcm.
+ * @param[in] pcm_len Length of pcm in bytes.
+ * @param[out] used Bytes of pcm taken.
+ * @param[out] out Buffer of the encoded frames, at least frame_max bytes.
+ * @param[in] out_size Size of out.
+ * @param[out] out_len Length of the encoded frames in out.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if out
+ * cannot hold a frame, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_encode(AI_AUDIO_ENC_HANDLE handle, const uint8_t *pcm, uint32_t pcm_len, uint32_t *used,
+                                    uint8_t *out, uint32_t out_size, uint32_t *out_len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t offset = 0, len = 0, copy = 0;
+
+    TUYA_CHECK_NULL_RETURN(handle, OPRT_INVALID_PARM);
+    TUYA_CHECK_NULL_RETURN(used, OPRT_INVALID_PARM);
+    TUYA_CHECK_NULL_RETURN(out_len, OPRT_INVALID_PARM);
+
+    *used = 0;
+    *out_len = 0;
+    if (NULL == pcm || 0 == pcm_len) {
+        return OPRT_OK;
+    }
+    if (out_size < handle->frame_max) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    // complete the tail of the last call first
+    if (handle->tail_len) {
+        copy = handle->frame_bytes - handle->tail_len;
+        copy = (copy > pcm_len) ? pcm_len : copy;
+        if (handle->tail_len + copy == handle->frame_bytes) {
+            memcpy(handle->tail + handle->tail_len, pcm, copy);
+            TUYA_CALL_ERR_RETURN(handle->ops->encode(handle->ctx, (const int16_t *)handle->tail,
+                                                     handle->frame_samples, out, &len));
+            handle->tail_len = 0;
+            *out_len += len;
+        } else {
+            memcpy(handle->tail + handle->tail_len, pcm, copy);
+            handle->tail_len += copy;
+        }
+        offset = copy;
+    }
+
+    while (pcm_len - offset >= handle->frame_bytes && out_size - *out_len >= handle->frame_max) {
+        TUYA_CALL_ERR_GOTO(__ai_audio_encoder_frame(handle, pcm + offset, out + *out_len, &len), __EXIT);
+        *out_len += len;
+        offset += handle->frame_bytes;
+    }
+
+    // keep the tail shorter than a frame, leave whole frames that did not fit
+    if (offset < pcm_len && pcm_len - offset < handle->frame_bytes) {
+        memcpy(handle->tail, pcm + offset, pcm_len - offset);
+        handle->tail_len = pcm_len - offset;
+        offset = pcm_len;
+    }
+
+__EXIT:
+    *used = offset;
+
+    return rt;
+}
+
+/**
+ * @brief Encodes the kept tail, padded with silence to a whole frame.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ * @param[out] out Buffer of the encoded frame, at least frame_max bytes.
+ * @param[in] out_size Size of out.
+ * @param[out] out_len Length of the encoded frame, 0 if no tail was kept.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_flush(AI_AUDIO_ENC_HANDLE handle, uint8_t *out, uint32_t out_size, uint32_t *out_len)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    TUYA_CHECK_NULL_RETURN(handle, OPRT_INVALID_PARM);
+    TUYA_CHECK_NULL_RETURN(out_len, OPRT_INVALID_PARM);
+
+    *out_len = 0;
+    if (0 == handle->tail_len) {
+        return OPRT_OK;
+    }
+    if (out_size < handle->frame_max) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    memset(handle->tail + handle->tail_len, 0, handle->frame_bytes - handle->tail_len);
+    handle->tail_len = 0;
+    TUYA_CALL_ERR_RETURN(
+        handle->ops->encode(handle->ctx, (const int16_t *)handle->tail, handle->frame_samples, out, out_len));
+
+    return rt;
+}
+
+/**
+ * @brief Drops the kept tail and the codec state.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return none
+ */
+void ai_audio_encoder_reset(AI_AUDIO_ENC_HANDLE handle)
+{
+    if (NULL == handle) {
+        return;
+    }
+
+    handle->tail_len = 0;
+    if (handle->ops->reset) {
+        handle->ops->reset(handle->ctx);
+    }
+}
+
+/**
+ * @brief Gets the codec type of the encoder stage.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return AI_AUDIO_CODEC_TYPE - codec of the output.
+ */
+AI_AUDIO_CODEC_TYPE ai_audio_encoder_get_codec(AI_AUDIO_ENC_HANDLE handle)
+{
+    return handle ? handle->ops->codec_type : AUDIO_CODEC_INVALID;
+}
+
+/**
+ * @brief Gets the max encoded length of one frame.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return uint32_t - max length in bytes.
+ */
+uint32_t ai_audio_encoder_get_frame_max(AI_AUDIO_ENC_HANDLE handle)
+{
+    return handle ? handle->frame_max : 0;
+}
+
+/**
+ * @brief Destroys the encoder stage.
+ *
+ * @param[in] handle Handle of the encoder stage.
+ *
+ * @return OPERATE_RET - OPRT_OK on success, or an error code on failure.
+ */
+OPERATE_RET ai_audio_encoder_destroy(AI_AUDIO_ENC_HANDLE handle)
+{
+    TUYA_CHECK_NULL_RETURN(handle, OPRT_INVALID_PARM);
+
+    handle->ops->destroy(handle->ctx);
+    tal_free(handle->tail);
+    tal_free(handle);
+
+    return OPRT_OK;
+}
@@ -10,6 +10,7 @@
  *
  */
 #define MINIMP3_IMPLEMENTATION
+#define MINIMP3_KEEP_SCRATCH // only the player thread decodes
 
 #include "tkl_system.h"
 #include "tkl_memory.h"
@@ -37,6 +38,16 @@
 #define MP3_PCM_SIZE_MAX           (MAX_NSAMP * MAX_NCHAN * MAX_NGRAN * 2)
 #define PLAYING_NO_DATA_TIMEOUT_MS (5 * 1000)
 
+// decoded pcm waiting for the output thread, one mp3 frame per period
+#ifndef AI_AUDIO_PLAYER_PCM_PERIODS
+#define AI_AUDIO_PLAYER_PCM_PERIODS 16
+#endif
+// decoded pcm needed before the output starts, again after an underrun
+#ifndef AI_AUDIO_PLAYER_PREFILL_MS
+#define AI_AUDIO_PLAYER_PREFILL_MS 120
+#endif
+#define AI_AUDIO_PLAYER_OUT_WAIT_MS 100
+
 #define AI_AUDIO_PLAYER_STAT_CHANGE(last_stat, new_stat)                                                               \
     do {                                                                                                               \
         if (last_stat != new_stat) {                                                                                   \
@@ -47,6 +58,28 @@
 /***********************************************************
 ***********************typedef define***********************
 ***********************************************************/
+typedef struct {
+    uint8_t *data;
+    uint32_t len;
+    uint32_t ms;
+} AI_AUDIO_PLAYER_PERIOD_T;
+
+// written by the decoder thread, drained by the output thread
+typedef struct {
+    MUTEX_HANDLE mutex;
+    SEM_HANDLE fill_sem; // wakes the output thread
+    uint8_t *mem;
+    AI_AUDIO_PLAYER_PERIOD_T period[AI_AUDIO_PLAYER_PCM_PERIODS];
+    uint32_t rd;
+    uint32_t wr;
+    uint32_t cnt;
+    uint32_t buf_ms;
+    uint32_t gen;   // bumped on reset, the period being played is dropped
+    bool prefill;   // hold the output until AI_AUDIO_PLAYER_PREFILL_MS is buffered
+    bool eos;       // no more pcm of the current stream will be decoded
+    bool out_busy;  // the output thread is playing a period
+} AI_AUDIO_PLAYER_PCM_RING_T;
+
 typedef struct {
     bool is_playing;
     bool is_writing;
@@ -68,8 +101,11 @@ typedef struct {
     uint8_t *mp3_raw;
     uint8_t *mp3_raw_head;
     uint32_t mp3_raw_used_len;
-    uint8_t *mp3_pcm; // mp3 decode to pcm buffer
 
+    THREAD_HANDLE out_thrd_hdl;
+    bool thrd_exit; // both threads leave their loop and clear their handle
+    AI_AUDIO_PLAYER_PCM_RING_T pcm;
+    AI_AUDIO_PLAYER_PIPE_STAT_T pipe_stat;
 } APP_PLAYER_T;
 
 /***********************************************************
@@ -84,6 +120,139 @@ static APP_PLAYER_T sg_player;
 /***********************************************************
 ***********************function define**********************
 ***********************************************************/
+static void __ai_audio_player_pcm_reset(void)
+{
+    AI_AUDIO_PLAYER_PCM_RING_T *pcm = &sg_player.pcm;
+
+    tal_mutex_lock(pcm->mutex);
+    pcm->rd = 0;
+    pcm->wr = 0;
+    pcm->cnt = 0;
+    pcm->buf_ms = 0;
+    pcm->gen++;
+    pcm->prefill = true;
+    pcm->eos = false;
+    tal_mutex_unlock(pcm->mutex);
+}
+
+static void __ai_audio_player_pcm_set_eos(bool eos)
+{
+    bool changed;
+
+    tal_mutex_lock(sg_player.pcm.mutex);
+    changed = (sg_player.pcm.eos != eos);
+    sg_player.pcm.eos = eos;
+    tal_mutex_unlock(sg_player.pcm.mutex);
+
+    if (changed && eos) {
+        // let the output play what is held back by the prefill
+        tal_semaphore_post(sg_player.pcm.fill_sem);
+    }
+}
+
+static bool __ai_audio_player_pcm_is_drained(void)
+{
+    bool drained;
+
+    tal_mutex_lock(sg_player.pcm.mutex);
+    drained = (0 == sg_player.pcm.cnt && false == sg_player.pcm.out_busy);
+    tal_mutex_unlock(sg_player.pcm.mutex);
+
+    return drained;
+}
+
+static AI_AUDIO_PLAYER_PERIOD_T *__ai_audio_player_pcm_get_free(void)
+{
+    AI_AUDIO_PLAYER_PCM_RING_T *pcm = &sg_player.pcm;
+    AI_AUDIO_PLAYER_PERIOD_T *period = NULL;
+
+    // only the decoder thread writes, the slot stays free until it is committed
+    tal_mutex_lock(pcm->mutex);
+    if (pcm->cnt < AI_AUDIO_PLAYER_PCM_PERIODS) {
+        period = &pcm->period[pcm->wr];
+    }
+    tal_mutex_unlock(pcm->mutex);
+
+    return period;
+}
+
+static void __ai_audio_player_pcm_commit(AI_AUDIO_PLAYER_PERIOD_T *period, uint32_t len, uint32_t ms)
+{
+    AI_AUDIO_PLAYER_PCM_RING_T *pcm = &sg_player.pcm;
+
+    period->len = len;
+    period->ms = ms;
+
+    tal_mutex_lock(pcm->mutex);
+    pcm->wr = (pcm->wr + 1) % AI_AUDIO_PLAYER_PCM_PERIODS;
+    pcm->cnt++;
+    pcm->buf_ms += ms;
+    tal_mutex_unlock(pcm->mutex);
+
+    tal_semaphore_post(pcm->fill_sem);
+}
+
+static AI_AUDIO_PLAYER_PERIOD_T *__ai_audio_player_pcm_peek(uint32_t *gen)
+{
+    AI_AUDIO_PLAYER_PCM_RING_T *pcm = &sg_player.pcm;
+    AI_AUDIO_PLAYER_PERIOD_T *period = NULL;
+
+    tal_mutex_lock(pcm->mutex);
+    if (0 == pcm->cnt) {
+        if (false == pcm->prefill && false == pcm->eos) {
+            // the stream goes on but the decoder fell behind
+            sg_player.pipe_stat.underrun++;
+            pcm->prefill = true;
+        }
+    } else if (false == pcm->prefill || pcm->eos || pcm->buf_ms >= AI_AUDIO_PLAYER_PREFILL_MS ||
+               pcm->cnt == AI_AUDIO_PLAYER_PCM_PERIODS) {
+        pcm->prefill = false;
+        pcm->out_busy = true;
+        period = &pcm->period[pcm->rd];
+        *gen = pcm->gen;
+    }
+    tal_mutex_unlock(pcm->mutex);
+
+    return period;
+}
+
+static void __ai_audio_player_pcm_release(uint32_t gen)
+{
+    AI_AUDIO_PLAYER_PCM_RING_T *pcm = &sg_player.pcm;
+
+    tal_mutex_lock(pcm->mutex);
+    if (gen == pcm->gen) {
+        pcm->buf_ms -= pcm->period[pcm->rd].ms;
+        pcm->rd = (pcm->rd + 1) % AI_AUDIO_PLAYER_PCM_PERIODS;
+        pcm->cnt--;
+        sg_player.pipe_stat.periods++;
+    }
+    pcm->out_busy = false;
+    tal_mutex_unlock(pcm->mutex);
+}
+
+static void __ai_audio_player_out_task(void *arg)
+{
+    AI_AUDIO_PLAYER_PERIOD_T *period = NULL;
+    THREAD_HANDLE thrd_hdl = NULL;
+    uint32_t gen = 0;
+
+    while (false == sg_player.thrd_exit) {
+        tal_semaphore_wait(sg_player.pcm.fill_sem, AI_AUDIO_PLAYER_OUT_WAIT_MS);
+
+        // the decoder keeps filling the ring while a period is played
+        while (NULL != (period = __ai_audio_player_pcm_peek(&gen))) {
+            tdl_audio_play(sg_player.audio_hdl, period->data, period->len);
+            __ai_audio_player_pcm_release(gen);
+        }
+    }
+
+    // ai_audio_player_deinit frees the ring once the handle is cleared
+    thrd_hdl = sg_player.out_thrd_hdl;
+    sg_player.out_thrd_hdl = NULL;
+    tkl_thread_release(thrd_hdl);
+}
+
 static OPERATE_RET __ai_audio_player_mp3_start(void)
 {
     OPERATE_RET rt = OPRT_OK;
@@ -99,6 +268,7 @@ static OPERATE_RET __ai_audio_player_mp3_start(void)
     }
 
     sg_player.mp3_raw_used_len = 0;
+    __ai_audio_player_pcm_reset();
 
     return rt;
 }
@@ -107,12 +277,19 @@ static OPERATE_RET __ai_audio_player_mp3_playing(void)
 {
     OPERATE_RET rt = OPRT_OK;
     APP_PLAYER_T *ctx = &sg_player;
+    AI_AUDIO_PLAYER_PERIOD_T *period = NULL;
 
     if (NULL == ctx->mp3_dec) {
         PR_ERR("mp3 decoder is NULL");
         return OPRT_COM_ERROR;
     }
 
+    // decoded far enough ahead, wait for the output to drain a period
+    period = __ai_audio_player_pcm_get_free();
+    if (NULL == period) {
+        goto __EXIT;
+    }
+
     tal_mutex_lock(sg_player.spk_rb_mutex);
     uint32_t rb_used_len = tuya_ring_buff_used_size_get(ctx->rb_hdl);
     tal_mutex_unlock(sg_player.spk_rb_mutex);
@@ -143,7 +320,7 @@ static OPERATE_RET __ai_audio_player_mp3_playing(void)
     }
 
     int samples = mp3dec_decode_frame(ctx->mp3_dec, ctx->mp3_raw_head, ctx->mp3_raw_used_len,
-                                      (mp3d_sample_t *)ctx->mp3_pcm, &ctx->mp3_frame_info);
+                                      (mp3d_sample_t *)period->data, &ctx->mp3_frame_info);
     if (samples == 0) {
         ctx->mp3_raw_used_len = 0;
         ctx->mp3_raw_head = ctx->mp3_raw;
@@ -154,12 +331,32 @@ static OPERATE_RET __ai_audio_player_mp3_playing(void)
     ctx->mp3_raw_used_len -= ctx->mp3_frame_info.frame_bytes;
     ctx->mp3_raw_head += ctx->mp3_frame_info.frame_bytes;
 
-    tdl_audio_play(ctx->audio_hdl, ctx->mp3_pcm, samples * 2);
+    __ai_audio_player_pcm_commit(period, samples * 2, samples * 1000 / ctx->mp3_frame_info.hz);
 
 __EXIT:
     return rt;
 }
 
+static void __ai_audio_player_mp3_deinit(void)
+{
+    if (sg_player.pcm.mem) {
+        tkl_system_psram_free(sg_player.pcm.mem);
+        sg_player.pcm.mem = NULL;
+    }
+
+    if (sg_player.mp3_raw) {
+        tkl_system_psram_free(sg_player.mp3_raw);
+        sg_player.mp3_raw = NULL;
+    }
+
+    if (sg_player.mp3_dec) {
+        tkl_system_psram_free(sg_player.mp3_dec);
+        sg_player.mp3_dec = NULL;
+    }
+
+    mp3d_scratch_release();
+}
+
 static OPERATE_RET __ai_audio_player_mp3_init(void)
 {
     OPERATE_RET rt = OPRT_OK;
@@ -169,21 +366,16 @@ static OPERATE_RET __ai_audio_player_mp3_init(void)
     sg_player.mp3_raw = (uint8_t *)tkl_system_psram_malloc(MAINBUF_SIZE);
     TUYA_CHECK_NULL_GOTO(sg_player.mp3_raw, __ERR);
 
-    sg_player.mp3_pcm = (uint8_t *)tkl_system_psram_malloc(MP3_PCM_SIZE_MAX);
-    TUYA_CHECK_NULL_GOTO(sg_player.mp3_pcm, __ERR);
+    sg_player.pcm.mem = (uint8_t *)tkl_system_psram_malloc(MP3_PCM_SIZE_MAX * AI_AUDIO_PLAYER_PCM_PERIODS);
+    TUYA_CHECK_NULL_GOTO(sg_player.pcm.mem, __ERR);
+    for (int i = 0; i < AI_AUDIO_PLAYER_PCM_PERIODS; i++) {
+        sg_player.pcm.period[i].data = sg_player.pcm.mem + i * MP3_PCM_SIZE_MAX;
+    }
 
     return rt;
 
 __ERR:
-    if (sg_player.mp3_pcm) {
-        tkl_system_psram_free(sg_player.mp3_pcm);
-        sg_player.mp3_pcm = NULL;
-    }
-
-    if (sg_player.mp3_raw) {
-        tkl_system_psram_free(sg_player.mp3_raw);
-        sg_player.mp3_raw = NULL;
-    }
+    __ai_audio_player_mp3_deinit();
 
     return OPRT_COM_ERROR;
 }
@@ -197,7 +389,7 @@ static void __ai_audio_player_task(void *arg)
 
     ctx->stat = AI_AUDIO_PLAYER_STAT_IDLE;
 
-    for (;;) {
+    while (false == ctx->thrd_exit) {
         delay_ms = ((ctx->stat == AI_AUDIO_PLAYER_STAT_IDLE) ? (20) : (5));
         tal_queue_fetch(sg_player.state_queue, &ctx->stat, delay_ms);
 
@@ -234,13 +426,23 @@ static void __ai_audio_player_task(void *arg)
             uint32_t rb_used_len = tuya_ring_buff_used_size_get(ctx->rb_hdl);
             tal_mutex_unlock(ctx->spk_rb_mutex);
             if (rb_used_len == 0 && 0 == ctx->mp3_raw_used_len && ctx->is_eof) {
-                PR_DEBUG("app player end");
-                ctx->stat = AI_AUDIO_PLAYER_STAT_FINISH;
+                // all decoded, finish once the output has played it
+                __ai_audio_player_pcm_set_eos(true);
+                if (__ai_audio_player_pcm_is_drained()) {
+                    PR_DEBUG("app player end");
+                    ctx->stat = AI_AUDIO_PLAYER_STAT_FINISH;
+                }
             }
         } break;
         case AI_AUDIO_PLAYER_STAT_FINISH: {
             tal_sw_timer_stop(ctx->tm_id);
 
+            // the no data timeout ends the stream too, play what the prefill still holds back first
+            __ai_audio_player_pcm_set_eos(true);
+            if (false == __ai_audio_player_pcm_is_drained()) {
+                break;
+            }
+
             ctx->is_playing = false;
             ctx->stat = AI_AUDIO_PLAYER_STAT_IDLE;
             ctx->is_eof = 0;
@@ -254,6 +456,10 @@ static void __ai_audio_player_task(void *arg)
 
         tal_mutex_unlock(sg_player.mutex);
     }
+
+    THREAD_HANDLE thrd_hdl = ctx->thrd_hdl;
+    ctx->thrd_hdl = NULL;
+    tkl_thread_release(thrd_hdl);
 }
 
 static void __app_playing_tm_cb(TIMER_ID timer_id, void *arg)
@@ -265,6 +471,22 @@ static void __app_playing_tm_cb(TIMER_ID timer_id, void *arg)
     return;
 }
 
+static void __app_player_set_id(char *id)
+{
+    if (sg_player.id) {
+        tkl_system_free(sg_player.id);
+        sg_player.id = NULL;
+    }
+
+    if (id) {
+        sg_player.id = tkl_system_malloc(strlen(id) + 1);
+        if (sg_player.id) {
+            strcpy(sg_player.id, id);
+            sg_player.id[strlen(id)] = '\0';
+        }
+    }
+}
+
 static bool __app_player_compare_id(char *id_1, char *id_2)
 {
     if (NULL == id_1 && NULL == id_2) {
@@ -312,9 +534,17 @@ OPERATE_RET ai_audio_player_init(void)
     // ring buffer mutex init
     TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&sg_player.spk_rb_mutex), __ERR);
 
-    // thread init
+    // decoded pcm ring init
+    TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&sg_player.pcm.mutex), __ERR);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&sg_player.pcm.fill_sem, 0, 1), __ERR);
+    sg_player.pcm.prefill = true;
+
+    // thread init, the output thread drains the pcm the decoder thread runs ahead with
+    TUYA_CALL_ERR_GOTO(tkl_thread_create(&sg_player.out_thrd_hdl, "ai_player_out", 1024 * 4, THREAD_PRIO_0,
+                                         __ai_audio_player_out_task, NULL),
+                       __ERR);
     TUYA_CALL_ERR_GOTO(
-        tkl_thread_create(&sg_player.thrd_hdl, "ai_player", 1024 * 4, THREAD_PRIO_0, __ai_audio_player_task, NULL),
+        tkl_thread_create(&sg_player.thrd_hdl, "ai_player", 1024 * 4, THREAD_PRIO_1, __ai_audio_player_task, NULL),
         __ERR);
 
     PR_DEBUG("app player init success");
@@ -322,6 +552,36 @@ OPERATE_RET ai_audio_player_init(void)
     return rt;
 
 __ERR:
+    ai_audio_player_deinit();
+
+    return rt;
+}
+
+/**
+ * @brief Stops the audio player and its threads, and releases the resources
+ *        set up by ai_audio_player_init.
+ *
+ * @param None
+ * @return OPERATE_RET - Returns OPRT_OK.
+ */
+OPERATE_RET ai_audio_player_deinit(void)
+{
+    ai_audio_player_stop();
+
+    // the threads clear their handle on the way out, the output one may be in the middle of a period
+    sg_player.thrd_exit = true;
+    if (sg_player.pcm.fill_sem) {
+        tal_semaphore_post(sg_player.pcm.fill_sem);
+    }
+    while (sg_player.thrd_hdl || sg_player.out_thrd_hdl) {
+        tal_system_sleep(10);
+    }
+
+    if (sg_player.tm_id) {
+        tal_sw_timer_delete(sg_player.tm_id);
+        sg_player.tm_id = NULL;
+    }
+
     if (sg_player.state_queue) {
         tal_queue_free(sg_player.state_queue);
         sg_player.state_queue = NULL;
@@ -342,12 +602,29 @@ __ERR:
         sg_player.rb_hdl = NULL;
     }
 
-    return rt;
+    if (sg_player.pcm.mutex) {
+        tal_mutex_release(sg_player.pcm.mutex);
+        sg_player.pcm.mutex = NULL;
+    }
+
+    if (sg_player.pcm.fill_sem) {
+        tal_semaphore_release(sg_player.pcm.fill_sem);
+        sg_player.pcm.fill_sem = NULL;
+    }
+
+    __ai_audio_player_mp3_deinit();
+    __app_player_set_id(NULL);
+    sg_player.thrd_exit = false;
+
+    return OPRT_OK;
 }
 
 /**
  * @brief Starts the audio player with the specified identifier.
  *
+ * If the player is already playing, the new stream is queued behind the
+ * current one and played without a gap, data of the old id is rejected from
+ * now on.
  *
  * @param id        The identifier for the current playback session.
  *                  If NULL, no specific ID is set.
@@ -360,25 +637,20 @@ OPERATE_RET ai_audio_player_start(char *id)
 
     tal_mutex_lock(sg_player.mutex);
 
+    __app_player_set_id(id);
+
     if (true == sg_player.is_playing) {
-        PR_NOTICE("player is already start");
+        // gapless, the new stream is decoded right behind what is queued of the current one
+        PR_NOTICE("player switch to id:%s", id ? id : "null");
+        sg_player.is_eof = 0;
+        if (AI_AUDIO_PLAYER_STAT_FINISH == sg_player.stat) {
+            sg_player.stat = AI_AUDIO_PLAYER_STAT_PLAY;
+        }
+        __ai_audio_player_pcm_set_eos(false);
         tal_mutex_unlock(sg_player.mutex);
         return OPRT_OK;
     }
 
-    if (sg_player.id) {
-        tkl_system_free(sg_player.id);
-        sg_player.id = NULL;
-    }
-
-    if (id) {
-        sg_player.id = tkl_system_malloc(strlen(id) + 1);
-        if (sg_player.id) {
-            strcpy(sg_player.id, id);
-            sg_player.id[strlen(id)] = '\0';
-        }
-    }
-
     sg_player.is_playing = true;
 
     AI_AUDIO_PLAYER_STATE_E stat = AI_AUDIO_PLAYER_STAT_START;
@@ -440,6 +712,7 @@ OPERATE_RET ai_audio_player_data_write(char *id, uint8_t *data, uint32_t len, ui
             uint32_t rb_free_len = tuya_ring_buff_free_size_get(sg_player.rb_hdl);
             tal_mutex_unlock(sg_player.spk_rb_mutex);
             if (0 == rb_free_len) {
+                sg_player.pipe_stat.overrun++;
                 // need unlock mutex before sleep
                 tal_mutex_unlock(sg_player.mutex);
                 tal_system_sleep(5);
@@ -502,6 +775,12 @@ OPERATE_RET ai_audio_player_stop(void)
     tuya_ring_buff_reset(sg_player.rb_hdl);
     tal_mutex_unlock(sg_player.spk_rb_mutex);
 
+    // drop the decoded pcm and let the period being played finish before stopping the output
+    __ai_audio_player_pcm_reset();
+    while (false == __ai_audio_player_pcm_is_drained()) {
+        tal_system_sleep(5);
+    }
+
     tdl_audio_play_stop(sg_player.audio_hdl);
 
     sg_player.is_playing = false;
@@ -530,3 +809,22 @@ uint8_t ai_audio_player_is_playing(void)
 {
     return sg_player.is_playing;
 }
+
+/**
+ * @brief Gets the counters of the decode-ahead pipeline.
+ *
+ * @param stat      Pointer to the counters to fill.
+ *
+ * @return OPERATE_RET - Returns OPRT_OK on success, otherwise returns an error code.
+ */
+OPERATE_RET ai_audio_player_get_pipe_stat(AI_AUDIO_PLAYER_PIPE_STAT_T *stat)
+{
+    TUYA_CHECK_NULL_RETURN(stat, OPRT_INVALID_PARM);
+
+    tal_mutex_lock(sg_player.pcm.mutex);
+    memcpy(stat, &sg_player.pipe_stat, sizeof(AI_AUDIO_PLAYER_PIPE_STAT_T));
+    stat->buffered_ms = sg_player.pcm.buf_ms;
+    tal_mutex_unlock(sg_player.pcm.mutex);
+
+    return OPRT_OK;
+}
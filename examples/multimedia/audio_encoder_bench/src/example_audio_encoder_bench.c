@@ -0,0 +1,199 @@
+/**
+ * @file example_audio_encoder_bench.c
+ * @brief Measures the cost of the ai audio upload encoders against the bandwidth they save.
+ *
+ * A few seconds of speech-like 16 kHz mono pcm are encoded the way the ai
+ * agent uploads them: in 100 ms chunks, into packets of whole frames. The
+ * encode time per second of audio and the bitrate of each codec are printed.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+
+#include "tal_api.h"
+#include "tkl_output.h"
+#include "ai_audio_encoder.h"
+
+/***********************************************************
+*************************micro define***********************
+***********************************************************/
+#define BENCH_LOOPS       20
+#define BENCH_SAMPLE_RATE 16000
+#define BENCH_AUDIO_MS    5000
+#define BENCH_CHUNK_MS    100  // what the cloud asr hands to the agent at a time
+#define BENCH_PKT_LEN     4096 // same as AI_AGENT_UPLOAD_PKT_LEN
+
+#define BENCH_SAMPLES   (BENCH_SAMPLE_RATE / 1000 * BENCH_AUDIO_MS)
+#define BENCH_CHUNK_LEN (BENCH_SAMPLE_RATE / 1000 * BENCH_CHUNK_MS * 2)
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+static const AI_AUDIO_CODEC_TYPE s_codecs[] = {AUDIO_CODEC_PCM, AUDIO_CODEC_ADPCM, AUDIO_CODEC_OPUS};
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+/* two triangle "formants" under a syllable envelope, plus some noise */
+static void __bench_pcm_gen(int16_t *pcm, uint32_t samples)
+{
+    uint32_t seed = 0x1234567;
+    int32_t f1 = 0, f2 = 0, d1 = 180, d2 = 620;
+    int32_t env, v;
+    uint32_t i;
+
+    for (i = 0; i < samples; i++) {
+        f1 += d1;
+        if (f1 > 8000 || f1 < -8000) {
+            d1 = -d1;
+        }
+        f2 += d2;
+        if (f2 > 4000 || f2 < -4000) {
+            d2 = -d2;
+        }
+        seed = seed * 1103515245 + 12345;
+
+        // 250 ms syllables, rising then falling
+        env = i % (BENCH_SAMPLE_RATE / 4);
+        env = (env < BENCH_SAMPLE_RATE / 8) ? env : (BENCH_SAMPLE_RATE / 4 - env);
+        v = (f1 + f2) * env / (BENCH_SAMPLE_RATE / 8) + (int32_t)((seed >> 16) & 0x1ff) - 0x100;
+        pcm[i] = (int16_t)v;
+    }
+}
+
+static OPERATE_RET __bench_encode(AI_AUDIO_ENC_HANDLE enc, const uint8_t *pcm, uint8_t *out, uint32_t *total)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t offset, chunk, len, used, out_len;
+
+    ai_audio_encoder_reset(enc);
+    for (offset = 0; offset < BENCH_SAMPLES * 2; offset += chunk) {
+        chunk = BENCH_SAMPLES * 2 - offset;
+        chunk = (chunk > BENCH_CHUNK_LEN) ? BENCH_CHUNK_LEN : chunk;
+        for (len = 0; len < chunk; len += used) {
+            TUYA_CALL_ERR_RETURN(
+                ai_audio_encoder_encode(enc, pcm + offset + len, chunk - len, &used, out, BENCH_PKT_LEN, &out_len));
+            *total += out_len;
+        }
+    }
+    TUYA_CALL_ERR_RETURN(ai_audio_encoder_flush(enc, out, BENCH_PKT_LEN, &out_len));
+    *total += out_len;
+
+    return rt;
+}
+
+static void __bench_codec(AI_AUDIO_CODEC_TYPE codec, const uint8_t *pcm, uint8_t *out)
+{
+    AI_AUDIO_ENC_HANDLE enc = NULL;
+    SYS_TIME_T start, cost;
+    uint32_t total = 0;
+    OPERATE_RET rt;
+    int i;
+
+    rt = ai_audio_encoder_create(codec, BENCH_SAMPLE_RATE, 1, &enc);
+    if (OPRT_NOT_FOUND == rt) {
+        PR_NOTICE("codec %d: no encoder registered, skipped", codec);
+        return;
+    } else if (OPRT_OK != rt) {
+        PR_ERR("codec %d: create fail, rt:%d", codec, rt);
+        return;
+    }
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        total = 0;
+        if (OPRT_OK != __bench_encode(enc, pcm, out, &total)) {
+            PR_ERR("codec %d: encode fail", codec);
+            goto __EXIT;
+        }
+    }
+    cost = tal_system_get_millisecond() - start;
+
+    PR_NOTICE("codec %3d: %6d us per second of audio, %6d bytes, %4d kbps, %3d%% of pcm, frame max %d", codec,
+              (int)((uint64_t)cost * 1000 * 1000 / BENCH_LOOPS / BENCH_AUDIO_MS), total,
+              (int)((uint64_t)total * 8 / BENCH_AUDIO_MS), (int)((uint64_t)total * 100 / (BENCH_SAMPLES * 2)),
+              ai_audio_encoder_get_frame_max(enc));
+
+__EXIT:
+    ai_audio_encoder_destroy(enc);
+}
+
+/**
+ * @brief user_main
+ *
+ * @return none
+ */
+void user_main(void)
+{
+    int16_t *pcm = NULL;
+    uint8_t *out = NULL;
+    uint32_t i;
+
+    /* basic init */
+    tal_log_init(TAL_LOG_LEVEL_DEBUG, 1024, (TAL_LOG_OUTPUT_CB)tkl_log_output);
+
+    PR_NOTICE("------ audio encoder benchmark start, %d ms audio, %d loops ------", BENCH_AUDIO_MS, BENCH_LOOPS);
+
+    pcm = tal_malloc(BENCH_SAMPLES * sizeof(int16_t));
+    out = tal_malloc(BENCH_PKT_LEN);
+    if (NULL == pcm || NULL == out) {
+        PR_ERR("malloc fail");
+        goto __EXIT;
+    }
+    __bench_pcm_gen(pcm, BENCH_SAMPLES);
+
+    for (i = 0; i < CNTSOF(s_codecs); i++) {
+        __bench_codec(s_codecs[i], (const uint8_t *)pcm, out);
+    }
+
+__EXIT:
+    tal_free(out);
+    tal_free(pcm);
+    PR_NOTICE("------ audio encoder benchmark end ------");
+
+    return;
+}
+
+/**
+ * @brief main
+ *
+ * @param argc
+ * @param argv
+ * @return void
+ */
+#if OPERATING_SYSTEM == SYSTEM_LINUX
+void main(int argc, char *argv[])
+{
+    user_main();
+
+    while (1) {
+        tal_system_sleep(500);
+    }
+}
+#else
+
+/* Tuya thread handle */
+static THREAD_HANDLE ty_app_thread = NULL;
+
+/**
+ * @brief  task thread
+ *
+ * @param[in] arg:Parameters when creating a task
+ * @return none
+ */
+static void tuya_app_thread(void *arg)
+{
+    user_main();
+
+    tal_thread_delete(ty_app_thread);
+    ty_app_thread = NULL;
+}
+
+void tuya_app_main(void)
+{
+    THREAD_CFG_T thrd_param = {4096, 4, "tuya_app_main"};
+    tal_thread_create_and_start(&ty_app_thread, NULL, NULL, tuya_app_thread, NULL, &thrd_param);
+}
+#endif
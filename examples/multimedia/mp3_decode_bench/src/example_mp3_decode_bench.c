@@ -0,0 +1,184 @@
+/**
+ * @file example_mp3_decode_bench.c
+ * @brief Measures the minimp3 builds used for the ai audio playback.
+ *
+ * The mp3 of the speaker example is decoded frame by frame, the way the ai
+ * audio player feeds minimp3, with each build of the decoder. The frames per
+ * second, the time and the cpu cycles (x86 hosts) per frame and a checksum of
+ * the pcm are printed, so a change of the decoder can be checked for both its
+ * speed and its output.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+
+#include "tal_api.h"
+#include "tkl_output.h"
+#include "app_media.h"
+#include "mp3_bench.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_CYCLES() __rdtsc()
+#else
+#define BENCH_CYCLES() 0
+#endif
+
+/***********************************************************
+*************************micro define***********************
+***********************************************************/
+#define BENCH_LOOPS 200
+
+/***********************************************************
+***********************typedef define***********************
+***********************************************************/
+typedef struct {
+    const char *name;
+    void (*init)(mp3dec_t *dec);
+    int (*decode)(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm, mp3dec_frame_info_t *info);
+} BENCH_DECODER_T;
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+static const BENCH_DECODER_T s_decoders[] = {
+    {"simd, kept scratch", mp3dec_init_simd, mp3dec_decode_frame_simd},
+    {"scalar, kept scratch", mp3dec_init_scalar, mp3dec_decode_frame_scalar},
+    {"scratch per frame", mp3dec_init_alloc, mp3dec_decode_frame_alloc},
+};
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+/* decodes the whole mp3 once, returns the frames with pcm */
+static uint32_t __bench_decode(const BENCH_DECODER_T *decoder, mp3dec_t *dec, mp3d_sample_t *pcm, uint32_t *sum)
+{
+    const uint8_t *mp3 = (const uint8_t *)media_src_hello_tuya_16k;
+    uint32_t len = sizeof(media_src_hello_tuya_16k);
+    mp3dec_frame_info_t info;
+    uint32_t offset = 0, frames = 0;
+    int samples, i;
+
+    decoder->init(dec);
+    while (offset < len) {
+        samples = decoder->decode(dec, mp3 + offset, len - offset, pcm, &info);
+        if (0 == info.frame_bytes) {
+            break;
+        }
+        offset += info.frame_bytes;
+        if (samples > 0) {
+            frames++;
+            for (i = 0; sum && i < samples * info.channels; i++) {
+                *sum = *sum * 31 + (uint16_t)pcm[i];
+            }
+        }
+    }
+
+    return frames;
+}
+
+static void __bench_decoder(const BENCH_DECODER_T *decoder, mp3dec_t *dec, mp3d_sample_t *pcm)
+{
+    uint32_t frames = 0, sum = 0;
+    SYS_TIME_T start, cost;
+    uint64_t cycles;
+    int i;
+
+    frames = __bench_decode(decoder, dec, pcm, &sum);
+    if (0 == frames) {
+        PR_ERR("%s: no frame decoded", decoder->name);
+        return;
+    }
+
+    start = tal_system_get_millisecond();
+    cycles = BENCH_CYCLES();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        __bench_decode(decoder, dec, pcm, NULL);
+    }
+    cycles = BENCH_CYCLES() - cycles;
+    cost = tal_system_get_millisecond() - start;
+    cost = cost ? cost : 1;
+
+    PR_NOTICE("%-22s %7d frames/s, %5d us/frame, %8d cycles/frame, pcm sum %08x", decoder->name,
+              (int)((uint64_t)frames * BENCH_LOOPS * 1000 / cost), (int)((uint64_t)cost * 1000 / frames / BENCH_LOOPS),
+              (int)(cycles / frames / BENCH_LOOPS), sum);
+}
+
+/**
+ * @brief user_main
+ *
+ * @return none
+ */
+void user_main(void)
+{
+    mp3d_sample_t *pcm = NULL;
+    mp3dec_t *dec = NULL;
+    uint32_t i;
+
+    /* basic init */
+    tal_log_init(TAL_LOG_LEVEL_DEBUG, 1024, (TAL_LOG_OUTPUT_CB)tkl_log_output);
+
+    PR_NOTICE("------ mp3 decode benchmark start, %d loops ------", BENCH_LOOPS);
+
+    dec = tal_malloc(sizeof(mp3dec_t));
+    pcm = tal_malloc(MINIMP3_MAX_SAMPLES_PER_FRAME * sizeof(mp3d_sample_t));
+    if (NULL == dec || NULL == pcm) {
+        PR_ERR("malloc fail");
+        goto __EXIT;
+    }
+
+    for (i = 0; i < CNTSOF(s_decoders); i++) {
+        __bench_decoder(&s_decoders[i], dec, pcm);
+    }
+
+__EXIT:
+    tal_free(pcm);
+    tal_free(dec);
+    PR_NOTICE("------ mp3 decode benchmark end ------");
+
+    return;
+}
+
+/**
+ * @brief main
+ *
+ * @param argc
+ * @param argv
+ * @return void
+ */
+#if OPERATING_SYSTEM == SYSTEM_LINUX
+void main(int argc, char *argv[])
+{
+    user_main();
+
+    while (1) {
+        tal_system_sleep(500);
+    }
+}
+#else
+
+/* Tuya thread handle */
+static THREAD_HANDLE ty_app_thread = NULL;
+
+/**
+ * @brief  task thread
+ *
+ * @param[in] arg:Parameters when creating a task
+ * @return none
+ */
+static void tuya_app_thread(void *arg)
+{
+    user_main();
+
+    tal_thread_delete(ty_app_thread);
+    ty_app_thread = NULL;
+}
+
+void tuya_app_main(void)
+{
+    THREAD_CFG_T thrd_param = {4096, 4, "tuya_app_main"};
+    tal_thread_create_and_start(&ty_app_thread, NULL, NULL, tuya_app_thread, NULL, &thrd_param);
+}
+#endif
@@ -0,0 +1,34 @@
+/**
+ * @file mp3_bench.h
+ * @brief The builds of minimp3 compared by the benchmark.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#ifndef __MP3_BENCH_H__
+#define __MP3_BENCH_H__
+
+#include "minimp3.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+void mp3dec_init_simd(mp3dec_t *dec);
+int mp3dec_decode_frame_simd(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm,
+                             mp3dec_frame_info_t *info);
+
+void mp3dec_init_scalar(mp3dec_t *dec);
+int mp3dec_decode_frame_scalar(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm,
+                               mp3dec_frame_info_t *info);
+
+void mp3dec_init_alloc(mp3dec_t *dec);
+int mp3dec_decode_frame_alloc(mp3dec_t *dec, const uint8_t *mp3, int mp3_bytes, mp3d_sample_t *pcm,
+                              mp3dec_frame_info_t *info);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __MP3_BENCH_H__ */
@@ -0,0 +1,18 @@
+/**
+ * @file mp3_bench_alloc.c
+ * @brief minimp3 as the ai audio player built it before: the scratch allocated and
+ *        cleared for every frame.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tal_api.h"
+
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_SCRATCH_MALLOC(size) tal_malloc(size)
+#define MINIMP3_SCRATCH_FREE(ptr)    tal_free(ptr)
+#define mp3dec_init                  mp3dec_init_alloc
+#define mp3dec_decode_frame          mp3dec_decode_frame_alloc
+
+#include "minimp3.h"
@@ -0,0 +1,19 @@
+/**
+ * @file mp3_bench_scalar.c
+ * @brief minimp3 with the generic scalar path and the scratch kept between frames.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tal_api.h"
+
+#define MINIMP3_IMPLEMENTATION
+#define MINIMP3_NO_SIMD
+#define MINIMP3_KEEP_SCRATCH
+#define MINIMP3_SCRATCH_MALLOC(size) tal_malloc(size)
+#define MINIMP3_SCRATCH_FREE(ptr)    tal_free(ptr)
+#define mp3dec_init                  mp3dec_init_scalar
+#define mp3dec_decode_frame          mp3dec_decode_frame_scalar
+
+#include "minimp3.h"
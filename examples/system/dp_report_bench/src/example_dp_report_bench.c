@@ -0,0 +1,237 @@
+/**
+ * @file example_dp_report_bench.c
+ * @brief Compares building a DP report with cJSON and with dp_rept_json_write.
+ *
+ * A report of a few typical DPs is encoded over and over, once by building a
+ * cJSON tree and printing it, once by writing the text into the reused report
+ * buffer. The time of each step and the heap left after the loops are printed.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+
+#include "tal_api.h"
+#include "tkl_output.h"
+#include "cJSON.h"
+#include "dp_schema.h"
+
+/***********************************************************
+*************************micro define***********************
+***********************************************************/
+#define BENCH_LOOPS   10000
+#define BENCH_DEVID   "6c1a2b3c4d5e6f7a8b9c0d"
+#define BENCH_DPS_CNT 4
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+static char s_schema_json[] = "["
+                              "{\"id\":1,\"mode\":\"rw\",\"type\":\"obj\",\"property\":{\"type\":\"bool\"}},"
+                              "{\"id\":2,\"mode\":\"rw\",\"type\":\"obj\","
+                              "\"property\":{\"type\":\"value\",\"max\":1000,\"min\":0,\"scale\":0}},"
+                              "{\"id\":3,\"mode\":\"rw\",\"type\":\"obj\","
+                              "\"property\":{\"type\":\"enum\",\"range\":[\"white\",\"colour\",\"scene\"]}},"
+                              "{\"id\":4,\"mode\":\"rw\",\"type\":\"obj\",\"property\":{\"type\":\"string\",\"maxlen\":64}}"
+                              "]";
+
+static char *s_enum_range[] = {"white", "colour", "scene"};
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+static void __bench_dps_init(dp_obj_t *dps)
+{
+    memset(dps, 0, sizeof(dp_obj_t) * BENCH_DPS_CNT);
+    dps[0].id = 1;
+    dps[0].type = PROP_BOOL;
+    dps[0].value.dp_bool = true;
+    dps[1].id = 2;
+    dps[1].type = PROP_VALUE;
+    dps[1].value.dp_value = 512;
+    dps[2].id = 3;
+    dps[2].type = PROP_ENUM;
+    dps[2].value.dp_enum = 1;
+    dps[3].id = 4;
+    dps[3].type = PROP_STR;
+    dps[3].value.dp_str = "living room \"lamp\"";
+}
+
+/* what the report encoder did before dp_rept_json_write */
+static char *__bench_cjson_build(dp_obj_t *dps)
+{
+    cJSON *root = cJSON_CreateObject();
+    char id[4];
+    char *out = NULL;
+    int i;
+
+    if (NULL == root) {
+        return NULL;
+    }
+    for (i = 0; i < BENCH_DPS_CNT; i++) {
+        snprintf(id, sizeof(id), "%d", dps[i].id);
+        switch (dps[i].type) {
+        case PROP_BOOL:
+            cJSON_AddBoolToObject(root, id, dps[i].value.dp_bool);
+            break;
+        case PROP_VALUE:
+            cJSON_AddNumberToObject(root, id, dps[i].value.dp_value);
+            break;
+        case PROP_ENUM:
+            cJSON_AddStringToObject(root, id, s_enum_range[dps[i].value.dp_enum]);
+            break;
+        case PROP_STR:
+            cJSON_AddStringToObject(root, id, dps[i].value.dp_str);
+            break;
+        }
+    }
+    out = cJSON_PrintUnformatted(root);
+    cJSON_Delete(root);
+
+    return out;
+}
+
+static void __bench_report(const char *name, SYS_TIME_T start)
+{
+    SYS_TIME_T cost = tal_system_get_millisecond() - start;
+
+    PR_NOTICE("%-24s %6d ns/op, free heap %d", name, (int)((uint64_t)cost * 1000000 / BENCH_LOOPS),
+              tal_system_get_free_heap_size());
+}
+
+/**
+ * @brief user_main
+ *
+ * @return none
+ */
+void user_main(void)
+{
+    dp_schema_t *schema = NULL;
+    dp_rept_valid_t *dpvalid = NULL;
+    dp_rept_arena_t arena;
+    dp_rept_in_t dpin;
+    dp_obj_t dps[BENCH_DPS_CNT];
+    SYS_TIME_T start;
+    uint32_t size;
+    char *json;
+    int i;
+
+    /* basic init */
+    tal_log_init(TAL_LOG_LEVEL_DEBUG, 1024, (TAL_LOG_OUTPUT_CB)tkl_log_output);
+
+    memset(&arena, 0, sizeof(arena));
+    PR_NOTICE("------ dp report benchmark start, %d loops ------", BENCH_LOOPS);
+
+    if (OPRT_OK != dp_schema_create(BENCH_DEVID, s_schema_json, &schema)) {
+        PR_ERR("schema create fail");
+        goto __EXIT;
+    }
+    dpvalid = tal_malloc(sizeof(dp_rept_valid_t) + BENCH_DPS_CNT);
+    if (NULL == dpvalid || OPRT_OK != dp_rept_arena_init(&arena, 1024)) {
+        PR_ERR("malloc fail");
+        goto __EXIT;
+    }
+
+    __bench_dps_init(dps);
+    memset(&dpin, 0, sizeof(dpin));
+    dpin.rept_type = T_OBJ_REPT;
+    dpin.dps = dps;
+    dpin.dpscnt = BENCH_DPS_CNT;
+
+    memset(dpvalid, 0, sizeof(dp_rept_valid_t) + BENCH_DPS_CNT);
+    if (OPRT_OK != dp_rept_valid_check(schema, &dpin, dpvalid)) {
+        PR_ERR("dp check fail");
+        goto __EXIT;
+    }
+
+    json = __bench_cjson_build(dps);
+    PR_NOTICE("cjson: %s", json ? json : "null");
+    cJSON_free(json);
+
+    size = dp_rept_json_size(schema, dpvalid, 0);
+    json = dp_rept_arena_lock(&arena, size);
+    if (NULL == json) {
+        PR_ERR("report buffer lock fail");
+        goto __EXIT;
+    }
+    if (dp_rept_json_write(schema, &dpin, dpvalid, 0, json, size) > 0) {
+        PR_NOTICE("write: %s", json);
+    }
+    dp_rept_arena_unlock(&arena);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        cJSON_free(__bench_cjson_build(dps));
+    }
+    __bench_report("cjson build and print", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        json = dp_rept_arena_lock(&arena, size);
+        dp_rept_json_write(schema, &dpin, dpvalid, 0, json, size);
+        dp_rept_arena_unlock(&arena);
+    }
+    __bench_report("dp_rept_json_write", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        size = dp_rept_json_size(schema, dpvalid, DP_APPEND_HEADER_FLAG);
+        json = dp_rept_arena_lock(&arena, size);
+        dp_rept_json_write(schema, &dpin, dpvalid, DP_APPEND_HEADER_FLAG, json, size);
+        dp_rept_arena_unlock(&arena);
+    }
+    __bench_report("write with lan header", start);
+
+__EXIT:
+    dp_rept_arena_deinit(&arena);
+    tal_free(dpvalid);
+    if (schema) {
+        dp_schema_delete(BENCH_DEVID);
+    }
+    PR_NOTICE("------ dp report benchmark end ------");
+
+    return;
+}
+
+/**
+ * @brief main
+ *
+ * @param argc
+ * @param argv
+ * @return void
+ */
+#if OPERATING_SYSTEM == SYSTEM_LINUX
+void main(int argc, char *argv[])
+{
+    user_main();
+
+    while (1) {
+        tal_system_sleep(500);
+    }
+}
+#else
+
+/* Tuya thread handle */
+static THREAD_HANDLE ty_app_thread = NULL;
+
+/**
+ * @brief  task thread
+ *
+ * @param[in] arg:Parameters when creating a task
+ * @return none
+ */
+static void tuya_app_thread(void *arg)
+{
+    user_main();
+
+    tal_thread_delete(ty_app_thread);
+    ty_app_thread = NULL;
+}
+
+void tuya_app_main(void)
+{
+    THREAD_CFG_T thrd_param = {4096, 4, "tuya_app_main"};
+    tal_thread_create_and_start(&ty_app_thread, NULL, NULL, tuya_app_thread, NULL, &thrd_param);
+}
+#endif
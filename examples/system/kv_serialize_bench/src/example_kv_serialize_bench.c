@@ -0,0 +1,222 @@
+/**
+ * @file example_kv_serialize_bench.c
+ * @brief Compares the text and the binary record format of tal_kv_serialize.
+ *
+ * A record shaped like the activation data is encoded and decoded in both
+ * formats, the size of each record and the time of each step are printed.
+ * The in-place read of a single key of a binary record is timed against
+ * decoding the whole text record.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+
+#include "tal_api.h"
+#include "tkl_output.h"
+
+/***********************************************************
+*************************micro define***********************
+***********************************************************/
+#define BENCH_LOOPS 20000
+
+/***********************************************************
+***********************typedef define***********************
+***********************************************************/
+typedef struct {
+    char devid[26];
+    char sec_key[17];
+    char local_key[17];
+    char schema_id[33];
+    char region[8];
+    char regist[8];
+    int timezone;
+    uint16_t port;
+    BOOL_T active;
+    uint8_t token[16];
+} bench_record_t;
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+extern int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len);
+extern int kv_deserialize(const char *in, kv_db_t *db, const uint32_t dbcnt);
+extern int kv_bin_serialize(const kv_db_t *db, const uint32_t dbcnt, uint8_t **out, uint32_t *out_len);
+extern int kv_bin_deserialize(const uint8_t *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt);
+extern int kv_bin_field_get(const uint8_t *in, uint32_t in_len, kv_db_t *item);
+
+static bench_record_t s_record = {
+    .devid = "6c1a2b3c4d5e6f7a8b9c0d",
+    .sec_key = "a1b2c3d4e5f6a7b8",
+    .local_key = "0f1e2d3c4b5a6978",
+    .schema_id = "000003abcd",
+    .region = "AY",
+    .regist = "pro",
+    .timezone = 28800,
+    .port = 8883,
+    .active = TRUE,
+    .token = {0x10, 0x32, 0x54, 0x76, 0x98, 0xba, 0xdc, 0xfe, 0x01, 0x23, 0x45, 0x67, 0x89, 0xab, 0xcd, 0xef},
+};
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+static void __bench_db_init(bench_record_t *rec, kv_db_t *db)
+{
+    kv_db_t tmpl[] = {
+        {"devId", KV_STRING, rec->devid, sizeof(rec->devid)},
+        {"secKey", KV_STRING, rec->sec_key, sizeof(rec->sec_key)},
+        {"localKey", KV_STRING, rec->local_key, sizeof(rec->local_key)},
+        {"schemaId", KV_STRING, rec->schema_id, sizeof(rec->schema_id)},
+        {"region", KV_STRING, rec->region, sizeof(rec->region)},
+        {"regist", KV_STRING, rec->regist, sizeof(rec->regist)},
+        {"timeZone", KV_INT, &rec->timezone, sizeof(rec->timezone)},
+        {"port", KV_USHORT, &rec->port, sizeof(rec->port)},
+        {"active", KV_BOOL, &rec->active, sizeof(rec->active)},
+        {"token", KV_RAW, rec->token, sizeof(rec->token)},
+    };
+
+    memcpy(db, tmpl, sizeof(tmpl));
+}
+
+#define BENCH_DB_CNT 10
+
+static void __bench_report(const char *name, SYS_TIME_T start)
+{
+    SYS_TIME_T cost = tal_system_get_millisecond() - start;
+
+    PR_NOTICE("%-24s %6d ns/op", name, (int)((uint64_t)cost * 1000000 / BENCH_LOOPS));
+}
+
+/**
+ * @brief user_main
+ *
+ * @return none
+ */
+void user_main(void)
+{
+    kv_db_t db[BENCH_DB_CNT];
+    bench_record_t out;
+    kv_db_t out_db[BENCH_DB_CNT];
+    char *text = NULL;
+    uint32_t text_len = 0;
+    uint8_t *bin = NULL;
+    uint32_t bin_len = 0;
+    SYS_TIME_T start;
+    int i;
+
+    /* basic init */
+    tal_log_init(TAL_LOG_LEVEL_DEBUG, 1024, (TAL_LOG_OUTPUT_CB)tkl_log_output);
+
+    memset(&out, 0, sizeof(out));
+    __bench_db_init(&s_record, db);
+    __bench_db_init(&out, out_db);
+
+    PR_NOTICE("------ kv serialize benchmark start, %d loops ------", BENCH_LOOPS);
+
+    if (OPRT_OK != kv_serialize(db, BENCH_DB_CNT, &text, &text_len) ||
+        OPRT_OK != kv_bin_serialize(db, BENCH_DB_CNT, &bin, &bin_len)) {
+        PR_ERR("serialize fail");
+        goto __EXIT;
+    }
+    PR_NOTICE("record size: text %d bytes, binary %d bytes", text_len, bin_len);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        char *buf = NULL;
+        uint32_t len = 0;
+        kv_serialize(db, BENCH_DB_CNT, &buf, &len);
+        tal_free(buf);
+    }
+    __bench_report("text serialize", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        uint8_t *buf = NULL;
+        uint32_t len = 0;
+        kv_bin_serialize(db, BENCH_DB_CNT, &buf, &len);
+        tal_free(buf);
+    }
+    __bench_report("binary serialize", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        __bench_db_init(&out, out_db);
+        kv_deserialize(text, out_db, BENCH_DB_CNT);
+    }
+    __bench_report("text deserialize", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        __bench_db_init(&out, out_db);
+        kv_bin_deserialize(bin, bin_len, out_db, BENCH_DB_CNT);
+    }
+    __bench_report("binary deserialize", start);
+    if (memcmp(&out, &s_record, sizeof(out))) {
+        PR_ERR("binary record does not match");
+    }
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        kv_db_t item = {"active", KV_BOOL, &out.active, sizeof(out.active)};
+        kv_deserialize(text, &item, 1);
+    }
+    __bench_report("text read one key", start);
+
+    start = tal_system_get_millisecond();
+    for (i = 0; i < BENCH_LOOPS; i++) {
+        kv_db_t item = {"active", KV_BOOL, &out.active, sizeof(out.active)};
+        kv_bin_field_get(bin, bin_len, &item);
+    }
+    __bench_report("binary read one key", start);
+
+__EXIT:
+    tal_free(text);
+    tal_free(bin);
+    PR_NOTICE("------ kv serialize benchmark end ------");
+
+    return;
+}
+
+/**
+ * @brief main
+ *
+ * @param argc
+ * @param argv
+ * @return void
+ */
+#if OPERATING_SYSTEM == SYSTEM_LINUX
+void main(int argc, char *argv[])
+{
+    user_main();
+
+    while (1) {
+        tal_system_sleep(500);
+    }
+}
+#else
+
+/* Tuya thread handle */
+static THREAD_HANDLE ty_app_thread = NULL;
+
+/**
+ * @brief  task thread
+ *
+ * @param[in] arg:Parameters when creating a task
+ * @return none
+ */
+static void tuya_app_thread(void *arg)
+{
+    user_main();
+
+    tal_thread_delete(ty_app_thread);
+    ty_app_thread = NULL;
+}
+
+void tuya_app_main(void)
+{
+    THREAD_CFG_T thrd_param = {4096, 4, "tuya_app_main"};
+    tal_thread_create_and_start(&ty_app_thread, NULL, NULL, tuya_app_thread, NULL, &thrd_param);
+}
+#endif
@@ -0,0 +1,242 @@
+/**
+ * @file example_log_async.c
+ * @brief Checks the asynchronous log output of tal_log.
+ *
+ * The ring buffer is drained while it is empty, both by tal_log_async_flush and
+ * by the idle writer thread, and nothing may be written. Then enough messages
+ * are logged to wrap the ring buffer several times, every one of them must be
+ * written once, in order, or be counted as dropped. At last the async output is
+ * restarted over and over while another thread logs, so the first record of a
+ * fresh ring buffer is drained while it is still being written.
+ *
+ * @copyright Copyright (c) 2021-2025 Tuya Inc. All Rights Reserved.
+ *
+ */
+
+#include "tuya_cloud_types.h"
+
+#include "tal_api.h"
+#include "tkl_output.h"
+
+/***********************************************************
+************************macro define************************
+***********************************************************/
+#define LOG_TEST_BUF_SIZE 1024
+#define LOG_TEST_MSG_NUM  200
+#define LOG_TEST_RESTARTS 200
+#define LOG_TEST_TAG      "log async test msg "
+
+/***********************************************************
+***********************variable define**********************
+***********************************************************/
+static volatile uint32_t sg_out_cnt = 0;
+static volatile uint32_t sg_out_err = 0;
+static volatile uint32_t sg_out_bad = 0;
+static volatile int sg_last_idx = -1;
+static THREAD_HANDLE sg_producer = NULL;
+
+/***********************************************************
+***********************function define**********************
+***********************************************************/
+static BOOL_T __log_test_is_text(const char *str)
+{
+    const uint8_t *p = (const uint8_t *)str;
+
+    for (; *p; p++) {
+        if ((*p < 0x20 || *p >= 0x7F) && *p != '\r' && *p != '\n' && *p != '\033') {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+static void __log_test_output(const char *str)
+{
+    const char *tag = strstr(str, LOG_TEST_TAG);
+    int idx = 0;
+
+    tkl_log_output(str);
+
+    // a record read before it was committed shows up as a binary record or with the stale bytes of the ring
+    if (0 == strncmp(str, "!B:", 3) || !__log_test_is_text(str)) {
+        sg_out_bad++;
+        return;
+    }
+    if (NULL == tag) {
+        return;
+    }
+    idx = atoi(tag + strlen(LOG_TEST_TAG));
+    if (idx <= sg_last_idx) {
+        sg_out_err++;
+    }
+    sg_last_idx = idx;
+    sg_out_cnt++;
+}
+
+static OPERATE_RET __log_test_empty(void)
+{
+    TAL_LOG_ASYNC_STAT_T stat;
+
+    // drained by the caller, then by the writer thread after its idle timeout
+    tal_log_async_flush();
+    tal_system_sleep(1500);
+    tal_log_async_flush();
+
+    if (OPRT_OK != tal_log_async_stat_get(&stat) || stat.write_cnt || sg_out_cnt) {
+        tal_log_print_raw("empty ring: %d records written\r\n", stat.write_cnt);
+        return OPRT_COM_ERROR;
+    }
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET __log_test_wrap(void)
+{
+    TAL_LOG_ASYNC_STAT_T stat;
+    int i;
+
+    for (i = 0; i < LOG_TEST_MSG_NUM; i++) {
+        // lengths vary so the records end at every offset of the ring buffer
+        PR_DEBUG(LOG_TEST_TAG "%d %.*s", i, i % 64, "................................................................");
+        if (0 == i % 8) {
+            tal_log_async_flush();
+        }
+    }
+    tal_log_async_flush();
+    tal_system_sleep(100);
+
+    if (OPRT_OK != tal_log_async_stat_get(&stat)) {
+        return OPRT_COM_ERROR;
+    }
+    if (sg_out_err || sg_out_bad || sg_out_cnt + stat.drop_cnt != LOG_TEST_MSG_NUM) {
+        tal_log_print_raw("wrap: %d written, %d dropped, %d out of order\r\n", sg_out_cnt, stat.drop_cnt,
+                          sg_out_err);
+        return OPRT_COM_ERROR;
+    }
+
+    return OPRT_OK;
+}
+
+static void __log_test_producer(void *args)
+{
+    int i = LOG_TEST_MSG_NUM;
+
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(sg_producer)) {
+        PR_DEBUG(LOG_TEST_TAG "%d", i++);
+    }
+}
+
+static OPERATE_RET __log_test_restart(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+    TAL_LOG_ASYNC_STAT_T stat;
+    int i, j;
+
+    THREAD_CFG_T thread_cfg = {
+        .thrdname = "log_test_producer",
+        .stackDepth = 4096,
+        .priority = THREAD_PRIO_3,
+    };
+    TUYA_CALL_ERR_RETURN(tal_thread_create_and_start(&sg_producer, NULL, NULL, __log_test_producer, NULL, &thread_cfg));
+
+    for (i = 0; i < LOG_TEST_RESTARTS && OPRT_OK == rt; i++) {
+        tal_log_async_stop();
+        rt = tal_log_async_start(LOG_TEST_BUF_SIZE);
+        // drain without a break until the first record of the fresh ring is out
+        for (j = 0; j < 10000 && OPRT_OK == rt; j++) {
+            tal_log_async_flush();
+            if (OPRT_OK == tal_log_async_stat_get(&stat) && stat.write_cnt) {
+                break;
+            }
+        }
+    }
+
+    tal_thread_delete(sg_producer);
+    while (THREAD_STATE_DELETE != tal_thread_get_state(sg_producer)) {
+        tal_system_sleep(10);
+    }
+    // the writer of the stopped ring and the synchronous output may interleave, only bad records count here
+    if (OPRT_OK != rt || sg_out_bad) {
+        tal_log_print_raw("restart: rt:%d, %d bad records\r\n", rt, sg_out_bad);
+        return OPRT_COM_ERROR;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief user_main
+ *
+ * @return none
+ */
+void user_main(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    /* basic init */
+    tal_log_init(TAL_LOG_LEVEL_DEBUG, 1024, __log_test_output);
+
+    // a fresh, small ring buffer, whatever tal_log_init started
+    tal_log_async_stop();
+    rt = tal_log_async_start(LOG_TEST_BUF_SIZE);
+    if (OPRT_OK != rt) {
+        tal_log_print_raw("log async start fail, rt:%d\r\n", rt);
+        return;
+    }
+
+    rt = __log_test_empty();
+    if (OPRT_OK == rt) {
+        rt = __log_test_wrap();
+    }
+    if (OPRT_OK == rt) {
+        rt = __log_test_restart();
+    }
+
+    tal_log_async_stop();
+    tal_log_print_raw("------ log async test %s ------\r\n", (OPRT_OK == rt) ? "PASS" : "FAIL");
+
+    return;
+}
+
+/**
+ * @brief main
+ *
+ * @param argc
+ * @param argv
+ * @return void
+ */
+#if OPERATING_SYSTEM == SYSTEM_LINUX
+void main(int argc, char *argv[])
+{
+    user_main();
+
+    while (1) {
+        tal_system_sleep(500);
+    }
+}
+#else
+
+/* Tuya thread handle */
+static THREAD_HANDLE ty_app_thread = NULL;
+
+/**
+ * @brief  task thread
+ *
+ * @param[in] arg:Parameters when creating a task
+ * @return none
+ */
+static void tuya_app_thread(void *arg)
+{
+    user_main();
+
+    tal_thread_delete(ty_app_thread);
+    ty_app_thread = NULL;
+}
+
+void tuya_app_main(void)
+{
+    THREAD_CFG_T thrd_param = {4096, 4, "tuya_app_main"};
+    tal_thread_create_and_start(&ty_app_thread, NULL, NULL, tuya_app_thread, NULL, &thrd_param);
+}
+#endif
@@ -3,6 +3,21 @@
 
 #include "tuya_cloud_types.h"
 #include "tal_memory.h"
+
+/* idle keep-alive connections kept by http_client_request, 0 to disable */
+#ifndef HTTP_CLIENT_POOL_SIZE
+#define HTTP_CLIENT_POOL_SIZE (2)
+#endif
+
+/* idle connections kept for one host:port:scheme */
+#ifndef HTTP_CLIENT_POOL_PER_HOST
+#define HTTP_CLIENT_POOL_PER_HOST (1)
+#endif
+
+/* an idle connection is closed after this time */
+#ifndef HTTP_CLIENT_POOL_IDLE_MS
+#define HTTP_CLIENT_POOL_IDLE_MS (30 * 1000)
+#endif
 /**
  * @ingroup http_enum_types
  * @brief The HTTP interface return status.
@@ -60,8 +75,22 @@ typedef struct http_client_response {
     uint16_t status_code;
 } http_client_response_t;
 
+typedef struct http_client_pool_stats {
+    uint32_t hit;              /**< requests sent on a kept connection */
+    uint32_t miss;             /**< requests that needed a new connection */
+    uint32_t stale;            /**< kept connections found closed by the server */
+    uint32_t connect_cnt;      /**< new connections */
+    uint32_t connect_ms_total; /**< time spent in TCP connect and TLS handshake */
+    uint32_t connect_ms_max;
+    uint32_t idle; /**< connections in the pool now */
+} http_client_pool_stats_t;
+
 http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response);
 
+void http_client_pool_flush(void);
+
+void http_client_pool_stats_get(http_client_pool_stats_t *stats);
+
 int http_client_free(http_client_response_t *response);
 
 #endif /* ifndef HTTP_CLIENT_INTERFACE_H */
@@ -8,6 +8,32 @@ extern "C" {
 #include "tuya_cloud_types.h"
 #include "http_client_interface.h"
 
+/* connections a download with parallel set can use at most */
+#ifndef HTTP_DOWNLOAD_PARALLEL_MAX
+#define HTTP_DOWNLOAD_PARALLEL_MAX (4)
+#endif
+
+/* bytes fetched by one range request of a parallel download, each connection
+ * buffers one segment */
+#ifndef HTTP_DOWNLOAD_SEGMENT_SIZE
+#define HTTP_DOWNLOAD_SEGMENT_SIZE (16 * 1024)
+#endif
+
+/* stack of the threads of a parallel download, they run the TLS handshake */
+#ifndef HTTP_DOWNLOAD_THREAD_STACK
+#define HTTP_DOWNLOAD_THREAD_STACK (4096)
+#endif
+
+/* progress is saved to KV each time this many more bytes were consumed */
+#ifndef HTTP_DOWNLOAD_CHECKPOINT_STEP
+#define HTTP_DOWNLOAD_CHECKPOINT_STEP (64 * 1024)
+#endif
+
+/* largest consumer state saved with a checkpoint */
+#ifndef HTTP_DOWNLOAD_CHECKPOINT_USER_MAX
+#define HTTP_DOWNLOAD_CHECKPOINT_USER_MAX (256)
+#endif
+
 typedef enum {
     DL_EVENT_CONNECTED,
     DL_EVENT_START,
@@ -15,6 +41,7 @@ typedef enum {
     DL_EVENT_ON_DATA,
     DL_EVENT_FINISH,
     DL_EVENT_FAULT,
+    DL_EVENT_CHECKPOINT,
 } http_download_event_id_t;
 
 typedef struct {
@@ -24,8 +51,22 @@ typedef struct {
     size_t file_size;
     uint32_t remain_len;
     void *user_data;
+    void *checkpoint;
+    size_t checkpoint_len;
 } http_download_event_t;
 
+/*
+ * Resuming (checkpoint_key set):
+ * - DL_EVENT_CHECKPOINT is raised after DL_EVENT_ON_DATA each time
+ *   HTTP_DOWNLOAD_CHECKPOINT_STEP more bytes were consumed, offset is the number
+ *   of bytes consumed. The consumer can point checkpoint/checkpoint_len to its
+ *   own state, it is saved with the offset.
+ * - DL_EVENT_ON_FILESIZE of a download that finds a checkpoint of the same file
+ *   has offset set to the byte it resumes from and checkpoint/checkpoint_len to
+ *   the state saved then. The consumer sets offset to 0 to start over.
+ * The checkpoint is deleted when the download finishes.
+ */
+
 typedef void (*http_download_event_cb_t)(http_download_event_id_t id, http_download_event_t *event);
 
 typedef struct {
@@ -37,6 +78,8 @@ typedef struct {
     size_t file_size;
     void *user_data;
     http_download_event_cb_t event_handler;
+    uint8_t parallel;           /**< connections fetching ranges at the same time, 0 or 1 for one */
+    const char *checkpoint_key; /**< KV key the progress is saved to, NULL not to resume */
 } http_download_config_t;
 
 int http_file_download(http_download_config_t *config);
@@ -4,6 +4,10 @@
 #include "core_http_client.h"
 #include "tuya_tls.h"
 #include "tal_log.h"
+#include "tal_mutex.h"
+#include "tal_system.h"
+#include "tal_event.h"
+#include "tal_workq_service.h"
 
 #define log_debug PR_DEBUG
 #define log_error PR_ERR
@@ -74,57 +78,417 @@ static http_client_status_t core_http_request_send(const TransportInterface_t *p
     return HTTP_CLIENT_SUCCESS;
 }
 
-http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+/* -------------------------------------------------------------------------- */
+/*                          Keep-alive connection pool                        */
+/* -------------------------------------------------------------------------- */
+/*
+ * Connections are returned to the pool after a response that does not close
+ * them and are taken again by the next request to the same host:port:scheme
+ * that trusts the same CA certificate, so a connection verified against one CA
+ * is never handed to a request that asked for another.
+ * A connection that stays idle for HTTP_CLIENT_POOL_IDLE_MS is closed by a
+ * delayed work, or by the next pool access if the work could not be created,
+ * one that the server closed meanwhile is found readable and dropped when taken.
+ * A change of the link status or type closes all of them.
+ */
+#define HTTP_CLIENT_POOL_HOST_LEN (128)
+
+typedef struct {
+    const char *host;
+    uint16_t port;
+    bool tls;
+    size_t ca_len;
+    uint32_t ca_hash; // FNV-1a of the CA certificate, 0 without tls
+} http_pool_key_t;
+
+typedef struct {
+    NetworkContext_t network; // NULL if the slot is free
+    char host[HTTP_CLIENT_POOL_HOST_LEN];
+    uint16_t port;
+    bool tls;
+    size_t ca_len;
+    uint32_t ca_hash;
+    SYS_TIME_T idle_since;
+} http_pool_conn_t;
+
+static struct {
+    MUTEX_HANDLE mutex;
+    http_client_pool_stats_t stats;
+#if HTTP_CLIENT_POOL_SIZE > 0
+    http_pool_conn_t conn[HTTP_CLIENT_POOL_SIZE];
+    bool subscribed;
+    DELAYED_WORK_HANDLE work; // expires the idle connections, NULL until created
+#endif
+} s_http_pool;
+
+static void http_pool_conn_close(NetworkContext_t network)
+{
+    tuya_transporter_close(network);
+    tuya_transporter_destroy(network);
+}
+
+static bool http_pool_lock(void)
+{
+    if (s_http_pool.mutex == NULL) {
+        MUTEX_HANDLE mutex = NULL;
+        if (OPRT_OK != tal_mutex_create_init(&mutex)) {
+            return false;
+        }
+        TAL_ENTER_CRITICAL();
+        if (s_http_pool.mutex == NULL) {
+            s_http_pool.mutex = mutex;
+            mutex = NULL;
+        }
+        TAL_EXIT_CRITICAL();
+        if (mutex) {
+            tal_mutex_release(mutex);
+        }
+    }
+
+    tal_mutex_lock(s_http_pool.mutex);
+    return true;
+}
+
+static void http_pool_unlock(void)
+{
+    tal_mutex_unlock(s_http_pool.mutex);
+}
+
+static void http_pool_key_make(http_pool_key_t *key, const http_client_request_t *request, uint16_t port, bool tls)
+{
+    size_t i;
+
+    key->host = request->host;
+    key->port = port;
+    key->tls = tls;
+    key->ca_len = tls ? request->cacert_len : 0;
+    key->ca_hash = 0;
+    if (tls) {
+        key->ca_hash = 2166136261u;
+        for (i = 0; i < request->cacert_len; i++) {
+            key->ca_hash = (key->ca_hash ^ request->cacert[i]) * 16777619u;
+        }
+    }
+}
+
+#if HTTP_CLIENT_POOL_SIZE > 0
+static bool http_pool_conn_match(const http_pool_conn_t *conn, const http_pool_key_t *key)
+{
+    return conn->network && conn->port == key->port && conn->tls == key->tls && conn->ca_len == key->ca_len &&
+           conn->ca_hash == key->ca_hash && 0 == strcmp(conn->host, key->host);
+}
+
+/* empty a slot, its connection is returned for closing after the unlock */
+static NetworkContext_t http_pool_slot_take(http_pool_conn_t *conn)
+{
+    NetworkContext_t network = conn->network;
+    conn->network = NULL;
+    s_http_pool.stats.idle--;
+    return network;
+}
+
+/* close the connections idle for too long, the pool is locked */
+static uint32_t http_pool_expire(NetworkContext_t *expired)
+{
+    uint32_t i, num = 0;
+    SYS_TIME_T now = tal_system_get_millisecond();
+
+    for (i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        if (s_http_pool.conn[i].network && now - s_http_pool.conn[i].idle_since >= HTTP_CLIENT_POOL_IDLE_MS) {
+            expired[num++] = http_pool_slot_take(&s_http_pool.conn[i]);
+        }
+    }
+    return num;
+}
+
+static void http_pool_expire_work(void *data);
+
+/* schedules the expiry of the oldest idle connection, the pool is locked */
+static void http_pool_rearm(void)
+{
+    SYS_TIME_T now = tal_system_get_millisecond();
+    SYS_TIME_T oldest = 0;
+    DELAYED_WORK_HANDLE work = NULL;
+    uint32_t i;
+    bool idle = false;
+
+    // retried by the next put until the workqueue service is up
+    if (s_http_pool.work == NULL) {
+        if (OPRT_OK != tal_workq_init_delayed(WORKQ_SYSTEM, http_pool_expire_work, NULL, &work)) {
+            return;
+        }
+        s_http_pool.work = work;
+    }
+    for (i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        if (s_http_pool.conn[i].network && (!idle || s_http_pool.conn[i].idle_since < oldest)) {
+            oldest = s_http_pool.conn[i].idle_since;
+            idle = true;
+        }
+    }
+    if (idle) {
+        tal_workq_start_delayed(s_http_pool.work, (TIME_MS)(oldest + HTTP_CLIENT_POOL_IDLE_MS - now), LOOP_ONCE);
+    }
+}
+
+static void http_pool_expire_work(void *data)
+{
+    NetworkContext_t expired[HTTP_CLIENT_POOL_SIZE];
+    uint32_t i, num = 0;
+
+    if (!http_pool_lock()) {
+        return;
+    }
+    num = http_pool_expire(expired);
+    http_pool_rearm();
+    http_pool_unlock();
+
+    for (i = 0; i < num; i++) {
+        http_pool_conn_close(expired[i]);
+    }
+}
+
+static int http_pool_link_event_cb(void *data)
+{
+    http_client_pool_flush();
+    return OPRT_OK;
+}
+
+/* not under the pool lock, the events flush the pool */
+static void http_pool_link_subscribe(void)
+{
+    bool subscribe = false;
+
+    TAL_ENTER_CRITICAL();
+    if (!s_http_pool.subscribed) {
+        s_http_pool.subscribed = true;
+        subscribe = true;
+    }
+    TAL_EXIT_CRITICAL();
+    if (subscribe) {
+        tal_event_subscribe(EVENT_LINK_STATUS_CHG, "http pool", http_pool_link_event_cb, SUBSCRIBE_TYPE_NORMAL);
+        tal_event_subscribe(EVENT_LINK_TYPE_CHG, "http pool", http_pool_link_event_cb, SUBSCRIBE_TYPE_NORMAL);
+    }
+}
+#endif
+
+static NetworkContext_t http_pool_get(const http_pool_key_t *key)
+{
+    NetworkContext_t network = NULL;
+
+#if HTTP_CLIENT_POOL_SIZE > 0
+    NetworkContext_t expired[HTTP_CLIENT_POOL_SIZE];
+    uint32_t i, num = 0;
+
+    if (!http_pool_lock()) {
+        return NULL;
+    }
+    num = http_pool_expire(expired);
+    for (i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        http_pool_conn_t *conn = &s_http_pool.conn[i];
+        if (http_pool_conn_match(conn, key)) {
+            network = http_pool_slot_take(conn);
+            break;
+        }
+    }
+    http_pool_unlock();
+
+    for (i = 0; i < num; i++) {
+        http_pool_conn_close(expired[i]);
+    }
+
+    /* nothing is expected on an idle connection, readable means closed by the server */
+    if (network && tuya_transporter_poll_read(network, 0) != 0) {
+        log_debug("keep-alive connection to %s:%d closed by peer", key->host, key->port);
+        http_pool_conn_close(network);
+        network = NULL;
+        http_pool_lock();
+        s_http_pool.stats.stale++;
+        http_pool_unlock();
+    }
+#endif
+
+    if (http_pool_lock()) {
+        if (network) {
+            s_http_pool.stats.hit++;
+        } else {
+            s_http_pool.stats.miss++;
+        }
+        http_pool_unlock();
+    }
+
+    return network;
+}
+
+static void http_pool_put(const http_pool_key_t *key, NetworkContext_t network)
+{
+#if HTTP_CLIENT_POOL_SIZE > 0
+    NetworkContext_t expired[HTTP_CLIENT_POOL_SIZE + 1];
+    http_pool_conn_t *slot = NULL;
+    http_pool_conn_t *oldest = NULL;
+    http_pool_conn_t *host_oldest = NULL;
+    uint32_t i, num = 0, host_num = 0;
+
+    http_pool_link_subscribe();
+    if (strlen(key->host) >= HTTP_CLIENT_POOL_HOST_LEN || !http_pool_lock()) {
+        http_pool_conn_close(network);
+        return;
+    }
+
+    num = http_pool_expire(expired);
+    for (i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        http_pool_conn_t *conn = &s_http_pool.conn[i];
+        if (conn->network == NULL) {
+            slot = slot ? slot : conn;
+            continue;
+        }
+        if (oldest == NULL || conn->idle_since < oldest->idle_since) {
+            oldest = conn;
+        }
+        if (http_pool_conn_match(conn, key)) {
+            host_num++;
+            if (host_oldest == NULL || conn->idle_since < host_oldest->idle_since) {
+                host_oldest = conn;
+            }
+        }
+    }
+
+    /* the least recently used connection makes room, of the same host first */
+    if (host_num >= HTTP_CLIENT_POOL_PER_HOST) {
+        slot = host_oldest;
+    } else if (slot == NULL) {
+        slot = oldest;
+    }
+    if (slot->network) {
+        expired[num++] = http_pool_slot_take(slot);
+    }
+
+    slot->network = network;
+    strcpy(slot->host, key->host);
+    slot->port = key->port;
+    slot->tls = key->tls;
+    slot->ca_len = key->ca_len;
+    slot->ca_hash = key->ca_hash;
+    slot->idle_since = tal_system_get_millisecond();
+    s_http_pool.stats.idle++;
+    http_pool_rearm();
+    http_pool_unlock();
+
+    for (i = 0; i < num; i++) {
+        http_pool_conn_close(expired[i]);
+    }
+#else
+    http_pool_conn_close(network);
+#endif
+}
+
+/**
+ * @brief Closes all the idle connections of the pool. Called on a change of
+ * the link status or type.
+ */
+void http_client_pool_flush(void)
+{
+#if HTTP_CLIENT_POOL_SIZE > 0
+    NetworkContext_t closing[HTTP_CLIENT_POOL_SIZE];
+    uint32_t i, num = 0;
+
+    if (!http_pool_lock()) {
+        return;
+    }
+    for (i = 0; i < HTTP_CLIENT_POOL_SIZE; i++) {
+        if (s_http_pool.conn[i].network) {
+            closing[num++] = http_pool_slot_take(&s_http_pool.conn[i]);
+        }
+    }
+    http_pool_unlock();
+
+    for (i = 0; i < num; i++) {
+        http_pool_conn_close(closing[i]);
+    }
+#endif
+}
+
+/**
+ * @brief Gets the pool counters.
+ *
+ * @param[out] stats The counters since boot.
+ */
+void http_client_pool_stats_get(http_client_pool_stats_t *stats)
+{
+    if (stats == NULL) {
+        return;
+    }
+
+    if (!http_pool_lock()) {
+        memset(stats, 0, sizeof(http_client_pool_stats_t));
+        return;
+    }
+    *stats = s_http_pool.stats;
+    http_pool_unlock();
+}
+
+static http_client_status_t http_client_connect(const http_client_request_t *request, uint16_t port, bool tls,
+                                                NetworkContext_t *network)
 {
-    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
     int ret = OPRT_OK;
+    SYS_TIME_T start = tal_system_get_millisecond();
 
-    /* TLS pre init */
-    NetworkContext_t network;
-    TUYA_TRANSPORT_TYPE_E transport_type = (request->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
-    network = tuya_transporter_create(transport_type, NULL);
-    if (NULL == network) {
+    *network = tuya_transporter_create(tls ? TRANSPORT_TYPE_TLS : TRANSPORT_TYPE_TCP, NULL);
+    if (NULL == *network) {
         return HTTP_CLIENT_MALLOC_FAULT;
     }
 
-    if (transport_type == TRANSPORT_TYPE_TLS) {
+    if (tls) {
         tuya_tls_config_t tls_config = {
             .ca_cert = (char *)request->cacert,
             .ca_cert_size = request->cacert_len,
             .hostname = (char *)request->host,
-            .port = (request->port == 0) ? DEFAULT_HTTPS_PORT : request->port,
+            .port = port,
             .timeout = request->timeout_ms,
             .mode = TUYA_TLS_SERVER_CERT_MODE,
             .verify = true,
         };
 
-        ret = tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
+        ret = tuya_transporter_ctrl(*network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config);
         if (OPRT_OK != ret) {
             log_error("network_tls_init fail:%d", ret);
-            return ret;
-        }
-
-        ret = tuya_transporter_connect(network, tls_config.hostname, tls_config.port, tls_config.timeout);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
+            tuya_transporter_destroy(*network);
+            *network = NULL;
             return HTTP_CLIENT_SEND_FAULT;
         }
+    }
 
+    ret = tuya_transporter_connect(*network, request->host, port, request->timeout_ms);
+    if (OPRT_OK != ret) {
+        http_pool_conn_close(*network);
+        *network = NULL;
+        return HTTP_CLIENT_SEND_FAULT;
+    }
+
+    if (tls) {
         log_debug("tls connencted!");
-    } else {
-        ret = tuya_transporter_connect(network, request->host, (request->port == 0) ? DEFAULT_HTTP_PORT : request->port,
-                                       request->timeout_ms);
-        if (OPRT_OK != ret) {
-            tuya_transporter_close(network);
-            tuya_transporter_destroy(network);
-            return HTTP_CLIENT_SEND_FAULT;
+    }
+
+    uint32_t connect_ms = (uint32_t)(tal_system_get_millisecond() - start);
+    if (http_pool_lock()) {
+        s_http_pool.stats.connect_cnt++;
+        s_http_pool.stats.connect_ms_total += connect_ms;
+        if (connect_ms > s_http_pool.stats.connect_ms_max) {
+            s_http_pool.stats.connect_ms_max = connect_ms;
         }
+        http_pool_unlock();
     }
-    /* http client TransportInterface */
-    TransportInterface_t pTransportInterface = {.pNetworkContext = (NetworkContext_t *)&network,
-                                                .recv = (TransportRecv_t)NetworkTransportRecv,
-                                                .send = (TransportSend_t)NetworkTransportSend};
+
+    return HTTP_CLIENT_SUCCESS;
+}
+
+http_client_status_t http_client_request(const http_client_request_t *request, http_client_response_t *response)
+{
+    http_client_status_t rt = HTTP_CLIENT_SUCCESS;
+    bool tls = (request->cacert != NULL);
+    uint16_t port = request->port ? request->port : (tls ? DEFAULT_HTTPS_PORT : DEFAULT_HTTP_PORT);
+    HTTPResponse_t http_response = {0};
+    http_pool_key_t pool_key;
+    int attempt;
 
     /* http client request object make */
     HTTPRequestInfo_t requestInfo = {
@@ -134,19 +498,60 @@ http_client_status_t http_client_request(const http_client_request_t *request, h
         .hostLen = strlen(request->host),
         .pPath = request->path,
         .pathLen = strlen(request->path),
+        .reqFlags = (HTTP_CLIENT_POOL_SIZE > 0) ? HTTP_REQUEST_KEEP_ALIVE_FLAG : 0,
     };
 
-    HTTPResponse_t http_response = {0};
+    http_pool_key_make(&pool_key, request, port, tls);
 
-    /* HTTP request send */
-    log_debug("http request send!");
-    rt = core_http_request_send((const TransportInterface_t *)&pTransportInterface,
-                                (const HTTPRequestInfo_t *)&requestInfo, request->headers, request->headers_count,
-                                (const uint8_t *)request->body, request->body_length, &http_response);
+    /* a kept connection can be closed by the server while the request is sent,
+     * then the request is sent once more on a new one. Only GET and HEAD, the
+     * server may have acted on a POST before the connection failed */
+    bool idempotent = (0 == strcmp(request->method, HTTP_METHOD_GET) || 0 == strcmp(request->method, HTTP_METHOD_HEAD));
 
-    /* tls disconnect */
-    tuya_transporter_close(network);
-    tuya_transporter_destroy(network);
+    for (attempt = 0; attempt < 2; attempt++) {
+        NetworkContext_t network = http_pool_get(&pool_key);
+        bool reused = (network != NULL);
+
+        if (reused && tls) {
+            /* the config still points to the buffers of the request that connected */
+            tuya_tls_config_t *tls_config = NULL;
+            tuya_transporter_ctrl(network, TUYA_TRANSPORTER_GET_TLS_CONFIG, &tls_config);
+            if (tls_config) {
+                tls_config->ca_cert = (char *)request->cacert;
+                tls_config->ca_cert_size = request->cacert_len;
+                tls_config->hostname = (char *)request->host;
+                tls_config->timeout = request->timeout_ms;
+            }
+        } else if (!reused) {
+            rt = http_client_connect(request, port, tls, &network);
+            if (HTTP_CLIENT_SUCCESS != rt) {
+                return rt;
+            }
+        }
+
+        /* http client TransportInterface */
+        TransportInterface_t pTransportInterface = {.pNetworkContext = (NetworkContext_t *)&network,
+                                                    .recv = (TransportRecv_t)NetworkTransportRecv,
+                                                    .send = (TransportSend_t)NetworkTransportSend};
+
+        /* HTTP request send */
+        log_debug("http request send!");
+        memset(&http_response, 0, sizeof(http_response));
+        rt = core_http_request_send((const TransportInterface_t *)&pTransportInterface,
+                                    (const HTTPRequestInfo_t *)&requestInfo, request->headers, request->headers_count,
+                                    (const uint8_t *)request->body, request->body_length, &http_response);
+
+        if (HTTP_CLIENT_SUCCESS == rt && !(http_response.respFlags & HTTP_RESPONSE_CONNECTION_CLOSE_FLAG)) {
+            http_pool_put(&pool_key, network);
+        } else {
+            http_pool_conn_close(network);
+        }
+
+        if (HTTP_CLIENT_SEND_FAULT != rt || !reused || !idempotent) {
+            break;
+        }
+        log_debug("kept connection failed, retry on a new one");
+    }
 
     if (OPRT_OK != rt) {
         log_error("http_request_send error:%d", rt);
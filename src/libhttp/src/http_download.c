@@ -14,10 +14,27 @@ typedef enum {
     DL_STATE_FILESIZE_GET,
     DL_STATE_RANGE_REQUEST,
     DL_STATE_DATE_GET,
+    DL_STATE_PARALLEL,
     DL_STATE_COMPLETE,
 } http_download_state_t;
 
+typedef struct http_download http_download_t;
+
 typedef struct {
+    http_download_t *ctx;
+    THREAD_HANDLE thread;
+    NetworkContext_t network;
+    TransportInterface_t transport;
+    HTTPRequestHeaders_t requestHeaders;
+    HTTPResponse_t response;
+    SEM_HANDLE free_sem; // the segment was delivered, the buffer can be reused
+    size_t seg_offset;
+    size_t seg_len;
+    bool ready;
+    uint8_t *buffer;
+} http_download_worker_t;
+
+struct http_download {
     http_download_config_t config;
     http_download_event_t event;
     TransportInterface_t transport;
@@ -31,9 +48,18 @@ typedef struct {
     size_t received_size;
     size_t remain_len;
     size_t offset;
+    size_t checkpoint_offset;
     uint8_t state;
+    bool file_size_notified;
     uint8_t *buffer;
-} http_download_t;
+
+    /* parallel download */
+    MUTEX_HANDLE mutex;
+    SEM_HANDLE ready_sem; // a segment was fetched, or a worker failed
+    SEM_HANDLE done_sem;  // a worker exited
+    size_t next_offset;   // start of the next segment to fetch
+    volatile bool abort;
+};
 
 #define MAX_RETRY_TIMES (8u)
 /*-----------------------------------------------------------*/
@@ -69,7 +95,29 @@ typedef struct {
 //! timeout sec
 #define HTTP_DOWNLOAD_TIMEOUT 180
 
+#define HTTP_DOWNLOAD_CHECKPOINT_MAGIC 0x48444350
+
+typedef struct {
+    uint32_t magic;
+    uint32_t url_hash;
+    uint32_t file_size;
+    uint32_t offset;
+    uint32_t user_len;
+    uint8_t user[0];
+} http_download_checkpoint_t;
+
 /*-----------------------------------------------------------*/
+static void http_download_response_free(HTTPResponse_t *response)
+{
+    if (response->pBuffer) {
+        tal_free(response->pBuffer);
+    }
+    if (response->pBody) {
+        tal_free((void *)response->pBody);
+    }
+    memset(response, 0, sizeof(HTTPResponse_t));
+}
+
 static int http_download_filesize_get(http_download_t *ctx)
 {
     int rt = 0;
@@ -105,31 +153,425 @@ static int http_download_filesize_get(http_download_t *ctx)
     pFileSizeStr += sizeof(char);
     ctx->file_size = (size_t)strtoul(pFileSizeStr, NULL, 10);
     PR_INFO("The file is %d bytes long.", (int32_t)ctx->file_size);
-    if (ctx->response.pBuffer) {
-        tal_free(ctx->response.pBuffer);
-    }
-    memset(&ctx->response, 0, sizeof(ctx->response));
+    http_download_response_free(&ctx->response);
 __exit:
     return rt;
 }
 
-static int http_download_range_request(http_download_t *ctx, uint32_t range_start, uint32_t range_end)
+static int http_download_range_request(http_download_t *ctx, const TransportInterface_t *transport,
+                                       HTTPRequestHeaders_t *requestHeaders, HTTPResponse_t *response,
+                                       uint32_t range_start, uint32_t range_end)
 {
     int rt = OPRT_OK;
 
     PR_DEBUG("Downloading bytes %d-%d, from %s...: ", range_start, range_end, ctx->host);
-    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(&ctx->requestHeaders, &ctx->requestInfo), __exit);
-    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(&ctx->requestHeaders, range_start, range_end), __exit);
-    PR_TRACE("Request Headers:\n%.*s", (int32_t)ctx->requestHeaders.headersLen, (char *)ctx->requestHeaders.pBuffer);
-    TUYA_CALL_ERR_GOTO(HTTPClient_Request(&ctx->transport, &ctx->requestHeaders, NULL, 0, &ctx->response,
-                                          HTTP_SEND_DISABLE_RECV_BODY_FLAG),
-                       __exit);
+    http_download_response_free(response);
+    TUYA_CALL_ERR_GOTO(HTTPClient_InitializeRequestHeaders(requestHeaders, &ctx->requestInfo), __exit);
+    TUYA_CALL_ERR_GOTO(HTTPClient_AddRangeHeader(requestHeaders, range_start, range_end), __exit);
+    PR_TRACE("Request Headers:\n%.*s", (int32_t)requestHeaders->headersLen, (char *)requestHeaders->pBuffer);
+    TUYA_CALL_ERR_GOTO(
+        HTTPClient_Request(transport, requestHeaders, NULL, 0, response, HTTP_SEND_DISABLE_RECV_BODY_FLAG), __exit);
     PR_TRACE("Received HTTP response from %s%s...", ctx->host, ctx->path);
-    PR_TRACE("Response Headers:\n%.*s", (int32_t)ctx->response.headersLen, ctx->response.pHeaders);
+    PR_TRACE("Response Headers:\n%.*s", (int32_t)response->headersLen, response->pHeaders);
 __exit:
     return rt;
 }
 
+static NetworkContext_t http_download_network_create(http_download_t *ctx)
+{
+    TUYA_TRANSPORT_TYPE_E transport_type = (ctx->config.cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
+    NetworkContext_t network = tuya_transporter_create(transport_type, NULL);
+
+    if (NULL == network) {
+        return NULL;
+    }
+    if (transport_type == TRANSPORT_TYPE_TLS) {
+        tuya_tls_config_t tls_config = {
+            .ca_cert = (char *)ctx->config.cacert,
+            .ca_cert_size = ctx->config.cacert_len,
+            .hostname = (char *)ctx->host,
+            .port = ctx->port,
+            .mode = TUYA_TLS_SERVER_CERT_MODE,
+            .verify = true,
+        };
+
+        if (OPRT_OK != tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config)) {
+            tuya_transporter_destroy(network);
+            return NULL;
+        }
+    }
+
+    return network;
+}
+
+/*-----------------------------------------------------------*/
+/* the checkpoint belongs to the file at host/path, the query often carries a
+ * token that changes on each try */
+static uint32_t http_download_url_hash(http_download_t *ctx)
+{
+    uint32_t hash = 2166136261u;
+    const char *p = NULL;
+
+    for (p = ctx->host; *p; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    for (p = ctx->path; *p && *p != '?'; p++) {
+        hash = (hash ^ (uint8_t)*p) * 16777619u;
+    }
+    return hash;
+}
+
+static void http_download_checkpoint_save(http_download_t *ctx)
+{
+    size_t consumed = ctx->received_size - ctx->remain_len;
+    http_download_checkpoint_t *record = NULL;
+
+    if (NULL == ctx->config.checkpoint_key || consumed < ctx->checkpoint_offset + HTTP_DOWNLOAD_CHECKPOINT_STEP ||
+        consumed >= ctx->file_size) {
+        return;
+    }
+
+    ctx->event.offset = consumed;
+    ctx->event.checkpoint = NULL;
+    ctx->event.checkpoint_len = 0;
+    ctx->config.event_handler(DL_EVENT_CHECKPOINT, &ctx->event);
+    if (ctx->event.checkpoint_len > HTTP_DOWNLOAD_CHECKPOINT_USER_MAX) {
+        PR_WARN("checkpoint state %d too long", (int)ctx->event.checkpoint_len);
+        goto __exit;
+    }
+
+    record = tal_malloc(sizeof(http_download_checkpoint_t) + ctx->event.checkpoint_len);
+    if (NULL == record) {
+        goto __exit;
+    }
+    record->magic = HTTP_DOWNLOAD_CHECKPOINT_MAGIC;
+    record->url_hash = http_download_url_hash(ctx);
+    record->file_size = ctx->file_size;
+    record->offset = consumed;
+    record->user_len = ctx->event.checkpoint_len;
+    if (record->user_len) {
+        memcpy(record->user, ctx->event.checkpoint, record->user_len);
+    }
+    if (OPRT_OK == tal_kv_set(ctx->config.checkpoint_key, (const uint8_t *)record,
+                              sizeof(http_download_checkpoint_t) + record->user_len)) {
+        ctx->checkpoint_offset = consumed;
+    }
+    tal_free(record);
+
+__exit:
+    ctx->event.checkpoint = NULL;
+    ctx->event.checkpoint_len = 0;
+}
+
+/* raise DL_EVENT_ON_FILESIZE, from the checkpoint if one of this file is found */
+static void http_download_resume(http_download_t *ctx)
+{
+    uint8_t *value = NULL;
+    size_t length = 0;
+    size_t offset = 0;
+
+    ctx->event.offset = 0;
+    ctx->event.checkpoint = NULL;
+    ctx->event.checkpoint_len = 0;
+    ctx->event.file_size = ctx->file_size;
+
+    if (ctx->config.checkpoint_key && OPRT_OK == tal_kv_get(ctx->config.checkpoint_key, &value, &length)) {
+        http_download_checkpoint_t *record = (http_download_checkpoint_t *)value;
+        if (length >= sizeof(http_download_checkpoint_t) && record->magic == HTTP_DOWNLOAD_CHECKPOINT_MAGIC &&
+            record->url_hash == http_download_url_hash(ctx) && record->file_size == ctx->file_size &&
+            record->offset < ctx->file_size && length == sizeof(http_download_checkpoint_t) + record->user_len) {
+            PR_INFO("resume download at %d of %d", (int)record->offset, (int)record->file_size);
+            offset = record->offset;
+            ctx->event.offset = offset;
+            ctx->event.checkpoint = record->user;
+            ctx->event.checkpoint_len = record->user_len;
+        }
+    }
+
+    ctx->config.event_handler(DL_EVENT_ON_FILESIZE, &ctx->event);
+
+    /* the consumer may refuse to resume */
+    if (ctx->event.offset < offset) {
+        offset = ctx->event.offset;
+    }
+    ctx->received_size = offset;
+    ctx->checkpoint_offset = offset;
+    ctx->remain_len = 0;
+    ctx->event.checkpoint = NULL;
+    ctx->event.checkpoint_len = 0;
+
+    if (value) {
+        tal_kv_free(value);
+    }
+}
+
+/* hand buffer[0, remain_len + len) to the consumer, the bytes it leaves are
+ * moved to the head of the buffer for the next call */
+static void http_download_data_notify(http_download_t *ctx, size_t len)
+{
+    ctx->event.data = (uint8_t *)ctx->buffer;
+    ctx->event.data_len = len + ctx->remain_len;
+    ctx->event.offset = ctx->received_size - ctx->remain_len;
+    ctx->event.remain_len = ctx->remain_len;
+    ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
+    if (ctx->event.remain_len) {
+        memmove(ctx->buffer, ctx->buffer + (ctx->event.data_len - ctx->event.remain_len), ctx->event.remain_len);
+    }
+    ctx->remain_len = ctx->event.remain_len;
+    ctx->received_size += len;
+
+    http_download_checkpoint_save(ctx);
+}
+
+/*-----------------------------------------------------------*/
+/*
+ * Parallel download: each worker owns a connection and a segment buffer, takes
+ * the next segment of the file, fetches it with a Range request on its
+ * keep-alive connection and waits until the segment was delivered. The calling
+ * thread delivers the segments to the consumer in file order, so at most one
+ * segment per worker is buffered.
+ */
+static int http_download_worker_fetch(http_download_worker_t *worker)
+{
+    http_download_t *ctx = worker->ctx;
+    size_t received = 0;
+    uint32_t retry = 0;
+    int rt = OPRT_OK;
+
+    for (retry = 0; retry < MAX_RETRY_TIMES && !ctx->abort; retry++) {
+        if (retry) {
+            tuya_transporter_close(worker->network);
+            tal_system_sleep(1000);
+            rt = tuya_transporter_connect(worker->network, ctx->host, ctx->port, ctx->config.timeout_ms);
+            if (OPRT_OK != rt) {
+                continue;
+            }
+        }
+
+        rt = http_download_range_request(ctx, &worker->transport, &worker->requestHeaders, &worker->response,
+                                         worker->seg_offset + received, worker->seg_offset + worker->seg_len - 1);
+        if (OPRT_OK != rt) {
+            continue;
+        }
+        if (worker->response.statusCode != HTTP_STATUS_CODE_PARTIAL_CONTENT) {
+            PR_ERR("range not supported, status %u", worker->response.statusCode);
+            return OPRT_NOT_SUPPORTED;
+        }
+
+        while (received < worker->seg_len && !ctx->abort) {
+            int32_t read_size = HTTPClient_Recv(&worker->transport, &worker->response, worker->buffer + received,
+                                                worker->seg_len - received);
+            if (read_size <= 0) {
+                rt = OPRT_RECV_ERR;
+                break;
+            }
+            received += read_size;
+        }
+        if (received >= worker->seg_len) {
+            return OPRT_OK;
+        }
+    }
+
+    PR_WARN("segment %d fetch fail:%d", (int)worker->seg_offset, rt);
+    return (OPRT_OK == rt) ? OPRT_COM_ERROR : rt;
+}
+
+static void http_download_worker_task(void *arg)
+{
+    http_download_worker_t *worker = (http_download_worker_t *)arg;
+    http_download_t *ctx = worker->ctx;
+    int rt = OPRT_OK;
+
+    rt = tuya_transporter_connect(worker->network, ctx->host, ctx->port, ctx->config.timeout_ms);
+    if (OPRT_OK != rt) {
+        /* the other workers may manage, http_download_worker_fetch reconnects */
+        PR_WARN("worker connect fail:%d", rt);
+    }
+
+    for (;;) {
+        tal_semaphore_wait_forever(worker->free_sem);
+
+        tal_mutex_lock(ctx->mutex);
+        if (ctx->abort || ctx->next_offset >= ctx->file_size) {
+            tal_mutex_unlock(ctx->mutex);
+            break;
+        }
+        worker->seg_offset = ctx->next_offset;
+        worker->seg_len = ctx->file_size - ctx->next_offset;
+        if (worker->seg_len > HTTP_DOWNLOAD_SEGMENT_SIZE) {
+            worker->seg_len = HTTP_DOWNLOAD_SEGMENT_SIZE;
+        }
+        ctx->next_offset += worker->seg_len;
+        tal_mutex_unlock(ctx->mutex);
+
+        rt = http_download_worker_fetch(worker);
+
+        tal_mutex_lock(ctx->mutex);
+        if (OPRT_OK == rt) {
+            worker->ready = true;
+        } else {
+            ctx->abort = true;
+        }
+        tal_mutex_unlock(ctx->mutex);
+        tal_semaphore_post(ctx->ready_sem);
+        if (OPRT_OK != rt) {
+            break;
+        }
+    }
+
+    tuya_transporter_close(worker->network);
+    http_download_response_free(&worker->response);
+    /* the worker must not touch ctx after this */
+    tal_semaphore_post(ctx->done_sem);
+}
+
+/* deliver the segment in pieces of at most range_length with the bytes the
+ * consumer left of the previous piece in front */
+static void http_download_segment_deliver(http_download_t *ctx, http_download_worker_t *worker)
+{
+    size_t pos = 0;
+
+    while (pos < worker->seg_len) {
+        size_t len = ctx->config.range_length - ctx->remain_len;
+        if (len > worker->seg_len - pos) {
+            len = worker->seg_len - pos;
+        }
+        memcpy(ctx->buffer + ctx->remain_len, worker->buffer + pos, len);
+        http_download_data_notify(ctx, len);
+        pos += len;
+    }
+}
+
+static int http_download_parallel(http_download_t *ctx)
+{
+    int rt = OPRT_OK;
+    uint8_t worker_num = ctx->config.parallel;
+    uint8_t started = 0;
+    uint8_t i = 0;
+    http_download_worker_t *workers = NULL;
+
+    if (worker_num > HTTP_DOWNLOAD_PARALLEL_MAX) {
+        worker_num = HTTP_DOWNLOAD_PARALLEL_MAX;
+    }
+
+    ctx->abort = false;
+    ctx->next_offset = ctx->received_size;
+    TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&ctx->mutex), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ctx->ready_sem, 0, worker_num), __exit);
+    TUYA_CALL_ERR_GOTO(tal_semaphore_create_init(&ctx->done_sem, 0, worker_num), __exit);
+    workers = tal_calloc(worker_num, sizeof(http_download_worker_t));
+    if (NULL == workers) {
+        rt = OPRT_MALLOC_FAILED;
+        goto __exit;
+    }
+
+    for (i = 0; i < worker_num; i++) {
+        http_download_worker_t *worker = &workers[i];
+        THREAD_CFG_T thrd_param = {
+            .priority = THREAD_PRIO_3,
+            .stackDepth = HTTP_DOWNLOAD_THREAD_STACK,
+            .thrdname = "http_dl",
+        };
+
+        worker->ctx = ctx;
+        worker->buffer = tal_malloc(HTTP_DOWNLOAD_SEGMENT_SIZE);
+        worker->requestHeaders.bufferLen = 512;
+        worker->requestHeaders.pBuffer = tal_malloc(worker->requestHeaders.bufferLen);
+        worker->network = http_download_network_create(ctx);
+        if (NULL == worker->buffer || NULL == worker->requestHeaders.pBuffer || NULL == worker->network ||
+            OPRT_OK != tal_semaphore_create_init(&worker->free_sem, 1, 1)) {
+            break;
+        }
+        worker->transport.pNetworkContext = (NetworkContext_t *)&worker->network;
+        worker->transport.send = NetworkTransportSend;
+        worker->transport.recv = NetworkTransportRecv;
+        if (OPRT_OK !=
+            tal_thread_create_and_start(&worker->thread, NULL, NULL, http_download_worker_task, worker, &thrd_param)) {
+            worker->thread = NULL;
+            break;
+        }
+        started++;
+    }
+    if (0 == started) {
+        rt = OPRT_COM_ERROR;
+        goto __exit;
+    }
+    PR_DEBUG("parallel download with %d connections", started);
+
+    while (ctx->received_size < ctx->file_size) {
+        http_download_worker_t *worker = NULL;
+
+        tal_mutex_lock(ctx->mutex);
+        for (i = 0; i < started; i++) {
+            if (workers[i].ready && workers[i].seg_offset == ctx->received_size) {
+                worker = &workers[i];
+                break;
+            }
+        }
+        tal_mutex_unlock(ctx->mutex);
+
+        if (worker) {
+            /* the worker waits on free_sem, the buffer is stable */
+            http_download_segment_deliver(ctx, worker);
+            worker->ready = false;
+            tal_semaphore_post(worker->free_sem);
+            continue;
+        }
+        if (ctx->abort) {
+            rt = OPRT_COM_ERROR;
+            break;
+        }
+        if (OPRT_OK != tal_semaphore_wait(ctx->ready_sem, HTTP_DOWNLOAD_TIMEOUT * 1000)) {
+            PR_ERR("parallel download stalled");
+            rt = OPRT_TIMEOUT;
+            break;
+        }
+    }
+
+__exit:
+    ctx->abort = true;
+    for (i = 0; i < started; i++) {
+        tal_semaphore_post(workers[i].free_sem);
+    }
+    for (i = 0; i < started; i++) {
+        tal_semaphore_wait_forever(ctx->done_sem);
+    }
+    if (workers) {
+        for (i = 0; i < worker_num; i++) {
+            if (workers[i].thread) {
+                tal_thread_delete(workers[i].thread);
+            }
+            if (workers[i].network) {
+                tuya_transporter_destroy(workers[i].network);
+            }
+            if (workers[i].free_sem) {
+                tal_semaphore_release(workers[i].free_sem);
+            }
+            if (workers[i].requestHeaders.pBuffer) {
+                tal_free(workers[i].requestHeaders.pBuffer);
+            }
+            if (workers[i].buffer) {
+                tal_free(workers[i].buffer);
+            }
+        }
+        tal_free(workers);
+    }
+    if (ctx->done_sem) {
+        tal_semaphore_release(ctx->done_sem);
+        ctx->done_sem = NULL;
+    }
+    if (ctx->ready_sem) {
+        tal_semaphore_release(ctx->ready_sem);
+        ctx->ready_sem = NULL;
+    }
+    if (ctx->mutex) {
+        tal_mutex_release(ctx->mutex);
+        ctx->mutex = NULL;
+    }
+
+    return rt;
+}
+
 /*-----------------------------------------------------------*/
 static int http_file_download_init(http_download_t *ctx, http_download_config_t *config)
 {
@@ -208,26 +650,13 @@ static int http_file_download_init(http_download_t *ctx, http_download_config_t
 int http_file_download(http_download_config_t *config)
 {
     int rt = OPRT_OK;
+    NetworkContext_t network = NULL;
 
     http_download_t *ctx = tal_calloc(1, sizeof(http_download_t));
     TUYA_CHECK_NULL_GOTO(ctx, __exit);
     TUYA_CALL_ERR_GOTO(http_file_download_init(ctx, config), __exit);
     /* TLS pre init */
-    TUYA_TRANSPORT_TYPE_E transport_type = (config->cacert == NULL) ? TRANSPORT_TYPE_TCP : TRANSPORT_TYPE_TLS;
-    NetworkContext_t network;
-    TUYA_CHECK_NULL_GOTO(network = tuya_transporter_create(transport_type, NULL), __exit);
-    if (transport_type == TRANSPORT_TYPE_TLS) {
-        tuya_tls_config_t tls_config = {
-            .ca_cert = (char *)config->cacert,
-            .ca_cert_size = config->cacert_len,
-            .hostname = (char *)ctx->host,
-            .port = ctx->port,
-            .mode = TUYA_TLS_SERVER_CERT_MODE,
-            .verify = true,
-        };
-
-        TUYA_CALL_ERR_GOTO(tuya_transporter_ctrl(network, TUYA_TRANSPORTER_SET_TLS_CONFIG, &tls_config), __exit);
-    }
+    TUYA_CHECK_NULL_GOTO(network = http_download_network_create(ctx), __exit);
     /* http client TransportInterface */
     ctx->transport.pNetworkContext = (NetworkContext_t *)&network;
     ctx->transport.send = NetworkTransportSend;
@@ -265,15 +694,36 @@ int http_file_download(http_download_config_t *config)
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
             }
-            if (ctx->config.event_handler) {
-                ctx->event.file_size = ctx->file_size;
-                ctx->config.event_handler(DL_EVENT_ON_FILESIZE, &ctx->event);
+            /* notified once, a reconnect continues the same download */
+            if (ctx->config.event_handler && !ctx->file_size_notified) {
+                ctx->file_size_notified = true;
+                http_download_resume(ctx);
+            }
+            if (ctx->config.parallel > 1 && ctx->config.event_handler &&
+                ctx->file_size - ctx->received_size > HTTP_DOWNLOAD_SEGMENT_SIZE) {
+                ctx->state = DL_STATE_PARALLEL;
+            } else {
+                ctx->state = DL_STATE_RANGE_REQUEST;
             }
-            ctx->state = DL_STATE_RANGE_REQUEST;
+            break;
+
+        case DL_STATE_PARALLEL:
+            tuya_transporter_close(network);
+            rt = http_download_parallel(ctx);
+            download_time = tal_time_get_posix();
+            if (OPRT_OK == rt) {
+                ctx->state = DL_STATE_COMPLETE;
+                break;
+            }
+            /* go on from the last delivered byte over one connection */
+            PR_WARN("parallel download fail:%d, continue with one connection", rt);
+            ctx->config.parallel = 0;
+            ctx->state = DL_STATE_NETWORK_CONNECT;
             break;
 
         case DL_STATE_RANGE_REQUEST:
-            rt = http_download_range_request(ctx, ctx->received_size, ctx->file_size);
+            rt = http_download_range_request(ctx, &ctx->transport, &ctx->requestHeaders, &ctx->response,
+                                             ctx->received_size, ctx->file_size);
             if (OPRT_OK != rt) {
                 ctx->state = DL_STATE_NETWORK_RECONNECT;
                 break;
@@ -290,17 +740,7 @@ int http_file_download(http_download_config_t *config)
                 break;
             }
             if (ctx->config.event_handler) {
-                ctx->event.data = (uint8_t *)ctx->buffer;
-                ctx->event.data_len = read_size + ctx->remain_len;
-                ctx->event.offset = ctx->received_size - ctx->remain_len;
-                ctx->event.remain_len = ctx->remain_len;
-                ctx->config.event_handler(DL_EVENT_ON_DATA, &ctx->event);
-                if (ctx->event.remain_len) {
-                    memmove(ctx->buffer, ctx->buffer + (ctx->event.data_len - ctx->event.remain_len),
-                            ctx->event.remain_len);
-                }
-                ctx->remain_len = ctx->event.remain_len;
-                ctx->received_size += read_size;
+                http_download_data_notify(ctx, read_size);
             }
             //! reset time
             download_time = tal_time_get_posix();
@@ -320,6 +760,9 @@ int http_file_download(http_download_config_t *config)
         case DL_STATE_COMPLETE:
             PR_INFO("Download Complete!");
             is_completed = true;
+            if (ctx->config.checkpoint_key) {
+                tal_kv_del(ctx->config.checkpoint_key);
+            }
             if (ctx->config.event_handler) {
                 ctx->config.event_handler(DL_EVENT_FINISH, &ctx->event);
             }
@@ -344,12 +787,13 @@ __exit:
         if (ctx->path) {
             tal_free(ctx->path);
         }
+        if (ctx->buffer) {
+            tal_free(ctx->buffer);
+        }
         if (ctx->requestHeaders.pBuffer) {
             tal_free(ctx->requestHeaders.pBuffer);
         }
-        if (ctx->response.pBuffer) {
-            tal_free(ctx->response.pBuffer);
-        }
+        http_download_response_free(&ctx->response);
 
         tal_free(ctx);
     }
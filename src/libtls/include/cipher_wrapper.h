@@ -25,9 +25,13 @@ typedef struct {
 int mbedtls_cipher_auth_encrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
                                         unsigned char *tag, size_t tag_len);
 
+int mbedtls_cipher_auth_encrypt_inplace_wrapper(const cipher_params_t *input, size_t tag_len);
+
 int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
                                         unsigned char *tag, size_t tag_len);
 
+int mbedtls_cipher_auth_decrypt_inplace_wrapper(const cipher_params_t *input, size_t tag_len, size_t *olen);
+
 int mbedtls_message_digest(mbedtls_md_type_t md_type, const uint8_t *input, size_t ilen, uint8_t *digest);
 
 int mbedtls_message_digest_hmac(mbedtls_md_type_t md_type, const uint8_t *key, size_t keylen, const uint8_t *input,
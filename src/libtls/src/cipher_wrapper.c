@@ -67,6 +67,117 @@ EXIT:
     return (ret);
 }
 
+/*
+ * Encrypts input->data in place, the tag is written right after the
+ * ciphertext, so input->data must have room for data_len + tag_len bytes.
+ */
+int mbedtls_cipher_auth_encrypt_inplace_wrapper(const cipher_params_t *input, size_t tag_len)
+{
+    if (input == NULL || input->data == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    int ret = OPRT_OK;
+    size_t olen = 0;
+    const mbedtls_cipher_info_t *cipher_info;
+    mbedtls_cipher_context_t cipher_ctx;
+
+    mbedtls_cipher_init(&cipher_ctx);
+
+    cipher_info = mbedtls_cipher_info_from_type(input->cipher_type);
+    if (cipher_info == NULL) {
+        PR_ERR("Cipher not found\n");
+        ret = OPRT_INVALID_PARM;
+        goto EXIT;
+    }
+
+    /* only GCM is known to allow the output on top of the input */
+    if (mbedtls_cipher_info_get_mode(cipher_info) != MBEDTLS_MODE_GCM) {
+        ret = OPRT_NOT_SUPPORTED;
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setup(&cipher_ctx, cipher_info)) != 0) {
+        PR_ERR("mbedtls_cipher_setup failed\n");
+        goto EXIT;
+    }
+
+    if ((input->key_len * 8) != mbedtls_cipher_info_get_key_bitlen(cipher_info)) {
+        PR_ERR("key_len:%d mbedtls_key_bitlen:%d", input->key_len * 8, mbedtls_cipher_info_get_key_bitlen(cipher_info));
+        ret = OPRT_INVALID_PARM;
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setkey(&cipher_ctx, input->key, mbedtls_cipher_info_get_key_bitlen(cipher_info),
+                                     MBEDTLS_ENCRYPT)) != 0) {
+        PR_ERR("mbedtls_cipher_setkey() returned error\n");
+        goto EXIT;
+    }
+
+    ret = mbedtls_cipher_auth_encrypt_ext(&cipher_ctx, input->nonce, input->nonce_len, input->ad, input->ad_len,
+                                          input->data, input->data_len, input->data, input->data_len + tag_len, &olen,
+                                          tag_len);
+
+EXIT:
+    mbedtls_cipher_free(&cipher_ctx);
+    return (ret);
+}
+
+/*
+ * Decrypts input->data in place, the tag is read right after the
+ * ciphertext, so input->data holds data_len + tag_len bytes.
+ */
+int mbedtls_cipher_auth_decrypt_inplace_wrapper(const cipher_params_t *input, size_t tag_len, size_t *olen)
+{
+    if (input == NULL || input->data == NULL || olen == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    int ret = OPRT_OK;
+    const mbedtls_cipher_info_t *cipher_info;
+    mbedtls_cipher_context_t cipher_ctx;
+
+    mbedtls_cipher_init(&cipher_ctx);
+
+    cipher_info = mbedtls_cipher_info_from_type(input->cipher_type);
+    if (cipher_info == NULL) {
+        PR_ERR("Cipher not found\n");
+        ret = OPRT_INVALID_PARM;
+        goto EXIT;
+    }
+
+    /* only GCM is known to allow the output on top of the input */
+    if (mbedtls_cipher_info_get_mode(cipher_info) != MBEDTLS_MODE_GCM) {
+        ret = OPRT_NOT_SUPPORTED;
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setup(&cipher_ctx, cipher_info)) != 0) {
+        PR_ERR("mbedtls_cipher_setup failed\n");
+        goto EXIT;
+    }
+
+    if ((input->key_len * 8) != mbedtls_cipher_info_get_key_bitlen(cipher_info)) {
+        PR_ERR("key_len:%d mbedtls_key_bitlen:%d", input->key_len * 8, mbedtls_cipher_info_get_key_bitlen(cipher_info));
+        ret = OPRT_INVALID_PARM;
+        goto EXIT;
+    }
+
+    if ((ret = mbedtls_cipher_setkey(&cipher_ctx, input->key, mbedtls_cipher_info_get_key_bitlen(cipher_info),
+                                     MBEDTLS_DECRYPT)) != 0) {
+        PR_ERR("mbedtls_cipher_setkey() returned error\n");
+        goto EXIT;
+    }
+
+    ret = mbedtls_cipher_auth_decrypt_ext(&cipher_ctx, input->nonce, input->nonce_len, input->ad, input->ad_len,
+                                          input->data, input->data_len + tag_len, input->data, input->data_len, olen,
+                                          tag_len);
+
+EXIT:
+    mbedtls_cipher_free(&cipher_ctx);
+    return (ret);
+}
+
 int mbedtls_cipher_auth_decrypt_wrapper(const cipher_params_t *input, unsigned char *output, size_t *olen,
                                         unsigned char *tag, size_t tag_len)
 {
@@ -6,6 +6,7 @@
 #include <string.h>
 #include "mphalport.h"
 #include "tal_system.h"
+#include "tal_kv.h"
 #include "tal_log.h"
 #include "tal_uart.h"
 #include "tkl_gpio.h"
@@ -122,6 +123,7 @@ uint32_t mp_hal_get_cpu_freq(void)
 void mp_hal_reset(void)
 {
     PR_NOTICE("System reset requested");
+    tal_kv_flush();
     tal_system_reset();
 }
 
@@ -55,6 +55,12 @@ typedef struct {
 
 #define TAL_LV_KEY_LEN 16
 
+/**
+ * @brief size of the buffer tal_kv_get_into needs for a value of len bytes,
+ * the value is decrypted in place and carries up to 16 bytes of padding
+ */
+#define TAL_KV_BUF_SIZE(len) (((len) / 16 + 1) * 16)
+
 typedef struct {
     char seed[TAL_LV_KEY_LEN + 1];
     char key[TAL_LV_KEY_LEN + 1];
@@ -102,6 +108,23 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length);
  */
 int tal_kv_get(const char *key, uint8_t **value, size_t *length);
 
+/**
+ * @brief Retrieves the value of key into a buffer of the caller.
+ *
+ * Unlike tal_kv_get nothing is allocated, the value is decrypted in place in
+ * buf.
+ *
+ * @param key The key to retrieve the value for.
+ * @param buf The buffer, the value is followed by a terminating 0.
+ * @param cap The size of buf, at least TAL_KV_BUF_SIZE of the value length.
+ * @param length The length of the value, or the size buf needs when
+ * OPRT_BUFFER_NOT_ENOUGH is returned.
+ *
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if buf is too small, or
+ * a negative error code if an error occurred.
+ */
+int tal_kv_get_into(const char *key, uint8_t *buf, size_t cap, size_t *length);
+
 /**
  * @brief Frees the memory allocated for a value in the TAL Key-Value store.
  *
@@ -114,6 +137,17 @@ int tal_kv_get(const char *key, uint8_t **value, size_t *length);
  */
 int tal_kv_free(uint8_t *value);
 
+/**
+ * @brief Writes the changes still held in RAM to flash.
+ *
+ * With ENABLE_KV_LOG, tal_kv_set is committed up to KV_LOG_COMMIT_MS later,
+ * call this before a reset or power off. tal_kv_del commits at once, together
+ * with the pending sets.
+ *
+ * @return OPRT_OK on success, or an error code if an error occurred.
+ */
+int tal_kv_flush(void);
+
 /**
  * @brief Deletes the specified key from the TAL Key-Value store.
  *
@@ -153,6 +187,19 @@ int tal_kv_serialize_set(const char *key, kv_db_t *db, size_t dbcnt);
  */
 int tal_kv_serialize_get(const char *key, kv_db_t *db, size_t dbcnt);
 
+/**
+ * @brief Reads one key of a record stored with tal_kv_serialize_set.
+ *
+ * A binary record is read in place, without decoding the other keys.
+ *
+ * @param key The key of the record.
+ * @param item The key to read within the record, filled as by
+ * tal_kv_serialize_get.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if a binary record has no such
+ * key, or an error code.
+ */
+int tal_kv_serialize_field_get(const char *key, kv_db_t *item);
+
 /**
  * @brief Executes the TAL KV command.
  *
@@ -0,0 +1,783 @@
+/**
+ * @file kv_log.c
+ * @brief Log-structured storage engine of tal_kv.
+ *
+ * All keys are kept in one append-only littlefs file instead of one file per
+ * key. Each tal_kv_set or tal_kv_del appends a record, the location of the
+ * latest value of each key is kept in a RAM hash index rebuilt by replaying the
+ * log at boot.
+ *
+ * Writes are coalesced: a value set again before the commit replaces the
+ * pending one, and all the pending records are appended and synced together
+ * KV_LOG_COMMIT_MS after the first one, so a burst of writes costs one
+ * littlefs commit. A delete commits at once with the pending sets, since an
+ * unbind is usually followed by a reset. When most of the log is overwritten
+ * values, the live records are copied to a new file that atomically replaces
+ * the log.
+ *
+ * Record: kv_log_rec_t, key, value, crc32 of the three. A record that fails
+ * the check ends the replay and is cut off, only a partially written tail can
+ * fail it since littlefs only exposes synced data after a power loss.
+ *
+ * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
+ *
+ */
+#include "tal_kv.h"
+#include "tal_api.h"
+#include "crc32i.h"
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+
+#ifndef KV_LOG_COMMIT_MS
+#define KV_LOG_COMMIT_MS (100)
+#endif
+
+/* pending bytes that are committed without waiting for KV_LOG_COMMIT_MS */
+#ifndef KV_LOG_PENDING_MAX
+#define KV_LOG_PENDING_MAX (4 * 1024)
+#endif
+
+/* a log smaller than this is never compacted */
+#ifndef KV_LOG_COMPACT_MIN
+#define KV_LOG_COMPACT_MIN (16 * 1024)
+#endif
+
+#define KV_LOG_FILE      ".kv.log"
+#define KV_LOG_TMP_FILE  ".kv.log.tmp"
+#define KV_LOG_MAGIC     0x4B564C00
+#define KV_LOG_SET       0x01
+#define KV_LOG_DEL       0x02
+#define KV_LOG_KEY_MAX   255
+#define KV_LOG_COPY_LEN  256
+#define KV_LOG_BUCKETS   16
+
+typedef struct {
+    uint32_t magic; // KV_LOG_MAGIC | KV_LOG_SET/KV_LOG_DEL
+    uint16_t key_len;
+    uint16_t reserved;
+    uint32_t val_len;
+} kv_log_rec_t;
+
+#define KV_LOG_REC_SIZE(key_len, val_len) (sizeof(kv_log_rec_t) + (key_len) + (val_len) + sizeof(uint32_t))
+
+typedef struct kv_log_entry {
+    struct kv_log_entry *next;
+    struct kv_log_entry *dirty_next;
+    uint32_t hash;
+    uint32_t offset; // of the value in the log, 0 if the key has no record
+    uint32_t len;
+    uint8_t *pending; // value waiting for the commit
+    uint32_t pending_len;
+    uint8_t dirty; // KV_LOG_SET or KV_LOG_DEL waiting for the commit
+    uint16_t key_len;
+    char key[0];
+} kv_log_entry_t;
+
+static struct {
+    lfs_t *lfs;
+    MUTEX_HANDLE lfs_mutex; // of tal_kv, guards the file system
+    MUTEX_HANDLE mutex;     // guards the index and the log file
+    lfs_file_t file;
+    kv_log_entry_t **bucket;
+    uint32_t bucket_num;
+    uint32_t entry_num;
+    kv_log_entry_t *dirty;
+    kv_log_entry_t **dirty_tail;
+    uint32_t pending_bytes;
+    uint32_t log_size;
+    uint32_t live_size; // bytes of the records the index points to
+    DELAYED_WORK_HANDLE work;
+    bool work_pending;
+    bool failed; // the log file is lost, every later call fails
+} s_kv_log;
+
+static uint32_t __kv_log_hash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*key) {
+        hash = (hash ^ (uint8_t)*key++) * 16777619u;
+    }
+    return hash;
+}
+
+static kv_log_entry_t *__kv_log_find(const char *key, uint32_t hash)
+{
+    kv_log_entry_t *entry = s_kv_log.bucket[hash & (s_kv_log.bucket_num - 1)];
+
+    for (; entry; entry = entry->next) {
+        if (entry->hash == hash && 0 == strcmp(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static void __kv_log_rehash(void)
+{
+    uint32_t num = s_kv_log.bucket_num * 2;
+    kv_log_entry_t **bucket = tal_calloc(num, sizeof(kv_log_entry_t *));
+    uint32_t i;
+
+    /* keep the chains long rather than fail */
+    if (NULL == bucket) {
+        return;
+    }
+    for (i = 0; i < s_kv_log.bucket_num; i++) {
+        kv_log_entry_t *entry = s_kv_log.bucket[i];
+        while (entry) {
+            kv_log_entry_t *next = entry->next;
+            entry->next = bucket[entry->hash & (num - 1)];
+            bucket[entry->hash & (num - 1)] = entry;
+            entry = next;
+        }
+    }
+    tal_free(s_kv_log.bucket);
+    s_kv_log.bucket = bucket;
+    s_kv_log.bucket_num = num;
+}
+
+static kv_log_entry_t *__kv_log_insert(const char *key, uint32_t hash)
+{
+    size_t key_len = strlen(key);
+    kv_log_entry_t *entry = tal_calloc(1, sizeof(kv_log_entry_t) + key_len + 1);
+
+    if (NULL == entry) {
+        return NULL;
+    }
+    memcpy(entry->key, key, key_len + 1);
+    entry->key_len = key_len;
+    entry->hash = hash;
+    entry->next = s_kv_log.bucket[hash & (s_kv_log.bucket_num - 1)];
+    s_kv_log.bucket[hash & (s_kv_log.bucket_num - 1)] = entry;
+    if (++s_kv_log.entry_num > s_kv_log.bucket_num * 2) {
+        __kv_log_rehash();
+    }
+    return entry;
+}
+
+/* the entry must not be dirty */
+static void __kv_log_remove(kv_log_entry_t *entry)
+{
+    kv_log_entry_t **pp = &s_kv_log.bucket[entry->hash & (s_kv_log.bucket_num - 1)];
+
+    while (*pp != entry) {
+        pp = &(*pp)->next;
+    }
+    *pp = entry->next;
+    s_kv_log.entry_num--;
+    tal_free(entry);
+}
+
+static void __kv_log_dirty_add(kv_log_entry_t *entry, uint8_t type)
+{
+    if (0 == entry->dirty) {
+        entry->dirty_next = NULL;
+        *s_kv_log.dirty_tail = entry;
+        s_kv_log.dirty_tail = &entry->dirty_next;
+    }
+    entry->dirty = type;
+}
+
+/* the committed value of entry is replaced or deleted */
+static void __kv_log_unlink_value(kv_log_entry_t *entry)
+{
+    if (entry->offset) {
+        s_kv_log.live_size -= KV_LOG_REC_SIZE(entry->key_len, entry->len);
+        entry->offset = 0;
+        entry->len = 0;
+    }
+}
+
+/* -------------------------------------------------------------------------- */
+/*                               log file access                              */
+/* -------------------------------------------------------------------------- */
+static int __kv_log_write(lfs_file_t *file, const void *data, uint32_t len)
+{
+    return (lfs_file_write(s_kv_log.lfs, file, data, len) == (lfs_ssize_t)len) ? OPRT_OK : OPRT_KVS_WR_FAIL;
+}
+
+static int __kv_log_append(uint8_t type, const kv_log_entry_t *entry, const uint8_t *value, uint32_t len)
+{
+    kv_log_rec_t rec = {
+        .magic = KV_LOG_MAGIC | type,
+        .key_len = entry->key_len,
+        .val_len = len,
+    };
+    uint32_t crc = hash_crc32i_init();
+
+    crc = hash_crc32i_update(crc, &rec, sizeof(rec));
+    crc = hash_crc32i_update(crc, entry->key, entry->key_len);
+    crc = hash_crc32i_finish(hash_crc32i_update(crc, value, len));
+
+    if (OPRT_OK != __kv_log_write(&s_kv_log.file, &rec, sizeof(rec)) ||
+        OPRT_OK != __kv_log_write(&s_kv_log.file, entry->key, entry->key_len) ||
+        (len && OPRT_OK != __kv_log_write(&s_kv_log.file, value, len)) ||
+        OPRT_OK != __kv_log_write(&s_kv_log.file, &crc, sizeof(crc))) {
+        return OPRT_KVS_WR_FAIL;
+    }
+    return OPRT_OK;
+}
+
+static int __kv_log_read(uint32_t offset, void *buf, uint32_t len)
+{
+    if (lfs_file_seek(s_kv_log.lfs, &s_kv_log.file, offset, LFS_SEEK_SET) < 0 ||
+        lfs_file_read(s_kv_log.lfs, &s_kv_log.file, buf, len) != (lfs_ssize_t)len) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    return OPRT_OK;
+}
+
+/* the record at offset, OPRT_OK if it is complete and its crc matches */
+static int __kv_log_rec_check(uint32_t offset, kv_log_rec_t *rec, char *key, uint8_t *buf)
+{
+    uint32_t crc = hash_crc32i_init();
+    uint32_t pos = 0;
+    uint32_t rec_crc = 0;
+
+    if (OPRT_OK != __kv_log_read(offset, rec, sizeof(kv_log_rec_t)) ||
+        (rec->magic & ~0xFF) != KV_LOG_MAGIC || 0 == rec->key_len || rec->key_len > KV_LOG_KEY_MAX ||
+        offset + KV_LOG_REC_SIZE(rec->key_len, rec->val_len) > s_kv_log.log_size ||
+        OPRT_OK != __kv_log_read(offset + sizeof(kv_log_rec_t), key, rec->key_len)) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    key[rec->key_len] = 0;
+    crc = hash_crc32i_update(crc, rec, sizeof(kv_log_rec_t));
+    crc = hash_crc32i_update(crc, key, rec->key_len);
+
+    offset += sizeof(kv_log_rec_t) + rec->key_len;
+    while (pos < rec->val_len) {
+        uint32_t len = rec->val_len - pos;
+        if (len > KV_LOG_COPY_LEN) {
+            len = KV_LOG_COPY_LEN;
+        }
+        if (OPRT_OK != __kv_log_read(offset + pos, buf, len)) {
+            return OPRT_KVS_RD_FAIL;
+        }
+        crc = hash_crc32i_update(crc, buf, len);
+        pos += len;
+    }
+    if (OPRT_OK != __kv_log_read(offset + pos, &rec_crc, sizeof(rec_crc)) || rec_crc != hash_crc32i_finish(crc)) {
+        return OPRT_KVS_RD_FAIL;
+    }
+    return OPRT_OK;
+}
+
+/* rebuild the index from the log, a torn tail is cut off */
+static int __kv_log_replay(void)
+{
+    kv_log_rec_t rec;
+    char *key = tal_malloc(KV_LOG_KEY_MAX + 1 + KV_LOG_COPY_LEN);
+    uint32_t offset = 0;
+
+    if (NULL == key) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    while (offset < s_kv_log.log_size) {
+        if (OPRT_OK != __kv_log_rec_check(offset, &rec, key, (uint8_t *)key + KV_LOG_KEY_MAX + 1)) {
+            PR_WARN("kv log cut at %d of %d", offset, s_kv_log.log_size);
+            lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, offset);
+            lfs_file_sync(s_kv_log.lfs, &s_kv_log.file);
+            s_kv_log.log_size = offset;
+            break;
+        }
+
+        uint32_t hash = __kv_log_hash(key);
+        kv_log_entry_t *entry = __kv_log_find(key, hash);
+        if ((rec.magic & 0xFF) == KV_LOG_SET) {
+            if (NULL == entry && NULL == (entry = __kv_log_insert(key, hash))) {
+                tal_free(key);
+                return OPRT_MALLOC_FAILED;
+            }
+            __kv_log_unlink_value(entry);
+            entry->offset = offset + sizeof(kv_log_rec_t) + rec.key_len;
+            entry->len = rec.val_len;
+            s_kv_log.live_size += KV_LOG_REC_SIZE(rec.key_len, rec.val_len);
+        } else if (entry) {
+            __kv_log_unlink_value(entry);
+            __kv_log_remove(entry);
+        }
+        offset += KV_LOG_REC_SIZE(rec.key_len, rec.val_len);
+    }
+
+    tal_free(key);
+    PR_DEBUG("kv log %d keys, %d of %d bytes live", s_kv_log.entry_num, s_kv_log.live_size, s_kv_log.log_size);
+    return OPRT_OK;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                            commit and compaction                           */
+/* -------------------------------------------------------------------------- */
+/* append the dirty entries and sync them in one go, the index is updated only
+ * once they are synced */
+static int __kv_log_commit(void)
+{
+    kv_log_entry_t *entry = NULL;
+    uint32_t offset = s_kv_log.log_size;
+    int rt = OPRT_OK;
+
+    if (s_kv_log.failed) {
+        return OPRT_KVS_WR_FAIL;
+    }
+    if (NULL == s_kv_log.dirty) {
+        return OPRT_OK;
+    }
+
+    tal_mutex_lock(s_kv_log.lfs_mutex);
+    if (lfs_file_seek(s_kv_log.lfs, &s_kv_log.file, s_kv_log.log_size, LFS_SEEK_SET) < 0) {
+        rt = OPRT_KVS_WR_FAIL;
+    }
+    for (entry = s_kv_log.dirty; entry && OPRT_OK == rt; entry = entry->dirty_next) {
+        if (KV_LOG_SET == entry->dirty) {
+            rt = __kv_log_append(KV_LOG_SET, entry, entry->pending, entry->pending_len);
+        } else if (entry->offset) {
+            rt = __kv_log_append(KV_LOG_DEL, entry, NULL, 0);
+        }
+    }
+    if (OPRT_OK == rt && LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file)) {
+        rt = OPRT_KVS_WR_FAIL;
+    }
+    /* the records written so far have valid crcs, the replay must not see them */
+    if (OPRT_OK != rt && (LFS_ERR_OK != lfs_file_truncate(s_kv_log.lfs, &s_kv_log.file, s_kv_log.log_size) ||
+                          LFS_ERR_OK != lfs_file_sync(s_kv_log.lfs, &s_kv_log.file))) {
+        PR_ERR("kv log rollback fail");
+        s_kv_log.failed = true;
+    }
+    tal_mutex_unlock(s_kv_log.lfs_mutex);
+
+    if (OPRT_OK != rt) {
+        /* the entries stay dirty and are written again by the next commit */
+        PR_ERR("kv log commit fail %d", rt);
+        return rt;
+    }
+
+    entry = s_kv_log.dirty;
+    s_kv_log.dirty = NULL;
+    s_kv_log.dirty_tail = &s_kv_log.dirty;
+    s_kv_log.pending_bytes = 0;
+    while (entry) {
+        kv_log_entry_t *next = entry->dirty_next;
+        uint8_t type = entry->dirty;
+
+        entry->dirty = 0;
+        if (KV_LOG_SET == type) {
+            __kv_log_unlink_value(entry);
+            entry->offset = offset + sizeof(kv_log_rec_t) + entry->key_len;
+            entry->len = entry->pending_len;
+            s_kv_log.live_size += KV_LOG_REC_SIZE(entry->key_len, entry->len);
+            offset += KV_LOG_REC_SIZE(entry->key_len, entry->len);
+            tal_free(entry->pending);
+            entry->pending = NULL;
+            entry->pending_len = 0;
+        } else {
+            if (entry->offset) {
+                offset += KV_LOG_REC_SIZE(entry->key_len, 0);
+            }
+            __kv_log_unlink_value(entry);
+            __kv_log_remove(entry);
+        }
+        entry = next;
+    }
+    s_kv_log.log_size = offset;
+
+    return OPRT_OK;
+}
+
+static bool __kv_log_compact_needed(void)
+{
+    return s_kv_log.log_size >= KV_LOG_COMPACT_MIN && s_kv_log.live_size < s_kv_log.log_size / 2;
+}
+
+/* copy the live records to a new log that replaces the old one, only called
+ * with no dirty entry */
+static int __kv_log_compact(void)
+{
+    lfs_file_t tmp;
+    uint8_t *buf = NULL;
+    uint32_t i, pos, offset = 0;
+    kv_log_entry_t *entry = NULL;
+    int rt = OPRT_OK;
+
+    buf = tal_malloc(KV_LOG_COPY_LEN);
+    if (NULL == buf) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    tal_mutex_lock(s_kv_log.lfs_mutex);
+    if (LFS_ERR_OK != lfs_file_open(s_kv_log.lfs, &tmp, KV_LOG_TMP_FILE, LFS_O_WRONLY | LFS_O_CREAT | LFS_O_TRUNC)) {
+        tal_mutex_unlock(s_kv_log.lfs_mutex);
+        tal_free(buf);
+        return OPRT_KVS_WR_FAIL;
+    }
+
+    for (i = 0; i < s_kv_log.bucket_num && OPRT_OK == rt; i++) {
+        for (entry = s_kv_log.bucket[i]; entry && OPRT_OK == rt; entry = entry->next) {
+            /* the record is copied as is, its crc still holds */
+            uint32_t start = entry->offset - sizeof(kv_log_rec_t) - entry->key_len;
+            uint32_t size = KV_LOG_REC_SIZE(entry->key_len, entry->len);
+            for (pos = 0; pos < size && OPRT_OK == rt; pos += KV_LOG_COPY_LEN) {
+                uint32_t len = (size - pos > KV_LOG_COPY_LEN) ? KV_LOG_COPY_LEN : size - pos;
+                rt = __kv_log_read(start + pos, buf, len);
+                if (OPRT_OK == rt) {
+                    rt = __kv_log_write(&tmp, buf, len);
+                }
+            }
+        }
+    }
+    if (LFS_ERR_OK != lfs_file_close(s_kv_log.lfs, &tmp) && OPRT_OK == rt) {
+        rt = OPRT_KVS_WR_FAIL;
+    }
+    if (OPRT_OK == rt) {
+        lfs_file_close(s_kv_log.lfs, &s_kv_log.file);
+        if (LFS_ERR_OK != lfs_rename(s_kv_log.lfs, KV_LOG_TMP_FILE, KV_LOG_FILE)) {
+            rt = OPRT_KVS_WR_FAIL;
+        }
+        /* the old log is still there if the rename failed */
+        if (LFS_ERR_OK != lfs_file_open(s_kv_log.lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT)) {
+            PR_ERR("kv log reopen fail");
+            s_kv_log.failed = true;
+            rt = OPRT_KVS_WR_FAIL;
+        }
+    } else {
+        lfs_remove(s_kv_log.lfs, KV_LOG_TMP_FILE);
+    }
+    tal_mutex_unlock(s_kv_log.lfs_mutex);
+    tal_free(buf);
+
+    if (OPRT_OK != rt) {
+        PR_ERR("kv log compact fail %d", rt);
+        return rt;
+    }
+
+    /* same walk as the copy */
+    for (i = 0; i < s_kv_log.bucket_num; i++) {
+        for (entry = s_kv_log.bucket[i]; entry; entry = entry->next) {
+            entry->offset = offset + sizeof(kv_log_rec_t) + entry->key_len;
+            offset += KV_LOG_REC_SIZE(entry->key_len, entry->len);
+        }
+    }
+    PR_DEBUG("kv log compacted %d -> %d", s_kv_log.log_size, offset);
+    s_kv_log.log_size = offset;
+    s_kv_log.live_size = offset;
+
+    return OPRT_OK;
+}
+
+static void __kv_log_work_cb(void *data)
+{
+    tal_mutex_lock(s_kv_log.mutex);
+    s_kv_log.work_pending = false;
+    if (OPRT_OK == __kv_log_commit() && __kv_log_compact_needed()) {
+        __kv_log_compact();
+    }
+    tal_mutex_unlock(s_kv_log.mutex);
+}
+
+/* run the work after delay_ms, false if the work queue is not up yet */
+static bool __kv_log_work_start(uint32_t delay_ms)
+{
+    if (NULL == s_kv_log.work &&
+        OPRT_OK != tal_workq_init_delayed(WORKQ_SYSTEM, __kv_log_work_cb, NULL, &s_kv_log.work)) {
+        s_kv_log.work = NULL;
+        return false;
+    }
+    if (!s_kv_log.work_pending) {
+        if (OPRT_OK != tal_workq_start_delayed(s_kv_log.work, delay_ms, LOOP_ONCE)) {
+            return false;
+        }
+        s_kv_log.work_pending = true;
+    }
+    return true;
+}
+
+/* the caller holds the mutex, now commits without the deferral */
+static int __kv_log_schedule(bool now)
+{
+    int rt = OPRT_OK;
+
+    if (!now && KV_LOG_COMMIT_MS && s_kv_log.pending_bytes < KV_LOG_PENDING_MAX &&
+        __kv_log_work_start(KV_LOG_COMMIT_MS)) {
+        return OPRT_OK;
+    }
+
+    rt = __kv_log_commit();
+    if (OPRT_OK == rt && __kv_log_compact_needed() && !__kv_log_work_start(0)) {
+        __kv_log_compact();
+    }
+    return rt;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                                 engine API                                 */
+/* -------------------------------------------------------------------------- */
+/**
+ * @brief Opens the log and rebuilds the index, called by tal_kv_init once the
+ * file system is mounted.
+ *
+ * @param lfs The mounted file system.
+ * @param lfs_mutex The mutex of tal_kv guarding the file system.
+ * @return OPRT_OK on success, an error code otherwise.
+ */
+int kv_log_init(lfs_t *lfs, MUTEX_HANDLE lfs_mutex)
+{
+    int rt = OPRT_OK;
+
+    if (s_kv_log.lfs) {
+        return OPRT_OK;
+    }
+
+    s_kv_log.bucket = tal_calloc(KV_LOG_BUCKETS, sizeof(kv_log_entry_t *));
+    TUYA_CHECK_NULL_RETURN(s_kv_log.bucket, OPRT_MALLOC_FAILED);
+    s_kv_log.bucket_num = KV_LOG_BUCKETS;
+    s_kv_log.dirty_tail = &s_kv_log.dirty;
+    s_kv_log.lfs_mutex = lfs_mutex;
+    TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&s_kv_log.mutex), __error);
+
+    tal_mutex_lock(lfs_mutex);
+    /* a compaction interrupted before the rename */
+    lfs_remove(lfs, KV_LOG_TMP_FILE);
+    rt = lfs_file_open(lfs, &s_kv_log.file, KV_LOG_FILE, LFS_O_RDWR | LFS_O_CREAT);
+    if (LFS_ERR_OK == rt) {
+        s_kv_log.lfs = lfs;
+        s_kv_log.log_size = lfs_file_size(lfs, &s_kv_log.file);
+        rt = __kv_log_replay();
+    }
+    tal_mutex_unlock(lfs_mutex);
+    if (OPRT_OK == rt) {
+        return OPRT_OK;
+    }
+    PR_ERR("kv log open fail %d", rt);
+    if (s_kv_log.lfs) {
+        lfs_file_close(lfs, &s_kv_log.file);
+        s_kv_log.lfs = NULL;
+    }
+
+__error:
+    /* the entries replayed so far are lost with the buckets */
+    if (s_kv_log.mutex) {
+        tal_mutex_release(s_kv_log.mutex);
+        s_kv_log.mutex = NULL;
+    }
+    tal_free(s_kv_log.bucket);
+    s_kv_log.bucket = NULL;
+    return rt;
+}
+
+/**
+ * @brief Stores the value of key, written to flash by the next commit.
+ *
+ * @param key The key.
+ * @param value The value as stored, it is copied.
+ * @param length The length of value.
+ * @return OPRT_OK on success, an error code otherwise.
+ */
+int kv_log_set(const char *key, const uint8_t *value, size_t length)
+{
+    uint32_t hash = __kv_log_hash(key);
+    kv_log_entry_t *entry = NULL;
+    uint8_t *pending = NULL;
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_log.lfs) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+    if (strlen(key) > KV_LOG_KEY_MAX) {
+        return OPRT_INVALID_PARM;
+    }
+
+    pending = tal_malloc(length);
+    TUYA_CHECK_NULL_RETURN(pending, OPRT_MALLOC_FAILED);
+    memcpy(pending, value, length);
+
+    tal_mutex_lock(s_kv_log.mutex);
+    if (s_kv_log.failed) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        tal_free(pending);
+        return OPRT_KVS_WR_FAIL;
+    }
+    entry = __kv_log_find(key, hash);
+    if (NULL == entry && NULL == (entry = __kv_log_insert(key, hash))) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        tal_free(pending);
+        return OPRT_MALLOC_FAILED;
+    }
+    /* a value not committed yet is replaced */
+    if (entry->pending) {
+        s_kv_log.pending_bytes -= entry->pending_len;
+        tal_free(entry->pending);
+    }
+    entry->pending = pending;
+    entry->pending_len = length;
+    s_kv_log.pending_bytes += length;
+    __kv_log_dirty_add(entry, KV_LOG_SET);
+    rt = __kv_log_schedule(false);
+    tal_mutex_unlock(s_kv_log.mutex);
+
+    return rt;
+}
+
+/**
+ * @brief Gets the value of key.
+ *
+ * @param key The key.
+ * @param value The value, from tal_malloc with one spare byte at the end.
+ * @param length The length of value.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the key has no value, an error
+ * code otherwise.
+ */
+int kv_log_get(const char *key, uint8_t **value, size_t *length)
+{
+    uint32_t hash = __kv_log_hash(key);
+    kv_log_entry_t *entry = NULL;
+    uint8_t *data = NULL;
+    uint32_t len = 0;
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_log.lfs) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    tal_mutex_lock(s_kv_log.mutex);
+    if (s_kv_log.failed) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_KVS_RD_FAIL;
+    }
+    entry = __kv_log_find(key, hash);
+    if (NULL == entry || KV_LOG_DEL == entry->dirty) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_NOT_FOUND;
+    }
+
+    len = entry->pending ? entry->pending_len : entry->len;
+    data = tal_malloc(len + 1);
+    if (NULL == data) {
+        rt = OPRT_MALLOC_FAILED;
+    } else if (entry->pending) {
+        memcpy(data, entry->pending, len);
+    } else {
+        tal_mutex_lock(s_kv_log.lfs_mutex);
+        rt = __kv_log_read(entry->offset, data, len);
+        tal_mutex_unlock(s_kv_log.lfs_mutex);
+    }
+    tal_mutex_unlock(s_kv_log.mutex);
+
+    if (OPRT_OK != rt) {
+        tal_free(data);
+        return rt;
+    }
+    *value = data;
+    *length = len;
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reads the value of key into a buffer of the caller.
+ *
+ * @param key The key.
+ * @param buf The buffer.
+ * @param cap The size of buf.
+ * @param length The length of the value, also set when buf is too small.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the key has no value,
+ * OPRT_BUFFER_NOT_ENOUGH if the value does not fit, an error code otherwise.
+ */
+int kv_log_get_into(const char *key, uint8_t *buf, size_t cap, size_t *length)
+{
+    uint32_t hash = __kv_log_hash(key);
+    kv_log_entry_t *entry = NULL;
+    uint32_t len = 0;
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_log.lfs) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    tal_mutex_lock(s_kv_log.mutex);
+    if (s_kv_log.failed) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_KVS_RD_FAIL;
+    }
+    entry = __kv_log_find(key, hash);
+    if (NULL == entry || KV_LOG_DEL == entry->dirty) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_NOT_FOUND;
+    }
+
+    len = entry->pending ? entry->pending_len : entry->len;
+    if (len > cap) {
+        rt = OPRT_BUFFER_NOT_ENOUGH;
+    } else if (entry->pending) {
+        memcpy(buf, entry->pending, len);
+    } else {
+        tal_mutex_lock(s_kv_log.lfs_mutex);
+        rt = __kv_log_read(entry->offset, buf, len);
+        tal_mutex_unlock(s_kv_log.lfs_mutex);
+    }
+    tal_mutex_unlock(s_kv_log.mutex);
+
+    *length = len;
+    return rt;
+}
+
+/**
+ * @brief Deletes key, the tombstone is synced with the pending sets before it
+ * returns.
+ *
+ * @param key The key.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the key has no value, an error
+ * code if the commit failed.
+ */
+int kv_log_del(const char *key)
+{
+    uint32_t hash = __kv_log_hash(key);
+    kv_log_entry_t *entry = NULL;
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_log.lfs) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    tal_mutex_lock(s_kv_log.mutex);
+    if (s_kv_log.failed) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_KVS_WR_FAIL;
+    }
+    entry = __kv_log_find(key, hash);
+    if (NULL == entry || KV_LOG_DEL == entry->dirty) {
+        tal_mutex_unlock(s_kv_log.mutex);
+        return OPRT_NOT_FOUND;
+    }
+    if (entry->pending) {
+        s_kv_log.pending_bytes -= entry->pending_len;
+        tal_free(entry->pending);
+        entry->pending = NULL;
+        entry->pending_len = 0;
+    }
+    __kv_log_dirty_add(entry, KV_LOG_DEL);
+    rt = __kv_log_schedule(true);
+    tal_mutex_unlock(s_kv_log.mutex);
+
+    return rt;
+}
+
+/**
+ * @brief Writes the pending changes to flash now.
+ *
+ * @return OPRT_OK on success, an error code otherwise.
+ */
+int kv_log_flush(void)
+{
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_log.lfs) {
+        return OPRT_OK;
+    }
+
+    tal_mutex_lock(s_kv_log.mutex);
+    rt = __kv_log_commit();
+    tal_mutex_unlock(s_kv_log.mutex);
+
+    return rt;
+}
+
+#endif
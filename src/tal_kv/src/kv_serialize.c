@@ -15,6 +15,18 @@
  * includes optimizations for memory usage and processing time, making it
  * suitable for resource-constrained environments.
  *
+ * kv_bin_serialize and kv_bin_deserialize provide a binary TLV alternative,
+ * a record is a header followed by one entry per key:
+ *
+ *   header: magic(1) version(1) schema(2) count(2)
+ *   entry:  type(1) key_len(1) val_len(2) key val
+ *
+ * Multi-byte fields are little endian. Integers keep the width of their
+ * type, strings are stored without the terminating 0, an empty string or raw
+ * value has val_len 0. schema is a hash of the keys and types in order, a
+ * record written from the same kv_db_t layout is decoded in order, each key
+ * is only compared with its entry instead of searched.
+ *
  * @copyright Copyright (c) 2021-2024 Tuya Inc. All Rights Reserved.
  *
  */
@@ -275,3 +287,398 @@ ERR_EXIT:
 
     return op_ret;
 }
+
+#define KV_BIN_MAGIC     0xA5 // never the first byte of the text format
+#define KV_BIN_VERSION   1
+#define KV_BIN_HEAD_LEN  6
+#define KV_BIN_ENTRY_LEN 4
+
+static uint32_t __kv_bin_int_size(kv_tp_t tp)
+{
+    switch (tp) {
+    case KV_CHAR:
+    case KV_BYTE:
+    case KV_BOOL:
+        return 1;
+    case KV_SHORT:
+    case KV_USHORT:
+        return 2;
+    case KV_INT:
+        return 4;
+    default:
+        return 0;
+    }
+}
+
+static uint32_t __kv_bin_val_len(const kv_db_t *item)
+{
+    if (item->tp == KV_STRING) {
+        return strlen((const char *)item->val);
+    } else if (item->tp == KV_RAW) {
+        return item->len;
+    }
+    return __kv_bin_int_size(item->tp);
+}
+
+static uint16_t __kv_bin_schema(const kv_db_t *db, const uint32_t dbcnt)
+{
+    uint32_t hash = 2166136261u;
+    uint32_t i = 0;
+    const char *key = NULL;
+
+    for (i = 0; i < dbcnt; i++) {
+        for (key = db[i].key; *key; key++) {
+            hash = (hash ^ (uint8_t)*key) * 16777619u;
+        }
+        hash = (hash ^ db[i].tp) * 16777619u;
+    }
+    return (uint16_t)(hash ^ (hash >> 16));
+}
+
+static uint16_t __kv_bin_get16(const uint8_t *p)
+{
+    return p[0] | (p[1] << 8);
+}
+
+static void __kv_bin_put16(uint8_t *p, uint16_t val)
+{
+    p[0] = val & 0xFF;
+    p[1] = val >> 8;
+}
+
+/**
+ * @brief Checks the header of a binary record.
+ *
+ * @return The number of entries, or a negative error code.
+ */
+static int __kv_bin_head_check(const uint8_t *in, uint32_t in_len)
+{
+    if (NULL == in || in_len < KV_BIN_HEAD_LEN || in[0] != KV_BIN_MAGIC) {
+        return OPRT_INVALID_PARM;
+    }
+    if (in[1] != KV_BIN_VERSION) {
+        PR_ERR("kv bin version %d not supported", in[1]);
+        return OPRT_NOT_SUPPORTED;
+    }
+    return __kv_bin_get16(in + 4);
+}
+
+/**
+ * @brief Returns the entry at offset of a binary record, NULL past the end or
+ * on a truncated entry.
+ */
+static const uint8_t *__kv_bin_entry(const uint8_t *in, uint32_t in_len, uint32_t offset)
+{
+    if (offset + KV_BIN_ENTRY_LEN > in_len ||
+        offset + KV_BIN_ENTRY_LEN + in[offset + 1] + __kv_bin_get16(in + offset + 2) > in_len) {
+        return NULL;
+    }
+    return in + offset;
+}
+
+#define KV_BIN_ENTRY_SIZE(entry) (KV_BIN_ENTRY_LEN + (entry)[1] + __kv_bin_get16((entry) + 2))
+#define KV_BIN_ENTRY_KEY(entry)  ((const char *)(entry) + KV_BIN_ENTRY_LEN)
+#define KV_BIN_ENTRY_VAL(entry)  ((entry) + KV_BIN_ENTRY_LEN + (entry)[1])
+
+static bool __kv_bin_key_match(const uint8_t *entry, const char *key)
+{
+    size_t key_len = strlen(key);
+
+    return key_len == entry[1] && 0 == memcmp(KV_BIN_ENTRY_KEY(entry), key, key_len);
+}
+
+/* the entry of key, searched from offset and then from the first entry */
+static const uint8_t *__kv_bin_find(const uint8_t *in, uint32_t in_len, const char *key, uint32_t *offset)
+{
+    const uint8_t *entry = NULL;
+    uint32_t pos = *offset;
+    bool wrapped = false;
+
+    for (;;) {
+        entry = __kv_bin_entry(in, in_len, pos);
+        if (NULL == entry) {
+            if (wrapped || KV_BIN_HEAD_LEN == *offset) {
+                return NULL;
+            }
+            wrapped = true;
+            pos = KV_BIN_HEAD_LEN;
+            continue;
+        }
+        if (wrapped && pos >= *offset) {
+            return NULL;
+        }
+        pos += KV_BIN_ENTRY_SIZE(entry);
+        if (__kv_bin_key_match(entry, key)) {
+            *offset = pos;
+            return entry;
+        }
+    }
+}
+
+/* decodes one entry into item, with the range checks of kv_deserialize */
+static int __kv_bin_decode(const uint8_t *entry, kv_db_t *item)
+{
+    kv_tp_t tp = entry[0];
+    uint32_t val_len = __kv_bin_get16(entry + 2);
+    const uint8_t *val = KV_BIN_ENTRY_VAL(entry);
+    int32_t num = 0;
+
+    if (item->tp <= KV_BOOL) {
+        if (tp > KV_BOOL || val_len != __kv_bin_int_size(tp)) {
+            return OPRT_COM_ERROR;
+        }
+        switch (tp) {
+        case KV_CHAR:
+            num = (int8_t)val[0];
+            break;
+        case KV_BYTE:
+        case KV_BOOL:
+            num = val[0];
+            break;
+        case KV_SHORT:
+            num = (int16_t)__kv_bin_get16(val);
+            break;
+        case KV_USHORT:
+            num = __kv_bin_get16(val);
+            break;
+        default:
+            num = (int32_t)(__kv_bin_get16(val) | ((uint32_t)__kv_bin_get16(val + 2) << 16));
+            break;
+        }
+        if ((KV_BOOL == item->tp) != (KV_BOOL == tp)) {
+            return OPRT_COM_ERROR;
+        }
+    } else if ((item->tp != KV_STRING && item->tp != KV_RAW) || (tp != KV_STRING && tp != KV_RAW)) {
+        return OPRT_COM_ERROR;
+    }
+
+    switch (item->tp) {
+    case KV_CHAR:
+        if (num < -128 || num > 127) {
+            return OPRT_COM_ERROR;
+        }
+        *((char *)item->val) = num;
+        break;
+    case KV_BYTE:
+        if (num < 0 || num > 255) {
+            return OPRT_COM_ERROR;
+        }
+        *((uint8_t *)item->val) = num;
+        break;
+    case KV_SHORT:
+        if (num < -32768 || num > 32767) {
+            return OPRT_COM_ERROR;
+        }
+        *((int16_t *)item->val) = num;
+        break;
+    case KV_USHORT:
+        if (num < 0 || num > 65535) {
+            return OPRT_COM_ERROR;
+        }
+        *((uint16_t *)item->val) = num;
+        break;
+    case KV_INT:
+        *((int *)item->val) = num;
+        break;
+    case KV_BOOL:
+        *((BOOL_T *)item->val) = num ? 1 : 0;
+        break;
+    case KV_STRING:
+        if (item->len < val_len + 1) {
+            return OPRT_COM_ERROR;
+        }
+        memcpy(item->val, val, val_len);
+        ((char *)item->val)[val_len] = 0;
+        break;
+    default:
+        if (item->len < val_len) {
+            return OPRT_COM_ERROR;
+        }
+        memcpy(item->val, val, val_len);
+        item->len = val_len;
+        break;
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Serializes the key-value pairs in the given database into a binary
+ * TLV record.
+ *
+ * @param db The pointer to the database containing the key-value pairs.
+ * @param dbcnt The number of key-value pairs in the database.
+ * @param out The pointer to store the record, free it with tal_free.
+ * @param out_len The pointer to store the length of the record.
+ * @return Returns OPRT_OK if serialization is successful, otherwise returns an
+ * error code.
+ */
+int kv_bin_serialize(const kv_db_t *db, const uint32_t dbcnt, uint8_t **out, uint32_t *out_len)
+{
+    uint32_t len = KV_BIN_HEAD_LEN;
+    uint32_t offset = KV_BIN_HEAD_LEN;
+    uint32_t key_len = 0;
+    uint32_t val_len = 0;
+    int32_t num = 0;
+    uint8_t *buf = NULL;
+    uint32_t i = 0;
+
+    if (dbcnt > 0xFFFF) {
+        return OPRT_INVALID_PARM;
+    }
+    for (i = 0; i < dbcnt; i++) {
+        key_len = strlen(db[i].key);
+        val_len = __kv_bin_val_len(&db[i]);
+        if (db[i].tp > KV_RAW || key_len > 0xFF || val_len > 0xFFFF) {
+            PR_ERR("kv bin %s type %d len %d invalid", db[i].key, db[i].tp, val_len);
+            return OPRT_INVALID_PARM;
+        }
+        len += KV_BIN_ENTRY_LEN + key_len + val_len;
+    }
+
+    buf = tal_malloc(len);
+    if (NULL == buf) {
+        PR_ERR("maloc fails %d", len);
+        return OPRT_MALLOC_FAILED;
+    }
+    buf[0] = KV_BIN_MAGIC;
+    buf[1] = KV_BIN_VERSION;
+    __kv_bin_put16(buf + 2, __kv_bin_schema(db, dbcnt));
+    __kv_bin_put16(buf + 4, dbcnt);
+
+    for (i = 0; i < dbcnt; i++) {
+        key_len = strlen(db[i].key);
+        val_len = __kv_bin_val_len(&db[i]);
+        buf[offset] = db[i].tp;
+        buf[offset + 1] = key_len;
+        __kv_bin_put16(buf + offset + 2, val_len);
+        offset += KV_BIN_ENTRY_LEN;
+        memcpy(buf + offset, db[i].key, key_len);
+        offset += key_len;
+
+        switch (db[i].tp) {
+        case KV_CHAR:
+            num = *((char *)db[i].val);
+            break;
+        case KV_BYTE:
+            num = *((uint8_t *)db[i].val);
+            break;
+        case KV_SHORT:
+            num = *((int16_t *)db[i].val);
+            break;
+        case KV_USHORT:
+            num = *((uint16_t *)db[i].val);
+            break;
+        case KV_INT:
+            num = *((int32_t *)db[i].val);
+            break;
+        case KV_BOOL:
+            num = (FALSE == *((BOOL_T *)db[i].val)) ? 0 : 1;
+            break;
+        default:
+            memcpy(buf + offset, db[i].val, val_len);
+            break;
+        }
+        if (db[i].tp <= KV_BOOL) {
+            buf[offset] = num & 0xFF;
+            if (val_len > 1) {
+                __kv_bin_put16(buf + offset, (uint16_t)num);
+            }
+            if (val_len > 2) {
+                __kv_bin_put16(buf + offset + 2, (uint16_t)((uint32_t)num >> 16));
+            }
+        }
+        offset += val_len;
+    }
+
+    *out = buf;
+    *out_len = len;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Deserializes a binary TLV record into a key-value database.
+ *
+ * Keys of db missing in the record are set to zero, like kv_deserialize.
+ *
+ * @param[in] in The record.
+ * @param[in] in_len The length of the record.
+ * @param[in,out] db The key-value database to populate.
+ * @param[in] dbcnt The number of elements in the key-value database.
+ * @return Returns OPRT_OK if the deserialization is successful. Otherwise, it
+ * returns an error code indicating the failure reason.
+ */
+int kv_bin_deserialize(const uint8_t *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt)
+{
+    int count = __kv_bin_head_check(in, in_len);
+    bool same_schema = false;
+    const uint8_t *entry = NULL;
+    uint32_t offset = KV_BIN_HEAD_LEN;
+    uint32_t i = 0;
+    int op_ret = OPRT_OK;
+
+    if (count < 0) {
+        return count;
+    }
+    same_schema = (count == dbcnt && __kv_bin_get16(in + 2) == __kv_bin_schema(db, dbcnt));
+
+    for (i = 0; i < dbcnt; i++) {
+        if (same_schema) {
+            // the 16-bit schema can collide, the key of the entry still has to match
+            entry = __kv_bin_entry(in, in_len, offset);
+            if (entry && __kv_bin_key_match(entry, db[i].key)) {
+                offset += KV_BIN_ENTRY_SIZE(entry);
+            } else {
+                same_schema = false;
+            }
+        }
+        if (!same_schema) {
+            entry = __kv_bin_find(in, in_len, db[i].key, &offset);
+        }
+        if (NULL == entry) {
+            memset(db[i].val, 0, db[i].len);
+            continue;
+        }
+        op_ret = __kv_bin_decode(entry, &db[i]);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("deserial %s fails %d", db[i].key, op_ret);
+            return op_ret;
+        }
+    }
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reads one key of a binary TLV record in place.
+ *
+ * @param[in] in The record.
+ * @param[in] in_len The length of the record.
+ * @param[in,out] item The key to read, its val and len as in kv_deserialize.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the record has no such key,
+ * or an error code.
+ */
+int kv_bin_field_get(const uint8_t *in, uint32_t in_len, kv_db_t *item)
+{
+    int count = __kv_bin_head_check(in, in_len);
+    const uint8_t *entry = NULL;
+    uint32_t offset = KV_BIN_HEAD_LEN;
+
+    if (count < 0) {
+        return count;
+    }
+    entry = __kv_bin_find(in, in_len, item->key, &offset);
+    if (NULL == entry) {
+        return OPRT_NOT_FOUND;
+    }
+    return __kv_bin_decode(entry, item);
+}
+
+/**
+ * @brief Tells whether a stored record is in the binary format.
+ */
+bool kv_bin_is_record(const uint8_t *in, uint32_t in_len)
+{
+    return in && in_len >= KV_BIN_HEAD_LEN && in[0] == KV_BIN_MAGIC;
+}
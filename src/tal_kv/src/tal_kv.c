@@ -35,9 +35,262 @@ static lfs_t lfs;
 static lfs_size_t lfs_flash_addr;
 static tal_kv_cfg_t lfs_kv_cfg;
 static MUTEX_HANDLE lfs_mutex;
+// held by tal_kv_set, tal_kv_del and the log migration from the store until the cache matches it
+static MUTEX_HANDLE kv_write_mutex;
 
 extern int kv_serialize(const kv_db_t *db, const uint32_t dbcnt, char **out, uint32_t *out_len);
 extern int kv_deserialize(const char *in, kv_db_t *db, const uint32_t dbcnt);
+extern int kv_bin_serialize(const kv_db_t *db, const uint32_t dbcnt, uint8_t **out, uint32_t *out_len);
+extern int kv_bin_deserialize(const uint8_t *in, uint32_t in_len, kv_db_t *db, const uint32_t dbcnt);
+extern int kv_bin_field_get(const uint8_t *in, uint32_t in_len, kv_db_t *item);
+extern bool kv_bin_is_record(const uint8_t *in, uint32_t in_len);
+
+#if defined(ENABLE_KV_SERIALIZE_BINARY) && (ENABLE_KV_SERIALIZE_BINARY == 1)
+#define KV_SERIALIZE_BINARY_SUPPORT 1
+#else
+#define KV_SERIALIZE_BINARY_SUPPORT 0
+#endif
+
+#if defined(ENABLE_KV_LOG) && (ENABLE_KV_LOG == 1)
+#define KV_LOG_SUPPORT 1
+extern int kv_log_init(lfs_t *lfs, MUTEX_HANDLE lfs_mutex);
+extern int kv_log_set(const char *key, const uint8_t *value, size_t length);
+extern int kv_log_get(const char *key, uint8_t **value, size_t *length);
+extern int kv_log_get_into(const char *key, uint8_t *buf, size_t cap, size_t *length);
+extern int kv_log_del(const char *key);
+extern int kv_log_flush(void);
+#else
+#define KV_LOG_SUPPORT 0
+#endif
+
+/**
+ * @brief bytes of decrypted values kept in RAM, 0 disables the cache
+ */
+#ifndef KV_CACHE_SIZE
+#define KV_CACHE_SIZE (1024)
+#endif
+
+/**
+ * @brief values longer than this are not cached
+ */
+#ifndef KV_CACHE_ITEM_MAX
+#define KV_CACHE_ITEM_MAX (256)
+#endif
+
+#if KV_CACHE_SIZE > 0
+typedef struct kv_cache_node {
+    struct kv_cache_node *prev;
+    struct kv_cache_node *next;
+    uint32_t hash;
+    uint32_t len;
+    uint8_t *data; // behind key
+    char key[0];
+} kv_cache_node_t;
+
+#define KV_CACHE_NODE_SIZE(key_len, len) (sizeof(kv_cache_node_t) + (key_len) + 1 + (len))
+
+static struct {
+    MUTEX_HANDLE mutex;
+    kv_cache_node_t *head; // most recently used
+    kv_cache_node_t *tail;
+    uint32_t gen; // bumped by every change, a read started before it is not cached
+    uint32_t bytes;
+    uint32_t items;
+    uint32_t hit;
+    uint32_t miss;
+    uint32_t evict;
+} s_kv_cache;
+
+static uint32_t __kv_cache_hash(const char *key)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*key) {
+        hash = (hash ^ (uint8_t)*key++) * 16777619u;
+    }
+    return hash;
+}
+
+static kv_cache_node_t *__kv_cache_find(const char *key, uint32_t hash)
+{
+    kv_cache_node_t *node = s_kv_cache.head;
+
+    for (; node; node = node->next) {
+        if (node->hash == hash && 0 == strcmp(node->key, key)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void __kv_cache_unlink(kv_cache_node_t *node)
+{
+    if (node->prev) {
+        node->prev->next = node->next;
+    } else {
+        s_kv_cache.head = node->next;
+    }
+    if (node->next) {
+        node->next->prev = node->prev;
+    } else {
+        s_kv_cache.tail = node->prev;
+    }
+}
+
+static void __kv_cache_push_front(kv_cache_node_t *node)
+{
+    node->prev = NULL;
+    node->next = s_kv_cache.head;
+    if (s_kv_cache.head) {
+        s_kv_cache.head->prev = node;
+    } else {
+        s_kv_cache.tail = node;
+    }
+    s_kv_cache.head = node;
+}
+
+static void __kv_cache_drop(kv_cache_node_t *node)
+{
+    __kv_cache_unlink(node);
+    s_kv_cache.bytes -= KV_CACHE_NODE_SIZE(strlen(node->key), node->len);
+    s_kv_cache.items--;
+    tal_free(node);
+}
+
+/**
+ * @brief Copies the cached value of key to a new allocation (value) or to buf.
+ *
+ * @return OPRT_OK on a hit, OPRT_NOT_FOUND on a miss with gen set for
+ * __kv_cache_put, OPRT_BUFFER_NOT_ENOUGH if cap is below TAL_KV_BUF_SIZE.
+ */
+static int __kv_cache_get(const char *key, uint8_t **value, uint8_t *buf, size_t cap, size_t *length, uint32_t *gen)
+{
+    uint32_t hash = __kv_cache_hash(key);
+    kv_cache_node_t *node = NULL;
+    int rt = OPRT_OK;
+
+    if (NULL == s_kv_cache.mutex) {
+        return OPRT_NOT_FOUND;
+    }
+
+    tal_mutex_lock(s_kv_cache.mutex);
+    node = __kv_cache_find(key, hash);
+    if (NULL == node) {
+        s_kv_cache.miss++;
+        *gen = s_kv_cache.gen;
+        tal_mutex_unlock(s_kv_cache.mutex);
+        return OPRT_NOT_FOUND;
+    }
+    s_kv_cache.hit++;
+    if (node != s_kv_cache.head) {
+        __kv_cache_unlink(node);
+        __kv_cache_push_front(node);
+    }
+
+    if (value) {
+        buf = tal_malloc(node->len + 1);
+        cap = TAL_KV_BUF_SIZE(node->len);
+    }
+    if (NULL == buf) {
+        rt = OPRT_MALLOC_FAILED;
+    } else if (cap < TAL_KV_BUF_SIZE(node->len)) {
+        *length = TAL_KV_BUF_SIZE(node->len);
+        rt = OPRT_BUFFER_NOT_ENOUGH;
+    } else {
+        memcpy(buf, node->data, node->len);
+        buf[node->len] = 0;
+        *length = node->len;
+        if (value) {
+            *value = buf;
+        }
+    }
+    tal_mutex_unlock(s_kv_cache.mutex);
+
+    return rt;
+}
+
+/**
+ * @brief Caches value for key, unless the cache changed since gen was taken.
+ */
+static void __kv_cache_put(const char *key, const uint8_t *value, size_t len, uint32_t gen)
+{
+    size_t key_len = strlen(key);
+    uint32_t size = KV_CACHE_NODE_SIZE(key_len, len);
+    kv_cache_node_t *node = NULL;
+
+    if (NULL == s_kv_cache.mutex || len > KV_CACHE_ITEM_MAX || size > KV_CACHE_SIZE) {
+        return;
+    }
+
+    node = tal_malloc(size);
+    if (NULL == node) {
+        return;
+    }
+    node->hash = __kv_cache_hash(key);
+    node->len = len;
+    memcpy(node->key, key, key_len + 1);
+    node->data = (uint8_t *)node->key + key_len + 1;
+    memcpy(node->data, value, len);
+
+    tal_mutex_lock(s_kv_cache.mutex);
+    if (gen != s_kv_cache.gen || __kv_cache_find(key, node->hash)) {
+        tal_mutex_unlock(s_kv_cache.mutex);
+        tal_free(node);
+        return;
+    }
+    while (s_kv_cache.tail && s_kv_cache.bytes + size > KV_CACHE_SIZE) {
+        __kv_cache_drop(s_kv_cache.tail);
+        s_kv_cache.evict++;
+    }
+    __kv_cache_push_front(node);
+    s_kv_cache.bytes += size;
+    s_kv_cache.items++;
+    tal_mutex_unlock(s_kv_cache.mutex);
+}
+
+/**
+ * @brief Drops key from the cache.
+ *
+ * @return The generation to pass to __kv_cache_put once the new value is stored.
+ */
+static uint32_t __kv_cache_del(const char *key)
+{
+    kv_cache_node_t *node = NULL;
+    uint32_t gen = 0;
+
+    if (NULL == s_kv_cache.mutex) {
+        return 0;
+    }
+
+    tal_mutex_lock(s_kv_cache.mutex);
+    node = __kv_cache_find(key, __kv_cache_hash(key));
+    if (node) {
+        __kv_cache_drop(node);
+    }
+    gen = ++s_kv_cache.gen;
+    tal_mutex_unlock(s_kv_cache.mutex);
+
+    return gen;
+}
+#else
+#define __kv_cache_get(key, value, buf, cap, length, gen) ((void)(gen), OPRT_NOT_FOUND)
+#define __kv_cache_put(key, value, len, gen)               ((void)(gen))
+#define __kv_cache_del(key)                                0
+#endif
+
+/**
+ * @brief Orders the changes of keys, so the cache and the log end with the
+ * value the last change stored.
+ */
+static void __kv_write_lock(void)
+{
+    tal_mutex_lock(kv_write_mutex);
+}
+
+static void __kv_write_unlock(void)
+{
+    tal_mutex_unlock(kv_write_mutex);
+}
 
 /**
  * Reads data from a user-provided block device.
@@ -147,6 +400,14 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
     memcpy(lfs_kv_cfg.key, sha256_ret, TAL_LV_KEY_LEN);
 
     tal_mutex_create_init(&lfs_mutex);
+    if (NULL == kv_write_mutex) {
+        tal_mutex_create_init(&kv_write_mutex);
+    }
+#if KV_CACHE_SIZE > 0
+    if (NULL == s_kv_cache.mutex) {
+        tal_mutex_create_init(&s_kv_cache.mutex);
+    }
+#endif
 
     TUYA_FLASH_BASE_INFO_T info;
     tkl_flash_get_one_type_info(TUYA_FLASH_TYPE_UF, &info);
@@ -178,9 +439,53 @@ int tal_kv_init(tal_kv_cfg_t *kv_cfg)
         err = lfs_mount(&lfs, &lfs_cfg);
     }
 
+#if KV_LOG_SUPPORT
+    if (LFS_ERR_OK == err) {
+        err = kv_log_init(&lfs, lfs_mutex);
+    }
+#endif
+
     return err;
 }
 
+#if KV_LOG_SUPPORT
+/* true while key still has a file of the per-file layout */
+static bool __kv_log_file_exist(const char *key)
+{
+    struct lfs_info info;
+    int rt;
+
+    tal_mutex_lock(lfs_mutex);
+    rt = lfs_stat(&lfs, key, &info);
+    tal_mutex_unlock(lfs_mutex);
+
+    return LFS_ERR_OK == rt;
+}
+
+/* removes the file of key once the log holding its newer value is on flash, kv_write_mutex held */
+static void __kv_log_file_drop(const char *key)
+{
+    if (!__kv_log_file_exist(key) || OPRT_OK != kv_log_flush()) {
+        return;
+    }
+    tal_mutex_lock(lfs_mutex);
+    lfs_remove(&lfs, key);
+    tal_mutex_unlock(lfs_mutex);
+}
+
+/* moves a key of the per-file layout to the log */
+static void __kv_log_migrate(const char *key, const uint8_t *ec_data, uint32_t ec_len)
+{
+    __kv_write_lock();
+    /* a set or del after the file was read removed it and the log holds the newer state */
+    if (__kv_log_file_exist(key) && OPRT_OK == kv_log_set(key, ec_data, ec_len)) {
+        __kv_log_file_drop(key);
+        PR_DEBUG("key %s moved to kv log", key);
+    }
+    __kv_write_unlock();
+}
+#endif
+
 /**
  * @brief Sets a key-value pair in the key-value store.
  *
@@ -205,13 +510,6 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
         return OPRT_INVALID_PARM;
     }
 
-    tal_mutex_lock(lfs_mutex);
-    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
-    if (LFS_ERR_OK != result) {
-        tal_mutex_unlock(lfs_mutex);
-        PR_ERR("lfs open %s err", key);
-        return result;
-    }
     uint8_t *ec_data = NULL;
     uint32_t ec_len = 0;
     uint8_t iv[16];
@@ -220,20 +518,49 @@ int tal_kv_set(const char *key, const uint8_t *value, size_t length)
     result =
         tal_aes128_cbc_encode((uint8_t *)value, length, (uint8_t *)lfs_kv_cfg.key, iv, &ec_data, (uint32_t *)&ec_len);
     if (OPRT_OK != result) {
-        lfs_file_close(&lfs, &file);
-        tal_mutex_unlock(lfs_mutex);
         PR_DEBUG("key %s encrypt failed", key);
         return result;
     }
-    lfs_file_rewind(&lfs, &file);
+
+    /* a get meanwhile must not see the old value, and only the value stored last is cached */
+    __kv_write_lock();
+    (void)__kv_cache_del(key);
+#if KV_LOG_SUPPORT
+    result = kv_log_set(key, ec_data, ec_len);
+    tal_aes_free_data(ec_data);
+    if (OPRT_OK != result) {
+        __kv_write_unlock();
+        PR_ERR("kv log set %s fail %d", key, result);
+        return result;
+    }
+    /* a get must not move the old value of the per-file layout over this one */
+    __kv_log_file_drop(key);
+    __kv_cache_put(key, value, length, __kv_cache_del(key));
+    __kv_write_unlock();
+    return OPRT_OK;
+#endif
+
+    tal_mutex_lock(lfs_mutex);
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDWR | LFS_O_CREAT | LFS_O_TRUNC);
+    if (LFS_ERR_OK != result) {
+        tal_mutex_unlock(lfs_mutex);
+        __kv_write_unlock();
+        tal_aes_free_data(ec_data);
+        PR_ERR("lfs open %s err", key);
+        return result;
+    }
     result = lfs_file_write(&lfs, &file, ec_data, ec_len);
     lfs_file_close(&lfs, &file);
     tal_aes_free_data(ec_data);
     tal_mutex_unlock(lfs_mutex);
     if (result != ec_len) {
+        __kv_write_unlock();
         PR_ERR("kv write fail %d", result);
         return OPRT_KVS_WR_FAIL;
     }
+    /* a get that read the old value before the store is not cached after this */
+    __kv_cache_put(key, value, length, __kv_cache_del(key));
+    __kv_write_unlock();
 
     return OPRT_OK;
 }
@@ -263,6 +590,33 @@ int tal_kv_get(const char *key, uint8_t **value, size_t *length)
         return OPRT_INVALID_PARM;
     }
 
+    uint8_t *ec_data = NULL;
+    uint32_t ec_len = 0;
+    uint8_t *dec_data = NULL;
+    uint32_t dec_len = 0;
+    uint8_t iv[16];
+    uint32_t gen = 0;
+
+    result = __kv_cache_get(key, value, NULL, 0, length, &gen);
+    if (OPRT_NOT_FOUND != result) {
+        return result;
+    }
+
+#if KV_LOG_SUPPORT
+    size_t log_len = 0;
+
+    result = kv_log_get(key, &ec_data, &log_len);
+    ec_len = log_len;
+    if (OPRT_NOT_FOUND != result) {
+        if (OPRT_OK != result) {
+            PR_ERR("kv log get %s fail %d", key, result);
+            return result;
+        }
+        goto __decrypt;
+    }
+    /* a key of the per-file layout, it is moved to the log below */
+#endif
+
     tal_mutex_lock(lfs_mutex);
     result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
     if (LFS_ERR_OK != result) {
@@ -270,12 +624,12 @@ int tal_kv_get(const char *key, uint8_t **value, size_t *length)
         tal_mutex_unlock(lfs_mutex);
         return result;
     }
-    uint8_t *ec_data = NULL;
-    uint32_t ec_len = lfs_file_size(&lfs, &file);
+    ec_len = lfs_file_size(&lfs, &file);
 
     ec_data = tal_malloc(ec_len + 1);
     if (NULL == ec_data) {
         result = OPRT_MALLOC_FAILED;
+        lfs_file_close(&lfs, &file);
         tal_mutex_unlock(lfs_mutex);
         return result;
     }
@@ -289,21 +643,112 @@ int tal_kv_get(const char *key, uint8_t **value, size_t *length)
         PR_ERR("kv read error %d", result);
         return OPRT_KVS_RD_FAIL;
     }
-    uint8_t *dec_data = NULL;
-    uint32_t dec_len = 0;
-    uint8_t iv[16];
 
+#if KV_LOG_SUPPORT
+    __kv_log_migrate(key, ec_data, ec_len);
+
+__decrypt:
+#endif
     memcpy(iv, lfs_kv_cfg.seed, 16);
     result = tal_aes128_cbc_decode(ec_data, ec_len, (uint8_t *)lfs_kv_cfg.key, iv, &dec_data, (uint32_t *)&dec_len);
     dec_len = tal_aes_get_actual_length(dec_data, dec_len);
     tal_free(ec_data);
     if (OPRT_OK != result || dec_len > ec_len) {
         PR_ERR("key %s decrypt failed %d, %d-%d", key, result, dec_len, ec_len);
+        tal_free(dec_data);
         return OPRT_BUFFER_NOT_ENOUGH;
     }
     *value = dec_data;
     *length = (size_t)dec_len;
     dec_data[dec_len] = 0;
+    __kv_cache_put(key, dec_data, dec_len, gen);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Retrieves the value of key into a buffer of the caller.
+ *
+ * Unlike tal_kv_get nothing is allocated, the value is decrypted in place in
+ * buf.
+ *
+ * @param key The key to retrieve the value for.
+ * @param buf The buffer, the value is followed by a terminating 0.
+ * @param cap The size of buf, at least TAL_KV_BUF_SIZE of the value length.
+ * @param length The length of the value, or the size buf needs when
+ * OPRT_BUFFER_NOT_ENOUGH is returned.
+ *
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if buf is too small, or
+ * a negative error code if an error occurred.
+ */
+int tal_kv_get_into(const char *key, uint8_t *buf, size_t cap, size_t *length)
+{
+    int result;
+    lfs_file_t file;
+
+    if (NULL == key || NULL == buf || NULL == length) {
+        return OPRT_INVALID_PARM;
+    }
+
+    size_t ec_len = 0;
+    int32_t dec_len = 0;
+    uint8_t iv[16];
+    uint32_t gen = 0;
+
+    result = __kv_cache_get(key, NULL, buf, cap, length, &gen);
+    if (OPRT_NOT_FOUND != result) {
+        return result;
+    }
+
+#if KV_LOG_SUPPORT
+    result = kv_log_get_into(key, buf, cap, &ec_len);
+    if (OPRT_NOT_FOUND != result) {
+        if (OPRT_OK != result) {
+            *length = ec_len;
+            return result;
+        }
+        goto __decrypt;
+    }
+#endif
+
+    tal_mutex_lock(lfs_mutex);
+    result = lfs_file_open(&lfs, &file, key, LFS_O_RDONLY);
+    if (LFS_ERR_OK != result) {
+        PR_ERR("lfs open %s %d err", key, result);
+        tal_mutex_unlock(lfs_mutex);
+        return result;
+    }
+    ec_len = lfs_file_size(&lfs, &file);
+    if (ec_len > cap) {
+        lfs_file_close(&lfs, &file);
+        tal_mutex_unlock(lfs_mutex);
+        *length = ec_len;
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    result = lfs_file_read(&lfs, &file, buf, ec_len);
+    lfs_file_close(&lfs, &file);
+    tal_mutex_unlock(lfs_mutex);
+    if (result <= 0) {
+        *length = 0;
+        PR_ERR("kv read error %d", result);
+        return OPRT_KVS_RD_FAIL;
+    }
+
+#if KV_LOG_SUPPORT
+    __kv_log_migrate(key, buf, ec_len);
+
+__decrypt:
+#endif
+    memcpy(iv, lfs_kv_cfg.seed, 16);
+    result = tal_aes128_cbc_decode_raw(buf, ec_len, (uint8_t *)lfs_kv_cfg.key, iv, buf);
+    dec_len = tal_aes_get_actual_length(buf, ec_len);
+    if (OPRT_OK != result || dec_len < 0) {
+        PR_ERR("key %s decrypt failed %d, %d-%d", key, result, dec_len, (int)ec_len);
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+    *length = (size_t)dec_len;
+    buf[dec_len] = 0;
+    __kv_cache_put(key, buf, dec_len, gen);
 
     return OPRT_OK;
 }
@@ -321,9 +766,20 @@ int tal_kv_del(const char *key)
 {
     PR_DEBUG("key:%s", key);
 
+    __kv_write_lock();
+    (void)__kv_cache_del(key);
     tal_mutex_lock(lfs_mutex);
     int result = lfs_remove(&lfs, key);
     tal_mutex_unlock(lfs_mutex);
+#if KV_LOG_SUPPORT
+    /* the key may also be left in the per-file layout */
+    if (OPRT_OK == kv_log_del(key)) {
+        result = LFS_ERR_OK;
+    }
+#endif
+    /* a get that read the value before the remove is not cached after this */
+    (void)__kv_cache_del(key);
+    __kv_write_unlock();
     if (LFS_ERR_OK == result) {
         PR_DEBUG("Deleted successfully");
         return OPRT_OK;
@@ -334,6 +790,23 @@ int tal_kv_del(const char *key)
     return OPRT_COM_ERROR;
 }
 
+/**
+ * @brief Writes the changes still held in RAM to flash.
+ *
+ * With ENABLE_KV_LOG, tal_kv_set and tal_kv_del are committed up to
+ * KV_LOG_COMMIT_MS later, call this before a reset or power off.
+ *
+ * @return OPRT_OK on success, or an error code if an error occurred.
+ */
+int tal_kv_flush(void)
+{
+#if KV_LOG_SUPPORT
+    return kv_log_flush();
+#else
+    return OPRT_OK;
+#endif
+}
+
 /**
  * @brief Frees the memory allocated for a value in the TAL Key-Value store.
  *
@@ -365,6 +838,16 @@ int tal_kv_free(uint8_t *value)
  */
 void tal_kv_cmd(int argc, char *argv[])
 {
+#if KV_CACHE_SIZE > 0
+    if (argc >= 2 && 0 == strcmp("stat", argv[1])) {
+        tal_mutex_lock(s_kv_cache.mutex);
+        PR_DEBUG("kv cache items:%d bytes:%d/%d hit:%d miss:%d evict:%d", s_kv_cache.items, s_kv_cache.bytes,
+                 KV_CACHE_SIZE, s_kv_cache.hit, s_kv_cache.miss, s_kv_cache.evict);
+        tal_mutex_unlock(s_kv_cache.mutex);
+        return;
+    }
+#endif
+
     if (argc < 3) {
         return;
     }
@@ -414,12 +897,18 @@ int tal_kv_serialize_set(const char *key, kv_db_t *db, size_t dbcnt)
     uint32_t len = 0;
     int ret = OPRT_OK;
 
+#if KV_SERIALIZE_BINARY_SUPPORT
+    ret = kv_bin_serialize(db, dbcnt, (uint8_t **)&buf, &len);
+#else
     ret = kv_serialize(db, dbcnt, &buf, &len);
+#endif
     if (OPRT_OK != ret) {
         PR_ERR("kv_serialize  fail. %d", ret);
         return ret;
     }
+#if !KV_SERIALIZE_BINARY_SUPPORT
     PR_TRACE("write buf:%s", buf);
+#endif
     ret = tal_kv_set(key, (const uint8_t *)buf, len);
     tal_free(buf);
     if (OPRT_OK != ret) {
@@ -437,6 +926,10 @@ int tal_kv_serialize_set(const char *key, kv_db_t *db, size_t dbcnt)
  * retrieves it from the key-value database. The serialized value is then
  * deserialized and stored in the provided `db` array.
  *
+ * Both the text and the binary format are read. With
+ * ENABLE_KV_SERIALIZE_BINARY a text record is rewritten in the binary format,
+ * keys of the record that are not in db are dropped.
+ *
  * @param key The key for which to retrieve the value.
  * @param db Pointer to the array where the deserialized value will be stored.
  * @param dbcnt The size of the `db` array.
@@ -458,12 +951,64 @@ int tal_kv_serialize_get(const char *key, kv_db_t *db, size_t dbcnt)
         PR_ERR("kv_get fails %s %d", key, ret);
         return ret;
     }
+    if (kv_bin_is_record(buf, len)) {
+        ret = kv_bin_deserialize(buf, len, db, dbcnt);
+        tal_free(buf);
+        if (OPRT_OK != ret) {
+            PR_ERR("kv_bin_deserialize fail. %d", ret);
+        }
+        return ret;
+    }
+
     ret = kv_deserialize((char *)buf, db, dbcnt);
     tal_free(buf);
     if (OPRT_OK != ret) {
         PR_ERR("kv_deserialize fail. %d", ret);
+        return ret;
     }
 
+#if KV_SERIALIZE_BINARY_SUPPORT
+    if (OPRT_OK == tal_kv_serialize_set(key, db, dbcnt)) {
+        PR_DEBUG("key %s moved to binary format", key);
+    }
+#endif
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reads one key of a record stored with tal_kv_serialize_set.
+ *
+ * A binary record is read in place, without decoding the other keys.
+ *
+ * @param key The key of the record.
+ * @param item The key to read within the record, filled as by
+ * tal_kv_serialize_get.
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if a binary record has no such
+ * key, or an error code.
+ */
+int tal_kv_serialize_field_get(const char *key, kv_db_t *item)
+{
+    if (NULL == key || NULL == item) {
+        return OPRT_INVALID_PARM;
+    }
+
+    uint8_t *buf = NULL;
+    size_t len = 0;
+    int ret = OPRT_OK;
+
+    ret = tal_kv_get(key, &buf, &len);
+    if (OPRT_OK != ret) {
+        PR_ERR("kv_get fails %s %d", key, ret);
+        return ret;
+    }
+    if (kv_bin_is_record(buf, len)) {
+        ret = kv_bin_field_get(buf, len, item);
+    } else {
+        ret = kv_deserialize((char *)buf, item, 1);
+    }
+    tal_free(buf);
+
     return ret;
 }
 
@@ -50,6 +50,10 @@ extern "C" {
  */
 #define EVENT_DESC_MAX_LEN (32)
 
+#ifndef EVENT_HASH_BUCKET_NUM
+#define EVENT_HASH_BUCKET_NUM (32) // must be power of 2
+#endif
+
 /**
  * @brief subscriber type
  *
@@ -86,6 +90,7 @@ typedef struct {
     char desc[EVENT_DESC_MAX_LEN + 1]; // description, used to record the subscribe info
     SUBSCRIBE_TYPE_E type;             // the subscribe type
     EVENT_SUBSCRIBE_CB cb;             // the subscribe callback function
+    uint32_t id;                       // unique id, used to find the subscriber from a snapshot
     struct tuya_list_head node;        // list node, used to attch to the event node
 } SUBSCRIBE_NODE_T;
 
@@ -93,12 +98,17 @@ typedef struct {
  * @brief the event node
  *
  */
-typedef struct {
-    MUTEX_HANDLE mutex; // mutex, protection the event publish and subscribe
+typedef struct subscribe_snapshot SUBSCRIBE_SNAPSHOT_T;
+
+typedef struct event_node {
+    MUTEX_HANDLE mutex; // mutex, protection the subscribe list and the snapshot swap
 
     char name[EVENT_NAME_MAX_LEN + 1];    // name, the event name
+    uint32_t hash;                        // hash of the name
+    struct event_node *hash_next;         // next event in the same hash bucket
     struct tuya_list_head node;           // list node, used to attach to the event manage module
     struct tuya_list_head subscribe_root; // subscibe root, used to manage the subscriber
+    SUBSCRIBE_SNAPSHOT_T *snapshot;       // read-only copy of subscribe_root, used by publish
 } EVENT_NODE_T;
 
 /**
@@ -112,8 +122,13 @@ typedef struct {
     struct tuya_list_head event_root;          // event root, used to manage the event
     struct tuya_list_head free_subscribe_root; // free subscriber list, used to manage the
                                                // subscribe which not found the event
+    EVENT_NODE_T *volatile hash_tbl[EVENT_HASH_BUCKET_NUM]; // event lookup table, read without lock
+    uint32_t subscribe_id;                                  // last id given to a subscriber
 } EVENT_MANAGE_T;
 
+// interned event id, valid for the whole life of the system
+typedef void *EVENT_ID;
+
 /**
  * @brief event initialization
  *
@@ -147,6 +162,10 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
 /**
  * @brief: unsubscribe event
  *
+ * @note a publish which started before the call dispatches from its own copy
+ * of the subscriber list, so the callback may still run once after return,
+ * the callback and its context must stay valid until such publish finishes
+ *
  * @param[in] name: event name
  * @param[in] desc: subscribe description
  * @param[in] cb: subscribe callback function
@@ -155,6 +174,39 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
  */
 OPERATE_RET tal_event_unsubscribe(const char *name, const char *desc, EVENT_SUBSCRIBE_CB cb);
 
+/**
+ * @brief: get the interned id of event, the event is created if not exist
+ *
+ * @param[in] name: event name
+ * @param[out] id: event id, used by tal_event_publish_id
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_id_get(const char *name, EVENT_ID *id);
+
+/**
+ * @brief: publish event by the interned id, without name lookup
+ *
+ * @param[in] id: event id from tal_event_id_get
+ * @param[in] data: event data
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_publish_id(EVENT_ID id, void *data);
+
+/**
+ * @brief: publish event in the system workqueue, return without waiting for
+ * the subscribers
+ *
+ * @param[in] name: event name
+ * @param[in] data: event data
+ * @param[in] len: data length, if not 0 a copy of data is delivered,
+ * otherwise the data pointer is delivered as is and must stay valid
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_event_publish_async(const char *name, void *data, uint32_t len);
+
 #ifdef __cplusplus
 }
 #endif /* __cplusplus */
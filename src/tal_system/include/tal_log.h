@@ -101,31 +101,84 @@ OPERATE_RET tal_log_print(const TAL_LOG_LEVEL_E level, const char *file, const i
 #define _THIS_FILE_NAME_ __FILE__
 #endif
 
-#define PR_ERR(fmt, ...)    tal_log_print(TAL_LOG_LEVEL_ERR, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-#define PR_WARN(fmt, ...)   tal_log_print(TAL_LOG_LEVEL_WARN, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-#define PR_NOTICE(fmt, ...) tal_log_print(TAL_LOG_LEVEL_NOTICE, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-#define PR_INFO(fmt, ...)   tal_log_print(TAL_LOG_LEVEL_INFO, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-#define PR_DEBUG(fmt, ...)  tal_log_print(TAL_LOG_LEVEL_DEBUG, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-#define PR_TRACE(fmt, ...)  tal_log_print(TAL_LOG_LEVEL_TRACE, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)
-
-#define PR_HEXDUMP_ERR(title, buf, size)                                                                               \
-    tal_log_hex_dump(TAL_LOG_LEVEL_ERR, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
-#define PR_HEXDUMP_WARN(title, buf, size)                                                                              \
-    tal_log_hex_dump(TAL_LOG_LEVEL_WARN, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
-#define PR_HEXDUMP_NOTICE(title, buf, size)                                                                            \
-    tal_log_hex_dump(TAL_LOG_LEVEL_NOTICE, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
-#define PR_HEXDUMP_INFO(title, buf, size)                                                                              \
-    tal_log_hex_dump(TAL_LOG_LEVEL_INFO, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
-#define PR_HEXDUMP_DEBUG(title, buf, size)                                                                             \
-    tal_log_hex_dump(TAL_LOG_LEVEL_DEBUG, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
-#define PR_HEXDUMP_TRACE(title, buf, size)                                                                             \
-    tal_log_hex_dump(TAL_LOG_LEVEL_TRACE, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size)
+// highest level compiled in, the calls above it are folded away by the compiler
+#ifndef TAL_LOG_COMPILE_LEVEL
+#if defined(LOG_COMPILE_LEVEL)
+#define TAL_LOG_COMPILE_LEVEL LOG_COMPILE_LEVEL
+#else
+#define TAL_LOG_COMPILE_LEVEL TAL_LOG_LEVEL_TRACE
+#endif
+#endif
+
+#define TAL_LOG_LEVEL_ENABLED(level) ((level) <= TAL_LOG_COMPILE_LEVEL)
+
+/**
+ * @brief log site of binary log, only its offset to tal_log_site_base is stored in
+ * the record, the host decoder reads file, line and fmt back from the ELF
+ */
+typedef struct {
+    uint32_t magic;
+    uint32_t line;
+    const char *file;
+    const char *fmt;
+} TAL_LOG_SITE_T;
+
+#define TAL_LOG_SITE_MAGIC 0x54534c47 // "GLST"
+
+OPERATE_RET tal_log_bin_print(const TAL_LOG_LEVEL_E level, const TAL_LOG_SITE_T *site, ...);
+
+// fmt must be a string literal
+#define __TAL_LOG_BIN_PRINT(level, fmt, ...)                                                                           \
+    ({                                                                                                                 \
+        static const TAL_LOG_SITE_T __tal_log_site = {TAL_LOG_SITE_MAGIC, __LINE__, _THIS_FILE_NAME_, fmt};            \
+        tal_log_bin_print(level, &__tal_log_site, ##__VA_ARGS__);                                                      \
+    })
+
+static inline OPERATE_RET __tal_log_print_none(void)
+{
+    return OPRT_OK;
+}
+
+#define __TAL_LOG_BIN(level, fmt, ...)                                                                                 \
+    (TAL_LOG_LEVEL_ENABLED(level) ? __TAL_LOG_BIN_PRINT(level, fmt, ##__VA_ARGS__) : __tal_log_print_none())
+
+#if defined(ENABLE_LOG_BINARY) && (ENABLE_LOG_BINARY == 1)
+#define __TAL_LOG_PRINT(level, fmt, ...) __TAL_LOG_BIN(level, fmt, ##__VA_ARGS__)
+#else
+#define __TAL_LOG_PRINT(level, fmt, ...)                                                                               \
+    (TAL_LOG_LEVEL_ENABLED(level) ? tal_log_print(level, _THIS_FILE_NAME_, __LINE__, fmt, ##__VA_ARGS__)            \
+                                  : __tal_log_print_none())
+#endif
+#define __TAL_LOG_HEXDUMP(level, title, buf, size)                                                                     \
+    (TAL_LOG_LEVEL_ENABLED(level) ? tal_log_hex_dump(level, _THIS_FILE_NAME_, __LINE__, title, 8, buf, size) : (void)0)
+
+#define PR_ERR(fmt, ...)    __TAL_LOG_PRINT(TAL_LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+#define PR_WARN(fmt, ...)   __TAL_LOG_PRINT(TAL_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define PR_NOTICE(fmt, ...) __TAL_LOG_PRINT(TAL_LOG_LEVEL_NOTICE, fmt, ##__VA_ARGS__)
+#define PR_INFO(fmt, ...)   __TAL_LOG_PRINT(TAL_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define PR_DEBUG(fmt, ...)  __TAL_LOG_PRINT(TAL_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define PR_TRACE(fmt, ...)  __TAL_LOG_PRINT(TAL_LOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+
+// always binary, decoded on the host by tools/log_decode.py
+#define PR_BIN_ERR(fmt, ...)    __TAL_LOG_BIN(TAL_LOG_LEVEL_ERR, fmt, ##__VA_ARGS__)
+#define PR_BIN_WARN(fmt, ...)   __TAL_LOG_BIN(TAL_LOG_LEVEL_WARN, fmt, ##__VA_ARGS__)
+#define PR_BIN_NOTICE(fmt, ...) __TAL_LOG_BIN(TAL_LOG_LEVEL_NOTICE, fmt, ##__VA_ARGS__)
+#define PR_BIN_INFO(fmt, ...)   __TAL_LOG_BIN(TAL_LOG_LEVEL_INFO, fmt, ##__VA_ARGS__)
+#define PR_BIN_DEBUG(fmt, ...)  __TAL_LOG_BIN(TAL_LOG_LEVEL_DEBUG, fmt, ##__VA_ARGS__)
+#define PR_BIN_TRACE(fmt, ...)  __TAL_LOG_BIN(TAL_LOG_LEVEL_TRACE, fmt, ##__VA_ARGS__)
+
+#define PR_HEXDUMP_ERR(title, buf, size)    __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_ERR, title, buf, size)
+#define PR_HEXDUMP_WARN(title, buf, size)   __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_WARN, title, buf, size)
+#define PR_HEXDUMP_NOTICE(title, buf, size) __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_NOTICE, title, buf, size)
+#define PR_HEXDUMP_INFO(title, buf, size)   __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_INFO, title, buf, size)
+#define PR_HEXDUMP_DEBUG(title, buf, size)  __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_DEBUG, title, buf, size)
+#define PR_HEXDUMP_TRACE(title, buf, size)  __TAL_LOG_HEXDUMP(TAL_LOG_LEVEL_TRACE, title, buf, size)
 #define PR_HEX_DUMP(title, width, buf, size)                                                                           \
     tal_log_hex_dump(TAL_LOG_LEVEL_NOTICE, __FILE__, __LINE__, title, width, buf, size)
 
 #define PR_DEBUG_RAW(fmt, ...) tal_log_print_raw(fmt, ##__VA_ARGS__)
 #define PR_TRACE_ENTER()       PR_TRACE("enter [%s]", (const char *)__func__)
-#define PR_TRACE_LEAVE()       PR_TRACE(("leave [%s]", (const char *)__func__))
+#define PR_TRACE_LEAVE()       PR_TRACE("leave [%s]", (const char *)__func__)
 
 /***********************************************************************
  ********************* struct ******************************************
@@ -133,6 +186,19 @@ OPERATE_RET tal_log_print(const TAL_LOG_LEVEL_E level, const char *file, const i
 // prototype of log output function
 typedef void (*TAL_LOG_OUTPUT_CB)(const char *str);
 
+// prototype of binary log output function, one call per record
+typedef void (*TAL_LOG_BIN_OUTPUT_CB)(const uint8_t *data, uint32_t len);
+
+/**
+ * @brief statistics of the asynchronous log output
+ */
+typedef struct {
+    uint32_t buf_size;  // ring buffer size
+    uint32_t max_used;  // high water mark of the ring buffer
+    uint32_t write_cnt; // records written to the output terminals
+    uint32_t drop_cnt;  // records dropped because the ring buffer was full
+} TAL_LOG_ASYNC_STAT_T;
+
 /***********************************************************************
  ********************* variable ****************************************
  **********************************************************************/
@@ -350,6 +416,61 @@ void tal_log_color_set(const TAL_LOG_LEVEL_E level, TAL_LOG_DISPLAY_MODE_E displ
 OPERATE_RET tal_log_color_print_raw(TAL_LOG_DISPLAY_MODE_E display_mode, TAL_LOG_FONT_COLOR_E font_color,
                                     TAL_LOG_BACKGROUND_COLOR_E background_color, const char *pFmt, ...);
 
+/**
+ * @brief start asynchronous log output
+ *
+ * @param[in] buf_size, ring buffer size, rounded up to power of 2, 0 means LOG_ASYNC_BUF_SIZE
+ *
+ * @note Log calls only format the message into a lock-free ring buffer, a low priority
+ * writer thread passes the records to the output terminals. Messages are dropped and
+ * counted when the ring buffer is full. tal_log_init starts it when ENABLE_LOG_ASYNC is set.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_log_async_start(uint32_t buf_size);
+
+/**
+ * @brief stop asynchronous log output, the pending records are written out
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_log_async_stop(void);
+
+/**
+ * @brief write out the pending records in the caller's context
+ *
+ * @note Call it before reboot or in the fault handler to avoid losing the last logs.
+ *
+ * @return NONE
+ */
+void tal_log_async_flush(void);
+
+/**
+ * @brief set the output of binary log records
+ *
+ * @param[in] output, binary output function, NULL means the records are written to the
+ * text output terminals as base64 lines "!B:...", which tools/log_decode.py understands
+ *
+ * @note The output can store the records in flash or a RAM ring for upload, each record
+ * is self-delimited.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_log_bin_output_set(const TAL_LOG_BIN_OUTPUT_CB output);
+
+/**
+ * @brief get the statistics of asynchronous log output
+ *
+ * @param[out] stat, statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_log_async_stat_get(TAL_LOG_ASYNC_STAT_T *stat);
+
 #ifdef __cplusplus
 }
 #endif /* __TAL_LOG_H__ */
@@ -51,6 +51,18 @@ typedef void *TIMER_ID;
 
 typedef void (*TAL_TIMER_CB)(TIMER_ID timer_id, void *arg);
 
+/**
+ * @brief dispatch statistics of the software timer
+ */
+typedef struct {
+    uint16_t total_cnt;
+    uint16_t running_cnt;
+    uint32_t dispatch_cnt; // callbacks invoked since init or last reset
+    uint32_t max_lag_ms;   // max delay between expire time and dispatch
+    uint32_t max_cb_ms;    // max duration of one callback
+    TAL_TIMER_CB max_cb;   // the callback which took max_cb_ms
+} TAL_SW_TIMER_STAT_T;
+
 /***********************************************************************
  ********************* variable ****************************************
  **********************************************************************/
@@ -180,6 +192,35 @@ OPERATE_RET tal_sw_timer_release(void);
  */
 int tal_sw_timer_get_num(void);
 
+/**
+ * @brief Get the dispatch statistics of the software timer
+ *
+ * @param[out] stat: statistics of the software timer
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_stat_get(TAL_SW_TIMER_STAT_T *stat);
+
+/**
+ * @brief Reset the dispatch statistics of the software timer
+ *
+ * @param void
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_stat_reset(void);
+
+/**
+ * @brief Dump all timers and the dispatch statistics, used for debug
+ *
+ * @param void
+ *
+ * @return void
+ */
+void tal_sw_timer_dump(void);
+
 #ifdef __cplusplus
 }
 #endif
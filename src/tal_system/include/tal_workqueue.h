@@ -39,6 +39,25 @@ typedef struct {
 } WORK_ITEM_T;
 typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
 
+/**
+ * @brief priority lanes of the workqueue, lower value is dequeued first
+ */
+typedef enum {
+    WORKQUEUE_PRIO_HIGH = 0,
+    WORKQUEUE_PRIO_NORMAL,
+    WORKQUEUE_PRIO_LOW,
+    WORKQUEUE_PRIO_MAX,
+} WORKQUEUE_PRIO_E;
+
+/**
+ * @brief config of the multi-worker workqueue
+ */
+typedef struct {
+    uint16_t queue_len;      // max items of each priority lane of each worker
+    uint8_t worker_num;      // number of worker threads
+    THREAD_CFG_T thread_cfg; // param of every worker thread
+} WORKQUEUE_CFG_T;
+
 /**
  * @brief create and initialize a workqueue which runs in thread context
  *
@@ -52,6 +71,20 @@ typedef BOOL_T (*WORKQUEUE_TRAVERSE_CB)(WORK_ITEM_T *item, void *ctx);
  */
 OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_cfg, WORKQUEUE_HANDLE *handle);
 
+/**
+ * @brief create and initialize a workqueue served by several worker threads
+ *
+ * @param[in] cfg workqueue config, see WORKQUEUE_CFG_T
+ * @param[out] handle the workqueue handle
+ *
+ * @note every worker owns one deque per priority lane, idle workers steal
+ * items from the others, so one blocked callback doesn't stall the queue.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_create_multi(const WORKQUEUE_CFG_T *cfg, WORKQUEUE_HANDLE *handle);
+
 /**
  * @brief put work task in workqueue
  *
@@ -76,6 +109,22 @@ OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, voi
  */
 OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void *data);
 
+/**
+ * @brief put work task in the priority lane of workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] prio the priority lane, see WORKQUEUE_PRIO_E
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @note a workqueue created by tal_workqueue_create has only one lane,
+ * WORKQUEUE_PRIO_HIGH is queued to the front and others to the back.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_prio(WORKQUEUE_HANDLE handle, WORKQUEUE_PRIO_E prio, WORKQUEUE_CB cb, void *data);
+
 /**
  * @brief cancel work task in workqueue
  *
@@ -34,8 +34,79 @@
 #include "tal_event.h"
 #include "tal_api.h"
 
+// publish reads the bucket chain without lock, the node must be complete before linked
+#define EVENT_MEMORY_BARRIER() __sync_synchronize()
+
+typedef struct {
+    EVENT_SUBSCRIBE_CB cb;
+    SUBSCRIBE_TYPE_E type;
+    uint32_t id; // id of the subscriber, a freed node may come back at the same address
+} SUBSCRIBE_ENTRY_T;
+
+// copy-on-write subscriber list, publish holds a reference while dispatching
+struct subscribe_snapshot {
+    int ref;
+    int cnt;
+    SUBSCRIBE_ENTRY_T entry[0];
+};
+
+typedef struct {
+    EVENT_NODE_T *event;
+    uint32_t len;
+    void *data;
+    uint8_t copy[0];
+} EVENT_ASYNC_T;
+
 static EVENT_MANAGE_T g_event_manager = {0};
 
+static uint32_t _event_name_hash(const char *name)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+
+    while (*name) {
+        hash ^= (uint8_t)(*name++);
+        hash *= 16777619u;
+    }
+
+    return hash;
+}
+
+// must be called with event mutex locked
+static OPERATE_RET _event_snapshot_rebuild(EVENT_NODE_T *event)
+{
+    struct tuya_list_head *pos = NULL;
+    SUBSCRIBE_NODE_T *entry = NULL;
+    SUBSCRIBE_SNAPSHOT_T *snapshot = NULL;
+    SUBSCRIBE_SNAPSHOT_T *old = event->snapshot;
+    int cnt = 0;
+
+    tuya_list_for_each(pos, &event->subscribe_root)
+    {
+        cnt++;
+    }
+
+    snapshot = tal_malloc(sizeof(SUBSCRIBE_SNAPSHOT_T) + cnt * sizeof(SUBSCRIBE_ENTRY_T));
+    TUYA_CHECK_NULL_RETURN(snapshot, OPRT_MALLOC_FAILED);
+    snapshot->ref = 1;
+    snapshot->cnt = 0;
+    tuya_list_for_each(pos, &event->subscribe_root)
+    {
+        entry = tuya_list_entry(pos, SUBSCRIBE_NODE_T, node);
+        snapshot->entry[snapshot->cnt].cb = entry->cb;
+        snapshot->entry[snapshot->cnt].type = entry->type;
+        snapshot->entry[snapshot->cnt].id = entry->id;
+        snapshot->cnt++;
+    }
+
+    event->snapshot = snapshot;
+    if (old && (0 == --old->ref)) {
+        tal_free(old);
+    }
+
+    return OPRT_OK;
+}
+
 BOOL_T _event_name_is_valid(const char *name)
 {
     if (!name) {
@@ -62,21 +133,48 @@ BOOL_T _event_desc_is_valid(const char *desc)
     return TRUE;
 }
 
+EVENT_NODE_T *_event_node_lookup(const char *name, uint32_t hash)
+{
+    EVENT_NODE_T *entry = g_event_manager.hash_tbl[hash & (EVENT_HASH_BUCKET_NUM - 1)];
+
+    for (; entry; entry = entry->hash_next) {
+        if ((entry->hash == hash) && (0 == strcmp(entry->name, name))) {
+            return entry;
+        }
+    }
+
+    return NULL;
+}
+
 EVENT_NODE_T *_event_node_create_init(const char *name)
 {
+    uint32_t hash = _event_name_hash(name);
+    EVENT_NODE_T *event = NULL;
+
+    tal_mutex_lock(g_event_manager.mutex);
+
+    // someone else may have created it before we got the lock
+    event = _event_node_lookup(name, hash);
+    if (event) {
+        tal_mutex_unlock(g_event_manager.mutex);
+        return event;
+    }
+
     // allocate memory
-    EVENT_NODE_T *event = tal_malloc(sizeof(EVENT_NODE_T));
-    TUYA_CHECK_NULL_RETURN(event, NULL);
+    event = tal_malloc(sizeof(EVENT_NODE_T));
+    if (NULL == event) {
+        tal_mutex_unlock(g_event_manager.mutex);
+        return NULL;
+    }
     memset(event, 0, sizeof(EVENT_NODE_T));
 
     // initialze the event node
     memcpy(event->name, name, strlen(name));
     event->name[strlen(name)] = '\0';
+    event->hash = hash;
     INIT_LIST_HEAD(&event->subscribe_root);
     tal_mutex_create_init(&event->mutex);
 
-    tal_mutex_lock(g_event_manager.mutex);
-
     // need check if there have free subscriber which subscribe this event
     struct tuya_list_head *free_pos = NULL;
     struct tuya_list_head *free_next = NULL;
@@ -98,8 +196,18 @@ EVENT_NODE_T *_event_node_create_init(const char *name)
         }
     }
 
-    // at last, need add this event to event manage root
+    if (OPRT_OK != _event_snapshot_rebuild(event)) {
+        tal_mutex_unlock(g_event_manager.mutex);
+        tal_mutex_release(event->mutex);
+        tal_free(event);
+        return NULL;
+    }
+
+    // at last, need add this event to event manage root and lookup table
     tuya_list_add_tail(&event->node, &g_event_manager.event_root);
+    event->hash_next = g_event_manager.hash_tbl[hash & (EVENT_HASH_BUCKET_NUM - 1)];
+    EVENT_MEMORY_BARRIER();
+    g_event_manager.hash_tbl[hash & (EVENT_HASH_BUCKET_NUM - 1)] = event;
     g_event_manager.event_cnt++;
 
     tal_mutex_unlock(g_event_manager.mutex);
@@ -109,19 +217,8 @@ EVENT_NODE_T *_event_node_create_init(const char *name)
 
 EVENT_NODE_T *_event_node_get(const char *name)
 {
-    // try to get event from event root
-    EVENT_NODE_T *entry = NULL;
-    struct tuya_list_head *pos = NULL;
-    tuya_list_for_each(pos, &g_event_manager.event_root)
-    {
-        // find by name
-        entry = tuya_list_entry(pos, EVENT_NODE_T, node);
-        if (0 == strcmp(entry->name, name)) {
-            return entry;
-        }
-    }
-
-    return NULL;
+    // event node is never freed, the lookup table is safe to read without lock
+    return _event_node_lookup(name, _event_name_hash(name));
 }
 
 SUBSCRIBE_NODE_T *_event_node_get_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
@@ -157,29 +254,65 @@ SUBSCRIBE_NODE_T *_event_node_get_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_
     return NULL;
 }
 
+// take the one-time subscriber off the list, only the publisher which removed it calls it
+BOOL_T _event_node_take_onetime(EVENT_NODE_T *event, uint32_t id)
+{
+    struct tuya_list_head *pos = NULL;
+    SUBSCRIBE_NODE_T *subscribe = NULL;
+    BOOL_T found = FALSE;
+
+    tal_mutex_lock(event->mutex);
+    tuya_list_for_each(pos, &event->subscribe_root)
+    {
+        subscribe = tuya_list_entry(pos, SUBSCRIBE_NODE_T, node);
+        if (subscribe->id == id) {
+            found = TRUE;
+            break;
+        }
+    }
+
+    if (found) {
+        tuya_list_del(&subscribe->node);
+        tal_free(subscribe);
+        _event_snapshot_rebuild(event);
+    }
+    tal_mutex_unlock(event->mutex);
+
+    return found;
+}
+
 OPERATE_RET _event_node_dispatch(EVENT_NODE_T *event, void *data)
 {
     OPERATE_RET rt = OPRT_OK;
+    SUBSCRIBE_SNAPSHOT_T *snapshot = NULL;
+    SUBSCRIBE_ENTRY_T *entry = NULL;
+    int i = 0;
+
+    // the mutex only guards taking the reference, callbacks run without it
+    tal_mutex_lock(event->mutex);
+    snapshot = event->snapshot;
+    snapshot->ref++;
+    tal_mutex_unlock(event->mutex);
 
     // dispatch in order
-    struct tuya_list_head *p = NULL;
-    struct tuya_list_head *n = NULL;
-    SUBSCRIBE_NODE_T *entry = NULL;
-    tuya_list_for_each_safe(p, n, &event->subscribe_root)
-    {
-        // find and call cb one by one
-        entry = tuya_list_entry(p, SUBSCRIBE_NODE_T, node);
+    for (i = 0; i < snapshot->cnt; i++) {
+        entry = &snapshot->entry[i];
+
+        // one-time event should be removed when dispatch
+        if ((entry->type == SUBSCRIBE_TYPE_ONETIME) && !_event_node_take_onetime(event, entry->id)) {
+            continue;
+        }
+
         if (entry->cb) {
             TUYA_CALL_ERR_LOG(entry->cb(data));
         }
+    }
 
-        // one-time event should be removed after dispatch
-        if (entry->type == SUBSCRIBE_TYPE_ONETIME) {
-            tuya_list_del(&entry->node);
-            tal_free(entry);
-            entry = NULL;
-        }
+    tal_mutex_lock(event->mutex);
+    if (0 == --snapshot->ref) {
+        tal_free(snapshot);
     }
+    tal_mutex_unlock(event->mutex);
 
     return rt;
 }
@@ -198,6 +331,7 @@ OPERATE_RET _event_node_add_free_subscribe(SUBSCRIBE_NODE_T *subscribe)
     new_entry = (SUBSCRIBE_NODE_T *)tal_malloc(sizeof(SUBSCRIBE_NODE_T));
     TUYA_CHECK_NULL_RETURN(new_entry, OPRT_MALLOC_FAILED);
     memcpy(new_entry, subscribe, sizeof(SUBSCRIBE_NODE_T));
+    new_entry->id = __sync_add_and_fetch(&g_event_manager.subscribe_id, 1);
 
     tuya_list_add_tail(&new_entry->node, &g_event_manager.free_subscribe_root);
     return rt;
@@ -217,6 +351,7 @@ OPERATE_RET _event_node_add_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *sub
     new_entry = (SUBSCRIBE_NODE_T *)tal_malloc(sizeof(SUBSCRIBE_NODE_T));
     TUYA_CHECK_NULL_RETURN(new_entry, OPRT_MALLOC_FAILED);
     memcpy(new_entry, subscribe, sizeof(SUBSCRIBE_NODE_T));
+    new_entry->id = __sync_add_and_fetch(&g_event_manager.subscribe_id, 1);
 
     // try to add, if emergence, add to first, otherwise, add to tail
     if (subscribe->type == SUBSCRIBE_TYPE_EMERGENCY) {
@@ -225,6 +360,12 @@ OPERATE_RET _event_node_add_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *sub
         tuya_list_add_tail(&new_entry->node, &event->subscribe_root);
     }
 
+    rt = _event_snapshot_rebuild(event);
+    if (OPRT_OK != rt) {
+        tuya_list_del(&new_entry->node);
+        tal_free(new_entry);
+    }
+
     return rt;
 }
 
@@ -259,6 +400,10 @@ OPERATE_RET _event_node_del_subscribe(EVENT_NODE_T *event, SUBSCRIBE_NODE_T *sub
     tuya_list_del(&new_entry->node);
     tal_free(new_entry);
     new_entry = NULL;
+
+    // stale snapshot still holds the removed subscriber if this fails
+    TUYA_CALL_ERR_LOG(_event_snapshot_rebuild(event));
+
     return rt;
 }
 
@@ -382,14 +527,110 @@ OPERATE_RET tal_event_publish(const char *name, void *data)
         TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
     }
 
-    // to keep the consistency, dispatch will done in mutex lock
-    tal_mutex_lock(event->mutex);
     // try to dispatch event to all subscribe
     // if one of the subscribe failed, it will continue but will return failed
     // to record the execute status
     TUYA_CALL_ERR_LOG(_event_node_dispatch(event, data));
 
-    tal_mutex_unlock(event->mutex);
+    return rt;
+}
+
+/**
+ * @brief Gets the interned id of an event.
+ *
+ * The event node is created if it does not exist yet. The id stays valid for
+ * the whole life of the system, so it can be looked up once and then used
+ * with tal_event_publish_id to skip the name hashing and comparison.
+ *
+ * @param[in] name The name of the event.
+ * @param[out] id The interned event id.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_id_get(const char *name, EVENT_ID *id)
+{
+    if (g_event_manager.inited != TRUE) {
+        tal_event_init();
+    }
+
+    if (!_event_name_is_valid(name)) {
+        return OPRT_BASE_EVENT_INVALID_EVENT_NAME;
+    }
+
+    TUYA_CHECK_NULL_RETURN(id, OPRT_INVALID_PARM);
+
+    EVENT_NODE_T *event = _event_node_get(name);
+    if (!event) {
+        event = _event_node_create_init(name);
+        TUYA_CHECK_NULL_RETURN(event, OPRT_MALLOC_FAILED);
+    }
+
+    *id = event;
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Publishes an event by its interned id.
+ *
+ * @param[in] id The event id got from tal_event_id_get.
+ * @param[in] data The data associated with the event.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_publish_id(EVENT_ID id, void *data)
+{
+    TUYA_CHECK_NULL_RETURN(id, OPRT_INVALID_PARM);
+
+    OPERATE_RET rt = OPRT_OK;
+    TUYA_CALL_ERR_LOG(_event_node_dispatch((EVENT_NODE_T *)id, data));
+
+    return rt;
+}
+
+static void _event_async_cb(void *data)
+{
+    EVENT_ASYNC_T *async = (EVENT_ASYNC_T *)data;
+
+    _event_node_dispatch(async->event, async->data);
+    tal_free(async);
+}
+
+/**
+ * @brief Publishes an event asynchronously.
+ *
+ * The event is dispatched later in the system workqueue, so a slow subscriber
+ * cannot block the publisher. If len is not 0, the data is copied and the copy
+ * is delivered to the subscribers, otherwise the data pointer is delivered as
+ * is and must stay valid until dispatched.
+ *
+ * @param[in] name The name of the event to publish.
+ * @param[in] data The data associated with the event.
+ * @param[in] len The length of data to copy, 0 means no copy.
+ * @return The operation result. Returns OPRT_OK on success, or an error code on
+ * failure.
+ */
+OPERATE_RET tal_event_publish_async(const char *name, void *data, uint32_t len)
+{
+    OPERATE_RET rt = OPRT_OK;
+    EVENT_ID id = NULL;
+
+    TUYA_CALL_ERR_RETURN(tal_event_id_get(name, &id));
+
+    EVENT_ASYNC_T *async = tal_malloc(sizeof(EVENT_ASYNC_T) + len);
+    TUYA_CHECK_NULL_RETURN(async, OPRT_MALLOC_FAILED);
+    async->event = (EVENT_NODE_T *)id;
+    async->len = len;
+    async->data = data;
+    if (len && data) {
+        memcpy(async->copy, data, len);
+        async->data = async->copy;
+    }
+
+    rt = tal_workq_schedule(WORKQ_SYSTEM, _event_async_cb, async);
+    if (OPRT_OK != rt) {
+        tal_free(async);
+    }
 
     return rt;
 }
@@ -432,13 +673,19 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
     memcpy(subscribe.desc, desc, strlen(desc));
     subscribe.desc[strlen(desc)] = '\0';
 
+    // check again with the manager mutex, the event may be created meanwhile
     EVENT_NODE_T *event = _event_node_get(name);
     if (!event) {
-        // if not found the event, add to the free list
         tal_mutex_lock(g_event_manager.mutex);
-        TUYA_CALL_ERR_LOG(_event_node_add_free_subscribe(&subscribe));
+        event = _event_node_get(name);
+        if (!event) {
+            // if not found the event, add to the free list
+            TUYA_CALL_ERR_LOG(_event_node_add_free_subscribe(&subscribe));
+        }
         tal_mutex_unlock(g_event_manager.mutex);
-    } else {
+    }
+
+    if (event) {
         // if found the event, add to the subscribe list
         tal_mutex_lock(event->mutex);
         TUYA_CALL_ERR_LOG(_event_node_add_subscribe(event, &subscribe));
@@ -457,6 +704,8 @@ OPERATE_RET tal_event_subscribe(const char *name, const char *desc, const EVENT_
  * description and name are valid before proceeding with the unsubscribe
  * operation. If the event is found, it is removed from the subscribe list. If
  * the event is not found, the subscription is removed from the free list.
+ * A publish which already took its snapshot of the subscribers may still call
+ * the callback once after this function returns.
  *
  * @param[in] name The name of the event to unsubscribe from.
  * @param[in] desc The description of the event to unsubscribe from.
@@ -13,6 +13,10 @@
  * - Configurable log levels ranging from debug to critical errors.
  * - Support for multiple log output destinations through callback registration.
  * - Thread-safe log message output using mutexes.
+ * - Optional deferred output, log calls only format into a lock-free ring
+ *   buffer which is drained by a background writer thread.
+ * - Binary log records holding only the log site and the raw arguments, the
+ *   text is rebuilt on the host by tools/log_decode.py.
  * - Integration with Tuya's IoT SDK for memory management and system utilities.
  *
  * The logging system is implemented using a linked list to manage output
@@ -35,6 +39,8 @@
 #include "tal_log.h"
 #include "tuya_list.h"
 #include "tal_mutex.h"
+#include "tal_semaphore.h"
+#include "tal_thread.h"
 #include "tal_system.h"
 #include "tal_time_service.h"
 #include "tal_memory.h"
@@ -45,6 +51,84 @@
 #define LOG_LEVEL_MIN 0
 #define LOG_LEVEL_MAX 5
 
+#if defined(ENABLE_LOG_ASYNC) && (ENABLE_LOG_ASYNC == 1)
+#define LOG_ASYNC_SUPPORT 1
+#else
+#define LOG_ASYNC_SUPPORT 0
+#endif
+
+#ifndef LOG_ASYNC_BUF_SIZE
+#define LOG_ASYNC_BUF_SIZE 8192
+#endif
+
+#ifndef STACK_SIZE_LOG_ASYNC
+#define STACK_SIZE_LOG_ASYNC 3072
+#endif
+
+// color + time + module + file:line
+#define LOG_PREFIX_MAX 128
+
+#define LOG_BIN_MAGIC     0xB1
+#define LOG_BIN_TRUNC     0x80 // level flag, arguments did not fit
+#define LOG_BIN_REC_MAX   192
+#define LOG_BIN_STR_MAX   0xFF
+#define LOG_BIN_LINE_HEAD "!B:"
+
+/**
+ * @brief binary log record header, followed by the arguments in native byte order
+ */
+typedef struct {
+    uint8_t magic;
+    uint8_t level;
+    uint16_t len; // whole record
+    uint32_t time_ms;
+    int32_t site; // offset to tal_log_site_base
+} LOG_BIN_HDR_T;
+
+#if LOG_ASYNC_SUPPORT
+#define LOG_MEMORY_BARRIER() __sync_synchronize()
+
+#define LOG_REC_ALIGN      8
+#define LOG_REC_SIZE(len)  ((sizeof(LOG_REC_HDR_T) + (len) + LOG_REC_ALIGN - 1) & ~(LOG_REC_ALIGN - 1))
+#define LOG_REC_FLAG_PAD   0x01 // skip to the ring buffer end
+#define LOG_REC_FLAG_BIN   0x02 // binary log record
+#define LOG_REC_LEN_MAX    0xFFFF
+#define LOG_ASYNC_BUF_MAX  0x10000
+#define LOG_ASYNC_IDLE_MS  1000
+#define LOG_ASYNC_RETRY_MS 10
+
+/**
+ * @brief record header in the ring buffer, the payload is a '\0' terminated string
+ *
+ * seq is written last with the inverted start position, so the writer can tell a
+ * committed record from a reserved one and from stale data of the previous lap.
+ */
+typedef struct {
+    volatile uint32_t seq;
+    uint16_t len;
+    uint8_t flag;
+    uint8_t resv;
+} LOG_REC_HDR_T;
+
+/**
+ * @brief multi-producer single-consumer ring buffer of log records
+ *
+ * Producers reserve space by cas on head, the consumer is whoever holds the
+ * log mutex, which is the writer thread or tal_log_async_flush.
+ */
+typedef struct {
+    uint8_t *buf;
+    uint32_t size;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    volatile uint32_t writer_idle;
+    uint32_t drop_reported;
+    SEM_HANDLE sem;
+    THREAD_HANDLE thread;
+    TAL_LOG_ASYNC_STAT_T stat;
+} LOG_ASYNC_T;
+#endif
+
 typedef struct {
     LIST_HEAD node;
     char *name;
@@ -73,6 +157,12 @@ typedef struct {
     int log_buf_len;
     BOOL_T ms_level;
     char *log_buf;
+    TAL_LOG_BIN_OUTPUT_CB bin_output;
+
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *volatile async;
+    volatile uint32_t async_users;
+#endif
 } LOG_MANAGE, *P_LOG_MANAGE;
 
 #define DEF_OUTPUT_NAME "def_output"
@@ -83,6 +173,9 @@ typedef struct {
 const char *sLevelStr[] = {"E", "W", "N", "I", "D", "T"};
 P_LOG_MANAGE pLogManage = NULL;
 
+// binary log sites are identified by the offset to this one
+const TAL_LOG_SITE_T tal_log_site_base = {TAL_LOG_SITE_MAGIC, 0, __FILE__, "tal log site base"};
+
 const LOG_TEXT_STYLE_S sDefaultStyle[LOG_LEVEL_MAX + 1] = {
     {TAL_LOG_DISPLAY_MODE_DEFAULT, TAL_LOG_FONT_COLOR_RED, TAL_LOG_BACKGROUND_COLOR_DEFAULT},
     {TAL_LOG_DISPLAY_MODE_DEFAULT, TAL_LOG_FONT_COLOR_YELLOW, TAL_LOG_BACKGROUND_COLOR_DEFAULT},
@@ -134,6 +227,11 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
         INIT_LIST_HEAD(&(tmp_log_mng->log_list));
         tmp_log_mng->curLogLevel = level;
         tmp_log_mng->ms_level = FALSE;
+        tmp_log_mng->bin_output = NULL;
+#if LOG_ASYNC_SUPPORT
+        tmp_log_mng->async = NULL;
+        tmp_log_mng->async_users = 0;
+#endif
         pLogManage = tmp_log_mng;
 
         // set default log style
@@ -146,6 +244,11 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
             tal_free(tmp_log_mng);
             return op_ret;
         }
+
+#if LOG_ASYNC_SUPPORT
+        // falls back to synchronous output on failure
+        tal_log_async_start(0);
+#endif
     } else {
         pLogManage->curLogLevel = level;
     }
@@ -153,7 +256,7 @@ OPERATE_RET tal_log_init(const TAL_LOG_LEVEL_E level, const int buf_len, const T
     return OPRT_OK;
 }
 
-void __output_logManage_buf(void)
+static void __output_logManage_str(const char *str)
 {
     P_LIST_HEAD pPos;
     LOG_OUT_NODE_S *output_node;
@@ -161,10 +264,242 @@ void __output_logManage_buf(void)
     {
         output_node = tuya_list_entry(pPos, LOG_OUT_NODE_S, node);
         if (output_node->out_term) {
-            output_node->out_term(pLogManage->log_buf);
+            output_node->out_term(str);
+        }
+    }
+}
+
+void __output_logManage_buf(void)
+{
+    __output_logManage_str(pLogManage->log_buf);
+}
+
+/**
+ * @brief output one binary record, called with the log mutex held
+ */
+static void __output_logManage_bin(const uint8_t *data, uint32_t len)
+{
+    static const char base64_tbl[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+    uint32_t i = 0, val = 0;
+    int pos = 0;
+
+    if (pLogManage->bin_output) {
+        pLogManage->bin_output(data, len);
+        return;
+    }
+
+    // "!B:" + base64 + "\r\n" keeps the text terminals usable
+    if ((int)(sizeof(LOG_BIN_LINE_HEAD) + (len + 2) / 3 * 4 + 2) > pLogManage->log_buf_len) {
+        return;
+    }
+    memcpy(pLogManage->log_buf, LOG_BIN_LINE_HEAD, sizeof(LOG_BIN_LINE_HEAD) - 1);
+    pos = sizeof(LOG_BIN_LINE_HEAD) - 1;
+    for (i = 0; i < len; i += 3) {
+        val = (uint32_t)data[i] << 16;
+        val |= (i + 1 < len) ? (uint32_t)data[i + 1] << 8 : 0;
+        val |= (i + 2 < len) ? (uint32_t)data[i + 2] : 0;
+        pLogManage->log_buf[pos++] = base64_tbl[(val >> 18) & 0x3F];
+        pLogManage->log_buf[pos++] = base64_tbl[(val >> 12) & 0x3F];
+        pLogManage->log_buf[pos++] = (i + 1 < len) ? base64_tbl[(val >> 6) & 0x3F] : '=';
+        pLogManage->log_buf[pos++] = (i + 2 < len) ? base64_tbl[val & 0x3F] : '=';
+    }
+    pLogManage->log_buf[pos++] = '\r';
+    pLogManage->log_buf[pos++] = '\n';
+    pLogManage->log_buf[pos] = '\0';
+    __output_logManage_buf();
+}
+
+#if LOG_ASYNC_SUPPORT
+static char *__log_ring_reserve(LOG_ASYNC_T *async, uint32_t len, uint8_t flag, uint32_t *pos)
+{
+    LOG_REC_HDR_T *hdr = NULL;
+    uint32_t need = LOG_REC_SIZE(len);
+    uint32_t head, tail, off, total, used;
+
+    do {
+        head = async->head;
+        tail = async->tail;
+        off = head & (async->size - 1);
+        total = need;
+        // a record never wraps, the rest of the ring is skipped by a pad record
+        if (off + need > async->size) {
+            total += async->size - off;
+        }
+        used = head + total - tail;
+        if (used > async->size) {
+            __sync_add_and_fetch(&async->stat.drop_cnt, 1);
+            return NULL;
+        }
+    } while (!__sync_bool_compare_and_swap(&async->head, head, head + total));
+
+    if (used > async->stat.max_used) {
+        async->stat.max_used = used;
+    }
+
+    if (total != need) {
+        hdr = (LOG_REC_HDR_T *)(async->buf + off);
+        hdr->len = async->size - off - sizeof(LOG_REC_HDR_T);
+        hdr->flag = LOG_REC_FLAG_PAD;
+        LOG_MEMORY_BARRIER();
+        hdr->seq = ~head;
+        head += async->size - off;
+    }
+
+    hdr = (LOG_REC_HDR_T *)(async->buf + (head & (async->size - 1)));
+    hdr->len = len;
+    hdr->flag = flag;
+    *pos = head;
+
+    return (char *)(hdr + 1);
+}
+
+static void __log_ring_commit(LOG_ASYNC_T *async, char *rec, uint32_t pos)
+{
+    LOG_REC_HDR_T *hdr = (LOG_REC_HDR_T *)rec - 1;
+
+    LOG_MEMORY_BARRIER();
+    hdr->seq = ~pos;
+    LOG_MEMORY_BARRIER();
+
+    // only the first producer after the writer went idle wakes it up
+    if (async->writer_idle && __sync_bool_compare_and_swap(&async->writer_idle, 1, 0)) {
+        tal_semaphore_post(async->sem);
+    }
+}
+
+/**
+ * @brief output the committed records, called with the log mutex held
+ *
+ * @return the number of records consumed
+ */
+static uint32_t __log_ring_drain(LOG_ASYNC_T *async)
+{
+    LOG_REC_HDR_T *hdr = NULL;
+    uint32_t tail = 0;
+    uint32_t cnt = 0;
+
+    while ((tail = async->tail) != async->head) {
+        hdr = (LOG_REC_HDR_T *)(async->buf + (tail & (async->size - 1)));
+        if (hdr->seq != ~tail) {
+            break; // reserved but not committed yet, keep the order
+        }
+        LOG_MEMORY_BARRIER();
+        if (hdr->flag & LOG_REC_FLAG_BIN) {
+            __output_logManage_bin((const uint8_t *)(hdr + 1), hdr->len);
+            async->stat.write_cnt++;
+        } else if (!(hdr->flag & LOG_REC_FLAG_PAD)) {
+            __output_logManage_str((const char *)(hdr + 1));
+            async->stat.write_cnt++;
+        }
+        cnt++;
+        LOG_MEMORY_BARRIER();
+        async->tail = tail + LOG_REC_SIZE(hdr->len);
+    }
+
+    if (async->drop_reported != async->stat.drop_cnt) {
+        char drop_info[64];
+        uint32_t drop_cnt = async->stat.drop_cnt;
+
+        snprintf(drop_info, sizeof(drop_info), "[log] %" PRIu32 " records dropped\r\n",
+                 drop_cnt - async->drop_reported);
+        async->drop_reported = drop_cnt;
+        __output_logManage_str(drop_info);
+    }
+
+    return cnt;
+}
+
+static OPERATE_RET __log_async_vpush(LOG_ASYNC_T *async, const char *prefix, int prefix_len, const char *suffix,
+                                     const char *pFmt, va_list ap)
+{
+    va_list cp;
+    int body_len = 0;
+    int suffix_len = strlen(suffix);
+    int max_len = pLogManage->log_buf_len - 1; // 1 -> "\0"
+    uint32_t pos = 0;
+    char *rec = NULL;
+
+    // measure first so the message is formatted right into its record
+    va_copy(cp, ap);
+    body_len = vsnprintf(NULL, 0, pFmt, cp);
+    va_end(cp);
+    if (body_len < 0) {
+        return OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+    }
+    if (max_len > LOG_REC_LEN_MAX - 1) {
+        max_len = LOG_REC_LEN_MAX - 1;
+    }
+    if (prefix_len + body_len + suffix_len > max_len) {
+        body_len = max_len - prefix_len - suffix_len;
+        if (body_len < 0) {
+            return OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+        }
+    }
+
+    rec = __log_ring_reserve(async, prefix_len + body_len + suffix_len + 1, 0, &pos);
+    if (NULL == rec) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+    memcpy(rec, prefix, prefix_len);
+    vsnprintf(rec + prefix_len, body_len + 1, pFmt, ap);
+    memcpy(rec + prefix_len + body_len, suffix, suffix_len + 1);
+    __log_ring_commit(async, rec, pos);
+
+    return OPRT_OK;
+}
+
+static LOG_ASYNC_T *__log_async_get(void)
+{
+    LOG_ASYNC_T *async = NULL;
+
+    if (NULL == pLogManage->async) {
+        return NULL;
+    }
+
+    // holds off tal_log_async_stop from freeing the ring under us
+    __sync_add_and_fetch(&pLogManage->async_users, 1);
+    async = pLogManage->async;
+    if (NULL == async) {
+        __sync_sub_and_fetch(&pLogManage->async_users, 1);
+    }
+
+    return async;
+}
+
+static void __log_async_put(void)
+{
+    __sync_sub_and_fetch(&pLogManage->async_users, 1);
+}
+
+static void __log_async_thread(void *args)
+{
+    LOG_ASYNC_T *async = (LOG_ASYNC_T *)args;
+    uint32_t cnt = 0;
+
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(async->thread)) {
+        tal_mutex_lock(pLogManage->mutex);
+        cnt = __log_ring_drain(async);
+        tal_mutex_unlock(pLogManage->mutex);
+        if (cnt) {
+            continue;
+        }
+
+        async->writer_idle = 1;
+        LOG_MEMORY_BARRIER();
+        if (async->tail == async->head) {
+            tal_semaphore_wait(async->sem, LOG_ASYNC_IDLE_MS);
+        } else {
+            // a producer is still writing its record
+            tal_semaphore_wait(async->sem, LOG_ASYNC_RETRY_MS);
         }
+        async->writer_idle = 0;
     }
+
+    tal_mutex_lock(pLogManage->mutex);
+    __log_ring_drain(async);
+    tal_mutex_unlock(pLogManage->mutex);
 }
+#endif
 
 OPERATE_RET __find_out_term_node(const char *name, LOG_OUT_NODE_S **node)
 {
@@ -336,6 +671,51 @@ OPERATE_RET tal_log_get_level(TAL_LOG_LEVEL_E *level)
     return OPRT_OK;
 }
 
+static int __log_prefix_format(char *buf, int buf_len, LOG_LEVEL logLevel, const char *pFilename, uint32_t line)
+{
+    const char *pTmpModuleName = "ty";
+    int len = 0;
+    int cnt = 0;
+
+    // color prefix
+    if (pLogManage->log_color.enable_color) {
+        cnt = snprintf(buf, buf_len, "\033[%d;%d;%dm", pLogManage->log_color.style[logLevel].display_mode,
+                       pLogManage->log_color.style[logLevel].font_color,
+                       pLogManage->log_color.style[logLevel].background_color);
+        if (cnt <= 0) {
+            return -1;
+        }
+        len += cnt;
+    }
+
+    POSIX_TM_S tm;
+    memset(&tm, 0, sizeof(tm));
+
+    if (pLogManage->ms_level == FALSE) {
+        tal_time_get_local_time_custom(0, &tm);
+        cnt = snprintf(buf + len, buf_len - len, "[%02d-%02d %02d:%02d:%02d %s %s][%s:%" PRIu32 "] ", tm.tm_mon + 1,
+                       tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, pTmpModuleName, sLevelStr[logLevel], pFilename,
+                       line);
+    } else {
+        SYS_TICK_T time_ms = tal_time_get_posix_ms();
+        TIME_T sec = (TIME_T)(time_ms / 1000);
+        uint32_t ms = (uint32_t)(time_ms % 1000);
+        tal_time_get_local_time_custom(sec, &tm);
+        cnt = snprintf(buf + len, buf_len - len, "[%02d-%02d %02d:%02d:%02d:%" PRIu32 " %s %s][%s:%" PRIu32 "] ",
+                       tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec, ms, pTmpModuleName,
+                       sLevelStr[logLevel], pFilename, line);
+    }
+    if (cnt <= 0) {
+        return -1;
+    }
+    len += cnt;
+    if (len > buf_len - 1) {
+        len = buf_len - 1;
+    }
+
+    return len;
+}
+
 /**
  * @brief Prints a log message with the specified log level, file name, line
  * number, and format string.
@@ -378,7 +758,6 @@ OPERATE_RET PrintLogV(LOG_LEVEL logLevel, char *pFile, uint32_t line, const char
     if (logLevel > tmpLogLevel) {
         return OPRT_BASE_LOG_MNG_PRINT_LOG_LEVEL_HIGHER;
     }
-    const char *pTmpModuleName = "ty";
     const char *pTmpFilename = NULL;
 
     if (NULL == pFile) {
@@ -396,37 +775,27 @@ OPERATE_RET PrintLogV(LOG_LEVEL logLevel, char *pFile, uint32_t line, const char
             pTmpFilename = pFile + pos + 1;
         }
     }
-    tal_mutex_lock(pLogManage->mutex);
 
-    // color prefix
-    if (pLogManage->log_color.enable_color) {
-        cnt = snprintf(pLogManage->log_buf, pLogManage->log_buf_len, "\033[%d;%d;%dm",
-                       pLogManage->log_color.style[logLevel].display_mode,
-                       pLogManage->log_color.style[logLevel].font_color,
-                       pLogManage->log_color.style[logLevel].background_color);
-        if (cnt <= 0) {
-            goto ERR_EXIT;
+    char *p_suffix = (pLogManage->log_color.enable_color) ? "\033[0m\r\n" : "\r\n";
+
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = __log_async_get();
+    if (async) {
+        char prefix[LOG_PREFIX_MAX];
+        OPERATE_RET op_ret = OPRT_BASE_LOG_MNG_FORMAT_STRING_FAILED;
+
+        cnt = __log_prefix_format(prefix, sizeof(prefix), logLevel, pTmpFilename, line);
+        if (cnt > 0) {
+            op_ret = __log_async_vpush(async, prefix, cnt, p_suffix, pFmt, ap);
         }
-        len += cnt;
+        __log_async_put();
+        return op_ret;
     }
+#endif
 
-    POSIX_TM_S tm;
-    memset(&tm, 0, sizeof(tm));
+    tal_mutex_lock(pLogManage->mutex);
 
-    if (pLogManage->ms_level == FALSE) {
-        tal_time_get_local_time_custom(0, &tm);
-        cnt = snprintf(pLogManage->log_buf + len, pLogManage->log_buf_len - len,
-                       "[%02d-%02d %02d:%02d:%02d %s %s][%s:%" PRIu32 "] ", tm.tm_mon + 1, tm.tm_mday, tm.tm_hour,
-                       tm.tm_min, tm.tm_sec, pTmpModuleName, sLevelStr[logLevel], pTmpFilename, line);
-    } else {
-        SYS_TICK_T time_ms = tal_time_get_posix_ms();
-        TIME_T sec = (TIME_T)(time_ms / 1000);
-        uint32_t ms = (uint32_t)(time_ms % 1000);
-        tal_time_get_local_time_custom(sec, &tm);
-        cnt = snprintf(pLogManage->log_buf + len, pLogManage->log_buf_len - len,
-                       "[%02d-%02d %02d:%02d:%02d:%" PRIu32 " %s %s][%s:%" PRIu32 "] ", tm.tm_mon + 1, tm.tm_mday,
-                       tm.tm_hour, tm.tm_min, tm.tm_sec, ms, pTmpModuleName, sLevelStr[logLevel], pTmpFilename, line);
-    }
+    cnt = __log_prefix_format(pLogManage->log_buf, pLogManage->log_buf_len, logLevel, pTmpFilename, line);
     if (cnt <= 0) {
         goto ERR_EXIT;
     }
@@ -437,7 +806,6 @@ OPERATE_RET PrintLogV(LOG_LEVEL logLevel, char *pFile, uint32_t line, const char
     }
     len += cnt;
 
-    char *p_suffix = (pLogManage->log_color.enable_color) ? "\033[0m\r\n" : "\r\n";
     if (len > (int)(pLogManage->log_buf_len - strlen(p_suffix) - 1)) { // 1 -> "\0"
         len = pLogManage->log_buf_len - strlen(p_suffix) - 1;
     }
@@ -489,6 +857,258 @@ OPERATE_RET tal_log_print(const TAL_LOG_LEVEL_E level, const char *file, const i
     return opRet;
 }
 
+#define LOG_BIN_PUT(type, value)                                                                                       \
+    do {                                                                                                               \
+        type __v = (type)(value);                                                                                      \
+        if (len + sizeof(type) > size) {                                                                               \
+            *trunc = TRUE;                                                                                             \
+            return len;                                                                                                \
+        }                                                                                                              \
+        memcpy(buf + len, &__v, sizeof(type));                                                                         \
+        len += sizeof(type);                                                                                           \
+    } while (0)
+
+/**
+ * @brief store the arguments of fmt as they are, in the order of the conversions
+ *
+ * Integers take the size of their C type, floats are stored as double and strings
+ * as one length byte followed by the characters, at most the precision of the
+ * conversion. The decoder walks the same fmt. A string that does not fit is cut
+ * to the room left, the arguments after one that does not fit are left out.
+ *
+ * @return the encoded length, trunc is set if anything was cut or left out
+ */
+static int __log_bin_args_encode(uint8_t *buf, uint32_t size, const char *fmt, va_list ap, BOOL_T *trunc)
+{
+    const char *p = fmt;
+    uint32_t len = 0;
+    uint8_t lm = 0; // length modifier, 'H' hh, 'q' ll
+    int prec = -1;  // -1 no precision
+
+    while (*p) {
+        if (*p++ != '%') {
+            continue;
+        }
+        if (*p == '%') {
+            p++;
+            continue;
+        }
+        while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') {
+            p++;
+        }
+        if (*p == '*') {
+            LOG_BIN_PUT(int32_t, va_arg(ap, int));
+            p++;
+        }
+        while (isdigit((int)*p)) {
+            p++;
+        }
+        prec = -1;
+        if (*p == '.') {
+            p++;
+            prec = 0;
+            if (*p == '*') {
+                prec = va_arg(ap, int);
+                LOG_BIN_PUT(int32_t, prec);
+                prec = (prec < 0) ? -1 : prec; // a negative precision is taken as omitted
+                p++;
+            }
+            while (isdigit((int)*p)) {
+                prec = prec * 10 + (*p - '0');
+                p++;
+            }
+        }
+
+        lm = 0;
+        if (*p == 'h' || *p == 'l') {
+            lm = *p++;
+            if (*p == lm) {
+                lm = (lm == 'l') ? 'q' : 'H';
+                p++;
+            }
+        } else if (*p == 'z' || *p == 'j' || *p == 't' || *p == 'L' || *p == 'q') {
+            lm = *p++;
+        }
+
+        switch (*p) {
+        case 'd':
+        case 'i':
+            if (lm == 'q' || lm == 'j') {
+                LOG_BIN_PUT(int64_t, va_arg(ap, long long));
+            } else if (lm == 'l') {
+                LOG_BIN_PUT(long, va_arg(ap, long));
+            } else if (lm == 'z' || lm == 't') {
+                LOG_BIN_PUT(intptr_t, va_arg(ap, intptr_t));
+            } else {
+                LOG_BIN_PUT(int32_t, va_arg(ap, int));
+            }
+            break;
+        case 'u':
+        case 'o':
+        case 'x':
+        case 'X':
+            if (lm == 'q' || lm == 'j') {
+                LOG_BIN_PUT(uint64_t, va_arg(ap, unsigned long long));
+            } else if (lm == 'l') {
+                LOG_BIN_PUT(unsigned long, va_arg(ap, unsigned long));
+            } else if (lm == 'z' || lm == 't') {
+                LOG_BIN_PUT(uintptr_t, va_arg(ap, uintptr_t));
+            } else {
+                LOG_BIN_PUT(uint32_t, va_arg(ap, unsigned int));
+            }
+            break;
+        case 'c':
+            LOG_BIN_PUT(int32_t, va_arg(ap, int));
+            break;
+        case 'p':
+            LOG_BIN_PUT(uintptr_t, va_arg(ap, void *));
+            break;
+        case 'e':
+        case 'E':
+        case 'f':
+        case 'F':
+        case 'g':
+        case 'G':
+        case 'a':
+        case 'A':
+            if (lm == 'L') {
+                LOG_BIN_PUT(double, va_arg(ap, long double));
+            } else {
+                LOG_BIN_PUT(double, va_arg(ap, double));
+            }
+            break;
+        case 's': {
+            const char *str = va_arg(ap, const char *);
+            uint32_t str_max = LOG_BIN_STR_MAX;
+            uint32_t str_len = 0;
+
+            if (NULL == str) {
+                str = "(null)";
+            }
+            // %.*s spans need not be terminated, never read past the precision
+            if (prec >= 0 && (uint32_t)prec < str_max) {
+                str_max = prec;
+            }
+            while (str_len < str_max && str[str_len]) {
+                str_len++;
+            }
+            if (len + 1 > size) {
+                *trunc = TRUE;
+                return len;
+            }
+            if (len + 1 + str_len > size) {
+                str_len = size - len - 1;
+                *trunc = TRUE;
+            }
+            buf[len++] = (uint8_t)str_len;
+            memcpy(buf + len, str, str_len);
+            len += str_len;
+            break;
+        }
+        case 'n':
+            (void)va_arg(ap, void *);
+            break;
+        default:
+            // unknown conversion, the decoder stops at the same place
+            return len;
+        }
+        p++;
+    }
+
+    return len;
+}
+
+/**
+ * @brief Prints a binary log record of the log site.
+ *
+ * Only the offset of the log site and the raw arguments are recorded, which is
+ * much cheaper than formatting the text. The record is written to the binary
+ * output set by tal_log_bin_output_set, or to the text output terminals as a
+ * base64 line. tools/log_decode.py rebuilds the text from the ELF. Normally it
+ * is called through the PR_BIN_xxx macros, or PR_xxx with ENABLE_LOG_BINARY.
+ *
+ * @param level The log level of the message.
+ * @param site The log site holding file, line and format string.
+ * @param ... The arguments of the format string.
+ * @return The result of the log printing operation.
+ */
+OPERATE_RET tal_log_bin_print(const TAL_LOG_LEVEL_E level, const TAL_LOG_SITE_T *site, ...)
+{
+    uint8_t rec[LOG_BIN_REC_MAX];
+    LOG_BIN_HDR_T *hdr = (LOG_BIN_HDR_T *)rec;
+    BOOL_T trunc = FALSE;
+    va_list ap;
+    int cnt = 0;
+
+    if (!pLogManage || NULL == site) {
+        return OPRT_INVALID_PARM;
+    }
+    if (level < LOG_LEVEL_MIN || level > LOG_LEVEL_MAX) {
+        return OPRT_INVALID_PARM;
+    }
+    if (level > pLogManage->curLogLevel) {
+        return OPRT_BASE_LOG_MNG_PRINT_LOG_LEVEL_HIGHER;
+    }
+
+    hdr->magic = LOG_BIN_MAGIC;
+    hdr->level = level;
+    hdr->time_ms = (uint32_t)tal_system_get_millisecond();
+    hdr->site = (int32_t)((intptr_t)site - (intptr_t)&tal_log_site_base);
+
+    va_start(ap, site);
+    cnt = __log_bin_args_encode(rec + sizeof(LOG_BIN_HDR_T), sizeof(rec) - sizeof(LOG_BIN_HDR_T), site->fmt, ap,
+                                &trunc);
+    va_end(ap);
+    if (trunc) {
+        // the decoder prints what was kept and marks the record
+        hdr->level |= LOG_BIN_TRUNC;
+    }
+    hdr->len = sizeof(LOG_BIN_HDR_T) + cnt;
+
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = __log_async_get();
+    if (async) {
+        OPERATE_RET op_ret = OPRT_EXCEED_UPPER_LIMIT;
+        uint32_t pos = 0;
+        char *data = __log_ring_reserve(async, hdr->len, LOG_REC_FLAG_BIN, &pos);
+
+        if (data) {
+            memcpy(data, rec, hdr->len);
+            __log_ring_commit(async, data, pos);
+            op_ret = OPRT_OK;
+        }
+        __log_async_put();
+        return op_ret;
+    }
+#endif
+
+    tal_mutex_lock(pLogManage->mutex);
+    __output_logManage_bin(rec, hdr->len);
+    tal_mutex_unlock(pLogManage->mutex);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Sets the output of binary log records.
+ *
+ * @param output The binary output function, NULL writes the records to the text
+ * output terminals as base64 lines.
+ * @return OPRT_OK on success, OPRT_INVALID_PARM if the log is not initialized.
+ */
+OPERATE_RET tal_log_bin_output_set(const TAL_LOG_BIN_OUTPUT_CB output)
+{
+    if (!pLogManage) {
+        return OPRT_INVALID_PARM;
+    }
+
+    tal_mutex_lock(pLogManage->mutex);
+    pLogManage->bin_output = output;
+    tal_mutex_unlock(pLogManage->mutex);
+
+    return OPRT_OK;
+}
+
 static OPERATE_RET __PrintLogVRaw(const char *pFmt, va_list ap)
 {
     int cnt = 0;
@@ -522,6 +1142,17 @@ OPERATE_RET tal_log_print_raw(const char *pFmt, ...)
     OPERATE_RET opRet = 0;
     va_list ap;
 
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = __log_async_get();
+    if (async) {
+        va_start(ap, pFmt);
+        opRet = __log_async_vpush(async, "", 0, "", pFmt, ap);
+        va_end(ap);
+        __log_async_put();
+        return opRet;
+    }
+#endif
+
     tal_mutex_lock(pLogManage->mutex);
     va_start(ap, pFmt);
     opRet = __PrintLogVRaw(pFmt, ap);
@@ -545,9 +1176,13 @@ void tal_log_release(void)
         return;
     }
 
+#if LOG_ASYNC_SUPPORT
+    tal_log_async_stop();
+#endif
+
     while (!tuya_list_empty(&(pLogManage->log_list))) {
         LOG_OUT_NODE_S *log_out_nd = NULL;
-        log_out_nd = tuya_list_entry(&(pLogManage->log_list.next), LOG_OUT_NODE_S, node);
+        log_out_nd = tuya_list_entry(pLogManage->log_list.next, LOG_OUT_NODE_S, node);
         tuya_list_del(&(log_out_nd->node));
         if (log_out_nd->name) {
             tal_free(log_out_nd->name);
@@ -694,6 +1329,23 @@ OPERATE_RET tal_log_color_print_raw(TAL_LOG_DISPLAY_MODE_E display_mode, TAL_LOG
         return OPRT_INVALID_PARM;
     }
 
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = __log_async_get();
+    if (async) {
+        char prefix[16] = {0};
+
+        if (pLogManage->log_color.enable_color) {
+            len = snprintf(prefix, sizeof(prefix), "\033[%d;%d;%dm", display_mode, font_color, background_color);
+        }
+        va_start(ap, pFmt);
+        opRet = __log_async_vpush(async, prefix, len, (pLogManage->log_color.enable_color) ? "\033[0m" : "", pFmt,
+                                  ap);
+        va_end(ap);
+        __log_async_put();
+        return opRet;
+    }
+#endif
+
     tal_mutex_lock(pLogManage->mutex);
     va_start(ap, pFmt);
     if (pLogManage->log_color.enable_color) {
@@ -735,3 +1387,172 @@ __EXIT:
 
     return opRet;
 }
+
+/**
+ * @brief Starts asynchronous log output.
+ *
+ * Allocates the ring buffer and creates the writer thread. From then on the log
+ * calls only format the message into the ring buffer, the records are written to
+ * the output terminals by the writer thread in order. When the ring buffer is
+ * full the message is dropped and counted, the writer reports the number of
+ * dropped records.
+ *
+ * @param buf_size The ring buffer size, rounded up to power of 2. 0 means LOG_ASYNC_BUF_SIZE.
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED if ENABLE_LOG_ASYNC is not set,
+ * or an error code if the allocation or thread creation fails.
+ */
+OPERATE_RET tal_log_async_start(uint32_t buf_size)
+{
+#if LOG_ASYNC_SUPPORT
+    OPERATE_RET op_ret = OPRT_OK;
+    LOG_ASYNC_T *async = NULL;
+    uint32_t size = 1024;
+
+    if (NULL == pLogManage) {
+        return OPRT_INVALID_PARM;
+    }
+    if (pLogManage->async) {
+        return OPRT_OK;
+    }
+
+    if (0 == buf_size) {
+        buf_size = LOG_ASYNC_BUF_SIZE;
+    }
+    while (size < buf_size && size < LOG_ASYNC_BUF_MAX) {
+        size <<= 1;
+    }
+
+    async = (LOG_ASYNC_T *)tal_malloc(sizeof(LOG_ASYNC_T) + size);
+    if (NULL == async) {
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(async, 0, sizeof(LOG_ASYNC_T));
+    async->buf = (uint8_t *)(async + 1);
+    async->size = size;
+    async->stat.buf_size = size;
+    // a record at pos is committed when its seq is ~pos, records are aligned so
+    // ~pos is never 0 and a zeroed ring holds no committed record on the first lap
+    memset(async->buf, 0, size);
+
+    op_ret = tal_semaphore_create_init(&async->sem, 0, 1);
+    if (OPRT_OK != op_ret) {
+        tal_free(async);
+        return op_ret;
+    }
+
+    THREAD_CFG_T thread_cfg = {
+        .stackDepth = STACK_SIZE_LOG_ASYNC,
+        .priority = THREAD_PRIO_4,
+        .thrdname = "log_async",
+    };
+    op_ret = tal_thread_create_and_start(&async->thread, NULL, NULL, __log_async_thread, async, &thread_cfg);
+    if (OPRT_OK != op_ret) {
+        tal_semaphore_release(async->sem);
+        tal_free(async);
+        return op_ret;
+    }
+
+    LOG_MEMORY_BARRIER();
+    pLogManage->async = async;
+
+    return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Stops asynchronous log output.
+ *
+ * Switches back to synchronous output, waits for the log calls still writing
+ * into the ring buffer, then lets the writer thread output the pending records
+ * and exit.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_SUPPORTED if ENABLE_LOG_ASYNC is not set.
+ */
+OPERATE_RET tal_log_async_stop(void)
+{
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = NULL;
+
+    if (NULL == pLogManage || NULL == pLogManage->async) {
+        return OPRT_OK;
+    }
+
+    async = pLogManage->async;
+    pLogManage->async = NULL;
+    LOG_MEMORY_BARRIER();
+    while (pLogManage->async_users) {
+        tal_system_sleep(1);
+    }
+
+    tal_thread_delete(async->thread);
+    tal_semaphore_post(async->sem);
+    while (THREAD_STATE_DELETE != tal_thread_get_state(async->thread)) {
+        tal_system_sleep(10);
+    }
+
+    tal_semaphore_release(async->sem);
+    tal_free(async);
+
+    return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
+}
+
+/**
+ * @brief Writes out the pending records in the caller's context.
+ *
+ * It is useful before reboot or in the fault handler, where the writer thread
+ * may never run again. Records whose producer is still formatting them are left
+ * to the writer thread.
+ */
+void tal_log_async_flush(void)
+{
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = NULL;
+
+    if (NULL == pLogManage) {
+        return;
+    }
+
+    async = __log_async_get();
+    if (NULL == async) {
+        return;
+    }
+    tal_mutex_lock(pLogManage->mutex);
+    __log_ring_drain(async);
+    tal_mutex_unlock(pLogManage->mutex);
+    __log_async_put();
+#endif
+}
+
+/**
+ * @brief Gets the statistics of asynchronous log output.
+ *
+ * @param stat The statistics output.
+ * @return OPRT_OK on success, OPRT_INVALID_PARM if asynchronous output is not
+ * running, OPRT_NOT_SUPPORTED if ENABLE_LOG_ASYNC is not set.
+ */
+OPERATE_RET tal_log_async_stat_get(TAL_LOG_ASYNC_STAT_T *stat)
+{
+#if LOG_ASYNC_SUPPORT
+    LOG_ASYNC_T *async = NULL;
+
+    if (NULL == stat || NULL == pLogManage) {
+        return OPRT_INVALID_PARM;
+    }
+
+    async = __log_async_get();
+    if (NULL == async) {
+        return OPRT_INVALID_PARM;
+    }
+    memcpy(stat, &async->stat, sizeof(TAL_LOG_ASYNC_STAT_T));
+    __log_async_put();
+
+    return OPRT_OK;
+#else
+    return OPRT_NOT_SUPPORTED;
+#endif
+}
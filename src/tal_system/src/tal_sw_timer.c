@@ -12,6 +12,21 @@
 #define STACK_SIZE_TIMERQ (4 * 1024)
 #endif
 
+#if defined(ENABLE_SW_TIMER_WHEEL) && (ENABLE_SW_TIMER_WHEEL == 1)
+#define SW_TIMER_WHEEL 1
+#else
+#define SW_TIMER_WHEEL 0
+#endif
+
+#if SW_TIMER_WHEEL
+// hierarchical timing wheel, 1 tick = 1 ms, 5 levels cover 2^30 ms
+#define TW_LVL_BITS 6
+#define TW_LVL_SIZE (1 << TW_LVL_BITS)
+#define TW_LVL_MASK (TW_LVL_SIZE - 1)
+#define TW_LVL_NUM  5
+#define TW_MAX_TICK ((1ULL << (TW_LVL_BITS * TW_LVL_NUM)) - 1)
+#endif
+
 typedef struct {
     LIST_HEAD node;
 
@@ -25,6 +40,15 @@ typedef struct {
     TIMER_TYPE type;
 } TIMER_T;
 
+#if SW_TIMER_WHEEL
+typedef struct {
+    LIST_HEAD slot[TW_LVL_NUM][TW_LVL_SIZE];
+    uint64_t bitmap[TW_LVL_NUM]; // non-empty slot hint, may be stale after stop/delete
+    uint64_t cur_tick;           // next tick to be processed
+    LIST_HEAD list_expired;      // expired timers waiting for dispatch
+} TIMER_WHEEL_T;
+#endif
+
 typedef struct {
     LIST_HEAD list_active;
     LIST_HEAD list_standby;
@@ -36,14 +60,166 @@ typedef struct {
     THREAD_HANDLE thread;
     SEM_HANDLE sem;
     TAL_TIMER_CB last_cb; // used to debug which cb is blocked
+
+#if SW_TIMER_WHEEL
+    TIMER_WHEEL_T wheel;
+#endif
+
+    // dispatch statistics
+    uint32_t dispatch_cnt;
+    uint32_t max_lag_ms;
+    uint32_t max_cb_ms;
+    TAL_TIMER_CB max_cb;
 } SW_TIMER_MGR_T;
 
 static SW_TIMER_MGR_T s_timer_mgr;
 
+static uint64_t __timer_now_ms(void)
+{
+    TIME_S nowSecTime = 0;
+    TIME_MS nowMsTime = 0;
+
+    tal_time_get_system_time(&nowSecTime, &nowMsTime);
+
+    return (uint64_t)nowSecTime * 1000 + (uint64_t)nowMsTime;
+}
+
+#if SW_TIMER_WHEEL
+static void __wheel_init(uint64_t now)
+{
+    int lvl, i;
+
+    for (lvl = 0; lvl < TW_LVL_NUM; lvl++) {
+        for (i = 0; i < TW_LVL_SIZE; i++) {
+            INIT_LIST_HEAD(&(s_timer_mgr.wheel.slot[lvl][i]));
+        }
+        s_timer_mgr.wheel.bitmap[lvl] = 0;
+    }
+    INIT_LIST_HEAD(&(s_timer_mgr.wheel.list_expired));
+    s_timer_mgr.wheel.cur_tick = now;
+}
+
+static void __wheel_add(TIMER_T *timer)
+{
+    TIMER_WHEEL_T *wheel = &(s_timer_mgr.wheel);
+    uint64_t expires = timer->expire_time;
+    uint64_t delta = 0;
+    int lvl = 0, idx = 0;
+
+    if (expires < wheel->cur_tick) {
+        expires = wheel->cur_tick;
+    } else if (expires - wheel->cur_tick > TW_MAX_TICK) {
+        // re-inserted from the top level once its slot cascades
+        expires = wheel->cur_tick + TW_MAX_TICK;
+    }
+
+    delta = expires - wheel->cur_tick;
+    for (lvl = 0; lvl < TW_LVL_NUM - 1; lvl++) {
+        if (delta < (1ULL << (TW_LVL_BITS * (lvl + 1)))) {
+            break;
+        }
+    }
+
+    idx = (expires >> (TW_LVL_BITS * lvl)) & TW_LVL_MASK;
+    tuya_list_add_tail(&(timer->node), &(wheel->slot[lvl][idx]));
+    wheel->bitmap[lvl] |= (1ULL << idx);
+}
+
+static void __wheel_cascade(int lvl, int idx)
+{
+    TIMER_WHEEL_T *wheel = &(s_timer_mgr.wheel);
+    LIST_HEAD *slot = &(wheel->slot[lvl][idx]);
+    TIMER_T *timer = NULL;
+
+    wheel->bitmap[lvl] &= ~(1ULL << idx);
+    while (!tuya_list_empty(slot)) {
+        timer = tuya_list_entry(slot->next, TIMER_T, node);
+        tuya_list_del(&(timer->node));
+        __wheel_add(timer);
+    }
+}
+
+static uint64_t __wheel_next_tick(void)
+{
+    TIMER_WHEEL_T *wheel = &(s_timer_mgr.wheel);
+    uint64_t next_tick = (uint64_t)-1;
+    uint64_t base = 0, tick = 0, bitmap = 0;
+    int lvl = 0, shift = 0, off = 0;
+
+    for (lvl = 0; lvl < TW_LVL_NUM; lvl++) {
+        shift = TW_LVL_BITS * lvl;
+        // drop stale hints
+        for (off = 0; off < TW_LVL_SIZE; off++) {
+            if ((wheel->bitmap[lvl] & (1ULL << off)) && tuya_list_empty(&(wheel->slot[lvl][off]))) {
+                wheel->bitmap[lvl] &= ~(1ULL << off);
+            }
+        }
+        if (0 == wheel->bitmap[lvl]) {
+            continue;
+        }
+
+        // the first slot of this level which is processed (level 0) or cascaded (others)
+        base = wheel->cur_tick >> shift;
+        if (wheel->cur_tick & ((1ULL << shift) - 1)) {
+            base++;
+        }
+        off = base & TW_LVL_MASK;
+        bitmap = (wheel->bitmap[lvl] >> off) | (off ? (wheel->bitmap[lvl] << (TW_LVL_SIZE - off)) : 0);
+        tick = (base + __builtin_ctzll(bitmap)) << shift;
+        if (tick < next_tick) {
+            next_tick = tick;
+        }
+    }
+
+    return next_tick;
+}
+
+static void __wheel_advance(uint64_t now)
+{
+    TIMER_WHEEL_T *wheel = &(s_timer_mgr.wheel);
+    LIST_HEAD *slot = NULL;
+    LIST_HEAD *p = NULL;
+    uint64_t remain = 0;
+    uint64_t next = 0;
+    int idx = 0, lvl = 0;
+
+    while (wheel->cur_tick <= now) {
+        idx = wheel->cur_tick & TW_LVL_MASK;
+
+        if (0 == idx) {
+            for (lvl = 1; lvl < TW_LVL_NUM; lvl++) {
+                int lvl_idx = (wheel->cur_tick >> (TW_LVL_BITS * lvl)) & TW_LVL_MASK;
+                __wheel_cascade(lvl, lvl_idx);
+                if (lvl_idx) {
+                    break;
+                }
+            }
+        }
+
+        slot = &(wheel->slot[0][idx]);
+        while (!tuya_list_empty(slot)) {
+            p = slot->next;
+            tuya_list_del(p);
+            tuya_list_add_tail(p, &(wheel->list_expired));
+        }
+        wheel->bitmap[0] &= ~(1ULL << idx);
+
+        // skip empty level-0 slots, once they are done jump to the next slot to process or cascade,
+        // so an idle gap does not walk every cascade boundary in it
+        remain = (TW_LVL_MASK == idx) ? 0 : (wheel->bitmap[0] >> (idx + 1));
+        next = remain ? wheel->cur_tick + __builtin_ctzll(remain) + 1 : __wheel_next_tick();
+        wheel->cur_tick = (next > now) ? now + 1 : next;
+    }
+}
+#endif
+
 static void __timer_attach(TIMER_T *timer)
 {
     tuya_list_del(&(timer->node));
 
+#if SW_TIMER_WHEEL
+    __wheel_add(timer);
+#else
     if (tuya_list_empty(&(s_timer_mgr.list_active))) {
         tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_active));
     } else {
@@ -63,15 +239,75 @@ static void __timer_attach(TIMER_T *timer)
             tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_active));
         }
     }
+#endif
 }
 
-static void __timer_dump(void)
+/**
+ * @brief get the first expired timer, must be called with the mutex locked
+ *
+ * @param[in] nowMS: current system time in ms
+ * @param[out] next_expired: time to wait when no timer is expired
+ *
+ * @return the expired timer, NULL means no timer is expired
+ */
+static TIMER_T *__timer_expired_get(uint64_t nowMS, SYS_TIME_T *next_expired)
 {
-    struct tuya_list_head *p = NULL;
+#if SW_TIMER_WHEEL
+    uint64_t next_tick = 0;
+
+    if (tuya_list_empty(&(s_timer_mgr.wheel.list_expired))) {
+        __wheel_advance(nowMS);
+    }
+
+    if (!tuya_list_empty(&(s_timer_mgr.wheel.list_expired))) {
+        return tuya_list_entry(s_timer_mgr.wheel.list_expired.next, TIMER_T, node);
+    }
+
+    next_tick = __wheel_next_tick();
+    if ((uint64_t)-1 != next_tick) {
+        *next_expired = (next_tick > nowMS) ? (next_tick - nowMS) : 1;
+    }
+#else
     TIMER_T *timer = NULL;
-    TAL_TIMER_CB *cb = NULL;
+
+    if (!tuya_list_empty(&(s_timer_mgr.list_active))) {
+        timer = tuya_list_entry(s_timer_mgr.list_active.next, TIMER_T, node);
+        if (timer->expire_time <= nowMS) {
+            return timer;
+        }
+        *next_expired = timer->expire_time - nowMS;
+    }
+#endif
+
+    return NULL;
+}
+
+static void __timer_dump_node(TIMER_T *timer)
+{
+    TAL_TIMER_CB *cb = &(timer->cb);
     TIMER_ID *timer_id = NULL;
 
+    if (timer->data) {
+        timer_id = timer->data;
+        if (*timer_id == timer->timer_id) {
+            cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
+        }
+    }
+    PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
+}
+
+static void __timer_dump_list(LIST_HEAD *list)
+{
+    struct tuya_list_head *p = NULL;
+
+    tuya_list_for_each(p, list)
+    {
+        __timer_dump_node(tuya_list_entry(p, TIMER_T, node));
+    }
+}
+
+static void __timer_dump(void)
+{
     TIME_S nowSecTime = 0;
     TIME_MS nowMsTime = 0;
 
@@ -85,88 +321,85 @@ static void __timer_dump(void)
 
     tal_mutex_lock(s_timer_mgr.mutex);
 
+    PR_NOTICE("dispatched:%u max lag:%ums max cb:%ums %p", s_timer_mgr.dispatch_cnt, s_timer_mgr.max_lag_ms,
+              s_timer_mgr.max_cb_ms, s_timer_mgr.max_cb);
+
     PR_NOTICE("running timers count:%d", s_timer_mgr.running_cnt);
-    tuya_list_for_each(p, &(s_timer_mgr.list_active))
-    {
-        timer = tuya_list_entry(p, TIMER_T, node);
-        cb = &(timer->cb);
-        if (timer->data) {
-            timer_id = timer->data;
-            if (*timer_id == timer->timer_id) {
-                cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
-            }
+#if SW_TIMER_WHEEL
+    int lvl, idx;
+
+    __timer_dump_list(&(s_timer_mgr.wheel.list_expired));
+    for (lvl = 0; lvl < TW_LVL_NUM; lvl++) {
+        for (idx = 0; idx < TW_LVL_SIZE; idx++) {
+            __timer_dump_list(&(s_timer_mgr.wheel.slot[lvl][idx]));
         }
-        PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
     }
+#else
+    __timer_dump_list(&(s_timer_mgr.list_active));
+#endif
 
     PR_NOTICE("standby timers count:%d", s_timer_mgr.total_cnt - s_timer_mgr.running_cnt);
-    tuya_list_for_each(p, &(s_timer_mgr.list_standby))
-    {
-        timer = tuya_list_entry(p, TIMER_T, node);
-        cb = &(timer->cb);
-        if (timer->data) {
-            timer_id = timer->data;
-            if (*timer_id == timer->timer_id) {
-                cb = (TAL_TIMER_CB *)((char *)timer->data + sizeof(TIMER_ID));
-            }
-        }
-        PR_NOTICE("%08x %d %d %p", timer->timer_id, timer->type, timer->interval, *cb);
-    }
+    __timer_dump_list(&(s_timer_mgr.list_standby));
 
     tal_mutex_unlock(s_timer_mgr.mutex);
 }
 
 static void __timer_dispatch(SYS_TIME_T *next_expired)
 {
-    TIME_S nowSecTime = 0;
-    TIME_MS nowMsTime = 0;
     uint64_t nowMS = 0;
+    uint64_t cb_start = 0;
+    uint32_t cb_ms = 0;
     TIMER_T *timer = NULL;
+    TIMER_ID timer_id = NULL;
+    void *timer_data = NULL;
     TAL_TIMER_CB timer_cb = NULL;
-    struct tuya_list_head *p = NULL;
 
     *next_expired = SEM_WAIT_FOREVER;
 
     do {
-        tal_time_get_system_time(&nowSecTime, &nowMsTime);
-        nowMS = (uint64_t)nowSecTime * 1000 + (uint64_t)nowMsTime;
+        nowMS = __timer_now_ms();
 
         tal_mutex_lock(s_timer_mgr.mutex);
 
         timer_cb = NULL;
-        tuya_list_for_each(p, &(s_timer_mgr.list_active))
-        {
-            timer = tuya_list_entry(p, TIMER_T, node);
+        timer = __timer_expired_get(nowMS, next_expired);
+        if (timer) {
+            timer_cb = timer->cb;
+            timer_id = timer->timer_id;
+            timer_data = timer->data;
+
+            // triggered timer has expire_time 0, no lag
+            if (timer->expire_time && (nowMS - timer->expire_time > s_timer_mgr.max_lag_ms)) {
+                s_timer_mgr.max_lag_ms = nowMS - timer->expire_time;
+            }
+            s_timer_mgr.dispatch_cnt++;
 
-            if (timer->expire_time > nowMS) {
-                p = &(s_timer_mgr.list_active);
-                *next_expired = timer->expire_time - nowMS;
+            if (TAL_TIMER_ONCE == timer->type) {
+                timer->is_running = FALSE;
+                s_timer_mgr.running_cnt--;
+                tuya_list_del(&(timer->node));
+                tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
             } else {
-                timer_cb = timer->cb;
-
-                if (TAL_TIMER_ONCE == timer->type) {
-                    timer->is_running = FALSE;
-                    s_timer_mgr.running_cnt--;
-                    tuya_list_del(&(timer->node));
-                    tuya_list_add_tail(&(timer->node), &(s_timer_mgr.list_standby));
-                } else {
-                    timer->expire_time = nowMS + timer->interval;
-                    __timer_attach(timer);
-                }
+                timer->expire_time = nowMS + timer->interval;
+                __timer_attach(timer);
             }
-
-            break;
         }
 
         tal_mutex_unlock(s_timer_mgr.mutex);
 
         if (timer_cb) {
             s_timer_mgr.last_cb = timer_cb;
-            timer_cb(timer->timer_id, timer->data);
+            cb_start = __timer_now_ms();
+            timer_cb(timer_id, timer_data);
+            cb_ms = __timer_now_ms() - cb_start;
+            if (cb_ms > s_timer_mgr.max_cb_ms) {
+                s_timer_mgr.max_cb_ms = cb_ms;
+                s_timer_mgr.max_cb = timer_cb;
+            }
             timer_cb = NULL;
             s_timer_mgr.last_cb = NULL;
         }
-    } while (p != &(s_timer_mgr.list_active));
+    } while (timer);
 }
 
 static void __timer_thread_cb(void *data)
@@ -203,6 +436,9 @@ OPERATE_RET tal_sw_timer_init(void)
 
     INIT_LIST_HEAD(&(s_timer_mgr.list_active));
     INIT_LIST_HEAD(&(s_timer_mgr.list_standby));
+#if SW_TIMER_WHEEL
+    __wheel_init(__timer_now_ms());
+#endif
 
     THREAD_CFG_T thread_cfg = {.stackDepth = STACK_SIZE_TIMERQ, .priority = THREAD_PRIO_0, .thrdname = "sys_timer"};
 
@@ -443,7 +679,11 @@ OPERATE_RET tal_sw_timer_trigger(TIMER_ID timer_id)
     timer->expire_time = 0;
     if (timer->is_running) {
         tuya_list_del(&(timer->node));
+#if SW_TIMER_WHEEL
+        tuya_list_add(&(timer->node), &(s_timer_mgr.wheel.list_expired));
+#else
         tuya_list_add(&(timer->node), &(s_timer_mgr.list_active));
+#endif
     }
     tal_mutex_unlock(s_timer_mgr.mutex);
     tal_semaphore_post(s_timer_mgr.sem);
@@ -486,6 +726,52 @@ int tal_sw_timer_get_num(void)
     return s_timer_mgr.running_cnt;
 }
 
+/**
+ * @brief Get the dispatch statistics of the software timer
+ *
+ * @param[out] stat: statistics of the software timer
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_stat_get(TAL_SW_TIMER_STAT_T *stat)
+{
+    if (NULL == stat) {
+        return OPRT_INVALID_PARM;
+    }
+
+    tal_mutex_lock(s_timer_mgr.mutex);
+    stat->total_cnt = s_timer_mgr.total_cnt;
+    stat->running_cnt = s_timer_mgr.running_cnt;
+    stat->dispatch_cnt = s_timer_mgr.dispatch_cnt;
+    stat->max_lag_ms = s_timer_mgr.max_lag_ms;
+    stat->max_cb_ms = s_timer_mgr.max_cb_ms;
+    stat->max_cb = s_timer_mgr.max_cb;
+    tal_mutex_unlock(s_timer_mgr.mutex);
+
+    return OPRT_OK;
+}
+
+/**
+ * @brief Reset the dispatch statistics of the software timer
+ *
+ * @param void
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_sw_timer_stat_reset(void)
+{
+    tal_mutex_lock(s_timer_mgr.mutex);
+    s_timer_mgr.dispatch_cnt = 0;
+    s_timer_mgr.max_lag_ms = 0;
+    s_timer_mgr.max_cb_ms = 0;
+    s_timer_mgr.max_cb = NULL;
+    tal_mutex_unlock(s_timer_mgr.mutex);
+
+    return OPRT_OK;
+}
+
 // used for debug
 void tal_sw_timer_dump(void)
 {
@@ -45,6 +45,10 @@
 #define STACK_SIZE_WORK_QUEUE (5 * 1024)
 #endif
 
+#ifndef WORKER_NUM_WORK_QUEUE
+#define WORKER_NUM_WORK_QUEUE 1
+#endif
+
 #ifndef STACK_SIZE_MSG_QUEUE
 #define STACK_SIZE_MSG_QUEUE (4 * 1024)
 #endif
@@ -73,7 +77,13 @@ OPERATE_RET tal_workq_init(void)
     thread_cfg.stackDepth += 1024;
 #endif
     thread_cfg.thrdname = "wq_system";
+#if WORKER_NUM_WORK_QUEUE > 1
+    WORKQUEUE_CFG_T wq_cfg = {
+        .queue_len = MAX_NODE_NUM_WORK_QUEUE, .worker_num = WORKER_NUM_WORK_QUEUE, .thread_cfg = thread_cfg};
+    TUYA_CALL_ERR_GOTO(tal_workqueue_create_multi(&wq_cfg, &wq_system), ERR_EXIT);
+#else
     TUYA_CALL_ERR_GOTO(tal_workqueue_create(MAX_NODE_NUM_WORK_QUEUE, &thread_cfg, &wq_system), ERR_EXIT);
+#endif
 
     thread_cfg.priority = THREAD_PRIO_1;
     thread_cfg.stackDepth = STACK_SIZE_MSG_QUEUE;
@@ -33,6 +33,7 @@
 
 #include "tuya_queue.h"
 #include "tal_log.h"
+#include "tal_mutex.h"
 #include "tal_memory.h"
 #include "tal_thread.h"
 #include "tal_system.h"
@@ -40,11 +41,38 @@
 #include "tal_workqueue.h"
 #include "tal_sw_timer.h"
 
+// per-worker deque of one priority lane, fixed size ring
 typedef struct {
+    WORK_ITEM_T *items;
+    uint16_t head;
+    uint16_t count;
+} WORK_DEQUE_T;
+
+struct tal_workqueue;
+
+typedef struct {
+    struct tal_workqueue *workqueue;
+    THREAD_HANDLE thread;
+    MUTEX_HANDLE mutex;
+    WORK_DEQUE_T lane[WORKQUEUE_PRIO_MAX];
+
+    WORKQUEUE_CB last_cb; // used to debug which cb is blocked
+    SYS_TIME_T last_cb_start;
+    uint32_t exec_cnt;
+    uint32_t steal_cnt;
+} WORKQUEUE_WORKER_T;
+
+typedef struct tal_workqueue {
     TUYA_QUEUE_HANDLE queue;
     THREAD_HANDLE thread;
     SEM_HANDLE sem;
     WORKQUEUE_CB last_cb; // used to debug which cb is blocked
+
+    // multi-worker mode, queue and thread are not used
+    uint16_t queue_len;
+    uint8_t worker_num;
+    uint32_t next_worker; // updated atomically by the producers
+    WORKQUEUE_WORKER_T *workers;
 } TAL_WORKQUEUE_T;
 
 static void __work_thread_cb(void *data)
@@ -74,6 +102,194 @@ static void __work_thread_cb(void *data)
     }
 }
 
+static BOOL_T __deque_push(WORK_DEQUE_T *deque, uint16_t size, WORK_ITEM_T *item, BOOL_T front)
+{
+    if (deque->count >= size) {
+        return FALSE;
+    }
+
+    if (front) {
+        deque->head = (deque->head + size - 1) % size;
+        deque->items[deque->head] = *item;
+    } else {
+        deque->items[(deque->head + deque->count) % size] = *item;
+    }
+    deque->count++;
+
+    return TRUE;
+}
+
+static BOOL_T __deque_pop(WORK_DEQUE_T *deque, uint16_t size, WORK_ITEM_T *item, BOOL_T back)
+{
+    if (0 == deque->count) {
+        return FALSE;
+    }
+
+    deque->count--;
+    if (back) {
+        *item = deque->items[(deque->head + deque->count) % size];
+    } else {
+        *item = deque->items[deque->head];
+        deque->head = (deque->head + 1) % size;
+    }
+
+    return TRUE;
+}
+
+/**
+ * @brief take one item, own lanes first, then steal the newest item of the
+ * same lane from other workers, so higher lanes always win across workers
+ */
+static BOOL_T __worker_pick(WORKQUEUE_WORKER_T *worker, WORK_ITEM_T *item)
+{
+    TAL_WORKQUEUE_T *workqueue = worker->workqueue;
+    WORKQUEUE_WORKER_T *victim = NULL;
+    BOOL_T found = FALSE;
+    uint8_t prio = 0, i = 0;
+    uint8_t self = worker - workqueue->workers;
+
+    for (prio = 0; prio < WORKQUEUE_PRIO_MAX; prio++) {
+        tal_mutex_lock(worker->mutex);
+        found = __deque_pop(&worker->lane[prio], workqueue->queue_len, item, FALSE);
+        tal_mutex_unlock(worker->mutex);
+        if (found) {
+            return TRUE;
+        }
+
+        for (i = 1; i < workqueue->worker_num; i++) {
+            victim = &workqueue->workers[(self + i) % workqueue->worker_num];
+            tal_mutex_lock(victim->mutex);
+            found = __deque_pop(&victim->lane[prio], workqueue->queue_len, item, TRUE);
+            tal_mutex_unlock(victim->mutex);
+            if (found) {
+                worker->steal_cnt++;
+                return TRUE;
+            }
+        }
+    }
+
+    return FALSE;
+}
+
+static void __worker_thread_cb(void *data)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    WORKQUEUE_WORKER_T *worker = (WORKQUEUE_WORKER_T *)data;
+    WORK_ITEM_T work_item = {0};
+
+    while (THREAD_STATE_RUNNING == tal_thread_get_state(worker->thread)) {
+        op_ret = tal_semaphore_wait(worker->workqueue->sem, SEM_WAIT_FOREVER);
+        if (OPRT_OK != op_ret) {
+            tal_system_sleep(10);
+            continue;
+        }
+
+        // the scan drops each lock in turn and can miss an item pushed behind it, the token
+        // stands for that item, so it goes back for the next scan instead of being lost
+        if (!__worker_pick(worker, &work_item)) {
+            tal_semaphore_post(worker->workqueue->sem);
+            tal_system_sleep(1);
+            continue;
+        }
+
+        if (work_item.cb) {
+            worker->last_cb_start = tal_system_get_millisecond();
+            worker->last_cb = work_item.cb;
+            work_item.cb(work_item.data);
+            worker->last_cb = NULL;
+            worker->exec_cnt++;
+        }
+    }
+}
+
+static WORKQUEUE_WORKER_T *__worker_self(TAL_WORKQUEUE_T *workqueue)
+{
+    BOOL_T is_self = FALSE;
+    uint8_t i = 0;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        if ((OPRT_OK == tal_thread_is_self(workqueue->workers[i].thread, &is_self)) && is_self) {
+            return &workqueue->workers[i];
+        }
+    }
+
+    return NULL;
+}
+
+static OPERATE_RET __workers_schedule(TAL_WORKQUEUE_T *workqueue, WORKQUEUE_PRIO_E prio, WORK_ITEM_T *item,
+                                      BOOL_T front)
+{
+    WORKQUEUE_WORKER_T *worker = NULL;
+    BOOL_T pushed = FALSE;
+    uint8_t start = 0, i = 0;
+
+    // work scheduled from a worker stays local, others are spread round robin
+    worker = __worker_self(workqueue);
+    if (worker) {
+        start = worker - workqueue->workers;
+    } else {
+        start = __sync_fetch_and_add(&workqueue->next_worker, 1) % workqueue->worker_num;
+    }
+
+    for (i = 0; (i < workqueue->worker_num) && !pushed; i++) {
+        worker = &workqueue->workers[(start + i) % workqueue->worker_num];
+        tal_mutex_lock(worker->mutex);
+        pushed = __deque_push(&worker->lane[prio], workqueue->queue_len, item, front);
+        tal_mutex_unlock(worker->mutex);
+    }
+
+    if (!pushed) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    return tal_semaphore_post(workqueue->sem);
+}
+
+static void __workers_traverse(TAL_WORKQUEUE_T *workqueue, WORKQUEUE_TRAVERSE_CB cb, void *ctx)
+{
+    WORKQUEUE_WORKER_T *worker = NULL;
+    WORK_DEQUE_T *deque = NULL;
+    BOOL_T go_on = TRUE;
+    uint8_t i = 0, prio = 0;
+    uint16_t j = 0;
+
+    for (i = 0; (i < workqueue->worker_num) && go_on; i++) {
+        worker = &workqueue->workers[i];
+        tal_mutex_lock(worker->mutex);
+        for (prio = 0; (prio < WORKQUEUE_PRIO_MAX) && go_on; prio++) {
+            deque = &worker->lane[prio];
+            for (j = 0; (j < deque->count) && go_on; j++) {
+                go_on = cb(&deque->items[(deque->head + j) % workqueue->queue_len], ctx);
+            }
+        }
+        tal_mutex_unlock(worker->mutex);
+    }
+}
+
+static void __workers_release(TAL_WORKQUEUE_T *workqueue)
+{
+    WORKQUEUE_WORKER_T *worker = NULL;
+    uint8_t i = 0, prio = 0;
+
+    for (i = 0; i < workqueue->worker_num; i++) {
+        worker = &workqueue->workers[i];
+        if (worker->mutex) {
+            tal_mutex_release(worker->mutex);
+        }
+        for (prio = 0; prio < WORKQUEUE_PRIO_MAX; prio++) {
+            if (worker->lane[prio].items) {
+                tal_free(worker->lane[prio].items);
+            }
+        }
+    }
+
+    if (workqueue->sem) {
+        tal_semaphore_release(workqueue->sem);
+    }
+    tal_free(workqueue->workers);
+    tal_free(workqueue);
+}
+
 static BOOL_T __work_cancel_traverse(void *item, void *ctx)
 {
     BOOL_T is_same = FALSE;
@@ -147,6 +363,83 @@ OPERATE_RET tal_workqueue_create(const uint16_t queue_len, THREAD_CFG_T *thread_
     return op_ret;
 }
 
+/**
+ * @brief create and initialize a workqueue served by several worker threads
+ *
+ * @param[in] cfg workqueue config, see WORKQUEUE_CFG_T
+ * @param[out] handle the workqueue handle
+ *
+ * @note every worker owns one deque per priority lane, idle workers steal
+ * items from the others, so one blocked callback doesn't stall the queue.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_create_multi(const WORKQUEUE_CFG_T *cfg, WORKQUEUE_HANDLE *handle)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+    TAL_WORKQUEUE_T *workqueue = NULL;
+    WORKQUEUE_WORKER_T *worker = NULL;
+    THREAD_CFG_T thread_cfg;
+    uint8_t i = 0, prio = 0;
+
+    if ((NULL == cfg) || (0 == cfg->queue_len) || (0 == cfg->worker_num) || (NULL == handle)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    workqueue = (TAL_WORKQUEUE_T *)tal_calloc(1, sizeof(TAL_WORKQUEUE_T));
+    if (NULL == workqueue) {
+        return OPRT_MALLOC_FAILED;
+    }
+
+    workqueue->workers = (WORKQUEUE_WORKER_T *)tal_calloc(cfg->worker_num, sizeof(WORKQUEUE_WORKER_T));
+    if (NULL == workqueue->workers) {
+        tal_free(workqueue);
+        return OPRT_MALLOC_FAILED;
+    }
+    workqueue->queue_len = cfg->queue_len;
+    workqueue->worker_num = cfg->worker_num;
+
+    op_ret = tal_semaphore_create_init(&workqueue->sem, 0, cfg->queue_len * cfg->worker_num * WORKQUEUE_PRIO_MAX);
+    if (OPRT_OK != op_ret) {
+        __workers_release(workqueue);
+        return op_ret;
+    }
+
+    for (i = 0; i < cfg->worker_num; i++) {
+        worker = &workqueue->workers[i];
+        worker->workqueue = workqueue;
+        op_ret = tal_mutex_create_init(&worker->mutex);
+        if (OPRT_OK != op_ret) {
+            __workers_release(workqueue);
+            return op_ret;
+        }
+        for (prio = 0; prio < WORKQUEUE_PRIO_MAX; prio++) {
+            worker->lane[prio].items = (WORK_ITEM_T *)tal_malloc(cfg->queue_len * sizeof(WORK_ITEM_T));
+            if (NULL == worker->lane[prio].items) {
+                __workers_release(workqueue);
+                return OPRT_MALLOC_FAILED;
+            }
+        }
+    }
+
+    // threads start last, nothing below can fail half way through the array
+    for (i = 0; i < cfg->worker_num; i++) {
+        thread_cfg = cfg->thread_cfg;
+        op_ret = tal_thread_create_and_start(&workqueue->workers[i].thread, NULL, NULL, __worker_thread_cb,
+                                             &workqueue->workers[i], &thread_cfg);
+        if (OPRT_OK != op_ret) {
+            PR_ERR("worker %d create failed %d", i, op_ret);
+            tal_workqueue_release(workqueue);
+            return op_ret;
+        }
+    }
+
+    *handle = workqueue;
+
+    return OPRT_OK;
+}
+
 /**
  * @brief put work task in workqueue
  *
@@ -168,6 +461,10 @@ OPERATE_RET tal_workqueue_schedule(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, voi
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
+    if (workqueue->workers) {
+        return __workers_schedule(workqueue, WORKQUEUE_PRIO_NORMAL, &work_item, FALSE);
+    }
+
     op_ret = tuya_queue_input(workqueue->queue, &work_item);
     if (OPRT_OK == op_ret) {
         op_ret = tal_semaphore_post(workqueue->sem);
@@ -197,6 +494,10 @@ OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
+    if (workqueue->workers) {
+        return __workers_schedule(workqueue, WORKQUEUE_PRIO_HIGH, &work_item, TRUE);
+    }
+
     op_ret = tuya_queue_input_instant(workqueue->queue, &work_item);
     if (OPRT_OK == op_ret) {
         op_ret = tal_semaphore_post(workqueue->sem);
@@ -205,6 +506,40 @@ OPERATE_RET tal_workqueue_schedule_instant(WORKQUEUE_HANDLE handle, WORKQUEUE_CB
     return op_ret;
 }
 
+/**
+ * @brief put work task in the priority lane of workqueue
+ *
+ * @param[in] handle the workqueue handle
+ * @param[in] prio the priority lane, see WORKQUEUE_PRIO_E
+ * @param[in] cb the work callback
+ * @param[in] data the work data
+ *
+ * @note a workqueue created by tal_workqueue_create has only one lane,
+ * WORKQUEUE_PRIO_HIGH is queued to the front and others to the back.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to
+ * tuya_error_code.h
+ */
+OPERATE_RET tal_workqueue_schedule_prio(WORKQUEUE_HANDLE handle, WORKQUEUE_PRIO_E prio, WORKQUEUE_CB cb, void *data)
+{
+    if ((NULL == handle) || (NULL == cb) || (prio >= WORKQUEUE_PRIO_MAX)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    WORK_ITEM_T work_item = {.cb = cb, .data = data};
+
+    if (workqueue->workers) {
+        return __workers_schedule(workqueue, prio, &work_item, FALSE);
+    }
+
+    if (WORKQUEUE_PRIO_HIGH == prio) {
+        return tal_workqueue_schedule_instant(handle, cb, data);
+    }
+
+    return tal_workqueue_schedule(handle, cb, data);
+}
+
 /**
  * @brief put work task in workqueue
  *
@@ -224,6 +559,11 @@ OPERATE_RET tal_workqueue_cancel(WORKQUEUE_HANDLE handle, WORKQUEUE_CB cb, void
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
     WORK_ITEM_T work_item = {.cb = cb, .data = data};
 
+    if (workqueue->workers) {
+        __workers_traverse(workqueue, (WORKQUEUE_TRAVERSE_CB)__work_cancel_traverse, &work_item);
+        return OPRT_OK;
+    }
+
     return tuya_queue_traverse(workqueue->queue, __work_cancel_traverse, &work_item);
 }
 
@@ -244,6 +584,11 @@ OPERATE_RET tal_workqueue_traverse(WORKQUEUE_HANDLE handle, WORKQUEUE_TRAVERSE_C
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    if (workqueue->workers) {
+        __workers_traverse(workqueue, cb, ctx);
+        return OPRT_OK;
+    }
+
     return tuya_queue_traverse(workqueue->queue, (TRAVERSE_CB)cb, ctx);
 }
 
@@ -262,6 +607,27 @@ uint16_t tal_workqueue_get_num(WORKQUEUE_HANDLE handle)
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
 
+    if (workqueue->workers) {
+        WORKQUEUE_WORKER_T *worker = NULL;
+        uint16_t num = 0;
+        uint8_t i = 0, prio = 0;
+
+        for (i = 0; i < workqueue->worker_num; i++) {
+            worker = &workqueue->workers[i];
+            if (worker->last_cb) {
+                PR_NOTICE("%p:last_cb %p blocked %dms", worker->thread, worker->last_cb,
+                          tal_system_get_millisecond() - worker->last_cb_start);
+            }
+            tal_mutex_lock(worker->mutex);
+            for (prio = 0; prio < WORKQUEUE_PRIO_MAX; prio++) {
+                num += worker->lane[prio].count;
+            }
+            tal_mutex_unlock(worker->mutex);
+        }
+
+        return num;
+    }
+
     if (workqueue->last_cb) {
         PR_NOTICE("%p:last_cb %p", workqueue->thread, workqueue->last_cb);
     }
@@ -287,6 +653,35 @@ OPERATE_RET tal_workqueue_release(WORKQUEUE_HANDLE handle)
     uint32_t count = 1;
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
 
+    if (workqueue->workers) {
+        uint8_t i = 0;
+
+        // workers whose creation failed have no thread
+        for (i = 0; i < workqueue->worker_num; i++) {
+            if (workqueue->workers[i].thread) {
+                tal_thread_delete(workqueue->workers[i].thread);
+            }
+        }
+
+        for (i = 0; i < workqueue->worker_num; i++) {
+            tal_semaphore_post(workqueue->sem);
+        }
+
+        for (i = 0; i < workqueue->worker_num; i++) {
+            while (workqueue->workers[i].thread &&
+                   THREAD_STATE_DELETE != tal_thread_get_state(workqueue->workers[i].thread)) {
+                tal_system_sleep(10);
+                if ((count++) % 500 == 0) {
+                    PR_NOTICE("%p still running", workqueue->workers[i].thread);
+                }
+            }
+        }
+
+        __workers_release(workqueue);
+
+        return OPRT_OK;
+    }
+
     op_ret = tal_thread_delete(workqueue->thread);
     if (OPRT_OK != op_ret) {
         return op_ret;
@@ -322,6 +717,10 @@ THREAD_HANDLE tal_workqueue_get_thread(WORKQUEUE_HANDLE handle)
     }
 
     TAL_WORKQUEUE_T *workqueue = (TAL_WORKQUEUE_T *)handle;
+    if (workqueue->workers) {
+        return workqueue->workers[0].thread;
+    }
+
     return workqueue->thread;
 }
 
@@ -169,6 +169,23 @@ typedef struct {
     AI_EVENT_CB event_cb;
 } AI_SESSION_CFG_T;
 
+#ifndef AI_BIZ_SEND_QUEUE_NUM
+#define AI_BIZ_SEND_QUEUE_NUM 16
+#endif
+
+typedef struct {
+    /** packets sent from the send queue */
+    uint32_t sent;
+    /** packets refused because the send queue stayed full */
+    uint32_t dropped;
+    /** packets waiting in the send queue */
+    uint32_t queued;
+    /** average time from enqueue to sent, unit:ms */
+    uint32_t latency_avg_ms;
+    /** max time from enqueue to sent, unit:ms */
+    uint32_t latency_max_ms;
+} AI_BIZ_SEND_STAT_T;
+
 /**
  * @brief create session
  *
@@ -222,6 +239,45 @@ OPERATE_RET tuya_ai_send_biz_pkt(uint16_t id, AI_BIZ_ATTR_INFO_T *attr, AI_PACKE
 OPERATE_RET tuya_ai_send_biz_pkt_custom(uint16_t id, AI_BIZ_ATTR_INFO_T *attr, AI_PACKET_PT type,
                                         AI_BIZ_HEAD_INFO_T *head, char *payload, AI_PACKET_WRITER_T *writer);
 
+/**
+ * @brief queue ai biz packet, the biz thread sends it
+ *
+ * The payload is copied, audio is sent before video and image, which go
+ * before text, file and event. Pointers inside attr must stay valid until
+ * the packet is sent.
+ *
+ * @param[in] id channel id
+ * @param[in] attr attribute
+ * @param[in] type packet type
+ * @param[in] head data head
+ * @param[in] payload data
+ * @param[in] timeout_ms max wait for room in the send queue
+ *
+ * @return OPRT_OK on success, OPRT_EXCEED_UPPER_LIMIT if the queue stayed full.
+ * Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_ai_biz_send_enqueue(uint16_t id, AI_BIZ_ATTR_INFO_T *attr, AI_PACKET_PT type,
+                                     AI_BIZ_HEAD_INFO_T *head, char *payload, uint32_t timeout_ms);
+
+/**
+ * @brief wait until every queued ai biz packet is sent
+ *
+ * @param[in] timeout_ms max wait
+ *
+ * @return OPRT_OK on success, OPRT_TIMEOUT if packets are still queued.
+ */
+OPERATE_RET tuya_ai_biz_send_flush(uint32_t timeout_ms);
+
+/**
+ * @brief get send queue statistics of a session
+ *
+ * @param[in] id session id
+ * @param[out] stat statistics
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_ai_biz_get_send_stat(AI_SESSION_ID id, AI_BIZ_SEND_STAT_T *stat);
+
 /**
  * @brief get send id
  *
@@ -25,6 +25,7 @@
 #include "tal_system.h"
 #include "tal_thread.h"
 #include "tal_mutex.h"
+#include "tal_semaphore.h"
 #include "uni_random.h"
 #include "tal_log.h"
 #include "tal_memory.h"
@@ -52,6 +53,42 @@ typedef struct {
     void *usr_data;
 } AI_BASIC_BIZ_MONITOR_T;
 
+typedef enum {
+    AI_BIZ_SEND_PRIO_AUDIO = 0,
+    AI_BIZ_SEND_PRIO_MEDIA, // video and image
+    AI_BIZ_SEND_PRIO_OTHER, // text, file and event
+    AI_BIZ_SEND_PRIO_NUM,
+} AI_BIZ_SEND_PRIO_E;
+
+typedef struct ai_biz_send_node {
+    struct ai_biz_send_node *next;
+    uint16_t id;
+    AI_PACKET_PT type;
+    uint8_t sidx; // session slot, AI_SESSION_MAX_NUM if the id has no session
+    BOOL_T has_attr;
+    BOOL_T has_data;
+    SYS_TIME_T put_time;
+    AI_BIZ_ATTR_INFO_T attr;
+    AI_BIZ_HEAD_INFO_T head;
+    char data[];
+} AI_BIZ_SEND_NODE_T;
+
+typedef struct {
+    AI_BIZ_SEND_NODE_T *head;
+    AI_BIZ_SEND_NODE_T *tail;
+} AI_BIZ_SEND_LIST_T;
+
+typedef struct {
+    MUTEX_HANDLE mutex;
+    SEM_HANDLE wakeup; // posted on enqueue
+    SEM_HANDLE room;   // free slots, producers wait on it when the queue is full
+    AI_BIZ_SEND_LIST_T list[AI_BIZ_SEND_PRIO_NUM];
+    uint32_t count;
+    BOOL_T busy; // a popped packet is being sent
+    uint64_t latency_sum[AI_SESSION_MAX_NUM];
+    AI_BIZ_SEND_STAT_T stat[AI_SESSION_MAX_NUM];
+} AI_BIZ_SEND_QUEUE_T;
+
 typedef struct {
     THREAD_HANDLE thread;
     BOOL_T terminate;
@@ -59,6 +96,8 @@ typedef struct {
     AI_SESSION_T session[AI_SESSION_MAX_NUM];
     AI_BIZ_RECV_CB cb;
     AI_BASIC_BIZ_MONITOR_T *monitor;
+    AI_BIZ_SEND_QUEUE_T sendq;
+    BOOL_T pull_mode; // some send channel has a get_cb to poll
 } AI_BASIC_BIZ_T;
 
 AI_BASIC_BIZ_MONITOR_T ai_monitor;
@@ -242,52 +281,224 @@ OPERATE_RET tuya_ai_send_biz_pkt_custom(uint16_t id, AI_BIZ_ATTR_INFO_T *attr, A
     return rt;
 }
 
-static void __ai_biz_thread_cb(void *args)
+static AI_BIZ_SEND_PRIO_E __ai_biz_send_prio(AI_PACKET_PT type)
+{
+    if (type == AI_PT_AUDIO) {
+        return AI_BIZ_SEND_PRIO_AUDIO;
+    } else if ((type == AI_PT_VIDEO) || (type == AI_PT_IMAGE)) {
+        return AI_BIZ_SEND_PRIO_MEDIA;
+    }
+    return AI_BIZ_SEND_PRIO_OTHER;
+}
+
+// the caller holds ai_basic_biz->mutex
+static uint8_t __ai_biz_send_sidx(uint16_t id)
+{
+    uint32_t idx = 0, sidx = 0;
+    for (idx = 0; idx < AI_SESSION_MAX_NUM; idx++) {
+        if (ai_basic_biz->session[idx].id[0] != 0) {
+            AI_SESSION_CFG_T *cfg = &ai_basic_biz->session[idx].cfg;
+            for (sidx = 0; sidx < cfg->send_num; sidx++) {
+                if (cfg->send[sidx].id == id) {
+                    return idx;
+                }
+            }
+        }
+    }
+    return AI_SESSION_MAX_NUM;
+}
+
+static OPERATE_RET __ai_biz_send_queue_init(AI_BIZ_SEND_QUEUE_T *q)
 {
     OPERATE_RET rt = OPRT_OK;
-    uint32_t idx = 0, sidx = 0, kdx = 0;
-    while (!ai_basic_biz->terminate && tal_thread_get_state(ai_basic_biz->thread) == THREAD_STATE_RUNNING) {
-        if (!tuya_ai_client_is_ready()) {
-            tal_system_sleep(200);
-            continue;
+    TUYA_CALL_ERR_RETURN(tal_mutex_create_init(&q->mutex));
+    TUYA_CALL_ERR_RETURN(tal_semaphore_create_init(&q->wakeup, 0, 1));
+    TUYA_CALL_ERR_RETURN(tal_semaphore_create_init(&q->room, AI_BIZ_SEND_QUEUE_NUM, AI_BIZ_SEND_QUEUE_NUM));
+    return rt;
+}
+
+static void __ai_biz_send_queue_deinit(AI_BIZ_SEND_QUEUE_T *q)
+{
+    AI_BIZ_SEND_NODE_T *node = NULL;
+    uint32_t prio = 0;
+    for (prio = 0; prio < AI_BIZ_SEND_PRIO_NUM; prio++) {
+        while ((node = q->list[prio].head) != NULL) {
+            q->list[prio].head = node->next;
+            OS_FREE(node);
         }
-        tal_mutex_lock(ai_basic_biz->mutex);
-        uint16_t sent_ids[AI_MAX_SESSION_ID_NUM * AI_SESSION_MAX_NUM] = {0};
-        uint32_t sent_ids_count = 0;
-        for (idx = 0; idx < AI_SESSION_MAX_NUM; idx++) {
-            if (ai_basic_biz->session[idx].id[0] != 0) {
-                AI_SESSION_T *session = &ai_basic_biz->session[idx];
-                for (sidx = 0; sidx < session->cfg.send_num; sidx++) {
-                    uint16_t send_id = session->cfg.send[sidx].id;
-                    uint8_t already_sent = false;
-                    for (kdx = 0; kdx < sent_ids_count; kdx++) {
-                        if (sent_ids[kdx] == send_id) {
-                            already_sent = true;
-                            break;
-                        }
+        q->list[prio].tail = NULL;
+    }
+    q->count = 0;
+    if (q->room) {
+        tal_semaphore_release(q->room);
+        q->room = NULL;
+    }
+    if (q->wakeup) {
+        tal_semaphore_release(q->wakeup);
+        q->wakeup = NULL;
+    }
+    if (q->mutex) {
+        tal_mutex_release(q->mutex);
+        q->mutex = NULL;
+    }
+}
+
+// drop queued packets of a session slot, AI_SESSION_MAX_NUM drops all of them
+static void __ai_biz_send_purge(uint8_t sidx)
+{
+    AI_BIZ_SEND_QUEUE_T *q = &ai_basic_biz->sendq;
+    AI_BIZ_SEND_NODE_T *node = NULL, *prev = NULL, *next = NULL;
+    uint32_t prio = 0;
+
+    tal_mutex_lock(q->mutex);
+    for (prio = 0; prio < AI_BIZ_SEND_PRIO_NUM; prio++) {
+        prev = NULL;
+        for (node = q->list[prio].head; node; node = next) {
+            next = node->next;
+            if ((sidx != AI_SESSION_MAX_NUM) && (node->sidx != sidx)) {
+                prev = node;
+                continue;
+            }
+            if (prev) {
+                prev->next = next;
+            } else {
+                q->list[prio].head = next;
+            }
+            if (q->list[prio].tail == node) {
+                q->list[prio].tail = prev;
+            }
+            OS_FREE(node);
+            q->count--;
+            tal_semaphore_post(q->room);
+        }
+    }
+    if (sidx == AI_SESSION_MAX_NUM) {
+        memset(q->stat, 0, sizeof(q->stat));
+        memset(q->latency_sum, 0, sizeof(q->latency_sum));
+    } else {
+        memset(&q->stat[sidx], 0, sizeof(AI_BIZ_SEND_STAT_T));
+        q->latency_sum[sidx] = 0;
+    }
+    tal_mutex_unlock(q->mutex);
+}
+
+// the caller holds q->mutex, the highest priority packet goes first
+static AI_BIZ_SEND_NODE_T *__ai_biz_send_pop(AI_BIZ_SEND_QUEUE_T *q)
+{
+    AI_BIZ_SEND_NODE_T *node = NULL;
+    uint32_t prio = 0;
+    for (prio = 0; prio < AI_BIZ_SEND_PRIO_NUM; prio++) {
+        node = q->list[prio].head;
+        if (node) {
+            q->list[prio].head = node->next;
+            if (NULL == q->list[prio].head) {
+                q->list[prio].tail = NULL;
+            }
+            q->count--;
+            if (node->sidx < AI_SESSION_MAX_NUM) {
+                q->stat[node->sidx].queued--;
+            }
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void __ai_biz_send_queued(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+    AI_BIZ_SEND_QUEUE_T *q = &ai_basic_biz->sendq;
+    AI_BIZ_SEND_NODE_T *node = NULL;
+    uint32_t latency = 0;
+
+    while (!ai_basic_biz->terminate) {
+        tal_mutex_lock(q->mutex);
+        node = __ai_biz_send_pop(q);
+        q->busy = (node != NULL);
+        tal_mutex_unlock(q->mutex);
+        if (NULL == node) {
+            break;
+        }
+        tal_semaphore_post(q->room);
+
+        rt = tuya_ai_send_biz_pkt(node->id, node->has_attr ? &node->attr : NULL, node->type, &node->head,
+                                  node->has_data ? node->data : NULL);
+        if (node->sidx < AI_SESSION_MAX_NUM) {
+            AI_BIZ_SEND_STAT_T *stat = &q->stat[node->sidx];
+            latency = (uint32_t)(tal_system_get_millisecond() - node->put_time);
+            tal_mutex_lock(q->mutex);
+            if (OPRT_OK == rt) {
+                stat->sent++;
+                q->latency_sum[node->sidx] += latency;
+                if (latency > stat->latency_max_ms) {
+                    stat->latency_max_ms = latency;
+                }
+            } else {
+                stat->dropped++;
+            }
+            tal_mutex_unlock(q->mutex);
+        }
+        OS_FREE(node);
+    }
+}
+
+// legacy channels hand their data over through get_cb and have to be polled
+static void __ai_biz_send_pulled(void)
+{
+    OPERATE_RET rt = OPRT_OK;
+    uint32_t idx = 0, sidx = 0, kdx = 0;
+    tal_mutex_lock(ai_basic_biz->mutex);
+    uint16_t sent_ids[AI_MAX_SESSION_ID_NUM * AI_SESSION_MAX_NUM] = {0};
+    uint32_t sent_ids_count = 0;
+    for (idx = 0; idx < AI_SESSION_MAX_NUM; idx++) {
+        if (ai_basic_biz->session[idx].id[0] != 0) {
+            AI_SESSION_T *session = &ai_basic_biz->session[idx];
+            for (sidx = 0; sidx < session->cfg.send_num; sidx++) {
+                uint16_t send_id = session->cfg.send[sidx].id;
+                uint8_t already_sent = false;
+                for (kdx = 0; kdx < sent_ids_count; kdx++) {
+                    if (sent_ids[kdx] == send_id) {
+                        already_sent = true;
+                        break;
                     }
-                    if (!already_sent) {
-                        sent_ids[sent_ids_count++] = send_id;
-                        AI_BIZ_SEND_DATA_T *send = &session->cfg.send[sidx];
-                        if (send->get_cb) {
-                            AI_BIZ_ATTR_INFO_T attr = {0};
-                            AI_BIZ_HEAD_INFO_T head = {0};
-                            char *payload = NULL;
-                            rt = send->get_cb(&attr, &head, &payload);
-                            if (rt != OPRT_OK) {
-                                continue;
-                            }
-                            tuya_ai_send_biz_pkt(send->id, &attr, send->type, &head, payload);
-                            if (send->free_cb) {
-                                send->free_cb(payload);
-                            }
+                }
+                if (!already_sent) {
+                    sent_ids[sent_ids_count++] = send_id;
+                    AI_BIZ_SEND_DATA_T *send = &session->cfg.send[sidx];
+                    if (send->get_cb) {
+                        AI_BIZ_ATTR_INFO_T attr = {0};
+                        AI_BIZ_HEAD_INFO_T head = {0};
+                        char *payload = NULL;
+                        rt = send->get_cb(&attr, &head, &payload);
+                        if (rt != OPRT_OK) {
+                            continue;
+                        }
+                        tuya_ai_send_biz_pkt(send->id, &attr, send->type, &head, payload);
+                        if (send->free_cb) {
+                            send->free_cb(payload);
                         }
                     }
                 }
             }
         }
-        tal_mutex_unlock(ai_basic_biz->mutex);
-        tal_system_sleep(AI_BIZ_TASK_DELAY);
+    }
+    tal_mutex_unlock(ai_basic_biz->mutex);
+}
+
+static void __ai_biz_thread_cb(void *args)
+{
+    while (!ai_basic_biz->terminate && tal_thread_get_state(ai_basic_biz->thread) == THREAD_STATE_RUNNING) {
+        if (!tuya_ai_client_is_ready()) {
+            tal_system_sleep(200);
+            continue;
+        }
+        __ai_biz_send_queued();
+        if (ai_basic_biz->pull_mode) {
+            __ai_biz_send_pulled();
+            tal_semaphore_wait(ai_basic_biz->sendq.wakeup, AI_BIZ_TASK_DELAY);
+        } else {
+            tal_semaphore_wait(ai_basic_biz->sendq.wakeup, SEM_WAIT_FOREVER);
+        }
     }
 
     PR_NOTICE("ai biz thread exit");
@@ -343,6 +554,7 @@ static void __ai_biz_deinit(void)
             tal_mutex_release(ai_basic_biz->mutex);
             ai_basic_biz->mutex = NULL;
         }
+        __ai_biz_send_queue_deinit(&ai_basic_biz->sendq);
         OS_FREE(ai_basic_biz);
         ai_basic_biz = NULL;
     }
@@ -735,11 +947,13 @@ static OPERATE_RET __ai_biz_session_destory(AI_SESSION_ID id, AI_STATUS_CODE cod
             break;
         }
     }
+    ai_basic_biz->pull_mode = __ai_biz_need_send_task();
     tal_mutex_unlock(ai_basic_biz->mutex);
     if (idx == AI_SESSION_MAX_NUM) {
         PR_ERR("session not found");
         return OPRT_COM_ERROR;
     }
+    __ai_biz_send_purge(idx);
 
     if (sync_cloud) {
         rt = tuya_ai_basic_session_close(id, code);
@@ -896,7 +1110,9 @@ static OPERATE_RET __ai_clt_close_evt(void *data)
             memset(&ai_basic_biz->session[idx], 0, sizeof(AI_SESSION_T));
         }
     }
+    ai_basic_biz->pull_mode = FALSE;
     tal_mutex_unlock(ai_basic_biz->mutex);
+    __ai_biz_send_purge(AI_SESSION_MAX_NUM);
     AI_PROTO_D("close all session success");
     return OPRT_OK;
 }
@@ -910,6 +1126,7 @@ static OPERATE_RET __ai_clt_run_evt(void *data)
         memset(ai_basic_biz, 0, sizeof(AI_BASIC_BIZ_T));
         ai_basic_biz->monitor = &ai_monitor;
         TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&ai_basic_biz->mutex), EXIT);
+        TUYA_CALL_ERR_GOTO(__ai_biz_send_queue_init(&ai_basic_biz->sendq), EXIT);
         tuya_ai_client_reg_cb(__ai_biz_recv_handle);
         PR_NOTICE("ai biz init success");
     }
@@ -934,11 +1151,13 @@ void tuya_ai_biz_deinit(void)
     if (ai_basic_biz) {
         if (ai_basic_biz->thread) {
             ai_basic_biz->terminate = TRUE;
+            tal_semaphore_post(ai_basic_biz->sendq.wakeup);
         } else {
             if (ai_basic_biz->mutex) {
                 tal_mutex_release(ai_basic_biz->mutex);
                 ai_basic_biz->mutex = NULL;
             }
+            __ai_biz_send_queue_deinit(&ai_basic_biz->sendq);
             OS_FREE(ai_basic_biz);
             ai_basic_biz = NULL;
         }
@@ -1019,8 +1238,10 @@ OPERATE_RET tuya_ai_biz_crt_session(uint32_t bizCode, AI_SESSION_CFG_T *cfg, uin
             break;
         }
     }
-    if (__ai_biz_need_send_task()) {
+    ai_basic_biz->pull_mode = __ai_biz_need_send_task();
+    if (ai_basic_biz->pull_mode) {
         __ai_biz_create_task();
+        tal_semaphore_post(ai_basic_biz->sendq.wakeup);
     }
     tal_mutex_unlock(ai_basic_biz->mutex);
 
@@ -1106,6 +1327,133 @@ OPERATE_RET tuya_ai_parse_event_attr(char *de_buf, uint32_t attr_len, AI_EVENT_A
     return __ai_parse_event_attr(de_buf, attr_len, event);
 }
 
+OPERATE_RET tuya_ai_biz_send_enqueue(uint16_t id, AI_BIZ_ATTR_INFO_T *attr, AI_PACKET_PT type,
+                                     AI_BIZ_HEAD_INFO_T *head, char *payload, uint32_t timeout_ms)
+{
+    OPERATE_RET rt = OPRT_OK;
+    AI_BIZ_SEND_QUEUE_T *q = NULL;
+    AI_BIZ_SEND_LIST_T *list = NULL;
+    AI_BIZ_SEND_NODE_T *node = NULL;
+    uint8_t sidx = AI_SESSION_MAX_NUM;
+    uint32_t len = 0;
+
+    if (ai_basic_biz == NULL) {
+        PR_ERR("ai biz is null");
+        return OPRT_COM_ERROR;
+    }
+    TUYA_CHECK_NULL_RETURN(head, OPRT_INVALID_PARM);
+    q = &ai_basic_biz->sendq;
+    len = payload ? head->len : 0;
+
+    tal_mutex_lock(ai_basic_biz->mutex);
+    sidx = __ai_biz_send_sidx(id);
+    rt = __ai_biz_create_task();
+    tal_mutex_unlock(ai_basic_biz->mutex);
+    if (OPRT_OK != rt) {
+        return rt;
+    }
+
+    if (OPRT_OK != tal_semaphore_wait(q->room, timeout_ms)) {
+        AI_PROTO_D("send queue full, id:%d, type:%d", id, type);
+        if (sidx < AI_SESSION_MAX_NUM) {
+            tal_mutex_lock(q->mutex);
+            q->stat[sidx].dropped++;
+            tal_mutex_unlock(q->mutex);
+        }
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    node = OS_MALLOC(sizeof(AI_BIZ_SEND_NODE_T) + len);
+    if (NULL == node) {
+        tal_semaphore_post(q->room);
+        return OPRT_MALLOC_FAILED;
+    }
+    memset(node, 0, sizeof(AI_BIZ_SEND_NODE_T));
+    node->id = id;
+    node->type = type;
+    node->sidx = sidx;
+    node->put_time = tal_system_get_millisecond();
+    if (attr) {
+        node->has_attr = TRUE;
+        memcpy(&node->attr, attr, sizeof(AI_BIZ_ATTR_INFO_T));
+    }
+    memcpy(&node->head, head, sizeof(AI_BIZ_HEAD_INFO_T));
+    if (payload) {
+        node->has_data = TRUE;
+        memcpy(node->data, payload, len);
+    }
+
+    tal_mutex_lock(q->mutex);
+    list = &q->list[__ai_biz_send_prio(type)];
+    if (list->tail) {
+        list->tail->next = node;
+    } else {
+        list->head = node;
+    }
+    list->tail = node;
+    q->count++;
+    if (sidx < AI_SESSION_MAX_NUM) {
+        q->stat[sidx].queued++;
+    }
+    tal_mutex_unlock(q->mutex);
+
+    tal_semaphore_post(q->wakeup);
+    return OPRT_OK;
+}
+
+OPERATE_RET tuya_ai_biz_send_flush(uint32_t timeout_ms)
+{
+    SYS_TIME_T start = tal_system_get_millisecond();
+    BOOL_T idle = FALSE;
+
+    if (ai_basic_biz == NULL) {
+        PR_ERR("ai biz is null");
+        return OPRT_COM_ERROR;
+    }
+
+    while (1) {
+        tal_mutex_lock(ai_basic_biz->sendq.mutex);
+        idle = (ai_basic_biz->sendq.count == 0) && !ai_basic_biz->sendq.busy;
+        tal_mutex_unlock(ai_basic_biz->sendq.mutex);
+        if (idle) {
+            return OPRT_OK;
+        }
+        if ((tal_system_get_millisecond() - start) >= timeout_ms) {
+            PR_ERR("flush send queue timeout, left:%d", ai_basic_biz->sendq.count);
+            return OPRT_TIMEOUT;
+        }
+        tal_system_sleep(AI_BIZ_TASK_DELAY);
+    }
+}
+
+OPERATE_RET tuya_ai_biz_get_send_stat(AI_SESSION_ID id, AI_BIZ_SEND_STAT_T *stat)
+{
+    uint32_t idx = 0;
+
+    if ((ai_basic_biz == NULL) || (id == NULL) || (stat == NULL)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    tal_mutex_lock(ai_basic_biz->mutex);
+    for (idx = 0; idx < AI_SESSION_MAX_NUM; idx++) {
+        if (ai_basic_biz->session[idx].id[0] != 0 && !strcmp(ai_basic_biz->session[idx].id, id)) {
+            break;
+        }
+    }
+    tal_mutex_unlock(ai_basic_biz->mutex);
+    if (idx == AI_SESSION_MAX_NUM) {
+        return OPRT_NOT_FOUND;
+    }
+
+    tal_mutex_lock(ai_basic_biz->sendq.mutex);
+    memcpy(stat, &ai_basic_biz->sendq.stat[idx], sizeof(AI_BIZ_SEND_STAT_T));
+    if (stat->sent) {
+        stat->latency_avg_ms = (uint32_t)(ai_basic_biz->sendq.latency_sum[idx] / stat->sent);
+    }
+    tal_mutex_unlock(ai_basic_biz->sendq.mutex);
+    return OPRT_OK;
+}
+
 OPERATE_RET tuya_ai_biz_monitor_register(AI_BIZ_MONITOR_CB recv_cb, AI_BIZ_MONITOR_CB send_cb, void *usr_data)
 {
     ai_monitor.recv_cb = recv_cb;
@@ -53,6 +53,12 @@
 #define AI_WRITE_SOCKET_BUF_SIZE 0
 #endif
 
+// one buffer is held by the sender, one by the packet handed to the receive callback
+#ifndef AI_PKT_POOL_NUM
+#define AI_PKT_POOL_NUM 2
+#endif
+#define AI_PKT_BUF_LEN (AI_MAX_FRAGMENT_LENGTH + AI_ADD_PKT_LEN)
+
 /**
  *
  * packet: AI_PACKET_HEAD_T+(iv)+len+payload+sign
@@ -71,6 +77,12 @@ typedef struct {
     uint32_t offset;
 } AI_SEND_FRAG_MNG_T;
 
+typedef struct {
+    MUTEX_HANDLE mutex;
+    char *mem;
+    uint32_t used;
+} AI_PKT_POOL_T;
+
 typedef struct {
     AI_ATOP_CFG_INFO_T config;
     MUTEX_HANDLE mutex;
@@ -89,7 +101,8 @@ typedef struct {
     AI_RECV_FRAG_MNG_T recv_frag_mng;
     AI_SEND_FRAG_MNG_T send_frag_mng[2]; // 0:image,1:file
     bool frag_flag;
-    char recv_buf[AI_MAX_FRAGMENT_LENGTH + AI_ADD_PKT_LEN];
+    AI_PKT_POOL_T pkt_pool;
+    char *recv_buf; // pool buffer of the packet handed out by tuya_ai_basic_pkt_read
 } AI_BASIC_PROTO_T;
 
 static AI_BASIC_PROTO_T *ai_basic_proto = NULL;
@@ -202,6 +215,80 @@ static AI_PACKET_SL __ai_get_sl(AI_SEND_PACKET_T *info, uint8_t is_decrypt)
     }
 }
 
+static OPERATE_RET __ai_pkt_pool_init(AI_PKT_POOL_T *pool)
+{
+    OPERATE_RET rt = OPRT_OK;
+
+    pool->mem = OS_MALLOC(AI_PKT_POOL_NUM * AI_PKT_BUF_LEN);
+    TUYA_CHECK_NULL_RETURN(pool->mem, OPRT_MALLOC_FAILED);
+    pool->used = 0;
+    rt = tal_mutex_create_init(&pool->mutex);
+    if (OPRT_OK != rt) {
+        OS_FREE(pool->mem);
+        pool->mem = NULL;
+    }
+    return rt;
+}
+
+static void __ai_pkt_pool_deinit(AI_PKT_POOL_T *pool)
+{
+    if (pool->mutex) {
+        tal_mutex_release(pool->mutex);
+        pool->mutex = NULL;
+    }
+    if (pool->mem) {
+        OS_FREE(pool->mem);
+        pool->mem = NULL;
+    }
+    pool->used = 0;
+}
+
+/* the buffer is not cleared, every byte sent or read is written before use */
+static char *__ai_pkt_buf_get(void)
+{
+    AI_PKT_POOL_T *pool = &ai_basic_proto->pkt_pool;
+    char *buf = NULL;
+    uint32_t idx = 0;
+
+    tal_mutex_lock(pool->mutex);
+    for (idx = 0; idx < AI_PKT_POOL_NUM; idx++) {
+        if (!(pool->used & BIT(idx))) {
+            pool->used |= BIT(idx);
+            buf = pool->mem + idx * AI_PKT_BUF_LEN;
+            break;
+        }
+    }
+    tal_mutex_unlock(pool->mutex);
+
+    if (NULL == buf) {
+        AI_PROTO_D("pkt pool empty, malloc");
+        buf = OS_MALLOC(AI_PKT_BUF_LEN);
+    }
+    return buf;
+}
+
+static bool __ai_pkt_buf_in_pool(char *buf)
+{
+    AI_PKT_POOL_T *pool = &ai_basic_proto->pkt_pool;
+    return (pool->mem && buf >= pool->mem && buf < pool->mem + AI_PKT_POOL_NUM * AI_PKT_BUF_LEN);
+}
+
+static void __ai_pkt_buf_put(char *buf)
+{
+    AI_PKT_POOL_T *pool = &ai_basic_proto->pkt_pool;
+
+    if (NULL == buf) {
+        return;
+    }
+    if (!__ai_pkt_buf_in_pool(buf)) {
+        OS_FREE(buf);
+        return;
+    }
+    tal_mutex_lock(pool->mutex);
+    pool->used &= ~BIT((buf - pool->mem) / AI_PKT_BUF_LEN);
+    tal_mutex_unlock(pool->mutex);
+}
+
 static void __ai_basic_proto_deinit(void)
 {
     if (ai_basic_proto) {
@@ -219,6 +306,7 @@ static void __ai_basic_proto_deinit(void)
             OS_FREE(ai_basic_proto->connection_id);
             ai_basic_proto->connection_id = NULL;
         }
+        __ai_pkt_pool_deinit(&ai_basic_proto->pkt_pool);
         OS_FREE(ai_basic_proto);
         ai_basic_proto = NULL;
     }
@@ -243,7 +331,6 @@ static void __ai_basic_proto_reinit(void)
     ai_basic_proto->connected = FALSE;
     ai_basic_proto->sequence_in = 0;
     ai_basic_proto->sequence_out = 1;
-    memset(ai_basic_proto->recv_buf, 0, sizeof(ai_basic_proto->recv_buf));
     memset(ai_basic_proto->encrypt_iv, 0, AI_IV_LEN);
     uni_random_string(ai_basic_proto->encrypt_iv, AI_IV_LEN);
     ai_basic_proto->sl = AI_PACKET_SECURITY_LEVEL;
@@ -266,6 +353,7 @@ static OPERATE_RET __ai_basic_proto_init(void)
         TUYA_CALL_ERR_GOTO(__ai_generate_crypt_key(), EXIT);
         TUYA_CALL_ERR_GOTO(__ai_generate_sign_key(), EXIT);
         TUYA_CALL_ERR_GOTO(tal_mutex_create_init(&ai_basic_proto->mutex), EXIT);
+        TUYA_CALL_ERR_GOTO(__ai_pkt_pool_init(&ai_basic_proto->pkt_pool), EXIT);
         ai_basic_proto->sequence_out = 1;
         uni_random_string(ai_basic_proto->encrypt_iv, AI_IV_LEN);
         ai_basic_proto->sl = AI_PACKET_SECURITY_LEVEL;
@@ -544,7 +632,8 @@ static int __ai_encrypt_add_pkcs(char *p, uint32_t len)
     return (len + cz);
 }
 
-static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint32_t len, char *output, uint32_t *en_len)
+/* encrypts data in place, data must have AI_ADD_PKT_LEN bytes behind len for padding and tag */
+static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint32_t len, uint32_t *en_len)
 {
     OPERATE_RET rt = OPRT_OK;
     int data_out_len = 0;
@@ -554,11 +643,10 @@ static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint3
     AI_PACKET_SL sl = __ai_get_sl(info, false);
     if (sl == AI_PACKET_SL2) {
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL2)
-        memcpy(output, data, len);
-        data_out_len = __ai_encrypt_add_pkcs(output, len);
+        data_out_len = __ai_encrypt_add_pkcs(data, len);
         char nonce[12] = {0};
         memcpy(nonce, ai_basic_proto->encrypt_iv, sizeof(nonce));
-        rt = mbedtls_chacha20_crypt((uint8_t *)key, (uint8_t *)nonce, 0, len, (uint8_t *)data, (uint8_t *)output);
+        rt = mbedtls_chacha20_crypt((uint8_t *)key, (uint8_t *)nonce, 0, len, (uint8_t *)data, (uint8_t *)data);
         if (OPRT_OK != rt) {
             PR_ERR("chacha20_crypt error:%d", rt);
             return rt;
@@ -567,10 +655,9 @@ static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint3
 #endif
     } else if (sl == AI_PACKET_SL3) {
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL3)
-        memcpy(output, data, len);
-        data_out_len = tal_pkcs7padding_buffer((uint8_t *)output, len);
-        rt = tal_aes256_cbc_encode_raw((uint8_t *)output, data_out_len, (uint8_t *)key,
-                                       (uint8_t *)ai_basic_proto->encrypt_iv, (uint8_t *)output);
+        data_out_len = tal_pkcs7padding_buffer((uint8_t *)data, len);
+        rt = tal_aes256_cbc_encode_raw((uint8_t *)data, data_out_len, (uint8_t *)key,
+                                       (uint8_t *)ai_basic_proto->encrypt_iv, (uint8_t *)data);
         if (OPRT_OK != rt) {
             PR_ERR("aes128_cbc_encode error:%d", rt);
             return rt;
@@ -579,9 +666,7 @@ static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint3
 #endif
     } else if (sl == AI_PACKET_SL4) {
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL4)
-        uint8_t tag[AI_GCM_TAG_LEN] = {0};
-        memcpy(output, data, len);
-        data_out_len = __ai_encrypt_add_pkcs(output, len);
+        data_out_len = __ai_encrypt_add_pkcs(data, len);
 
         const cipher_params_t en_input = {
             .cipher_type = MBEDTLS_CIPHER_AES_256_GCM,
@@ -591,20 +676,19 @@ static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint3
             .nonce_len = AI_IV_LEN,
             .ad = NULL,
             .ad_len = 0,
-            .data = (uint8_t *)output,
+            .data = (uint8_t *)data,
             .data_len = data_out_len,
         };
-        rt = mbedtls_cipher_auth_encrypt_wrapper(&en_input, (uint8_t *)output, (size_t *)en_len, tag, sizeof(tag));
+        // the tag is written right behind the ciphertext
+        rt = mbedtls_cipher_auth_encrypt_inplace_wrapper(&en_input, AI_GCM_TAG_LEN);
         if (rt != OPRT_OK) {
             PR_ERR("aes128_gcm_encode error:%x", rt);
         }
-        memcpy(output + *en_len, tag, sizeof(tag));
-        *en_len += sizeof(tag);
-        // tuya_debug_hex_dump("encrypt_data", 64, (uint8_t *)output, *en_len);
+        *en_len = data_out_len + AI_GCM_TAG_LEN;
+        // tuya_debug_hex_dump("encrypt_data", 64, (uint8_t *)data, *en_len);
 #endif
     } else if (sl == AI_PACKET_SL0) {
         AI_PROTO_D("sl:%d do not need crypt", sl);
-        memcpy(output, data, len);
         *en_len = len;
     } else {
         PR_ERR("sl:%d err", sl);
@@ -614,7 +698,8 @@ static OPERATE_RET __ai_encrypt_packet(AI_SEND_PACKET_T *info, char *data, uint3
     return rt;
 }
 
-static OPERATE_RET __ai_decrypt_packet(char *data, uint32_t len, char *output, uint32_t *de_len)
+/* decrypts data in place, the plain text starts at data */
+static OPERATE_RET __ai_decrypt_packet(char *data, uint32_t len, uint32_t *de_len)
 {
     OPERATE_RET rt = OPRT_OK;
     char *key = __ai_get_crypt_key();
@@ -625,22 +710,22 @@ static OPERATE_RET __ai_decrypt_packet(char *data, uint32_t len, char *output, u
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL2)
         char nonce[12] = {0};
         memcpy(nonce, ai_basic_proto->decrypt_iv, sizeof(nonce));
-        rt = mbedtls_chacha20_crypt((uint8_t *)key, (uint8_t *)nonce, 0, len, (uint8_t *)data, (uint8_t *)output);
+        rt = mbedtls_chacha20_crypt((uint8_t *)key, (uint8_t *)nonce, 0, len, (uint8_t *)data, (uint8_t *)data);
         if (OPRT_OK != rt) {
             PR_ERR("chacha20_crypt error:%d", rt);
             return rt;
         }
-        *de_len = len - output[len - 1];
+        *de_len = len - data[len - 1];
 #endif
     } else if (sl == AI_PACKET_SL3) {
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL3)
         rt = tal_aes256_cbc_decode_raw((uint8_t *)data, len, (uint8_t *)key, (uint8_t *)ai_basic_proto->decrypt_iv,
-                                       (uint8_t *)output);
+                                       (uint8_t *)data);
         if (OPRT_OK != rt) {
             PR_ERR("aes128_cbc_decode error:%d", rt);
             return rt;
         }
-        *de_len = len - output[len - 1];
+        *de_len = len - data[len - 1];
 #endif
     } else if (sl == AI_PACKET_SL4) {
 #if (AI_PACKET_SECURITY_LEVEL == AI_PACKET_SL4)
@@ -660,17 +745,17 @@ static OPERATE_RET __ai_decrypt_packet(char *data, uint32_t len, char *output, u
             .data_len = len - AI_GCM_TAG_LEN,
         };
 
-        rt = mbedtls_cipher_auth_decrypt_wrapper(&de_input, (uint8_t *)output, (size_t *)de_len,
-                                                 (uint8_t *)(data + len - AI_GCM_TAG_LEN), AI_GCM_TAG_LEN);
+        // the tag follows the ciphertext in the packet
+        size_t olen = 0;
+        rt = mbedtls_cipher_auth_decrypt_inplace_wrapper(&de_input, AI_GCM_TAG_LEN, &olen);
         if (rt != OPRT_OK) {
             PR_ERR("aes128_gcm_decode error:%x", rt);
             return rt;
         }
-        *de_len = *de_len - output[*de_len - 1];
+        *de_len = olen - data[olen - 1];
 #endif
     } else if (sl == AI_PACKET_SL0) {
         AI_PROTO_D("sl:%d do not need crypt ", sl);
-        memcpy(output, data, len);
         *de_len = len;
     } else {
         AI_PROTO_D("sl:%d err", sl);
@@ -680,6 +765,7 @@ static OPERATE_RET __ai_decrypt_packet(char *data, uint32_t len, char *output, u
     return rt;
 }
 
+/* builds the payload at payload_buf and encrypts it there */
 static OPERATE_RET __ai_pack_payload(AI_SEND_PACKET_T *info, char *payload_buf, uint32_t *payload_len,
                                      AI_FRAG_FLAG frag, uint32_t origin_len)
 {
@@ -689,9 +775,7 @@ static OPERATE_RET __ai_pack_payload(AI_SEND_PACKET_T *info, char *payload_buf,
     TUYA_CHECK_NULL_RETURN(info, OPRT_INVALID_PARM);
     packet_len = __ai_get_send_payload_len(info, frag);
 
-    char *buf = OS_MALLOC(packet_len);
-    TUYA_CHECK_NULL_RETURN(buf, OPRT_MALLOC_FAILED);
-    memset(buf, 0, packet_len);
+    char *buf = payload_buf;
 
     if (tuya_ai_is_need_attr(frag)) {
         AI_PAYLOAD_HEAD_T payload_head = {0};
@@ -732,7 +816,6 @@ static OPERATE_RET __ai_pack_payload(AI_SEND_PACKET_T *info, char *payload_buf,
                     memcpy(buf + offset, info->attrs[idx]->value.str, attr_idx_len);
                 } else {
                     PR_ERR("unknow payload type:%d", payload_type);
-                    OS_FREE(buf);
                     return OPRT_COM_ERROR;
                 }
                 offset += attr_idx_len;
@@ -751,12 +834,11 @@ static OPERATE_RET __ai_pack_payload(AI_SEND_PACKET_T *info, char *payload_buf,
     AI_PROTO_D("payload len:%d, offset:%d", packet_len, offset);
 
     // tuya_debug_hex_dump("payload_uncrypt", 64, (uint8_t *)buf, packet_len);
-    rt = __ai_encrypt_packet(info, buf, packet_len, payload_buf, payload_len);
+    rt = __ai_encrypt_packet(info, buf, packet_len, payload_len);
     if (OPRT_OK != rt) {
         PR_ERR("encrypt packet failed, rt:%d", rt);
     }
 
-    OS_FREE(buf);
     return rt;
 }
 
@@ -892,9 +974,8 @@ static OPERATE_RET __ai_packet_write(AI_SEND_PACKET_T *info, AI_FRAG_FLAG frag,
         PR_ERR("send packet too long, len: %d", uncrypt_len);
         return OPRT_COM_ERROR;
     }
-    char *send_pkt_buf = OS_MALLOC(uncrypt_len);
+    char *send_pkt_buf = __ai_pkt_buf_get();
     TUYA_CHECK_NULL_RETURN(send_pkt_buf, OPRT_MALLOC_FAILED);
-    memset(send_pkt_buf, 0, uncrypt_len);
 
     uint32_t head_len = sizeof(AI_PACKET_HEAD_T);
     // AI_PROTO_D("head len:%d", head_len);
@@ -960,7 +1041,7 @@ static OPERATE_RET __ai_packet_write(AI_SEND_PACKET_T *info, AI_FRAG_FLAG frag,
 #endif
 
 EXIT:
-    OS_FREE(send_pkt_buf);
+    __ai_pkt_buf_put(send_pkt_buf);
     return rt;
 }
 
@@ -1491,10 +1572,14 @@ static int __ai_baisc_read_pkt_head(char *recv_buf)
 
 void tuya_ai_basic_pkt_free(char *data)
 {
+    char *recv_buf = ai_basic_proto->recv_buf;
     if (data == ai_basic_proto->recv_frag_mng.data) {
         OS_FREE(data);
         ai_basic_proto->recv_frag_mng.data = NULL;
         memset(&ai_basic_proto->recv_frag_mng, 0, sizeof(AI_RECV_FRAG_MNG_T));
+    } else if (recv_buf && (data >= recv_buf) && (data < recv_buf + AI_PKT_BUF_LEN)) {
+        ai_basic_proto->recv_buf = NULL;
+        __ai_pkt_buf_put(recv_buf);
     } else {
         OS_FREE(data);
     }
@@ -1519,10 +1604,9 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
     uint8_t calc_sign[AI_SIGN_LEN] = {0};
     uint8_t packet_sign[AI_SIGN_LEN] = {0};
     char *decrypt_buf = NULL;
-    char *recv_buf = ai_basic_proto->recv_buf;
-    TUYA_CHECK_NULL_RETURN(recv_buf, OPRT_COM_ERROR);
+    char *recv_buf = __ai_pkt_buf_get();
+    TUYA_CHECK_NULL_RETURN(recv_buf, OPRT_MALLOC_FAILED);
 
-    memset(recv_buf, 0, sizeof(ai_basic_proto->recv_buf));
     AI_PROTO_D("recv packet ing");
     int recv_len = __ai_baisc_read_pkt_head(recv_buf);
     if (recv_len <= 0) {
@@ -1542,7 +1626,7 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
     AI_PROTO_D("recv head len:%d", head_len);
     AI_PROTO_D("recv packet len:%d", packet_len);
 
-    if (packet_len + head_len > sizeof(ai_basic_proto->recv_buf)) {
+    if (packet_len + head_len > AI_PKT_BUF_LEN) {
         PR_ERR("recv packet too long, pkt len:%u, head len:%u", packet_len, head_len);
         recv_len = OPRT_RESOURCE_NOT_READY;
         goto EXIT;
@@ -1593,15 +1677,21 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
         goto EXIT;
     }
 
+    // the payload is decrypted in the receive buffer and handed out from there
     uint32_t decrypt_len = 0;
-    decrypt_buf = OS_MALLOC(packet_len + head_len + AI_ADD_PKT_LEN);
-    TUYA_CHECK_NULL_RETURN(decrypt_buf, OPRT_MALLOC_FAILED);
-    memset(decrypt_buf, 0, packet_len + head_len + AI_ADD_PKT_LEN);
-    rt = __ai_decrypt_packet(payload, payload_len, decrypt_buf, &decrypt_len);
+    decrypt_buf = payload;
+    rt = __ai_decrypt_packet(payload, payload_len, &decrypt_len);
     if (OPRT_OK != rt) {
         PR_ERR("decrypt packet failed, rt:%d", rt);
         goto EXIT;
     }
+    if (decrypt_len > payload_len) {
+        PR_ERR("decrypt len error, decrypt len:%d, payload len:%d", decrypt_len, payload_len);
+        recv_len = OPRT_RESOURCE_NOT_READY;
+        goto EXIT;
+    }
+    // text payloads are parsed as strings, the padding, tag and sign after the plaintext leave room for the '\0'
+    decrypt_buf[decrypt_len] = '\0';
     AI_PROTO_D("decrypt len:%d", decrypt_len);
     AI_PROTO_D("frag flag:%d, sdk frag flag:%d", head->frag_flag, __ai_basic_get_frag_flag());
 
@@ -1652,8 +1742,8 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
             memset(ai_basic_proto->recv_frag_mng.data, 0, frag_total_len);
             memcpy(ai_basic_proto->recv_frag_mng.data, decrypt_buf, decrypt_len);
             ai_basic_proto->recv_frag_mng.offset = decrypt_len;
-            OS_FREE(decrypt_buf);
-            decrypt_buf = NULL;
+            __ai_pkt_buf_put(recv_buf);
+            recv_buf = NULL;
             rt = tuya_ai_basic_pkt_read(out, out_len, out_frag);
             if (rt != OPRT_OK) {
                 PR_ERR("read continue frag packet failed, rt:%d", rt);
@@ -1663,8 +1753,8 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
             memcpy(ai_basic_proto->recv_frag_mng.data + ai_basic_proto->recv_frag_mng.offset, decrypt_buf, decrypt_len);
             ai_basic_proto->recv_frag_mng.frag_flag = current_frag_flag;
             ai_basic_proto->recv_frag_mng.offset += decrypt_len;
-            OS_FREE(decrypt_buf);
-            decrypt_buf = NULL;
+            __ai_pkt_buf_put(recv_buf);
+            recv_buf = NULL;
             rt = tuya_ai_basic_pkt_read(out, out_len, out_frag);
             if (rt != OPRT_OK) {
                 PR_ERR("read continue ing frag packet failed, rt:%d", rt);
@@ -1674,17 +1764,19 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
             memcpy(ai_basic_proto->recv_frag_mng.data + ai_basic_proto->recv_frag_mng.offset, decrypt_buf, decrypt_len);
             ai_basic_proto->recv_frag_mng.frag_flag = current_frag_flag;
             ai_basic_proto->recv_frag_mng.offset += decrypt_len;
-            OS_FREE(decrypt_buf);
-            decrypt_buf = NULL;
+            __ai_pkt_buf_put(recv_buf);
+            recv_buf = NULL;
             *out = ai_basic_proto->recv_frag_mng.data;
             *out_len = ai_basic_proto->recv_frag_mng.offset;
             *out_frag = AI_PACKET_NO_FRAG;
         } else {
+            ai_basic_proto->recv_buf = recv_buf;
             *out = decrypt_buf;
             *out_len = decrypt_len;
             *out_frag = AI_PACKET_NO_FRAG;
         }
     } else {
+        ai_basic_proto->recv_buf = recv_buf;
         *out = decrypt_buf;
         *out_len = decrypt_len;
         *out_frag = head->frag_flag;
@@ -1693,10 +1785,7 @@ OPERATE_RET tuya_ai_basic_pkt_read(char **out, uint32_t *out_len, AI_FRAG_FLAG *
     return rt;
 
 EXIT:
-    if (decrypt_buf) {
-        OS_FREE(decrypt_buf);
-        decrypt_buf = NULL;
-    }
+    __ai_pkt_buf_put(recv_buf);
     if (ai_basic_proto->recv_frag_mng.data) {
         OS_FREE(ai_basic_proto->recv_frag_mng.data);
     }
@@ -1823,7 +1912,7 @@ OPERATE_RET tuya_ai_auth_resp(void)
     AI_PAYLOAD_HEAD_T *packet = (AI_PAYLOAD_HEAD_T *)de_buf;
     if (packet->attribute_flag != AI_HAS_ATTR) {
         PR_ERR("auth resp packet has no attribute");
-        OS_FREE(de_buf);
+        tuya_ai_basic_pkt_free(de_buf);
         return OPRT_COM_ERROR;
     }
 
@@ -1839,7 +1928,7 @@ OPERATE_RET tuya_ai_auth_resp(void)
         PR_ERR("auth resp packet type error %d", packet->type);
         rt = OPRT_COM_ERROR;
     }
-    OS_FREE(de_buf);
+    tuya_ai_basic_pkt_free(de_buf);
     return rt;
 }
 
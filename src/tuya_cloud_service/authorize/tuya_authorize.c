@@ -85,6 +85,7 @@ OPERATE_RET tuya_authorize_write(const char *uuid, const char *authkey)
         (OPRT_OK == tal_kv_set(KVKEY_TYOPEN_AUTHKEY, (const uint8_t *)authkey, AUTHKEY_LENGTH))) {
         PR_INFO("Authorization write succeeds.");
 
+        tal_kv_flush();
         tal_system_reset();
         return OPRT_OK;
     } else {
@@ -79,7 +79,7 @@ static OPERATE_RET __mqbind_link_activete_cb(void *data)
 
 static void mqtt_bind_activate_token_on(tuya_protocol_event_t *ev)
 {
-    cJSON *data = (cJSON *)(ev->data);
+    cJSON *data = tuya_protocol_event_data_get(ev);
     mqtt_bind_t *mqbind = (mqtt_bind_t *)(ev->user_data);
 
     if (NULL == cJSON_GetObjectItem(data, "token")) {
@@ -180,7 +180,8 @@ void mqtt_bind_token_get_thread(void *args)
                 continue;
             }
             /* register token callback */
-            tuya_mqtt_protocol_register(&mqbind->mqctx, PRO_MQ_ACTIVE_TOKEN_ON, mqtt_bind_activate_token_on, mqbind);
+            tuya_mqtt_protocol_register_raw(&mqbind->mqctx, PRO_MQ_ACTIVE_TOKEN_ON, mqtt_bind_activate_token_on,
+                                            mqbind);
             mqbind->state = STATE_MQTT_BIND_CONNECT;
             break;
         }
@@ -11,7 +11,8 @@
  *
  *        Key functionalities include:
  *        - MQTT client connection and disconnection handling
- *        - Subscription to MQTT topics and message callback registration
+ *        - Subscription to MQTT topics and message callback registration,
+ *          dispatched through a topic trie supporting '+' and '#' wildcards
  *        - Publishing messages to MQTT topics
  *        - Parsing and processing of Tuya protocol messages
  *        - Secure signature generation for MQTT access
@@ -44,6 +45,205 @@ typedef struct {
     uint8_t data[0];
 } pv22_packet_object_t;
 
+#define MQTT_DISPATCH_CACHE_NUM 8
+
+/* Callbacks are collected under the lock and called after it is released, so
+ * they may register or unregister without deadlock or use after free of the
+ * registration. The flip side is that a callback collected just before an
+ * unregister still runs once after the unregister returned. */
+typedef struct {
+    union {
+        mqtt_subscribe_message_cb_t subscribe;
+        tuya_protocol_callback_t protocol;
+    } cb;
+    void *user_data;
+    bool raw; // protocol handler without cJSON tree
+} mqtt_dispatch_entry_t;
+
+typedef struct {
+    mqtt_dispatch_entry_t cache[MQTT_DISPATCH_CACHE_NUM];
+    mqtt_dispatch_entry_t *entry;
+    uint32_t num;
+    uint32_t max;
+} mqtt_dispatch_set_t;
+
+static void mqtt_dispatch_set_init(mqtt_dispatch_set_t *set)
+{
+    set->entry = set->cache;
+    set->num = 0;
+    set->max = MQTT_DISPATCH_CACHE_NUM;
+}
+
+static mqtt_dispatch_entry_t *mqtt_dispatch_set_add(mqtt_dispatch_set_t *set)
+{
+    if (set->num == set->max) {
+        mqtt_dispatch_entry_t *entry = tal_malloc(2 * set->max * sizeof(mqtt_dispatch_entry_t));
+        if (NULL == entry) {
+            PR_ERR("malloc error, callback dropped");
+            return NULL;
+        }
+        memcpy(entry, set->entry, set->num * sizeof(mqtt_dispatch_entry_t));
+        if (set->entry != set->cache) {
+            tal_free(set->entry);
+        }
+        set->entry = entry;
+        set->max *= 2;
+    }
+
+    return &set->entry[set->num++];
+}
+
+static void mqtt_dispatch_set_deinit(mqtt_dispatch_set_t *set)
+{
+    if (set->entry != set->cache) {
+        tal_free(set->entry);
+    }
+    set->entry = set->cache;
+    set->num = 0;
+}
+
+/* -------------------------------------------------------------------------- */
+/*                              Topic filter trie                             */
+/* -------------------------------------------------------------------------- */
+static const char *mqtt_topic_level_end(const char *level)
+{
+    while (*level && *level != '/') {
+        level++;
+    }
+    return level;
+}
+
+static bool mqtt_topic_node_is(const mqtt_topic_node_t *node, char wildcard)
+{
+    return node->level_len == 1 && node->level[0] == wildcard;
+}
+
+static mqtt_topic_node_t *mqtt_topic_node_find(mqtt_topic_node_t *node, const char *level, size_t level_len)
+{
+    for (; node; node = node->next) {
+        if (node->level_len == level_len && !memcmp(node->level, level, level_len)) {
+            return node;
+        }
+    }
+    return NULL;
+}
+
+/* node of the topic filter, created along the path if create is set */
+static mqtt_topic_node_t *mqtt_topic_node_get(tuya_mqtt_context_t *context, const char *topic, bool create)
+{
+    mqtt_topic_node_t **list = &context->subscribe_tree;
+    mqtt_topic_node_t *parent = NULL;
+    mqtt_topic_node_t *node = NULL;
+    const char *level = topic;
+    const char *end = NULL;
+
+    for (;;) {
+        end = mqtt_topic_level_end(level);
+        node = mqtt_topic_node_find(*list, level, end - level);
+        if (NULL == node) {
+            if (!create) {
+                return NULL;
+            }
+            node = tal_calloc(1, sizeof(mqtt_topic_node_t) + (end - level));
+            if (NULL == node) {
+                return NULL;
+            }
+            node->level_len = end - level;
+            memcpy(node->level, level, end - level);
+            node->parent = parent;
+            node->next = *list;
+            *list = node;
+        }
+        if (*end == '\0') {
+            return node;
+        }
+        parent = node;
+        list = &node->child;
+        level = end + 1;
+    }
+}
+
+/* release the nodes without filters and children, from node up to the root */
+static void mqtt_topic_node_prune(tuya_mqtt_context_t *context, mqtt_topic_node_t *node)
+{
+    while (node && NULL == node->handles && NULL == node->child) {
+        mqtt_topic_node_t *parent = node->parent;
+        mqtt_topic_node_t **list = parent ? &parent->child : &context->subscribe_tree;
+
+        while (*list != node) {
+            list = &(*list)->next;
+        }
+        *list = node->next;
+        tal_free(node);
+        node = parent;
+    }
+}
+
+static void mqtt_topic_handles_collect(mqtt_subscribe_handle_t *handle, mqtt_dispatch_set_t *set)
+{
+    mqtt_dispatch_entry_t *entry = NULL;
+
+    for (; handle; handle = handle->next) {
+        entry = mqtt_dispatch_set_add(set);
+        if (entry) {
+            entry->cb.subscribe = handle->cb;
+            entry->user_data = handle->userdata;
+        }
+    }
+}
+
+/* collect the filters of node and its siblings matching the topic from level */
+static void mqtt_topic_match(mqtt_topic_node_t *node, const char *level, bool first, mqtt_dispatch_set_t *set)
+{
+    const char *end = mqtt_topic_level_end(level);
+    size_t level_len = end - level;
+    // wildcards do not match the first level of "$SYS/..." topics
+    bool wildcard = !(first && level[0] == '$');
+    mqtt_topic_node_t *child = NULL;
+
+    for (; node; node = node->next) {
+        if (mqtt_topic_node_is(node, '#')) {
+            if (wildcard) {
+                mqtt_topic_handles_collect(node->handles, set);
+            }
+            continue;
+        }
+        if (!(wildcard && mqtt_topic_node_is(node, '+')) &&
+            !(node->level_len == level_len && !memcmp(node->level, level, level_len))) {
+            continue;
+        }
+        if (*end != '\0') {
+            mqtt_topic_match(node->child, end + 1, false, set);
+            continue;
+        }
+        mqtt_topic_handles_collect(node->handles, set);
+        // "a/#" matches "a" as well
+        for (child = node->child; child; child = child->next) {
+            if (mqtt_topic_node_is(child, '#')) {
+                mqtt_topic_handles_collect(child->handles, set);
+            }
+        }
+    }
+}
+
+static void mqtt_topic_tree_release(mqtt_topic_node_t *node)
+{
+    mqtt_topic_node_t *next = NULL;
+    mqtt_subscribe_handle_t *handle = NULL;
+
+    for (; node; node = next) {
+        next = node->next;
+        mqtt_topic_tree_release(node->child);
+        while (node->handles) {
+            handle = node->handles;
+            node->handles = handle->next;
+            tal_free(handle->topic);
+            tal_free(handle);
+        }
+        tal_free(node);
+    }
+}
+
 static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_access_t *signout)
 {
     if (NULL == input || signout == NULL) {
@@ -99,7 +299,7 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
  * when an MQTT subscribe message is received.
  *
  * @param context The MQTT context.
- * @param topic The topic to subscribe to.
+ * @param topic The topic to subscribe to, may contain the '+' and '#' wildcards.
  * @param cb The callback function to be called when a subscribe message is
  * received.
  * @param userdata User-defined data that will be passed to the callback
@@ -110,7 +310,7 @@ static int tuya_mqtt_signature_tool(const tuya_meta_info_t *input, tuya_mqtt_acc
 int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context, const char *topic,
                                                   mqtt_subscribe_message_cb_t cb, void *userdata)
 {
-    if (!context || !topic) {
+    if (!context || !topic || !context->mutex) {
         return OPRT_INVALID_PARM;
     }
 
@@ -119,37 +319,48 @@ int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context,
         return OPRT_COM_ERROR;
     }
 
+    if (NULL == cb) {
+        cb = on_subscribe_message_default;
+    }
+
+    tal_mutex_lock(context->mutex);
+    mqtt_topic_node_t *node = mqtt_topic_node_get(context, topic, true);
+    if (NULL == node) {
+        tal_mutex_unlock(context->mutex);
+        PR_ERR("malloc error");
+        return OPRT_MALLOC_FAILED;
+    }
+
     /* Repetition filter */
-    mqtt_subscribe_handle_t *target = context->subscribe_list;
-    while (target) {
-        if (!memcmp(target->topic, topic, target->topic_length) && target->cb == cb) {
+    mqtt_subscribe_handle_t *target = node->handles;
+    for (; target; target = target->next) {
+        if (target->cb == cb) {
+            tal_mutex_unlock(context->mutex);
             PR_WARN("Repetition:%s", topic);
             return OPRT_OK;
         }
-        target = target->next;
     }
 
     /* Intser new handle */
     mqtt_subscribe_handle_t *newtarget = tal_calloc(1, sizeof(mqtt_subscribe_handle_t));
-    if (!newtarget) {
+    if (newtarget) {
+        newtarget->topic_length = strlen(topic);
+        newtarget->topic = tal_calloc(1, newtarget->topic_length + 1); // strdup
+    }
+    if (!newtarget || !newtarget->topic) {
+        tal_free(newtarget);
+        mqtt_topic_node_prune(context, node);
+        tal_mutex_unlock(context->mutex);
         PR_ERR("malloc error");
         return OPRT_MALLOC_FAILED;
     }
-
-    newtarget->topic_length = strlen(topic);
-    newtarget->topic = tal_calloc(1, newtarget->topic_length + 1); // strdup
     strcpy(newtarget->topic, topic);
-
-    if (cb) {
-        newtarget->cb = cb;
-    } else {
-        newtarget->cb = on_subscribe_message_default;
-    }
+    newtarget->cb = cb;
     newtarget->userdata = userdata;
-    /* LOCK */
-    newtarget->next = context->subscribe_list;
-    context->subscribe_list = newtarget;
-    /* UNLOCK */
+    newtarget->next = node->handles;
+    node->handles = newtarget;
+    tal_mutex_unlock(context->mutex);
+
     return OPRT_OK;
 }
 
@@ -159,7 +370,7 @@ int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context,
  * This function unregisters the callback function that was previously
  * registered for handling MQTT subscribe messages. The callback function will
  * no longer be called when a subscribe message is received for the specified
- * topic.
+ * topic after the call, a message dispatched before may still call it once.
  *
  * @param context The MQTT context.
  * @param topic The topic for which the callback function should be
@@ -168,26 +379,23 @@ int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context,
  */
 int tuya_mqtt_subscribe_message_callback_unregister(tuya_mqtt_context_t *context, const char *topic)
 {
-    if (!context || !topic) {
+    if (!context || !topic || !context->mutex) {
         return OPRT_INVALID_PARM;
     }
 
-    size_t topic_length = strlen(topic);
-
-    /* LOCK */
-    /* Remove object form list */
-    mqtt_subscribe_handle_t **target = &context->subscribe_list;
-    while (*target) {
-        mqtt_subscribe_handle_t *entry = *target;
-        if (entry->topic_length == topic_length && !memcmp(topic, entry->topic, topic_length)) {
-            *target = entry->next;
+    /* Remove object form trie */
+    tal_mutex_lock(context->mutex);
+    mqtt_topic_node_t *node = mqtt_topic_node_get(context, topic, false);
+    if (node) {
+        while (node->handles) {
+            mqtt_subscribe_handle_t *entry = node->handles;
+            node->handles = entry->next;
             tal_free(entry->topic);
             tal_free(entry);
-        } else {
-            target = &entry->next;
         }
+        mqtt_topic_node_prune(context, node);
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->mutex);
 
     uint16_t msgid = mqtt_client_unsubscribe(context->mqtt_client, topic, MQTT_QOS_1);
     if (msgid <= 0) {
@@ -200,82 +408,171 @@ int tuya_mqtt_subscribe_message_callback_unregister(tuya_mqtt_context_t *context
 static void mqtt_subscribe_message_distribute(tuya_mqtt_context_t *context, uint16_t msgid,
                                               const mqtt_client_message_t *msg)
 {
-    const char *topic = msg->topic;
-    size_t topic_length = strlen(msg->topic);
+    mqtt_dispatch_set_t set;
+    uint32_t i = 0;
 
-    /* LOCK */
-    mqtt_subscribe_handle_t *target = context->subscribe_list;
-    for (; target; target = target->next) {
-        if (target->topic_length == topic_length && !memcmp(topic, target->topic, target->topic_length)) {
-            target->cb(msgid, msg, target->userdata);
-        }
+    mqtt_dispatch_set_init(&set);
+    tal_mutex_lock(context->mutex);
+    mqtt_topic_match(context->subscribe_tree, msg->topic, true, &set);
+    tal_mutex_unlock(context->mutex);
+
+    for (i = 0; i < set.num; i++) {
+        set.entry[i].cb.subscribe(msgid, msg, set.entry[i].user_data);
     }
-    /* UNLOCK */
+    mqtt_dispatch_set_deinit(&set);
 }
 
 /* -------------------------------------------------------------------------- */
 /*                       Tuya internal subscribe message                      */
 /* -------------------------------------------------------------------------- */
+/* the plaintext is never longer than the ciphertext, size + 1 is enough */
+static uint8_t *mqtt_rx_buf_reserve(tuya_mqtt_context_t *context, size_t size)
+{
+    if (context->rx_buf_size >= size) {
+        return context->rx_buf;
+    }
+
+    tal_free(context->rx_buf);
+    context->rx_buf_size = 0;
+    context->rx_buf = tal_malloc(size);
+    if (context->rx_buf) {
+        context->rx_buf_size = size;
+    }
+    return context->rx_buf;
+}
+
+/* keep small buffers for the next message, give large bursts back to the heap */
+static void mqtt_rx_buf_trim(tuya_mqtt_context_t *context)
+{
+    if (context->rx_buf_size > TUYA_MQTT_RX_BUF_KEEP) {
+        tal_free(context->rx_buf);
+        context->rx_buf = NULL;
+        context->rx_buf_size = 0;
+    }
+}
+
 static int tuya_protocol_message_parse_process(tuya_mqtt_context_t *context, const uint8_t *payload, size_t payload_len)
 {
     int ret = OPRT_OK;
 
-    char *jsonstr = NULL;
-    ret = tuya_parse_protocol_data(DP_CMD_MQ, (uint8_t *)payload, payload_len, context->signature.cipherkey,
-                                   (char **)&jsonstr);
+    uint8_t *buf = mqtt_rx_buf_reserve(context, payload_len + 1);
+    if (NULL == buf) {
+        PR_ERR("rx buf malloc fail:%d", (int)payload_len);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    size_t json_len = 0;
+    ret = tuya_parse_protocol_data_to(DP_CMD_MQ, payload, payload_len, context->signature.cipherkey, buf,
+                                      context->rx_buf_size, &json_len);
     if (OPRT_OK != ret) {
         PR_ERR("Cmd Parse Fail:%d", ret);
+        mqtt_rx_buf_trim(context);
         return OPRT_COM_ERROR;
     }
 
-    PR_DEBUG("Data JSON:%s", jsonstr);
-
-    /* json parse */
-    cJSON *root = NULL;
-    cJSON *json = NULL;
-    root = cJSON_Parse((const char *)jsonstr);
-    tal_free(jsonstr);
-    if (NULL == root) {
-        PR_ERR("JSON parse error");
-        return OPRT_CJSON_PARSE_ERR;
-    }
-
-    /* JSON key verfiy */
-    if ((NULL == cJSON_GetObjectItem(root, "protocol")) || (NULL == cJSON_GetObjectItem(root, "t")) ||
-        (NULL == cJSON_GetObjectItem(root, "data"))) {
-        PR_ERR("param is no correct");
-        cJSON_Delete(root);
-        return OPRT_CJSON_GET_ERR;
-    }
+    PR_DEBUG("Data JSON:%s", (char *)buf);
 
-    /* protocol ID */
-    int protocol_id = cJSON_GetObjectItem(root, "protocol")->valueint;
-    json = cJSON_GetObjectItem(root, "data");
-    if (NULL == json) {
-        PR_ERR("get json err");
-        cJSON_Delete(root);
-        return OPRT_CJSON_GET_ERR;
+    /* header scan, protocol t and data are required */
+    tuya_protocol_msg_t msg;
+    ret = tuya_protocol_msg_scan((const char *)buf, json_len, &msg);
+    if (OPRT_OK != ret) {
+        PR_ERR("param is no correct:%d", ret);
+        mqtt_rx_buf_trim(context);
+        return ret;
     }
 
     /* dispatch */
     tuya_protocol_event_t event;
-    event.event_id = protocol_id;
-    event.root_json = root;
-    event.data = cJSON_GetObjectItem(root, "data");
-
-    /* LOCK */
-    tuya_protocol_handle_t *target = context->protocol_list;
+    memset(&event, 0, sizeof(event));
+    event.event_id = msg.protocol;
+    event.t = msg.t;
+    event.data_raw = msg.data.type == TUYA_JSON_STRING ? msg.data.ptr - 1 : msg.data.ptr;
+    event.data_len = msg.data.type == TUYA_JSON_STRING ? msg.data.len + 2 : msg.data.len;
+    event.root_raw = (const char *)buf;
+    event.root_len = json_len;
+
+    mqtt_dispatch_set_t set;
+    mqtt_dispatch_entry_t *entry = NULL;
+    bool need_json = false;
+    uint32_t i = 0;
+
+    mqtt_dispatch_set_init(&set);
+    tal_mutex_lock(context->mutex);
+    tuya_protocol_handle_t *target = context->protocol_tbl[msg.protocol & (TUYA_MQTT_PROTOCOL_TBL_SIZE - 1)];
     for (; target; target = target->next) {
-        if (target->id == protocol_id) {
-            event.user_data = target->user_data, target->cb(&event);
+        if (target->id == msg.protocol && NULL != (entry = mqtt_dispatch_set_add(&set))) {
+            entry->cb.protocol = target->cb;
+            entry->user_data = target->user_data;
+            entry->raw = target->raw;
+            need_json |= !target->raw;
+        }
+    }
+    tal_mutex_unlock(context->mutex);
+
+    /* handlers registered without the raw flag get the trees they always had */
+    if (need_json) {
+        event.root_json = cJSON_ParseWithLength((const char *)buf, json_len);
+        event.data = cJSON_GetObjectItem(event.root_json, "data");
+        if (NULL == event.root_json) {
+            PR_ERR("json parse fail, protocol:%d", msg.protocol);
         }
     }
-    /* UNLOCK */
 
-    cJSON_Delete(root);
+    for (i = 0; i < set.num; i++) {
+        if (!set.entry[i].raw && NULL == event.root_json) {
+            continue;
+        }
+        event.user_data = set.entry[i].user_data;
+        set.entry[i].cb.protocol(&event);
+    }
+    mqtt_dispatch_set_deinit(&set);
+
+    if (event.root_json) {
+        cJSON_Delete(event.root_json);
+    } else if (event.data) {
+        cJSON_Delete(event.data);
+    }
+    mqtt_rx_buf_trim(context);
     return OPRT_OK;
 }
 
+/**
+ * @brief Gets the "data" part of a protocol event as a cJSON tree.
+ *
+ * @param event The event passed to the protocol callback.
+ * @return The "data" tree, or NULL if it is not valid JSON.
+ */
+cJSON *tuya_protocol_event_data_get(tuya_protocol_event_t *event)
+{
+    if (NULL == event) {
+        return NULL;
+    }
+
+    if (NULL == event->data && NULL != event->data_raw) {
+        event->data = cJSON_ParseWithLength(event->data_raw, event->data_len);
+    }
+    return event->data;
+}
+
+/**
+ * @brief Takes the "data" tree of a protocol event over.
+ *
+ * @param event The event passed to the protocol callback.
+ * @return The "data" tree owned by the caller, or NULL if it is not valid JSON.
+ */
+cJSON *tuya_protocol_event_data_detach(tuya_protocol_event_t *event)
+{
+    cJSON *data = tuya_protocol_event_data_get(event);
+    /* the tree belongs to root_json, which the other handlers still read */
+    if (data && event->root_json) {
+        return cJSON_Duplicate(data, true);
+    }
+    if (data) {
+        event->data = NULL;
+    }
+    return data;
+}
+
 static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata)
 {
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
@@ -285,6 +582,263 @@ static void on_subscribe_message_default(uint16_t msgid, const mqtt_client_messa
     }
 }
 
+/* -------------------------------------------------------------------------- */
+/*                              Publish pipeline                              */
+/* -------------------------------------------------------------------------- */
+/*
+ * QoS1 publishes are queued on publish_list, at most MQTT_PUBLISH_WINDOW of
+ * them wait for their PUBACK in publish_inflight, placed from the msgid. Every
+ * handle also sits in the timeout wheel, a bucket per MQTT_PUBLISH_WHEEL_TICK_MS
+ * of deadline, so the loop only looks at the buckets it has passed.
+ * Callbacks are called without publish_mutex held.
+ */
+#define MQTT_PUBLISH_INFLIGHT_MASK (MQTT_PUBLISH_WINDOW - 1)
+#define MQTT_PUBLISH_WHEEL_MASK    (MQTT_PUBLISH_WHEEL_SIZE - 1)
+
+#if (MQTT_PUBLISH_WINDOW & MQTT_PUBLISH_INFLIGHT_MASK) || (MQTT_PUBLISH_WHEEL_SIZE & MQTT_PUBLISH_WHEEL_MASK)
+#error "MQTT_PUBLISH_WINDOW and MQTT_PUBLISH_WHEEL_SIZE must be powers of 2"
+#endif
+
+static uint32_t mqtt_publish_now(void)
+{
+    return (uint32_t)tal_system_get_millisecond();
+}
+
+/* one allocation, the payload is stored right after the handle */
+static mqtt_publish_handle_t *mqtt_publish_handle_new(const char *topic, size_t payload_size,
+                                                      mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms)
+{
+    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t) + payload_size);
+    if (handle == NULL) {
+        return NULL;
+    }
+    memset(handle, 0, sizeof(mqtt_publish_handle_t));
+    handle->topic = (char *)topic;
+    handle->payload = handle->data;
+    handle->payload_length = payload_size;
+    handle->deadline = mqtt_publish_now() + (uint32_t)timeout_ms;
+    handle->cb = cb;
+    handle->user_data = user_data;
+    return handle;
+}
+
+static void mqtt_publish_wheel_add(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    /* rounded up, the bucket is swept once its tick has passed and the deadline with it */
+    uint32_t tick = handle->deadline / MQTT_PUBLISH_WHEEL_TICK_MS;
+
+    if (handle->deadline % MQTT_PUBLISH_WHEEL_TICK_MS) {
+        tick++;
+    }
+
+    /* the current bucket is already swept */
+    if ((int32_t)(tick - context->publish_wheel_tick) <= 0) {
+        tick = context->publish_wheel_tick + 1;
+    }
+
+    mqtt_publish_handle_t **bucket = &context->publish_wheel[tick & MQTT_PUBLISH_WHEEL_MASK];
+    handle->wheel_next = *bucket;
+    if (*bucket) {
+        (*bucket)->wheel_pprev = &handle->wheel_next;
+    }
+    handle->wheel_pprev = bucket;
+    *bucket = handle;
+}
+
+static void mqtt_publish_wheel_del(mqtt_publish_handle_t *handle)
+{
+    *handle->wheel_pprev = handle->wheel_next;
+    if (handle->wheel_next) {
+        handle->wheel_next->wheel_pprev = handle->wheel_pprev;
+    }
+    handle->wheel_next = NULL;
+    handle->wheel_pprev = NULL;
+}
+
+/* the caller makes sure the window is not full, so a free slot is found */
+static void mqtt_publish_inflight_add(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    uint32_t i;
+    for (i = 0; i < MQTT_PUBLISH_WINDOW; i++) {
+        uint32_t slot = (handle->msgid + i) & MQTT_PUBLISH_INFLIGHT_MASK;
+        if (context->publish_inflight[slot] == NULL) {
+            context->publish_inflight[slot] = handle;
+            context->publish_inflight_num++;
+            return;
+        }
+    }
+}
+
+static mqtt_publish_handle_t *mqtt_publish_inflight_take(tuya_mqtt_context_t *context, uint16_t msgid)
+{
+    uint32_t i;
+    for (i = 0; i < MQTT_PUBLISH_WINDOW; i++) {
+        uint32_t slot = (msgid + i) & MQTT_PUBLISH_INFLIGHT_MASK;
+        mqtt_publish_handle_t *handle = context->publish_inflight[slot];
+        if (handle && handle->msgid == msgid) {
+            context->publish_inflight[slot] = NULL;
+            context->publish_inflight_num--;
+            return handle;
+        }
+    }
+    return NULL;
+}
+
+static void mqtt_publish_pending_append(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    handle->next = NULL;
+    if (context->publish_tail) {
+        context->publish_tail->next = handle;
+    } else {
+        context->publish_list = handle;
+    }
+    context->publish_tail = handle;
+}
+
+/* take a handle out of the pending queue or the window */
+static void mqtt_publish_detach(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    if (handle->msgid) {
+        mqtt_publish_inflight_take(context, handle->msgid);
+        return;
+    }
+
+    mqtt_publish_handle_t *prev = NULL;
+    mqtt_publish_handle_t **link = &context->publish_list;
+    while (*link && *link != handle) {
+        prev = *link;
+        link = &(*link)->next;
+    }
+    if (*link == NULL) {
+        return;
+    }
+    *link = handle->next;
+    if (context->publish_tail == handle) {
+        context->publish_tail = prev;
+    }
+}
+
+/* send one QoS1 publish and move it into the window, publish_mutex held */
+static bool mqtt_publish_send(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle)
+{
+    uint16_t msgid =
+        mqtt_client_publish(context->mqtt_client, handle->topic, handle->payload, handle->payload_length, MQTT_QOS_1);
+    if (msgid == 0) {
+        return false;
+    }
+    handle->msgid = msgid;
+    mqtt_publish_inflight_add(context, handle);
+    return true;
+}
+
+/* send the pending publishes while the window has room, publish_mutex held */
+static void mqtt_publish_pending_flush(tuya_mqtt_context_t *context)
+{
+    while (context->publish_list && context->publish_inflight_num < MQTT_PUBLISH_WINDOW) {
+        mqtt_publish_handle_t *handle = context->publish_list;
+        if (!mqtt_publish_send(context, handle)) {
+            break;
+        }
+        context->publish_list = handle->next;
+        if (context->publish_list == NULL) {
+            context->publish_tail = NULL;
+        }
+        handle->next = NULL;
+    }
+}
+
+/* sweep the wheel up to now, the expired handles are returned linked by next */
+static mqtt_publish_handle_t *mqtt_publish_expire(tuya_mqtt_context_t *context, uint32_t now)
+{
+    mqtt_publish_handle_t *expired = NULL;
+    mqtt_publish_handle_t **expired_tail = &expired;
+    uint32_t now_tick = now / MQTT_PUBLISH_WHEEL_TICK_MS;
+    uint32_t ticks = now_tick - context->publish_wheel_tick;
+
+    if (ticks > MQTT_PUBLISH_WHEEL_SIZE) {
+        ticks = MQTT_PUBLISH_WHEEL_SIZE;
+    }
+
+    for (; ticks > 0; ticks--) {
+        mqtt_publish_handle_t *handle = context->publish_wheel[(now_tick - ticks + 1) & MQTT_PUBLISH_WHEEL_MASK];
+        while (handle) {
+            mqtt_publish_handle_t *wheel_next = handle->wheel_next;
+            /* a bucket is only swept after its tick, what is left belongs to a later lap */
+            if ((int32_t)(handle->deadline - now) <= 0) {
+                mqtt_publish_wheel_del(handle);
+                mqtt_publish_detach(context, handle);
+                handle->next = NULL;
+                *expired_tail = handle;
+                expired_tail = &handle->next;
+            }
+            handle = wheel_next;
+        }
+    }
+    context->publish_wheel_tick = now_tick;
+
+    return expired;
+}
+
+static void mqtt_publish_notify(mqtt_publish_handle_t *list, int result)
+{
+    while (list) {
+        mqtt_publish_handle_t *next = list->next;
+        list->cb(result, list->user_data);
+        tal_free(list);
+        list = next;
+    }
+}
+
+/* the handle belongs to the pipeline from here */
+static int mqtt_publish_submit(tuya_mqtt_context_t *context, mqtt_publish_handle_t *handle, bool async)
+{
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_wheel_add(context, handle);
+    /* the lock is held over the send, a PUBACK can not arrive before the msgid is recorded */
+    if (async == false && context->publish_list == NULL && context->publish_inflight_num < MQTT_PUBLISH_WINDOW &&
+        mqtt_publish_send(context, handle)) {
+        tal_mutex_unlock(context->publish_mutex);
+        return OPRT_OK;
+    }
+    mqtt_publish_pending_append(context, handle);
+    tal_mutex_unlock(context->publish_mutex);
+    return OPRT_OK;
+}
+
+/* no PUBACK is coming for the window after a disconnect, send it again first */
+static void mqtt_publish_requeue(tuya_mqtt_context_t *context)
+{
+    mqtt_publish_handle_t *head = NULL;
+    mqtt_publish_handle_t *last = NULL;
+    uint32_t i;
+
+    tal_mutex_lock(context->publish_mutex);
+    for (i = 0; i < MQTT_PUBLISH_WINDOW; i++) {
+        mqtt_publish_handle_t *handle = context->publish_inflight[i];
+        if (handle == NULL) {
+            continue;
+        }
+        context->publish_inflight[i] = NULL;
+        handle->msgid = 0;
+        handle->next = NULL;
+        if (last) {
+            last->next = handle;
+        } else {
+            head = handle;
+        }
+        last = handle;
+    }
+    context->publish_inflight_num = 0;
+    if (head) {
+        last->next = context->publish_list;
+        if (context->publish_list == NULL) {
+            context->publish_tail = last;
+        }
+        context->publish_list = head;
+    }
+    tal_mutex_unlock(context->publish_mutex);
+}
+
 /* -------------------------------------------------------------------------- */
 /*                         MQTT Client event callback                         */
 /* -------------------------------------------------------------------------- */
@@ -309,6 +863,7 @@ static void mqtt_client_disconnected_cb(void *client, void *userdata)
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
     PR_INFO("mqtt client disconnected!");
     context->is_connected = false;
+    mqtt_publish_requeue(context);
     if (context->on_disconnect) {
         context->on_disconnect(context, context->user_data);
     }
@@ -337,20 +892,15 @@ static void mqtt_client_puback_cb(void *client, uint16_t msgid, void *userdata)
     tuya_mqtt_context_t *context = (tuya_mqtt_context_t *)userdata;
     PR_DEBUG("PUBACK ID:%d", msgid);
 
-    /* LOCK */
-    /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
-    for (; *next_handle; next_handle = &(*next_handle)->next) {
-        mqtt_publish_handle_t *entry = *next_handle;
-        if (msgid == entry->msgid) {
-            entry->cb(OPRT_OK, entry->user_data);
-            *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
-            break;
-        }
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *handle = mqtt_publish_inflight_take(context, msgid);
+    if (handle) {
+        mqtt_publish_wheel_del(handle);
+        handle->next = NULL;
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->publish_mutex);
+
+    mqtt_publish_notify(handle, OPRT_OK);
 }
 
 /**
@@ -392,10 +942,29 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
         return rt;
     }
 
+    rt = tal_mutex_create_init(&context->mutex);
+    if (OPRT_OK != rt) {
+        PR_ERR("mqtt mutex create error:%d", rt);
+        return rt;
+    }
+
+    rt = tal_mutex_create_init(&context->publish_mutex);
+    if (OPRT_OK != rt) {
+        PR_ERR("mqtt mutex create error:%d", rt);
+        tal_mutex_release(context->mutex);
+        context->mutex = NULL;
+        return rt;
+    }
+    context->publish_wheel_tick = mqtt_publish_now() / MQTT_PUBLISH_WHEEL_TICK_MS;
+
     /* MQTT Client object new */
     context->mqtt_client = mqtt_client_new();
     if (context->mqtt_client == NULL) {
         PR_ERR("mqtt client new fault.");
+        tal_mutex_release(context->publish_mutex);
+        context->publish_mutex = NULL;
+        tal_mutex_release(context->mutex);
+        context->mutex = NULL;
         return OPRT_MALLOC_FAILED;
     }
 
@@ -418,6 +987,12 @@ int tuya_mqtt_init(tuya_mqtt_context_t *context, const tuya_mqtt_config_t *confi
     mqtt_status = mqtt_client_init(context->mqtt_client, &mqtt_config);
     if (mqtt_status != MQTT_STATUS_SUCCESS) {
         PR_ERR("MQTT init failed: Status = %d.", mqtt_status);
+        mqtt_client_free(context->mqtt_client);
+        context->mqtt_client = NULL;
+        tal_mutex_release(context->publish_mutex);
+        context->publish_mutex = NULL;
+        tal_mutex_release(context->mutex);
+        context->mutex = NULL;
         return OPRT_COM_ERROR;
     }
 
@@ -511,33 +1086,22 @@ int tuya_mqtt_stop(tuya_mqtt_context_t *context)
     return OPRT_OK;
 }
 
-/**
- * @brief Registers a MQTT protocol with the given context.
- *
- * This function registers a MQTT protocol with the specified context. The
- * protocol is identified by the protocol ID. When a message with the registered
- * protocol ID is received, the provided callback function will be called.
- *
- * @param[in] context The MQTT context to register the protocol with.
- * @param[in] protocol_id The ID of the protocol to register.
- * @param[in] cb The callback function to be called when a message with the
- * registered protocol ID is received.
- * @param[in] user_data User data to be passed to the callback function.
- *
- * @return 0 on success, negative error code on failure.
- */
-int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
-                                void *user_data)
+/* raw handlers read the message in place, the others get root_json and data */
+static int mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
+                                  void *user_data, bool raw)
 {
     if (context == NULL || context->is_inited == false || cb == NULL) {
         return OPRT_INVALID_PARM;
     }
 
-    /* LOCK */
+    tuya_protocol_handle_t **bucket = &context->protocol_tbl[protocol_id & (TUYA_MQTT_PROTOCOL_TBL_SIZE - 1)];
+
+    tal_mutex_lock(context->mutex);
     /* Repetition filter */
-    tuya_protocol_handle_t *target = context->protocol_list;
+    tuya_protocol_handle_t *target = *bucket;
     while (target) {
         if (target->id == protocol_id && target->cb == cb) {
+            tal_mutex_unlock(context->mutex);
             return OPRT_COM_ERROR;
         }
         target = target->next;
@@ -545,24 +1109,70 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
 
     tuya_protocol_handle_t *new_handle = tal_calloc(1, sizeof(tuya_protocol_handle_t));
     if (!new_handle) {
+        tal_mutex_unlock(context->mutex);
         return OPRT_MALLOC_FAILED;
     }
     new_handle->id = protocol_id;
     new_handle->cb = cb;
     new_handle->user_data = user_data;
-    new_handle->next = context->protocol_list;
-    context->protocol_list = new_handle;
-    /* UNLOCK */
+    new_handle->raw = raw;
+    new_handle->next = *bucket;
+    *bucket = new_handle;
+    tal_mutex_unlock(context->mutex);
 
     return OPRT_OK;
 }
 
+/**
+ * @brief Registers a MQTT protocol with the given context.
+ *
+ * This function registers a MQTT protocol with the specified context. The
+ * protocol is identified by the protocol ID. When a message with the registered
+ * protocol ID is received, the provided callback function will be called with
+ * root_json and data filled.
+ *
+ * @param[in] context The MQTT context to register the protocol with.
+ * @param[in] protocol_id The ID of the protocol to register.
+ * @param[in] cb The callback function to be called when a message with the
+ * registered protocol ID is received.
+ * @param[in] user_data User data to be passed to the callback function.
+ *
+ * @return 0 on success, negative error code on failure.
+ */
+int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
+                                void *user_data)
+{
+    return mqtt_protocol_register(context, protocol_id, cb, user_data, false);
+}
+
+/**
+ * @brief Registers a MQTT protocol handler which reads the message in place.
+ *
+ * Same as tuya_mqtt_protocol_register(), but no cJSON tree is built for the
+ * handler, it reads data_raw and root_raw or calls
+ * tuya_protocol_event_data_get().
+ *
+ * @param[in] context The MQTT context to register the protocol with.
+ * @param[in] protocol_id The ID of the protocol to register.
+ * @param[in] cb The callback function to be called when a message with the
+ * registered protocol ID is received.
+ * @param[in] user_data User data to be passed to the callback function.
+ *
+ * @return 0 on success, negative error code on failure.
+ */
+int tuya_mqtt_protocol_register_raw(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
+                                    void *user_data)
+{
+    return mqtt_protocol_register(context, protocol_id, cb, user_data, true);
+}
+
 /**
  * Unregisters a protocol from the Tuya MQTT service.
  *
  * This function unregisters a protocol identified by the given protocol ID from
  * the Tuya MQTT service. The protocol ID and callback function must match the
- * ones used during registration.
+ * ones used during registration. A message dispatched before the call may
+ * still call cb once after return, see mqtt_dispatch_entry_t.
  *
  * @param context The Tuya MQTT context.
  * @param protocol_id The ID of the protocol to unregister.
@@ -575,9 +1185,9 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
         return OPRT_INVALID_PARM;
     }
 
-    /* LOCK */
+    tal_mutex_lock(context->mutex);
     /* Remove object form list */
-    tuya_protocol_handle_t **target = &context->protocol_list;
+    tuya_protocol_handle_t **target = &context->protocol_tbl[protocol_id & (TUYA_MQTT_PROTOCOL_TBL_SIZE - 1)];
     while (*target) {
         tuya_protocol_handle_t *entry = *target;
         if (entry->id == protocol_id && entry->cb == cb) {
@@ -587,7 +1197,7 @@ int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protoco
             target = &entry->next;
         }
     }
-    /* UNLOCK */
+    tal_mutex_unlock(context->mutex);
 
     return OPRT_OK;
 }
@@ -607,18 +1217,21 @@ int tuya_mqtt_protocol_unregister_all(tuya_mqtt_context_t *context)
     }
 
     PR_DEBUG("Unregister all MQTT Protocol");
-    /* LOCK */
+    tal_mutex_lock(context->mutex);
     /* Remove object form list */
+    uint32_t i = 0;
     tuya_protocol_handle_t *entry = NULL;
-    tuya_protocol_handle_t *target = context->protocol_list;
-    while (target) {
-        entry = target;
-        target = entry->next;
-        tal_free(entry);
+    tuya_protocol_handle_t *target = NULL;
+    for (i = 0; i < TUYA_MQTT_PROTOCOL_TBL_SIZE; i++) {
+        target = context->protocol_tbl[i];
+        while (target) {
+            entry = target;
+            target = entry->next;
+            tal_free(entry);
+        }
+        context->protocol_tbl[i] = NULL;
     }
-    /* UNLOCK */
-
-    context->protocol_list = NULL;
+    tal_mutex_unlock(context->mutex);
 
     return OPRT_OK;
 }
@@ -654,38 +1267,11 @@ int tuya_mqtt_client_publish_common(tuya_mqtt_context_t *context, const char *to
         return OPRT_OK;
     }
 
-    mqtt_publish_handle_t *handle = tal_malloc(sizeof(mqtt_publish_handle_t));
+    mqtt_publish_handle_t *handle = mqtt_publish_handle_new(topic, payload_length, cb, user_data, timeout_ms);
     TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
-    handle->next = NULL;
-    handle->msgid = 0;
-    handle->topic = (char *)topic;
-    handle->timeout = tal_time_get_posix() + timeout_ms;
-    handle->cb = cb;
-    handle->user_data = user_data;
-    handle->payload_length = payload_length;
-    handle->payload = tal_malloc(payload_length);
-    if (handle->payload == NULL) {
-        return OPRT_MALLOC_FAILED;
-    }
     memcpy(handle->payload, payload, payload_length);
 
-    if (async == false) {
-        handle->msgid = mqtt_client_publish(context->mqtt_client, handle->topic, handle->payload,
-                                            handle->payload_length, MQTT_QOS_1);
-    }
-
-    if (context->publish_list == NULL) {
-        context->publish_list = handle;
-        return OPRT_OK;
-    }
-
-    mqtt_publish_handle_t *last = context->publish_list;
-    while (last->next != NULL) {
-        last = last->next;
-    }
-    last->next = handle;
-
-    return OPRT_OK;
+    return mqtt_publish_submit(context, handle, async);
 }
 
 /**
@@ -718,23 +1304,78 @@ int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *conte
         return OPRT_COM_ERROR;
     }
 
+    const tuya_protocol_iov_t iov = {.data = data, .len = length};
+    return tuya_mqtt_protocol_data_publish_iov_common(context, topic, protocol_id, &iov, 1, cb, user_data, timeout_ms,
+                                                      async);
+}
+
+/**
+ * Publishes MQTT protocol data given as fragments.
+ *
+ * @param context The MQTT context.
+ * @param topic The topic to publish the data to.
+ * @param protocol_id The protocol ID.
+ * @param iov The data fragments.
+ * @param iov_cnt The number of fragments.
+ * @param cb The callback function to be called after the publish operation is
+ * complete.
+ * @param user_data User data to be passed to the callback function.
+ * @param timeout_ms The timeout value for the publish operation in
+ * milliseconds.
+ * @param async Specifies whether the publish operation should be performed
+ * asynchronously.
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int tuya_mqtt_protocol_data_publish_iov_common(tuya_mqtt_context_t *context, const char *topic, uint16_t protocol_id,
+                                               const tuya_protocol_iov_t *iov, uint32_t iov_cnt,
+                                               mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms,
+                                               bool async)
+{
+    if (context == NULL || context->is_inited == false || topic == NULL || iov == NULL ||
+        (cb == NULL && async == true)) {
+        return OPRT_INVALID_PARM;
+    }
+
+    if (context->is_connected == false) {
+        return OPRT_COM_ERROR;
+    }
+
     int ret = OPRT_OK;
+    uint32_t i = 0;
+    uint32_t payload_len = 0;
+    uint32_t frame_len = 0;
+
+    for (i = 0; i < iov_cnt; i++) {
+        payload_len += iov[i].len;
+    }
 
-    char *buffer = NULL;
-    uint32_t buffer_len = 0;
+    uint32_t frame_size = tuya_pack_protocol_frame_size(DP_CMD_MQ, payload_len);
+    if (cb == NULL) {
+        /* QoS0, nothing to keep after the send */
+        uint8_t *frame = tal_malloc(frame_size);
+        TUYA_CHECK_NULL_RETURN(frame, OPRT_MALLOC_FAILED);
+        ret = tuya_pack_protocol_data_iov(DP_CMD_MQ, iov, iov_cnt, protocol_id,
+                                          (uint8_t *)context->signature.cipherkey, frame, frame_size, &frame_len);
+        if (ret == OPRT_OK && mqtt_client_publish(context->mqtt_client, topic, frame, frame_len, MQTT_QOS_0) <= 0) {
+            ret = OPRT_COM_ERROR;
+        }
+        tal_free(frame);
+        return ret;
+    }
 
-    ret = tuya_pack_protocol_data(DP_CMD_MQ, (const char *)data, protocol_id, (uint8_t *)context->signature.cipherkey,
-                                  &buffer, &buffer_len);
+    /* pack straight into the publish handle */
+    mqtt_publish_handle_t *handle = mqtt_publish_handle_new(topic, frame_size, cb, user_data, timeout_ms);
+    TUYA_CHECK_NULL_RETURN(handle, OPRT_MALLOC_FAILED);
+    ret = tuya_pack_protocol_data_iov(DP_CMD_MQ, iov, iov_cnt, protocol_id, (uint8_t *)context->signature.cipherkey,
+                                      handle->payload, frame_size, &frame_len);
     if (ret != OPRT_OK) {
-        PR_ERR("tuya_pack_protocol_data error:%d", ret);
+        PR_ERR("tuya_pack_protocol_data_iov error:%d", ret);
+        tal_free(handle);
         return ret;
     }
+    handle->payload_length = frame_len;
 
-    /* mqtt client publish */
-    ret = tuya_mqtt_client_publish_common(context, (const char *)topic, (const uint8_t *)buffer, buffer_len, cb,
-                                          user_data, timeout_ms, async);
-    tal_free(buffer);
-    return ret;
+    return mqtt_publish_submit(context, handle, async);
 }
 
 /**
@@ -828,6 +1469,12 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
         return rt;
     }
 
+    /* publish timeout */
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_handle_t *expired = mqtt_publish_expire(context, mqtt_publish_now());
+    tal_mutex_unlock(context->publish_mutex);
+    mqtt_publish_notify(expired, OPRT_TIMEOUT);
+
     /* reconnect */
     if (context->is_connected == false) {
         mqtt_status = mqtt_client_connect(context->mqtt_client);
@@ -851,26 +1498,10 @@ int tuya_mqtt_loop(tuya_mqtt_context_t *context)
         return rt;
     }
 
-    /* LOCK */
     /* publish async process */
-    mqtt_publish_handle_t **next_handle = &context->publish_list;
-    for (; *next_handle; next_handle = &(*next_handle)->next) {
-        mqtt_publish_handle_t *entry = *next_handle;
-
-        if (entry->timeout <= tal_time_get_posix()) {
-            entry->cb(OPRT_TIMEOUT, entry->user_data);
-            *next_handle = entry->next;
-            tal_free(entry->payload);
-            tal_free(entry);
-            continue;
-        }
-
-        if (entry->msgid <= 0) {
-            entry->msgid =
-                mqtt_client_publish(context->mqtt_client, entry->topic, entry->payload, entry->payload_length, 1);
-        }
-    }
-    /* UNLOCK */
+    tal_mutex_lock(context->publish_mutex);
+    mqtt_publish_pending_flush(context);
+    tal_mutex_unlock(context->publish_mutex);
 
     /* yield */
     mqtt_client_yield(context->mqtt_client);
@@ -903,6 +1534,25 @@ int tuya_mqtt_destory(tuya_mqtt_context_t *context)
         }
     }
 
+    /* no more callback from the client, drop the subscriptions */
+    mqtt_topic_tree_release(context->subscribe_tree);
+    context->subscribe_tree = NULL;
+    tal_mutex_release(context->mutex);
+    context->mutex = NULL;
+
+    /* fail the publishes still outstanding */
+    mqtt_publish_requeue(context);
+    mqtt_publish_handle_t *outstanding = context->publish_list;
+    context->publish_list = NULL;
+    context->publish_tail = NULL;
+    memset(context->publish_wheel, 0, sizeof(context->publish_wheel));
+    mqtt_publish_notify(outstanding, OPRT_COM_ERROR);
+    tal_mutex_release(context->publish_mutex);
+    context->publish_mutex = NULL;
+    tal_free(context->rx_buf);
+    context->rx_buf = NULL;
+    context->rx_buf_size = 0;
+
     return OPRT_OK;
 }
 
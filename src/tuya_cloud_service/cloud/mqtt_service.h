@@ -30,6 +30,9 @@ extern "C" {
 #include "cJSON.h"
 #include "mqtt_client_interface.h"
 #include "backoff_algorithm.h"
+#include "tal_mutex.h"
+#include "tuya_protocol.h"
+#include "tuya_config_defaults.h"
 
 // data max len
 #define TUYA_MQTT_CLIENTID_MAXLEN   (32U)
@@ -41,6 +44,12 @@ extern "C" {
 #define TUYA_MQTT_TOPIC_MAXLEN      (64U)
 #define TUYA_MQTT_TOPIC_MAXLEN      (64U)
 
+// buckets of the protocol id table, power of 2
+#define TUYA_MQTT_PROTOCOL_TBL_SIZE (16U)
+
+// receive buffers up to this size are kept for the next message
+#define TUYA_MQTT_RX_BUF_KEEP (1024U)
+
 // Tuya mqtt protocol
 #define PRO_DATA_PUSH            4  /* device -> cloud push dp data */
 #define PRO_CMD                  5  /* cloud -> device send dp data */
@@ -123,11 +132,27 @@ typedef struct {
     char topic_out[TUYA_MQTT_TOPIC_MAXLEN + 1];
 } tuya_mqtt_access_t;
 
+/**
+ * data_raw and root_raw point into the receive buffer and are only valid during
+ * the callback, read fields in place with tuya_protocol_json_field_get(), or get
+ * a tree of the "data" part with tuya_protocol_event_data_get().
+ *
+ * root_json and data are filled as before for the handlers registered with
+ * tuya_mqtt_protocol_register(). The message is only parsed into a tree when
+ * such a handler is registered for it, handlers registered with
+ * tuya_mqtt_protocol_register_raw() see both NULL unless another handler needs
+ * them, or until tuya_protocol_event_data_get().
+ */
 typedef struct {
     uint16_t event_id;
-    cJSON *root_json;
-    cJSON *data;
+    cJSON *root_json; // whole message, NULL for raw handlers
+    cJSON *data;      // "data" of root_json, NULL for raw handlers until tuya_protocol_event_data_get()
     void *user_data;
+    uint32_t t;
+    const char *data_raw; // "data" of the message, not NUL terminated
+    size_t data_len;
+    const char *root_raw; // the whole message
+    size_t root_len;
 } tuya_protocol_event_t;
 
 typedef tuya_protocol_event_t tuya_mqtt_event_t; // compat TODO:remove
@@ -139,6 +164,7 @@ typedef struct tuya_protocol_handle {
     uint16_t id;
     tuya_protocol_callback_t cb;
     void *user_data;
+    bool raw; // reads the raw views only, no cJSON tree is built for it
 } tuya_protocol_handle_t;
 
 typedef void (*mqtt_subscribe_message_cb_t)(uint16_t msgid, const mqtt_client_message_t *msg, void *userdata);
@@ -151,25 +177,48 @@ typedef struct mqtt_subscribe_handle {
     void *userdata;
 } mqtt_subscribe_handle_t;
 
+// one level of the subscribed topic filters, '+' and '#' are levels too
+typedef struct mqtt_topic_node {
+    struct mqtt_topic_node *next;     // sibling
+    struct mqtt_topic_node *child;    // first node of the next level
+    struct mqtt_topic_node *parent;
+    mqtt_subscribe_handle_t *handles; // filters ending at this level
+    uint16_t level_len;
+    char level[0];
+} mqtt_topic_node_t;
+
 typedef void (*mqtt_publish_notify_cb_t)(int result, void *user_data);
 
+// a QoS1 publish waiting to be sent or acknowledged, the payload follows it
 typedef struct mqtt_publish_handle {
-    struct mqtt_publish_handle *next;
-    uint16_t msgid;
-    int timeout;
+    struct mqtt_publish_handle *next;         // pending queue
+    struct mqtt_publish_handle *wheel_next;   // timeout wheel bucket
+    struct mqtt_publish_handle **wheel_pprev;
+    uint16_t msgid; // 0 until sent
+    uint32_t deadline;
     char *topic;
     uint8_t *payload;
     size_t payload_length;
     mqtt_publish_notify_cb_t cb;
     void *user_data;
+    uint8_t data[0];
 } mqtt_publish_handle_t;
 
 typedef struct {
     void *mqtt_client;
     tuya_mqtt_access_t signature;
-    tuya_protocol_handle_t *protocol_list;
-    mqtt_subscribe_handle_t *subscribe_list;
-    mqtt_publish_handle_t *publish_list;
+    MUTEX_HANDLE mutex; // protects protocol_tbl and subscribe_tree
+    tuya_protocol_handle_t *protocol_tbl[TUYA_MQTT_PROTOCOL_TBL_SIZE];
+    mqtt_topic_node_t *subscribe_tree;
+    MUTEX_HANDLE publish_mutex;         // protects the publish pipeline below
+    mqtt_publish_handle_t *publish_list; // not sent yet, in order
+    mqtt_publish_handle_t *publish_tail;
+    mqtt_publish_handle_t *publish_inflight[MQTT_PUBLISH_WINDOW]; // waiting PUBACK, by msgid
+    uint32_t publish_inflight_num;
+    mqtt_publish_handle_t *publish_wheel[MQTT_PUBLISH_WHEEL_SIZE];
+    uint32_t publish_wheel_tick;
+    uint8_t *rx_buf; // decrypt buffer, only used in the mqtt loop
+    size_t rx_buf_size;
     BackoffAlgorithmContext_t backoff_algorithm;
     uint32_t sequence_in;
     uint32_t sequence_out;
@@ -265,6 +314,25 @@ bool tuya_mqtt_connected(tuya_mqtt_context_t *context);
 int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
                                 void *user_data);
 
+/**
+ * @brief Registers a MQTT protocol handler which reads the message in place.
+ *
+ * Same as tuya_mqtt_protocol_register(), but root_json and data are not
+ * filled for the handler, it reads data_raw and root_raw, or calls
+ * tuya_protocol_event_data_get() when it needs a tree. Messages which only
+ * raw handlers receive are never parsed into a cJSON tree.
+ *
+ * @param context The MQTT context to register the protocol with.
+ * @param protocol_id The ID of the protocol to register.
+ * @param cb The callback function to be called when a message with the
+ * registered protocol ID is received.
+ * @param user_data User data to be passed to the callback function.
+ *
+ * @return 0 on success, or a negative error code on failure.
+ */
+int tuya_mqtt_protocol_register_raw(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb,
+                                    void *user_data);
+
 /**
  * @brief Unregisters a MQTT protocol with the specified protocol ID and
  * callback function.
@@ -272,7 +340,13 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
  * This function unregisters a MQTT protocol from the given MQTT context. The
  * protocol ID and callback function are used to identify the protocol to be
  * unregistered. Once unregistered, the protocol will no longer receive MQTT
- * messages.
+ * messages dispatched after the call.
+ *
+ * @note the callbacks of a message are collected under the lock and called
+ * after it is released, so a message dispatched before the call may still run
+ * cb once after return. cb and its user_data must stay valid until the MQTT
+ * thread is done with that message, e.g. free the user_data from the MQTT
+ * thread itself. Calling this from within cb is safe.
  *
  * @param context The MQTT context from which to unregister the protocol.
  * @param protocol_id The ID of the protocol to unregister.
@@ -281,6 +355,29 @@ int tuya_mqtt_protocol_register(tuya_mqtt_context_t *context, uint16_t protocol_
  */
 int tuya_mqtt_protocol_unregister(tuya_mqtt_context_t *context, uint16_t protocol_id, tuya_protocol_callback_t cb);
 
+/**
+ * @brief Gets the "data" part of a protocol event as a cJSON tree.
+ *
+ * The tree is parsed on the first call and shared by all callbacks of the same
+ * message, it is released after the last callback returns.
+ *
+ * @param event The event passed to the protocol callback.
+ * @return The "data" tree, or NULL if it is not valid JSON.
+ */
+cJSON *tuya_protocol_event_data_get(tuya_protocol_event_t *event);
+
+/**
+ * @brief Takes the "data" tree of a protocol event over.
+ *
+ * Same as tuya_protocol_event_data_get(), but the caller owns the returned
+ * tree and must cJSON_Delete() it. When root_json is filled for another
+ * handler the caller gets a copy.
+ *
+ * @param event The event passed to the protocol callback.
+ * @return The "data" tree, or NULL if it is not valid JSON.
+ */
+cJSON *tuya_protocol_event_data_detach(tuya_protocol_event_t *event);
+
 /**
  * @brief Publishes protocol data using MQTT.
  *
@@ -360,6 +457,32 @@ int tuya_mqtt_protocol_data_publish_with_topic_common(tuya_mqtt_context_t *conte
                                                       mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms,
                                                       bool async);
 
+/**
+ * Publishes MQTT protocol data given as fragments.
+ *
+ * The fragments are packed and encrypted straight into one frame, which is
+ * then kept by the publish handle until it is acknowledged, so a publish costs
+ * a single payload allocation.
+ *
+ * @param context The MQTT context.
+ * @param topic The topic to publish the data to.
+ * @param protocol_id The protocol ID.
+ * @param iov The data fragments, their concatenation is a JSON value.
+ * @param iov_cnt The number of fragments.
+ * @param cb The callback function to be called when the publish operation is
+ * complete.
+ * @param user_data User data to be passed to the callback function.
+ * @param timeout_ms The timeout value in milliseconds.
+ * @param async Specifies whether the publish operation should be performed
+ * asynchronously.
+ *
+ * @return Returns 0 on success, or a negative error code on failure.
+ */
+int tuya_mqtt_protocol_data_publish_iov_common(tuya_mqtt_context_t *context, const char *topic, uint16_t protocol_id,
+                                               const tuya_protocol_iov_t *iov, uint32_t iov_cnt,
+                                               mqtt_publish_notify_cb_t cb, void *user_data, int timeout_ms,
+                                               bool async);
+
 /**
  * Publishes a message to an MQTT topic using the Tuya MQTT client.
  *
@@ -403,7 +526,11 @@ int tuya_mqtt_subscribe_message_callback_register(tuya_mqtt_context_t *context,
  * This function unregisters the callback function that was previously
  * registered for handling MQTT subscribe messages. Once unregistered, the
  * callback function will no longer be called when a subscribe message is
- * received.
+ * received after the call.
+ *
+ * @note a message dispatched before the call may still run the callback once
+ * after return, as for tuya_mqtt_protocol_unregister(). The callback and its
+ * userdata must stay valid until the MQTT thread is done with that message.
  *
  * @param context The MQTT context.
  * @param topic The topic for which the callback function should be
@@ -97,4 +97,44 @@
 #define MATOP_TIMEOUT_MS_DEFAULT (8000U)
 #endif
 
+#ifndef MQTT_PUBLISH_WINDOW
+#define MQTT_PUBLISH_WINDOW (8U) // QoS1 publishes waiting for PUBACK, power of 2
+#endif
+
+#ifndef MQTT_PUBLISH_WHEEL_TICK_MS
+#define MQTT_PUBLISH_WHEEL_TICK_MS (250U)
+#endif
+
+#ifndef MQTT_PUBLISH_WHEEL_SIZE
+#define MQTT_PUBLISH_WHEEL_SIZE (32U) // power of 2
+#endif
+
+#ifndef MQTT_PUBLISH_BATCH_MS
+#define MQTT_PUBLISH_BATCH_MS (20U) // DP reports within this window share one publish, 0 to disable
+#endif
+
+#ifndef MQTT_PUBLISH_BATCH_MAX
+#define MQTT_PUBLISH_BATCH_MAX (1024U) // max length of the coalesced dps
+#endif
+
+#ifndef MQTT_PUBLISH_BATCH_CB_MAX
+#define MQTT_PUBLISH_BATCH_CB_MAX (8U) // max notified reports in one batch
+#endif
+
+#ifndef DP_REPT_ARENA_MAX
+#define DP_REPT_ARENA_MAX (1024U) // reused DP report buffer, larger reports are allocated, 0 to disable
+#endif
+
+#ifndef OTA_DOWNLOAD_PARALLEL
+#define OTA_DOWNLOAD_PARALLEL (1U) // connections fetching the firmware at the same time
+#endif
+
+/**
+ * @brief Resume an interrupted firmware download after a reboot. The OTA port
+ * must accept data from a non zero offset after tal_ota_start_notify.
+ */
+#ifndef OTA_DOWNLOAD_RESUME
+#define OTA_DOWNLOAD_RESUME (0)
+#endif
+
 #endif /* ifndef TUYA_CONFIG_DEFAULTS_H_ */
@@ -81,6 +81,7 @@ static bool __watchdog_feed(void)
 static int __health_reboot_cb(void *data)
 {
     PR_DEBUG("recive reboot req ack! device will reboot!");
+    tal_kv_flush();
     tal_system_reset();
     return OPRT_OK;
 }
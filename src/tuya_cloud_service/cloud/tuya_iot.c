@@ -52,6 +52,8 @@ typedef enum {
 
 static tuya_iot_client_t *s_iot_client_solo;
 
+static void dp_batch_deinit(tuya_iot_client_t *client);
+
 /* -------------------------------------------------------------------------- */
 /*                          Internal utils functions                          */
 /* -------------------------------------------------------------------------- */
@@ -269,32 +271,32 @@ static int client_activate_process(tuya_iot_client_t *client, const char *token)
 static void mqtt_service_dp_receive_on(tuya_protocol_event_t *ev)
 {
     tuya_iot_client_t *client = ev->user_data;
-    cJSON *data = (cJSON *)(ev->data);
-    if (NULL == cJSON_GetObjectItem(data, "dps")) {
+    tuya_json_span_t dps;
+    if (OPRT_OK != tuya_protocol_json_field_get(ev->data_raw, ev->data_len, "dps", &dps)) {
         PR_ERR("not found dps");
         return;
     }
 
-    tuya_iot_dp_parse(client, DP_CMD_MQ, cJSON_DetachItemFromObject(ev->root_json, "data"));
+    tuya_iot_dp_parse(client, DP_CMD_MQ, tuya_protocol_event_data_detach(ev));
 }
 
 static void mqtt_service_reset_cmd_on(tuya_protocol_event_t *ev)
 {
     tuya_iot_client_t *client = ev->user_data;
-    cJSON *data = (cJSON *)(ev->data);
+    tuya_json_span_t item;
 
-    if (NULL == cJSON_GetObjectItem(data, "gwId")) {
+    if (OPRT_OK != tuya_protocol_json_field_get(ev->data_raw, ev->data_len, "gwId", &item)) {
         PR_ERR("not found gwId");
+    } else {
+        PR_WARN("Reset id:%.*s", (int)item.len, item.ptr);
     }
 
-    PR_WARN("Reset id:%s", cJSON_GetObjectItem(data, "gwId")->valuestring);
-
     /* DP event send */
     client->event.id = TUYA_EVENT_RESET;
     client->event.type = TUYA_DATE_TYPE_INTEGER;
 
-    if (cJSON_GetObjectItem(ev->root_json, "type") &&
-        strcmp(cJSON_GetObjectItem(ev->root_json, "type")->valuestring, "reset_factory") == 0) {
+    if (OPRT_OK == tuya_protocol_json_field_get(ev->root_raw, ev->root_len, "type", &item) &&
+        tuya_protocol_json_str_equal(&item, "reset_factory")) {
         PR_DEBUG("cmd is reset factory, ungister");
         client->event.value.asInteger = TUYA_RESET_TYPE_REMOTE_FACTORY;
     } else {
@@ -360,11 +362,11 @@ static void matop_app_notify_upgrade_info_on(atop_base_response_t *response, voi
 static void mqtt_service_upgrade_notify_on(tuya_mqtt_event_t *ev)
 {
     tuya_iot_client_t *client = ev->user_data;
-    cJSON *data = (cJSON *)(ev->data);
+    tuya_json_span_t item;
     int ota_channel = 0;
 
-    if (cJSON_GetObjectItem(data, "firmwareType")) {
-        ota_channel = cJSON_GetObjectItem(data, "firmwareType")->valueint;
+    if (OPRT_OK == tuya_protocol_json_field_get(ev->data_raw, ev->data_len, "firmwareType", &item)) {
+        tuya_protocol_json_int_get(&item, &ota_channel);
     }
 
     int rt = matop_service_upgrade_info_get(&client->matop, ota_channel, matop_app_notify_upgrade_info_on, client);
@@ -387,6 +389,15 @@ static void mqtt_client_connected_on(void *context, void *user_data)
         tal_sw_timer_start(client->check_upgrade_timer, 1000 * 1, TAL_TIMER_ONCE);
     }
 
+    /* DP batch kept while disconnected */
+    if (client->dp_batch.dps) {
+        tal_mutex_lock(client->dp_batch.mutex);
+        if (client->dp_batch.dps_len && client->dp_batch.work) {
+            tal_workq_start_delayed(client->dp_batch.work, MQTT_PUBLISH_BATCH_MS, LOOP_ONCE);
+        }
+        tal_mutex_unlock(client->dp_batch.mutex);
+    }
+
     /* Send connected event*/
     client->event.id = TUYA_EVENT_MQTT_CONNECTED;
     client->event.type = TUYA_DATE_TYPE_UNDEFINED;
@@ -444,7 +455,7 @@ static void check_auto_upgrade_timeout_on(TIMER_ID timer, void *user_data)
 static void mqtt_rtc_req_notify_cb(tuya_protocol_event_t *ev)
 {
     tuya_iot_client_t *client = ev->user_data;
-    cJSON *data = (cJSON *)(ev->data);
+    cJSON *data = tuya_protocol_event_data_get(ev);
     client->event.id = TUYA_EVENT_RTC_REQ;
     client->event.type = TUYA_DATE_TYPE_JSON;
     client->event.value.asJSON = data;
@@ -492,11 +503,11 @@ static int run_state_mqtt_connect_start(tuya_iot_client_t *client)
     }
 
     /* callback register */
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_CMD, mqtt_service_dp_receive_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_GW_RESET, mqtt_service_reset_cmd_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_UPGD_REQ, mqtt_service_upgrade_notify_on, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_MQ_DPCACHE_NOTIFY, mqtt_atop_dp_cache_notify_cb, client);
-    tuya_mqtt_protocol_register(&client->mqctx, PRO_RTC_REQ, mqtt_rtc_req_notify_cb, client);
+    tuya_mqtt_protocol_register_raw(&client->mqctx, PRO_CMD, mqtt_service_dp_receive_on, client);
+    tuya_mqtt_protocol_register_raw(&client->mqctx, PRO_GW_RESET, mqtt_service_reset_cmd_on, client);
+    tuya_mqtt_protocol_register_raw(&client->mqctx, PRO_UPGD_REQ, mqtt_service_upgrade_notify_on, client);
+    tuya_mqtt_protocol_register_raw(&client->mqctx, PRO_MQ_DPCACHE_NOTIFY, mqtt_atop_dp_cache_notify_cb, client);
+    tuya_mqtt_protocol_register_raw(&client->mqctx, PRO_RTC_REQ, mqtt_rtc_req_notify_cb, client);
     
     return rt;
 }
@@ -603,6 +614,21 @@ int tuya_iot_init(tuya_iot_client_t *client, const tuya_iot_config_t *config)
     if (OPRT_OK != ret) {
         return ret;
     }
+
+#if MQTT_PUBLISH_BATCH_MS > 0
+    /* DP report batch, reports go out one by one if this fails */
+    if (OPRT_OK == tal_mutex_create_init(&client->dp_batch.mutex)) {
+        client->dp_batch.dps = tal_malloc(MQTT_PUBLISH_BATCH_MAX + 1);
+        if (client->dp_batch.dps == NULL) {
+            tal_mutex_release(client->dp_batch.mutex);
+            client->dp_batch.mutex = NULL;
+        }
+    }
+#endif
+#if DP_REPT_ARENA_MAX > 0
+    /* without it each DP report allocates its own buffer */
+    dp_rept_arena_init(&client->dp_arena, DP_REPT_ARENA_MAX);
+#endif
     s_iot_client_solo = client;
 
     client->state = STATE_IDLE;
@@ -715,6 +741,15 @@ int tuya_iot_reset(tuya_iot_client_t *client)
  */
 int tuya_iot_destroy(tuya_iot_client_t *client)
 {
+    if (client == NULL) {
+        return OPRT_INVALID_PARM;
+    }
+
+    dp_batch_deinit(client);
+#if DP_REPT_ARENA_MAX > 0
+    dp_rept_arena_deinit(&client->dp_arena);
+#endif
+
     return OPRT_OK;
 }
 
@@ -1050,36 +1085,272 @@ int tuya_iot_activated_data_remove(tuya_iot_client_t *client)
     return OPRT_OK;
 }
 
+static int dp_report_json_publish(tuya_iot_client_t *client, const char *dps, const char *time,
+                                  tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms, bool async)
+{
+    /* {"devId":"xx","dps":{..},"t":xx}, packed straight into the frame */
+    tuya_protocol_iov_t iov[7];
+    uint32_t iov_cnt = 0;
+
+    iov[iov_cnt++] = (tuya_protocol_iov_t){"{\"devId\":\"", 10};
+    iov[iov_cnt++] = (tuya_protocol_iov_t){client->activate.devid, strlen(client->activate.devid)};
+    iov[iov_cnt++] = (tuya_protocol_iov_t){"\",\"dps\":", 8};
+    iov[iov_cnt++] = (tuya_protocol_iov_t){dps, strlen(dps)};
+    if (time) {
+        iov[iov_cnt++] = (tuya_protocol_iov_t){",\"t\":", 5};
+        iov[iov_cnt++] = (tuya_protocol_iov_t){time, strlen(time)};
+    }
+    iov[iov_cnt++] = (tuya_protocol_iov_t){"}", 1};
+
+    /* Report buffer */
+    return tuya_mqtt_protocol_data_publish_iov_common(&client->mqctx, client->mqctx.signature.topic_out, PRO_DATA_PUSH,
+                                                      iov, iov_cnt, (mqtt_publish_notify_cb_t)cb, user_data,
+                                                      timeout_ms, async);
+}
+
+/*
+ * DP report batch
+ *
+ * Reports without a time that come within MQTT_PUBLISH_BATCH_MS are merged
+ * into one dps object and go out as one publish. A DP id already in the batch,
+ * a full batch or a report that can not be merged sends the batch first, so
+ * the cloud sees the values in the order they were reported.
+ *
+ * A batch that fails to go out is kept and sent again, after
+ * MQTT_PUBLISH_BATCH_MS while connected or when MQTT connects again. Reports
+ * that would have to overtake it fail like unbatched reports do. After
+ * DP_BATCH_RETRY_MAX failed sends while connected the batch is dropped and its
+ * waiters get the error.
+ */
+#define DP_BATCH_RETRY_MAX 5
+
+typedef struct {
+    uint8_t num;
+    tuya_dp_waiter_t waiter[MQTT_PUBLISH_BATCH_CB_MAX];
+} dp_batch_notify_t;
+
+typedef struct {
+    const tuya_dp_batch_t *batch;
+    uint32_t num;
+    bool dup;
+} dp_batch_scan_t;
+
+static void dp_batch_waiters_call(const dp_batch_notify_t *notify, int result)
+{
+    uint8_t i;
+    for (i = 0; i < notify->num; i++) {
+        notify->waiter[i].cb(result, notify->waiter[i].user_data);
+    }
+}
+
+static void dp_batch_notify_cb(int result, void *user_data)
+{
+    dp_batch_waiters_call((dp_batch_notify_t *)user_data, result);
+    tal_free(user_data);
+}
+
+static bool dp_batch_scan_cb(const char *key, size_t key_len, const tuya_json_span_t *val, void *arg)
+{
+    dp_batch_scan_t *scan = (dp_batch_scan_t *)arg;
+    tuya_json_span_t old;
+    char id[16];
+
+    scan->num++;
+    if (key_len >= sizeof(id)) {
+        scan->dup = true;
+        return false;
+    }
+    memcpy(id, key, key_len);
+    id[key_len] = '\0';
+    if (OPRT_OK == tuya_protocol_json_field_get(scan->batch->dps, scan->batch->dps_len, id, &old)) {
+        scan->dup = true;
+        return false;
+    }
+    return true;
+}
+
+/* send the batch and empty it, batch mutex held. When the publish fails the
+ * batch is kept for a retry, once the retries are used up it is dropped and
+ * the waiters are copied to failed, to be called without the mutex */
+static int dp_batch_publish(tuya_iot_client_t *client, dp_batch_notify_t *failed)
+{
+    tuya_dp_batch_t *batch = &client->dp_batch;
+    dp_batch_notify_t *notify = NULL;
+    int rt = OPRT_OK;
+
+    failed->num = 0;
+    if (batch->dps_len == 0) {
+        return OPRT_OK;
+    }
+
+    if (batch->waiter_num) {
+        notify = tal_malloc(sizeof(dp_batch_notify_t));
+        if (notify == NULL) {
+            rt = OPRT_MALLOC_FAILED;
+        } else {
+            notify->num = batch->waiter_num;
+            memcpy(notify->waiter, batch->waiter, batch->waiter_num * sizeof(tuya_dp_waiter_t));
+        }
+    }
+
+    if (rt == OPRT_OK) {
+        batch->dps[batch->dps_len] = '\0';
+        rt = dp_report_json_publish(client, batch->dps, NULL, notify ? dp_batch_notify_cb : NULL, notify,
+                                    batch->timeout_ms, false);
+        if (rt != OPRT_OK) {
+            tal_free(notify);
+        }
+    }
+
+    if (rt != OPRT_OK && ++batch->retry <= DP_BATCH_RETRY_MAX) {
+        PR_WARN("dp batch publish error:%d, kept for retry %d", rt, batch->retry);
+        return rt;
+    }
+    if (rt != OPRT_OK) {
+        PR_ERR("dp batch publish error:%d, %d bytes dropped", rt, batch->dps_len);
+        failed->num = batch->waiter_num;
+        memcpy(failed->waiter, batch->waiter, batch->waiter_num * sizeof(tuya_dp_waiter_t));
+    }
+
+    batch->dps_len = 0;
+    batch->waiter_num = 0;
+    batch->timeout_ms = 0;
+    batch->retry = 0;
+    return rt;
+}
+
+static void dp_batch_flush(void *data)
+{
+    tuya_iot_client_t *client = (tuya_iot_client_t *)data;
+    dp_batch_notify_t failed = {0};
+    int rt = OPRT_OK;
+
+    tal_mutex_lock(client->dp_batch.mutex);
+    /* kept until MQTT connects again, see mqtt_client_connected_on */
+    if (tuya_mqtt_connected(&client->mqctx)) {
+        rt = dp_batch_publish(client, &failed);
+        if (client->dp_batch.dps_len) {
+            tal_workq_start_delayed(client->dp_batch.work, MQTT_PUBLISH_BATCH_MS, LOOP_ONCE);
+        }
+    }
+    tal_mutex_unlock(client->dp_batch.mutex);
+
+    dp_batch_waiters_call(&failed, rt);
+}
+
+/* the reports still in the batch are not sent, their waiters get an error */
+static void dp_batch_deinit(tuya_iot_client_t *client)
+{
+    tuya_dp_batch_t *batch = &client->dp_batch;
+    dp_batch_notify_t dropped = {0};
+
+    if (batch->mutex == NULL) {
+        return;
+    }
+
+    tal_mutex_lock(batch->mutex);
+    if (batch->work) {
+        tal_workq_cancel_delayed(batch->work);
+        batch->work = NULL;
+    }
+    dropped.num = batch->waiter_num;
+    memcpy(dropped.waiter, batch->waiter, batch->waiter_num * sizeof(tuya_dp_waiter_t));
+    tal_free(batch->dps);
+    batch->dps = NULL;
+    batch->dps_len = 0;
+    batch->waiter_num = 0;
+    tal_mutex_unlock(batch->mutex);
+
+    tal_mutex_release(batch->mutex);
+    batch->mutex = NULL;
+    dp_batch_waiters_call(&dropped, OPRT_COM_ERROR);
+}
+
 static int tuya_iot_dp_report_json_common(tuya_iot_client_t *client, const char *dps, const char *time,
                                           tuya_dp_notify_cb_t cb, void *user_data, int timeout_ms, bool async)
 {
-    if (client == NULL || dps == NULL) {
+    if (client == NULL || dps == NULL || (cb == NULL && async == true)) {
         PR_ERR("param error");
         return OPRT_INVALID_PARM;
     }
 
-    int ret;
-    int printlen = 0;
-    char *buffer = NULL;
+    tuya_dp_batch_t *batch = &client->dp_batch;
+    if (batch->dps == NULL) {
+        return dp_report_json_publish(client, dps, time, cb, user_data, timeout_ms, async);
+    }
 
-    /* Package JSON format */
-    if (time) {
-        buffer = tal_malloc(strlen(dps) + strlen(time) + 64);
-        TUYA_CHECK_NULL_RETURN(buffer, OPRT_MALLOC_FAILED);
-        printlen = sprintf(buffer, "{\"devId\":\"%s\",\"dps\":%s,\"t\":%s}", client->activate.devid, dps, time);
+    if (tuya_mqtt_connected(&client->mqctx) == false) {
+        return OPRT_COM_ERROR;
+    }
+
+    /* the object without surrounding blanks */
+    const char *head = dps;
+    const char *tail = dps + strlen(dps);
+    while (*head == ' ' || *head == '\t' || *head == '\r' || *head == '\n') {
+        head++;
+    }
+    while (tail > head && (tail[-1] == ' ' || tail[-1] == '\t' || tail[-1] == '\r' || tail[-1] == '\n')) {
+        tail--;
+    }
+    uint32_t len = tail - head;
+
+    dp_batch_notify_t failed = {0};
+    int failed_rt = OPRT_OK;
+    int rt = OPRT_OK;
+
+    tal_mutex_lock(batch->mutex);
+
+    if (batch->work == NULL && OPRT_OK != tal_workq_init_delayed(WORKQ_HIGHTPRI, dp_batch_flush, client, &batch->work)) {
+        batch->work = NULL;
+    }
+
+    dp_batch_scan_t scan = {.batch = batch, .num = 0, .dup = false};
+    bool join = batch->work && time == NULL && len <= MQTT_PUBLISH_BATCH_MAX &&
+                OPRT_OK == tuya_protocol_json_object_walk(head, len, dp_batch_scan_cb, &scan) && scan.num;
+
+    /* merging drops the opening brace of the report and the closing one of the batch */
+    if (!join || scan.dup || batch->dps_len + len - 1 > MQTT_PUBLISH_BATCH_MAX ||
+        (cb && batch->waiter_num == MQTT_PUBLISH_BATCH_CB_MAX)) {
+        failed_rt = dp_batch_publish(client, &failed);
+        if (batch->dps_len) {
+            /* the batch is kept for a retry, the report can not overtake it. As
+             * for the other errors cb is not called, the caller cleans up */
+            tal_mutex_unlock(batch->mutex);
+            return failed_rt;
+        }
+    }
+
+    if (!join) {
+        rt = dp_report_json_publish(client, dps, time, cb, user_data, timeout_ms, async);
+        tal_mutex_unlock(batch->mutex);
+        dp_batch_waiters_call(&failed, failed_rt);
+        return rt;
+    }
+
+    if (batch->dps_len == 0) {
+        memcpy(batch->dps, head, len);
+        batch->dps_len = len;
+        tal_workq_start_delayed(batch->work, MQTT_PUBLISH_BATCH_MS, LOOP_ONCE);
     } else {
-        buffer = tal_malloc(strlen(dps) + 64);
-        TUYA_CHECK_NULL_RETURN(buffer, OPRT_MALLOC_FAILED);
-        printlen = sprintf(buffer, "{\"devId\":\"%s\",\"dps\":%s}", client->activate.devid, dps);
+        batch->dps[batch->dps_len - 1] = ',';
+        memcpy(batch->dps + batch->dps_len, head + 1, len - 1);
+        batch->dps_len += len - 1;
     }
 
-    /* Report buffer */
-    ret = tuya_mqtt_protocol_data_publish_common(&client->mqctx, PRO_DATA_PUSH, (const uint8_t *)buffer,
-                                                 (uint16_t)printlen, (mqtt_publish_notify_cb_t)cb, user_data,
-                                                 timeout_ms, async);
-    tal_free(buffer);
-    return ret;
+    if (cb) {
+        batch->waiter[batch->waiter_num].cb = cb;
+        batch->waiter[batch->waiter_num].user_data = user_data;
+        batch->waiter_num++;
+        if (timeout_ms > batch->timeout_ms) {
+            batch->timeout_ms = timeout_ms;
+        }
+    }
+
+    tal_mutex_unlock(batch->mutex);
+    dp_batch_waiters_call(&failed, failed_rt);
+    return OPRT_OK;
 }
+
 /**
  * @brief Reports device status asynchronously in JSON format.
  *
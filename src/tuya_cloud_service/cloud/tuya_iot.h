@@ -217,6 +217,23 @@ typedef struct {
     tuya_token_get_cb_t cb[MAX_TOKEN_GET_NUM];
 } tuya_token_get_t;
 
+typedef struct {
+    tuya_dp_notify_cb_t cb;
+    void *user_data;
+} tuya_dp_waiter_t;
+
+/* DP reports within MQTT_PUBLISH_BATCH_MS are sent as one publish */
+typedef struct {
+    MUTEX_HANDLE mutex;
+    DELAYED_WORK_HANDLE work; // flush, created on first use
+    char *dps;                // merged dps object, MQTT_PUBLISH_BATCH_MAX + 1 bytes, NULL if batching is off
+    uint32_t dps_len;         // 0 when nothing is waiting
+    int timeout_ms;           // longest timeout of the waiters
+    uint8_t retry;            // failed sends of the kept batch
+    uint8_t waiter_num;
+    tuya_dp_waiter_t waiter[MQTT_PUBLISH_BATCH_CB_MAX];
+} tuya_dp_batch_t;
+
 struct tuya_iot_client_handle {
     tuya_iot_config_t config;
     tuya_activated_data_t activate;
@@ -226,6 +243,8 @@ struct tuya_iot_client_handle {
     tuya_token_get_t token_get;
     tuya_binding_info_t *binding;
     TIMER_ID check_upgrade_timer;
+    tuya_dp_batch_t dp_batch;
+    dp_rept_arena_t dp_arena;
     uint8_t status;
     uint8_t state;
     uint8_t nextstate;
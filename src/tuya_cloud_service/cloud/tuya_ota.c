@@ -21,6 +21,14 @@
 #include "iotdns.h"
 #include "mix_method.h"
 
+/* the state of the firmware hash is saved with the download checkpoint */
+#if OTA_DOWNLOAD_RESUME
+#include "mbedtls/sha256.h"
+#if !defined(MBEDTLS_SHA256_ALT)
+#define OTA_DOWNLOAD_CHECKPOINT_KEY "ota_dl_ckpt"
+#endif
+#endif
+
 typedef struct {
     tuya_ota_config_t config;
     tuya_ota_msg_t msg;
@@ -55,6 +63,15 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
 
     case DL_EVENT_ON_FILESIZE:
         PR_DEBUG("DL_EVENT_ON_FILESIZE");
+#ifdef OTA_DOWNLOAD_CHECKPOINT_KEY
+        if (event->offset && 0 == ota->channel && event->checkpoint_len == sizeof(mbedtls_sha256_context)) {
+            PR_DEBUG("resume at %d", event->offset);
+            memcpy(ota->sha256, event->checkpoint, sizeof(mbedtls_sha256_context));
+            ota->progress_percent = event->offset * 100 / event->file_size;
+        } else {
+            event->offset = 0;
+        }
+#endif
         if (0 == ota->channel) {
             tal_ota_start_notify(event->file_size, TUYA_OTA_FULL, TUYA_OTA_PATH_AIR);
         } else if (event_cb) {
@@ -120,6 +137,15 @@ static void file_download_event_cb(http_download_event_id_t id, http_download_ev
         }
         break;
 
+#ifdef OTA_DOWNLOAD_CHECKPOINT_KEY
+    case DL_EVENT_CHECKPOINT:
+        if (0 == ota->channel) {
+            event->checkpoint = ota->sha256;
+            event->checkpoint_len = sizeof(mbedtls_sha256_context);
+        }
+        break;
+#endif
+
     case DL_EVENT_FAULT:
         PR_DEBUG("DL_EVENT_FAULT");
         tuya_ota_upgrade_status_report(ota, TUS_UPGRD_EXEC);
@@ -169,7 +195,7 @@ static void ota_process_thread_func(void *arg)
 
     tuya_iotdns_query_domain_certs(ota->msg.fw_url, &cert, &cert_len);
 
-    http_download_config_t download_cfg;
+    http_download_config_t download_cfg = {0};
     download_cfg.file_size = ota->msg.file_size;
     download_cfg.range_length = ota->config.range_size;
     download_cfg.timeout_ms = ota->config.timeout_ms;
@@ -178,6 +204,10 @@ static void ota_process_thread_func(void *arg)
     download_cfg.url = ota->msg.fw_url;
     download_cfg.event_handler = file_download_event_cb;
     download_cfg.user_data = ota;
+    download_cfg.parallel = OTA_DOWNLOAD_PARALLEL;
+#ifdef OTA_DOWNLOAD_CHECKPOINT_KEY
+    download_cfg.checkpoint_key = OTA_DOWNLOAD_CHECKPOINT_KEY;
+#endif
 
     http_file_download(&download_cfg);
     tal_free(cert);
@@ -18,6 +18,7 @@
  *
  */
 
+#include <inttypes.h>
 #include "tuya_protocol.h"
 #include "tal_api.h"
 #include "crc32i.h"
@@ -72,9 +73,14 @@ uint32_t tuya_pack_protocol_serial_no(void)
 }
 
 static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t *data, const uint32_t len,
-                                          const uint8_t *key, char **out_data)
+                                          const uint8_t *key, uint8_t *out, size_t out_size, size_t *out_len)
 {
     OPERATE_RET op_ret = OPRT_OK;
+    if (len < PV23_EXCEPT_DATA_LEN) {
+        PR_ERR("pv2.3 len invalid %d", len);
+        return OPRT_INVALID_PARM;
+    }
+
     if (memcmp(data, TUYA_PV23, PV23_VERSION_LEN) != 0) {
         PR_ERR("verison error, must pv2.3");
         return OPRT_VERSION_FMT_ERR;
@@ -97,9 +103,9 @@ static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t
 
     uint8_t *ad_data = (uint8_t *)(data + 0);
     uint32_t data_len = len - PV23_EXCEPT_DATA_LEN;
-    size_t ec_len = 0;
-    uint8_t *ec_data = tal_malloc(data_len + 1);
-    TUYA_CHECK_NULL_RETURN(ec_data, OPRT_MALLOC_FAILED);
+    if (out_size < data_len + 1) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
 
     // decrypt data
     op_ret = mbedtls_cipher_auth_decrypt_wrapper(
@@ -112,23 +118,19 @@ static OPERATE_RET __parse_data_with_pv23(const DP_CMD_TYPE_E cmd, const uint8_t
                                  .ad_len = PV23_AD_DATA_LEN,
                                  .data = (unsigned char *)(data + PV23_DATA_OFFSET),
                                  .data_len = data_len},
-        ec_data, &ec_len, (unsigned char *)(data + (len - PV23_TAG_LEN)), PV23_TAG_LEN);
+        out, out_len, (unsigned char *)(data + (len - PV23_TAG_LEN)), PV23_TAG_LEN);
     if (op_ret != OPRT_OK) {
         PR_ERR("mbedtls_cipher_auth_decrypt_wrapper:0x%x", -op_ret);
-        *out_data = NULL;
-        tal_free(ec_data);
         return op_ret;
     }
 
-    ec_data[ec_len] = 0;
-
-    *out_data = (char *)ec_data;
+    out[*out_len] = 0;
 
     return OPRT_OK;
 }
 
 static OPERATE_RET __parse_data_with_lpv35(const DP_CMD_TYPE_E cmd, const uint8_t *data, const uint32_t len,
-                                           const uint8_t *key, char **out_data)
+                                           const uint8_t *key, uint8_t *out, size_t out_size, size_t *out_len)
 {
     char pv_buf[4];
     memset(pv_buf, 0, sizeof(pv_buf));
@@ -142,43 +144,44 @@ static OPERATE_RET __parse_data_with_lpv35(const DP_CMD_TYPE_E cmd, const uint8_
     memcpy(&cmd_from, (data + CMD_FROM_OFFSET_22_32), sizeof(uint32_t));
     cmd_from = UNI_NTOHL(cmd_from);
 
-    uint8_t *ec_data = NULL;
     uint32_t ec_len = len - DATA_OFFSET_22_32;
+    if (out_size < ec_len + 1) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
 
-    ec_data = tal_malloc(ec_len + 1);
-    TUYA_CHECK_NULL_RETURN(ec_data, OPRT_MALLOC_FAILED);
-    memcpy(ec_data, data + DATA_OFFSET_22_32, ec_len);
-
-    ec_data[ec_len] = 0;
-
-    *out_data = (char *)ec_data;
+    memcpy(out, data + DATA_OFFSET_22_32, ec_len);
+    out[ec_len] = 0;
+    *out_len = ec_len;
 
     return OPRT_OK;
 }
 
 /**
- * @brief Parses the protocol data for a given command.
+ * @brief Parses the protocol data for a given command into a caller buffer.
  *
- * This function takes in the command type, data, length, key, and a pointer to
- * store the output data. It parses the protocol data based on the provided
- * command and returns the result in the `out_data` parameter.
+ * Same as tuya_parse_protocol_data, but the plaintext is written to `out`
+ * instead of a new allocation, so a receive path can keep one buffer for all
+ * messages. The plaintext is never longer than the input, `len + 1` bytes of
+ * `out` are always enough.
  *
  * @param cmd The command type to parse.
  * @param data The input data to be parsed.
  * @param len The length of the input data.
  * @param key The key used for parsing the data.
- * @param out_data A pointer to store the parsed output data.
+ * @param out Buffer receiving the plaintext, NUL terminated.
+ * @param out_size Size of `out`.
+ * @param out_len Length of the plaintext, without the terminator.
  *
  * @return The operation result status. Possible values are:
  *         - OPRT_OK: Operation successful.
  *         - OPRT_INVALID_PARM: Invalid parameter provided.
- *         - OPRT_MALLOC_FAILED: Memory allocation failed.
- *         - OPRT_PARSE_FAILED: Parsing of the protocol data failed.
+ *         - OPRT_BUFFER_NOT_ENOUGH: `out` is too small for the plaintext.
+ *         - Others: Decrypting the protocol data failed.
  */
-OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
-                                     char **out_data)
+OPERATE_RET tuya_parse_protocol_data_to(const DP_CMD_TYPE_E cmd, const uint8_t *data, const int len, const char *key,
+                                        uint8_t *out, size_t out_size, size_t *out_len)
 {
-    if ((NULL == data) || (len < DATA_OFFSET_22_32)) {
+    if ((NULL == data) || (len < DATA_OFFSET_22_32) || (NULL == out) || (NULL == out_len)) {
         PR_ERR("data is NULL OR Len Invalid %d", len);
         return OPRT_INVALID_PARM;
     }
@@ -196,7 +199,7 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
     if (DP_CMD_LAN == cmd) {
         if (0 == strcmp(pv, "3.5")) {
             PR_TRACE("Data From LAN AND V=3.5");
-            op_ret = __parse_data_with_lpv35(cmd, data, len, (uint8_t *)key, out_data);
+            op_ret = __parse_data_with_lpv35(cmd, data, len, (uint8_t *)key, out, out_size, out_len);
         } else {
             PR_ERR("Data From LAN But No Match Parse %s", pv);
             return OPRT_COM_ERROR;
@@ -204,7 +207,7 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
     } else if (DP_CMD_MQ == cmd) {
         if (0 == strcmp(pv, "2.3")) {
             PR_TRACE("Data From MQTT AND V=2.3");
-            op_ret = __parse_data_with_pv23(cmd, data, len, (uint8_t *)key, out_data);
+            op_ret = __parse_data_with_pv23(cmd, data, len, (uint8_t *)key, out, out_size, out_len);
         } else {
             PR_ERR("Data From MQTT But No Match Parse %s", pv);
             return OPRT_COM_ERROR;
@@ -217,163 +220,215 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
     return op_ret;
 }
 
-static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
-                                             const uint32_t pro, const uint32_t num, const uint8_t *key,
-                                             uint8_t **pack_out, uint32_t *out_len)
+/**
+ * @brief Parses the protocol data for a given command.
+ *
+ * This function takes in the command type, data, length, key, and a pointer to
+ * store the output data. It parses the protocol data based on the provided
+ * command and returns the result in the `out_data` parameter.
+ *
+ * @param cmd The command type to parse.
+ * @param data The input data to be parsed.
+ * @param len The length of the input data.
+ * @param key The key used for parsing the data.
+ * @param out_data A pointer to store the parsed output data.
+ *
+ * @return The operation result status. Possible values are:
+ *         - OPRT_OK: Operation successful.
+ *         - OPRT_INVALID_PARM: Invalid parameter provided.
+ *         - OPRT_MALLOC_FAILED: Memory allocation failed.
+ *         - OPRT_PARSE_FAILED: Parsing of the protocol data failed.
+ */
+OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
+                                     char **out_data)
 {
-    OPERATE_RET op_ret = OPRT_OK;
-    char *out = NULL;
-    int offset = 0;
+    if ((NULL == data) || (len < DATA_OFFSET_22_32) || (NULL == out_data)) {
+        PR_ERR("data is NULL OR Len Invalid %d", len);
+        return OPRT_INVALID_PARM;
+    }
 
-    PR_TRACE("To:%d src:%s pro:%d num:%d", cmd, src, pro, num);
-    // make json data
-    int len = strlen(src) + 60;
-    out = tal_malloc(len);
-    if (NULL == out) {
-        PR_ERR("tal_malloc Fails %d", len);
-        return OPRT_MALLOC_FAILED;
+    size_t out_len = 0;
+    uint8_t *out = tal_malloc(len + 1);
+    TUYA_CHECK_NULL_RETURN(out, OPRT_MALLOC_FAILED);
+
+    OPERATE_RET op_ret = tuya_parse_protocol_data_to(cmd, data, len, key, out, len + 1, &out_len);
+    if (OPRT_OK != op_ret) {
+        *out_data = NULL;
+        tal_free(out);
+        return op_ret;
+    }
+
+    *out_data = (char *)out;
+
+    return OPRT_OK;
+}
+
+// {"protocol":x,"t":x,"data": + payload + }
+static uint32_t __pack_envelope_write(char *out, uint32_t size, const uint32_t pro, const tuya_protocol_iov_t *iov,
+                                      uint32_t iov_cnt)
+{
+    uint32_t i = 0;
+    int offset = snprintf(out, size, "{\"protocol\":%" PRIu32 ",\"t\":%" PRIu32 ",\"data\":", pro,
+                          (uint32_t)tal_time_get_posix());
+    if (offset < 0 || (uint32_t)offset >= size) {
+        return 0;
     }
 
-    // offset += sprintf(out + offset, "{\"protocol\":%d,\"t\":%d,\"data\":%s", pro, (uint32_t)tal_time_get_posix(),
-    // src);
-    offset += sprintf(out + offset, "{\"protocol\":%" PRIu32 ",\"t\":%" PRIu32 ",\"data\":%s", pro,
-                      (uint32_t)tal_time_get_posix(), src);
+    for (i = 0; i < iov_cnt; i++) {
+        if (iov[i].len + 1 > size - offset) {
+            return 0;
+        }
+        memcpy(out + offset, iov[i].data, iov[i].len);
+        offset += iov[i].len;
+    }
 
+    if ((uint32_t)offset + 1 > size) {
+        return 0;
+    }
     out[offset++] = '}';
-    out[offset] = 0;
 
-    PR_TRACE("After Pack:%s offset:%d", out, offset);
+    return offset;
+}
 
-    // make pack data
-    uint8_t *buf = tal_malloc(offset + PV23_EXCEPT_DATA_LEN);
-    if (buf == NULL) {
-        tal_free(out);
-        return OPRT_MALLOC_FAILED;
+static OPERATE_RET __pack_data_with_cmd_pv23(const DP_CMD_TYPE_E cmd, const char *pv, const tuya_protocol_iov_t *iov,
+                                             uint32_t iov_cnt, const uint32_t pro, const uint32_t num,
+                                             const uint8_t *key, uint8_t *frame, uint32_t frame_size,
+                                             uint32_t *out_len)
+{
+    OPERATE_RET op_ret = OPRT_OK;
+
+    if (frame_size < PV23_EXCEPT_DATA_LEN) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    // make json data, straight into the frame
+    uint32_t offset = __pack_envelope_write((char *)frame + PV23_DATA_OFFSET, frame_size - PV23_EXCEPT_DATA_LEN, pro,
+                                            iov, iov_cnt);
+    if (0 == offset) {
+        return OPRT_BUFFER_NOT_ENOUGH;
     }
-    memset(buf, 0, offset + PV23_EXCEPT_DATA_LEN);
+
+    PR_TRACE("To:%d pro:%d num:%d After Pack:%.*s", cmd, pro, num, (int)offset, frame + PV23_DATA_OFFSET);
 
     // make head data
     // version
-    memcpy(buf + PV23_VERSION_OFFSET, pv, PV_LEN_22_32);
+    memcpy(frame + PV23_VERSION_OFFSET, pv, PV_LEN_22_32);
 
     // seq
     uint32_t tmp = UNI_HTONL(num);
-    memcpy(buf + PV23_SEQ_OFFSET, (uint8_t *)(&tmp), sizeof(uint32_t));
+    memcpy(frame + PV23_SEQ_OFFSET, (uint8_t *)(&tmp), sizeof(uint32_t));
 
     // cmd from
     tmp = UNI_HTONL(0x00000001);
-    memcpy(buf + PV23_CMD_FROM_OFFSET, (uint8_t *)(&tmp), sizeof(uint32_t));
+    memcpy(frame + PV23_CMD_FROM_OFFSET, (uint8_t *)(&tmp), sizeof(uint32_t));
 
     // reserve
-    memset(buf + PV23_RESERVE_OFFSET, 0, 1);
+    memset(frame + PV23_RESERVE_OFFSET, 0, PV23_RESERVE_LEN);
 
     // nonce
-    uni_random_string((char *)(buf + PV23_NONCE_OFFSET), PV23_NONCE_LEN);
-
-    // AES GCM encrypt
-    size_t encrypt_olen = 0;
-    op_ret = mbedtls_cipher_auth_encrypt_wrapper(&(const cipher_params_t){.cipher_type = MBEDTLS_CIPHER_AES_128_GCM,
-                                                                          .key = (unsigned char *)key,
-                                                                          .key_len = 16,
-                                                                          .nonce = buf + PV23_NONCE_OFFSET,
-                                                                          .nonce_len = PV23_NONCE_LEN,
-                                                                          .ad = buf,
-                                                                          .ad_len = PV23_AD_DATA_LEN,
-                                                                          .data = (unsigned char *)out,
-                                                                          .data_len = strlen(out)},
-                                                 buf + PV23_DATA_OFFSET, &encrypt_olen, buf + PV23_DATA_OFFSET + offset,
-                                                 PV23_TAG_LEN);
-    tal_free(out);
+    uni_random_string((char *)(frame + PV23_NONCE_OFFSET), PV23_NONCE_LEN);
+
+    // AES GCM encrypt in place, the tag follows the data
+    op_ret = mbedtls_cipher_auth_encrypt_inplace_wrapper(&(const cipher_params_t){.cipher_type =
+                                                                                      MBEDTLS_CIPHER_AES_128_GCM,
+                                                                                  .key = (unsigned char *)key,
+                                                                                  .key_len = 16,
+                                                                                  .nonce = frame + PV23_NONCE_OFFSET,
+                                                                                  .nonce_len = PV23_NONCE_LEN,
+                                                                                  .ad = frame,
+                                                                                  .ad_len = PV23_AD_DATA_LEN,
+                                                                                  .data = frame + PV23_DATA_OFFSET,
+                                                                                  .data_len = offset},
+                                                         PV23_TAG_LEN);
     if (op_ret != OPRT_OK) {
-        PR_ERR("mbedtls_cipher_auth_encrypt_wrapper:0x%x", -op_ret);
-        tal_free(buf);
+        PR_ERR("mbedtls_cipher_auth_encrypt_inplace_wrapper:0x%x", -op_ret);
         return op_ret;
     }
 
-    *pack_out = buf;
-    *out_len = PV23_EXCEPT_DATA_LEN + encrypt_olen;
+    *out_len = PV23_EXCEPT_DATA_LEN + offset;
 
     return OPRT_OK;
 }
 
-static OPERATE_RET __pack_data_with_cmd_lpv35(const DP_CMD_TYPE_E cmd, const char *pv, const char *src,
-                                              const uint32_t pro, const uint32_t num, const uint8_t *key,
-                                              uint8_t **pack_out, uint32_t *out_len)
+static OPERATE_RET __pack_data_with_cmd_lpv35(const DP_CMD_TYPE_E cmd, const char *pv, const tuya_protocol_iov_t *iov,
+                                              uint32_t iov_cnt, const uint32_t pro, const uint32_t num,
+                                              const uint8_t *key, uint8_t *frame, uint32_t frame_size,
+                                              uint32_t *out_len)
 {
-    char *out = NULL;
-    int offset = 0;
-
-    PR_TRACE("To:%d src:%s pro:%d num:%d", cmd, src, pro, num);
-
-    // make json data
-    int len = strlen(src) + 60;
-    out = tal_malloc(len);
-    if (NULL == out) {
-        PR_ERR("tal_malloc Fails %d", len);
-        return OPRT_MALLOC_FAILED;
+    if (frame_size < DATA_OFFSET_22_32) {
+        return OPRT_BUFFER_NOT_ENOUGH;
     }
 
-    // offset += sprintf(out + offset, "{\"protocol\":%d,\"t\":%d,\"data\":%s", pro, (uint32_t)tal_time_get_posix(),
-    // src);
-    offset += sprintf(out + offset, "{\"protocol\":%" PRIu32 ",\"t\":%" PRIu32 ",\"data\":%s", pro,
-                      (uint32_t)tal_time_get_posix(), src);
-
-    out[offset++] = '}';
-    out[offset] = 0;
-
-    PR_TRACE("After Pack:%s offset:%d", out, offset);
-
-    // make pack data
-    uint8_t *buf = tal_malloc(DATA_OFFSET_22_32 + offset + 16);
-    if (buf == NULL) {
-        tal_free(out);
-        return OPRT_MALLOC_FAILED;
+    // not aes data, make json data straight into the frame
+    uint32_t offset = __pack_envelope_write((char *)frame + DATA_OFFSET_22_32, frame_size - DATA_OFFSET_22_32, pro,
+                                            iov, iov_cnt);
+    if (0 == offset) {
+        return OPRT_BUFFER_NOT_ENOUGH;
     }
-    memset(buf, 0, DATA_OFFSET_22_32 + offset + 16);
 
-    // not aes data
-    memcpy(buf + DATA_OFFSET_22_32, out, offset);
-    tal_free(out);
+    PR_TRACE("To:%d pro:%d num:%d After Pack:%.*s", cmd, pro, num, (int)offset, frame + DATA_OFFSET_22_32);
 
-    *pack_out = buf;
     *out_len = (DATA_OFFSET_22_32 + offset);
 
     // make head data
-    memcpy(buf + PV_OFFSET_22_32, pv, PV_LEN_22_32);
+    memcpy(frame + PV_OFFSET_22_32, pv, PV_LEN_22_32);
 
     uint32_t tmp = UNI_HTONL(0x00000000);
-    memcpy(buf + CRC_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
+    memcpy(frame + CRC_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
 
     tmp = UNI_HTONL(num);
-    memcpy(buf + SEQ_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
+    memcpy(frame + SEQ_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
 
     tmp = UNI_HTONL(0x00000001);
-    memcpy(buf + CMD_FROM_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
+    memcpy(frame + CMD_FROM_OFFSET_22_32, (uint8_t *)(&tmp), sizeof(uint32_t));
 
     return OPRT_OK;
 }
 
 /**
- * @brief Packs the protocol data for Tuya Cloud service.
+ * @brief Gets the frame size needed to pack a payload.
  *
- * This function takes the command type, source data, protocol version,
- * encryption key, and outputs the packed protocol data.
+ * @param cmd The command type.
+ * @param payload_len Total length of the payload fragments.
+ *
+ * @return The frame size in bytes, 0 if cmd is not supported.
+ */
+uint32_t tuya_pack_protocol_frame_size(const DP_CMD_TYPE_E cmd, uint32_t payload_len)
+{
+    if (DP_CMD_MQ == cmd) {
+        return PV23_EXCEPT_DATA_LEN + TUYA_PACK_ENVELOPE_MAX + payload_len;
+    } else if (DP_CMD_LAN == cmd) {
+        return DATA_OFFSET_22_32 + TUYA_PACK_ENVELOPE_MAX + payload_len;
+    }
+    return 0;
+}
+
+/**
+ * @brief Packs a payload given as fragments into a caller frame.
+ *
+ * The envelope header, the protocol JSON prefix, the fragments and the suffix
+ * are written straight into `frame` and encrypted there, nothing is allocated.
+ * The payload is the concatenation of the fragments and must be a JSON value.
  *
  * @param cmd The command type.
- * @param src The source data to be packed.
- * @param pro The protocol version.
+ * @param iov The payload fragments.
+ * @param iov_cnt Number of fragments.
+ * @param pro The protocol number.
  * @param key The encryption key.
- * @param out Pointer to the output packed data.
- * @param out_len Pointer to the length of the output packed data.
+ * @param frame The frame buffer, see tuya_pack_protocol_frame_size().
+ * @param frame_size Size of `frame`.
+ * @param out_len Length of the packed frame.
  *
  * @return The operation result status.
  *     - OPRT_OK: Operation successful.
+ *     - OPRT_BUFFER_NOT_ENOUGH: `frame` is too small.
  *     - Other error codes: Operation failed.
  */
-OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t pro, uint8_t *key,
-                                    char **out, uint32_t *out_len)
+OPERATE_RET tuya_pack_protocol_data_iov(const DP_CMD_TYPE_E cmd, const tuya_protocol_iov_t *iov, uint32_t iov_cnt,
+                                        const uint32_t pro, const uint8_t *key, uint8_t *frame, uint32_t frame_size,
+                                        uint32_t *out_len)
 {
-    if ((NULL == src) || NULL == out) {
+    if ((NULL == iov && iov_cnt) || NULL == frame || NULL == out_len) {
         PR_ERR("Invalid Param");
         return OPRT_INVALID_PARM;
     }
@@ -392,7 +447,7 @@ OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, co
     if (DP_CMD_LAN == cmd) {
         if (0 == strcmp(pv, "3.5")) {
             PR_TRACE("Data To LAN AND V=3.5");
-            op_ret = __pack_data_with_cmd_lpv35(cmd, pv, src, pro, num, (uint8_t *)key, (uint8_t **)out, out_len);
+            op_ret = __pack_data_with_cmd_lpv35(cmd, pv, iov, iov_cnt, pro, num, key, frame, frame_size, out_len);
         } else {
             PR_ERR("Data To LAN But No Match Parse %s", pv);
             return OPRT_COM_ERROR;
@@ -400,7 +455,7 @@ OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, co
     } else if (DP_CMD_MQ == cmd) {
         if (0 == strcmp(pv, "2.3")) {
             PR_TRACE("Data To MQTT AND V=2.3");
-            op_ret = __pack_data_with_cmd_pv23(cmd, pv, src, pro, num, key, (uint8_t **)out, out_len);
+            op_ret = __pack_data_with_cmd_pv23(cmd, pv, iov, iov_cnt, pro, num, key, frame, frame_size, out_len);
         } else {
             PR_ERR("Data To MQTT But No Match Parse %s", pv);
             return OPRT_COM_ERROR;
@@ -413,6 +468,55 @@ OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, co
     return op_ret;
 }
 
+/**
+ * @brief Packs the protocol data for Tuya Cloud service.
+ *
+ * This function takes the command type, source data, protocol version,
+ * encryption key, and outputs the packed protocol data.
+ *
+ * @param cmd The command type.
+ * @param src The source data to be packed.
+ * @param pro The protocol version.
+ * @param key The encryption key.
+ * @param out Pointer to the output packed data.
+ * @param out_len Pointer to the length of the output packed data.
+ *
+ * @return The operation result status.
+ *     - OPRT_OK: Operation successful.
+ *     - Other error codes: Operation failed.
+ */
+OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t pro, uint8_t *key,
+                                    char **out, uint32_t *out_len)
+{
+    if ((NULL == src) || NULL == out) {
+        PR_ERR("Invalid Param");
+        return OPRT_INVALID_PARM;
+    }
+
+    tuya_protocol_iov_t iov = {.data = src, .len = strlen(src)};
+    uint32_t frame_size = tuya_pack_protocol_frame_size(cmd, iov.len);
+    if (0 == frame_size) {
+        PR_ERR("Invlaid Cmd:%d", cmd);
+        return OPRT_COM_ERROR;
+    }
+
+    uint8_t *frame = tal_malloc(frame_size);
+    if (NULL == frame) {
+        PR_ERR("tal_malloc Fails %d", frame_size);
+        return OPRT_MALLOC_FAILED;
+    }
+
+    OPERATE_RET op_ret = tuya_pack_protocol_data_iov(cmd, &iov, 1, pro, key, frame, frame_size, out_len);
+    if (OPRT_OK != op_ret) {
+        tal_free(frame);
+        return op_ret;
+    }
+
+    *out = (char *)frame;
+
+    return OPRT_OK;
+}
+
 /**
  * @brief Retrieves the size of the frame buffer for LPV35 frame objects.
  *
@@ -628,3 +732,325 @@ OPERATE_RET lpv35_frame_parse(const uint8_t *key, int key_len, const uint8_t *in
 
     return op_ret;
 }
+
+/***********************************************************
+ * In place JSON scan
+ *
+ * Cloud messages are only read for a few top level members, the scanner walks
+ * the text once and returns spans into it, nested values are skipped by
+ * bracket counting. It validates just enough to find member boundaries, values
+ * that are used as trees still go through cJSON.
+ ***********************************************************/
+static const char *__json_ws_skip(const char *p, const char *end)
+{
+    while (p < end && (' ' == *p || '\t' == *p || '\r' == *p || '\n' == *p)) {
+        p++;
+    }
+    return p;
+}
+
+// p is at the opening quote, returns the closing quote or NULL
+static const char *__json_str_end(const char *p, const char *end)
+{
+    for (p++; p < end; p++) {
+        if ('\\' == *p) {
+            p++;
+        } else if ('"' == *p) {
+            return p;
+        }
+    }
+    return NULL;
+}
+
+// returns the first byte after the value at p, or NULL if it is malformed
+static const char *__json_value_scan(const char *p, const char *end, tuya_json_span_t *val)
+{
+    const char *q = p;
+    uint32_t depth = 0;
+
+    if (p >= end) {
+        return NULL;
+    }
+
+    if ('"' == *p) {
+        q = __json_str_end(p, end);
+        if (NULL == q) {
+            return NULL;
+        }
+        val->type = TUYA_JSON_STRING;
+        val->ptr = p + 1;
+        val->len = q - p - 1;
+        return q + 1;
+    }
+
+    if ('{' == *p || '[' == *p) {
+        for (; q < end; q++) {
+            if ('"' == *q) {
+                q = __json_str_end(q, end);
+                if (NULL == q) {
+                    return NULL;
+                }
+            } else if ('{' == *q || '[' == *q) {
+                depth++;
+            } else if (('}' == *q || ']' == *q) && 0 == --depth) {
+                break;
+            }
+        }
+        if (q >= end) {
+            return NULL;
+        }
+        val->type = ('{' == *p) ? TUYA_JSON_OBJECT : TUYA_JSON_ARRAY;
+        val->ptr = p;
+        val->len = q + 1 - p;
+        return q + 1;
+    }
+
+    while (q < end && ',' != *q && '}' != *q && ']' != *q && ' ' != *q && '\t' != *q && '\r' != *q && '\n' != *q) {
+        q++;
+    }
+    val->ptr = p;
+    val->len = q - p;
+    if (4 == val->len && 0 == memcmp(p, "true", 4)) {
+        val->type = TUYA_JSON_TRUE;
+    } else if (5 == val->len && 0 == memcmp(p, "false", 5)) {
+        val->type = TUYA_JSON_FALSE;
+    } else if (4 == val->len && 0 == memcmp(p, "null", 4)) {
+        val->type = TUYA_JSON_NULL;
+    } else if (val->len && ('-' == *p || ('0' <= *p && *p <= '9'))) {
+        val->type = TUYA_JSON_NUMBER;
+    } else {
+        return NULL;
+    }
+    return q;
+}
+
+// calls cb for each top level member until it returns false
+static OPERATE_RET __json_object_walk(const char *json, size_t len, tuya_json_field_cb_t cb, void *arg)
+{
+    const char *end = json + len;
+    const char *p = __json_ws_skip(json, end);
+    const char *q = NULL;
+    tuya_json_span_t val;
+
+    if (p >= end || '{' != *p) {
+        return OPRT_CJSON_PARSE_ERR;
+    }
+
+    p = __json_ws_skip(p + 1, end);
+    if (p < end && '}' == *p) {
+        return OPRT_OK;
+    }
+
+    while (p < end && '"' == *p) {
+        q = __json_str_end(p, end);
+        if (NULL == q) {
+            break;
+        }
+
+        const char *key = p + 1;
+        size_t key_len = q - key;
+
+        p = __json_ws_skip(q + 1, end);
+        if (p >= end || ':' != *p) {
+            break;
+        }
+
+        p = __json_value_scan(__json_ws_skip(p + 1, end), end, &val);
+        if (NULL == p) {
+            break;
+        }
+
+        if (!cb(key, key_len, &val, arg)) {
+            return OPRT_OK;
+        }
+
+        p = __json_ws_skip(p, end);
+        if (p < end && '}' == *p) {
+            return OPRT_OK;
+        }
+        if (p >= end || ',' != *p) {
+            break;
+        }
+        p = __json_ws_skip(p + 1, end);
+    }
+
+    return OPRT_CJSON_PARSE_ERR;
+}
+
+#define MSG_SCAN_PROTOCOL (1 << 0)
+#define MSG_SCAN_T        (1 << 1)
+#define MSG_SCAN_DATA     (1 << 2)
+#define MSG_SCAN_ALL      (MSG_SCAN_PROTOCOL | MSG_SCAN_T | MSG_SCAN_DATA)
+
+typedef struct {
+    tuya_protocol_msg_t *msg;
+    uint8_t found;
+} msg_scan_ctx_t;
+
+static bool __msg_scan_field(const char *key, size_t key_len, const tuya_json_span_t *val, void *arg)
+{
+    msg_scan_ctx_t *ctx = (msg_scan_ctx_t *)arg;
+    int num = 0;
+
+    if (8 == key_len && 0 == memcmp(key, "protocol", 8)) {
+        if (OPRT_OK == tuya_protocol_json_int_get(val, &num)) {
+            ctx->msg->protocol = num;
+            ctx->found |= MSG_SCAN_PROTOCOL;
+        }
+    } else if (1 == key_len && 't' == key[0]) {
+        if (OPRT_OK == tuya_protocol_json_int_get(val, &num)) {
+            ctx->msg->t = (uint32_t)num;
+            ctx->found |= MSG_SCAN_T;
+        }
+    } else if (4 == key_len && 0 == memcmp(key, "data", 4)) {
+        ctx->msg->data = *val;
+        ctx->found |= MSG_SCAN_DATA;
+    }
+
+    return MSG_SCAN_ALL != ctx->found;
+}
+
+/**
+ * @brief Scans the header of a cloud message in place.
+ *
+ * @param json The message text.
+ * @param len The message length.
+ * @param msg Receives protocol, t and the span of data.
+ *
+ * @return OPRT_OK on success, OPRT_CJSON_PARSE_ERR on malformed text,
+ * OPRT_CJSON_GET_ERR if a header member is missing.
+ */
+OPERATE_RET tuya_protocol_msg_scan(const char *json, size_t len, tuya_protocol_msg_t *msg)
+{
+    if (NULL == json || NULL == msg) {
+        return OPRT_INVALID_PARM;
+    }
+
+    memset(msg, 0, sizeof(tuya_protocol_msg_t));
+    msg_scan_ctx_t ctx = {.msg = msg, .found = 0};
+
+    OPERATE_RET rt = __json_object_walk(json, len, __msg_scan_field, &ctx);
+    if (OPRT_OK != rt) {
+        return rt;
+    }
+
+    return (MSG_SCAN_ALL == ctx.found) ? OPRT_OK : OPRT_CJSON_GET_ERR;
+}
+
+typedef struct {
+    const char *key;
+    size_t key_len;
+    tuya_json_span_t *val;
+    bool found;
+} field_get_ctx_t;
+
+static bool __field_get_cb(const char *key, size_t key_len, const tuya_json_span_t *val, void *arg)
+{
+    field_get_ctx_t *ctx = (field_get_ctx_t *)arg;
+
+    if (key_len == ctx->key_len && 0 == memcmp(key, ctx->key, key_len)) {
+        *ctx->val = *val;
+        ctx->found = true;
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Finds a top level member of a JSON object in place.
+ *
+ * @param json The object text.
+ * @param len The object length.
+ * @param key The member name.
+ * @param val Receives the span of the member value.
+ *
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if the member is missing,
+ * OPRT_CJSON_PARSE_ERR on malformed text.
+ */
+OPERATE_RET tuya_protocol_json_field_get(const char *json, size_t len, const char *key, tuya_json_span_t *val)
+{
+    if (NULL == json || NULL == key || NULL == val) {
+        return OPRT_INVALID_PARM;
+    }
+
+    field_get_ctx_t ctx = {.key = key, .key_len = strlen(key), .val = val, .found = false};
+
+    OPERATE_RET rt = __json_object_walk(json, len, __field_get_cb, &ctx);
+    if (OPRT_OK != rt) {
+        return rt;
+    }
+
+    return ctx.found ? OPRT_OK : OPRT_NOT_FOUND;
+}
+
+/**
+ * @brief Walks the top level members of a JSON object in place.
+ *
+ * @param json The object text.
+ * @param len The object length.
+ * @param cb Called for each member until it returns false.
+ * @param arg Passed to cb.
+ *
+ * @return OPRT_OK on success, OPRT_CJSON_PARSE_ERR on malformed text.
+ */
+OPERATE_RET tuya_protocol_json_object_walk(const char *json, size_t len, tuya_json_field_cb_t cb, void *arg)
+{
+    if (NULL == json || NULL == cb) {
+        return OPRT_INVALID_PARM;
+    }
+
+    return __json_object_walk(json, len, cb, arg);
+}
+
+/**
+ * @brief Converts a number span to an integer, the fraction is dropped.
+ *
+ * @param val The span of a number.
+ * @param out Receives the value.
+ *
+ * @return OPRT_OK on success, OPRT_INVALID_PARM if val is not a number.
+ */
+OPERATE_RET tuya_protocol_json_int_get(const tuya_json_span_t *val, int *out)
+{
+    if (NULL == val || NULL == out || TUYA_JSON_NUMBER != val->type) {
+        return OPRT_INVALID_PARM;
+    }
+
+    const char *p = val->ptr;
+    const char *end = val->ptr + val->len;
+    bool neg = false;
+    int64_t num = 0;
+
+    if (p < end && '-' == *p) {
+        neg = true;
+        p++;
+    }
+    if (p >= end || *p < '0' || *p > '9') {
+        return OPRT_INVALID_PARM;
+    }
+    for (; p < end && '0' <= *p && *p <= '9'; p++) {
+        if (num <= UINT32_MAX) {
+            num = num * 10 + (*p - '0');
+        }
+    }
+
+    *out = (int)(neg ? -num : num);
+    return OPRT_OK;
+}
+
+/**
+ * @brief Compares a string span with a C string.
+ *
+ * @param val The span of a string.
+ * @param str The string to compare with.
+ *
+ * @return true if val is a string equal to str.
+ */
+bool tuya_protocol_json_str_equal(const tuya_json_span_t *val, const char *str)
+{
+    if (NULL == val || NULL == str || TUYA_JSON_STRING != val->type) {
+        return false;
+    }
+
+    return (strlen(str) == val->len) && (0 == memcmp(val->ptr, str, val->len));
+}
@@ -89,6 +89,47 @@ typedef struct {
 } lpv35_frame_object_t;
 
 typedef dp_cmd_type_t DP_CMD_TYPE_E;
+
+// room for {"protocol":x,"t":x,"data": and } around a packed payload
+#define TUYA_PACK_ENVELOPE_MAX (48)
+
+// one fragment of a payload to pack
+typedef struct {
+    const void *data;
+    size_t len;
+} tuya_protocol_iov_t;
+
+typedef enum {
+    TUYA_JSON_INVALID = 0,
+    TUYA_JSON_STRING,
+    TUYA_JSON_NUMBER,
+    TUYA_JSON_OBJECT,
+    TUYA_JSON_ARRAY,
+    TUYA_JSON_TRUE,
+    TUYA_JSON_FALSE,
+    TUYA_JSON_NULL,
+} tuya_json_type_t;
+
+/**
+ * A JSON value in place in its source text. Strings exclude the quotes and keep
+ * their escapes, other values are the raw text, objects and arrays include the
+ * brackets.
+ */
+typedef struct {
+    const char *ptr;
+    size_t len;
+    tuya_json_type_t type;
+} tuya_json_span_t;
+
+// called for each member of an object, return false to stop the walk
+typedef bool (*tuya_json_field_cb_t)(const char *key, size_t key_len, const tuya_json_span_t *val, void *arg);
+
+// header of a cloud message: {"protocol":x,"t":x,"data":{...}}
+typedef struct {
+    int protocol;
+    uint32_t t;
+    tuya_json_span_t data;
+} tuya_protocol_msg_t;
 /***********************************************************
  *  Function: parse_data_with_cmd
  *  Input: cmd data len
@@ -112,6 +153,84 @@ typedef dp_cmd_type_t DP_CMD_TYPE_E;
 OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, const int len, const char *key,
                                      char **out_data);
 
+/**
+ * @brief parse protocol data into a caller buffer
+ *
+ * @param[in] cmd refer to DP_CMD_TYPE_E
+ * @param[in] data origin data
+ * @param[in] len data length
+ * @param[in] key parse key
+ * @param[out] out plaintext, NUL terminated, len + 1 bytes are always enough
+ * @param[in] out_size size of out
+ * @param[out] out_len plaintext length
+ *
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if out is too small.
+ * Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_parse_protocol_data_to(const DP_CMD_TYPE_E cmd, const uint8_t *data, const int len, const char *key,
+                                        uint8_t *out, size_t out_size, size_t *out_len);
+
+/**
+ * @brief scan the header of a cloud message without building a cJSON tree
+ *
+ * @param[in] json message text
+ * @param[in] len message length
+ * @param[out] msg protocol, t and the span of data, pointing into json
+ *
+ * @return OPRT_OK on success, OPRT_CJSON_PARSE_ERR if the text is not a JSON
+ * object, OPRT_CJSON_GET_ERR if protocol, t or data is missing
+ */
+OPERATE_RET tuya_protocol_msg_scan(const char *json, size_t len, tuya_protocol_msg_t *msg);
+
+/**
+ * @brief find a member of a JSON object in place
+ *
+ * Only the top level of the object is searched, nested values are skipped
+ * without being parsed.
+ *
+ * @param[in] json object text
+ * @param[in] len object length
+ * @param[in] key member name
+ * @param[out] val span of the member value
+ *
+ * @return OPRT_OK on success, OPRT_NOT_FOUND if there is no such member,
+ * OPRT_CJSON_PARSE_ERR if the text is not a JSON object
+ */
+OPERATE_RET tuya_protocol_json_field_get(const char *json, size_t len, const char *key, tuya_json_span_t *val);
+
+/**
+ * @brief walk the members of a JSON object in place
+ *
+ * @param[in] json object text
+ * @param[in] len object length
+ * @param[in] cb called for each top level member, key is not NUL terminated
+ * @param[in] arg passed to cb
+ *
+ * @return OPRT_OK on success, OPRT_CJSON_PARSE_ERR if the text is not a JSON
+ * object
+ */
+OPERATE_RET tuya_protocol_json_object_walk(const char *json, size_t len, tuya_json_field_cb_t cb, void *arg);
+
+/**
+ * @brief convert a number span to an integer
+ *
+ * @param[in] val span of a number, the fraction is dropped
+ * @param[out] out value
+ *
+ * @return OPRT_OK on success, OPRT_INVALID_PARM if val is not a number
+ */
+OPERATE_RET tuya_protocol_json_int_get(const tuya_json_span_t *val, int *out);
+
+/**
+ * @brief compare a string span with a C string
+ *
+ * @param[in] val span of a string
+ * @param[in] str string to compare with
+ *
+ * @return true if val is a string equal to str
+ */
+bool tuya_protocol_json_str_equal(const tuya_json_span_t *val, const char *str);
+
 /**
  * @brief pack protocol data
  *
@@ -129,6 +248,38 @@ OPERATE_RET tuya_parse_protocol_data(const DP_CMD_TYPE_E cmd, uint8_t *data, con
  */
 OPERATE_RET tuya_pack_protocol_data(const DP_CMD_TYPE_E cmd, const char *src, const uint32_t pro, uint8_t *key,
                                     char **out, uint32_t *out_len);
+
+/**
+ * @brief get the frame size needed to pack a payload
+ *
+ * @param[in] cmd refer to DP_CMD_TYPE_E
+ * @param[in] payload_len total length of the payload fragments
+ *
+ * @return frame size in bytes, 0 if cmd is not supported
+ */
+uint32_t tuya_pack_protocol_frame_size(const DP_CMD_TYPE_E cmd, uint32_t payload_len);
+
+/**
+ * @brief pack a payload given as fragments into a caller frame
+ *
+ * The envelope and the fragments are written straight into the frame and
+ * encrypted in place, nothing is allocated.
+ *
+ * @param[in] cmd refer to DP_CMD_TYPE_E
+ * @param[in] iov payload fragments, their concatenation is a JSON value
+ * @param[in] iov_cnt number of fragments
+ * @param[in] pro pro
+ * @param[in] key pack key
+ * @param[out] frame frame buffer, see tuya_pack_protocol_frame_size
+ * @param[in] frame_size size of frame
+ * @param[out] out_len packed frame length
+ *
+ * @return OPRT_OK on success, OPRT_BUFFER_NOT_ENOUGH if frame is too small.
+ * Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_pack_protocol_data_iov(const DP_CMD_TYPE_E cmd, const tuya_protocol_iov_t *iov, uint32_t iov_cnt,
+                                        const uint32_t pro, const uint8_t *key, uint8_t *frame, uint32_t frame_size,
+                                        uint32_t *out_len);
 /**
  * @brief add head and tail in lpv35 frame
  *
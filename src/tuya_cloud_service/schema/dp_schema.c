@@ -23,18 +23,137 @@
 
 #define MAX_TRANS_TYPE_NUM (DTT_SCT_SCENE + 1)
 
+#ifndef DP_SCHEMA_NUM_MAX
 #define DP_SCHEMA_NUM_MAX 1
+#endif
+
+// buckets of the devid hash table, power of 2
+#ifndef DP_SCHEMA_BUCKET_NUM
+#define DP_SCHEMA_BUCKET_NUM 8
+#endif
 
 typedef struct {
     // DELAYED_WORK_HANDLE tmm_dp_sync;
     uint16_t serial_no;
     MUTEX_HANDLE mutex;
     uint8_t schema_num;
-    dp_schema_t *schema_list[DP_SCHEMA_NUM_MAX];
+    dp_schema_t *bucket[DP_SCHEMA_BUCKET_NUM];
 } dp_schema_mgr_t;
 
 static dp_schema_mgr_t s_dsmgr = {0};
 
+static uint32_t dp_devid_hash(const char *devid)
+{
+    uint32_t hash = 2166136261u;
+
+    while (*devid) {
+        hash = (hash ^ (uint8_t)*devid++) * 16777619u;
+    }
+    return hash;
+}
+
+/**
+ * @brief Writes val as decimal text to out.
+ *
+ * @return The number of characters written, no terminating 0 is added.
+ */
+static uint16_t dp_json_uint_output(char *out, uint32_t val)
+{
+    char tmp[10];
+    uint16_t len = 0;
+    uint16_t i = 0;
+
+    do {
+        tmp[len++] = '0' + val % 10;
+        val /= 10;
+    } while (val);
+    for (i = 0; i < len; i++) {
+        out[i] = tmp[len - 1 - i];
+    }
+    return len;
+}
+
+static uint16_t dp_json_int_output(char *out, int val)
+{
+    if (val < 0) {
+        out[0] = '-';
+        return 1 + dp_json_uint_output(out + 1, 0u - (uint32_t)val);
+    }
+    return dp_json_uint_output(out, (uint32_t)val);
+}
+
+/**
+ * @brief Writes str as a quoted json string to out, escaped as cJSON does.
+ *
+ * @param out The output, NULL to get the length only.
+ * @return The number of characters written, no terminating 0 is added.
+ */
+static uint32_t dp_json_str_output(char *out, const char *str)
+{
+    static const char hex[] = "0123456789abcdef";
+    const uint8_t *in = (const uint8_t *)str;
+    uint32_t len = 0;
+    char esc = 0;
+
+    if (out) {
+        out[len] = '"';
+    }
+    len++;
+    for (; *in; in++) {
+        switch (*in) {
+        case '"':
+            esc = '"';
+            break;
+        case '\\':
+            esc = '\\';
+            break;
+        case '\b':
+            esc = 'b';
+            break;
+        case '\f':
+            esc = 'f';
+            break;
+        case '\n':
+            esc = 'n';
+            break;
+        case '\r':
+            esc = 'r';
+            break;
+        case '\t':
+            esc = 't';
+            break;
+        default:
+            esc = (*in < 0x20) ? 'u' : 0;
+            break;
+        }
+        if (0 == esc) {
+            if (out) {
+                out[len] = *in;
+            }
+            len++;
+        } else if ('u' != esc) {
+            if (out) {
+                out[len] = '\\';
+                out[len + 1] = esc;
+            }
+            len += 2;
+        } else {
+            if (out) {
+                memcpy(out + len, "\\u00", 4);
+                out[len + 4] = hex[*in >> 4];
+                out[len + 5] = hex[*in & 0x0F];
+            }
+            len += 6;
+        }
+    }
+    if (out) {
+        out[len] = '"';
+    }
+    len++;
+
+    return len;
+}
+
 /**
  * @brief Appends a JSON string to the given data with the specified time, type,
  * and repetition sequence.
@@ -118,16 +237,10 @@ __err_exit:
  */
 dp_node_t *dp_node_find(dp_schema_t *schema, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
+    if (id < 0 || id > 255 || 0 == schema->index[id]) {
+        return NULL;
     }
-    return dpnode;
+    return &schema->node[schema->index[id] - 1];
 }
 
 /**
@@ -138,19 +251,15 @@ dp_node_t *dp_node_find(dp_schema_t *schema, int id)
  */
 dp_schema_t *dp_schema_find(const char *devid)
 {
-    int i = 0;
+    uint32_t hash = dp_devid_hash(devid);
+    dp_schema_t *schema = NULL;
 
     PR_TRACE("try to find schema devid %s", devid);
-    dp_schema_mgr_t *dsmgr = &s_dsmgr;
-    for (i = 0; i < DP_SCHEMA_NUM_MAX; i++) {
-        if (NULL == dsmgr->schema_list[i]) {
-            continue;
-        }
-        if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
-            return dsmgr->schema_list[i];
+    schema = s_dsmgr.bucket[hash & (DP_SCHEMA_BUCKET_NUM - 1)];
+    for (; schema; schema = schema->next) {
+        if (schema->devid_hash == hash && 0 == strcmp(devid, schema->devid)) {
+            return schema;
         }
-
-        PR_TRACE("find schema devid %s, not match!", dsmgr->schema_list[i]->devid);
     }
 
     return NULL;
@@ -168,20 +277,11 @@ dp_schema_t *dp_schema_find(const char *devid)
  */
 dp_node_t *dp_node_find_by_devid(char *devid, int id)
 {
-    int i;
-    dp_node_t *dpnode = NULL;
-
     dp_schema_t *schema = dp_schema_find(devid);
     if (NULL == schema) {
         return NULL;
     }
-    for (i = 0; i < schema->num; i++) {
-        if (schema->node[i].desc.id == id) {
-            dpnode = &schema->node[i];
-            break;
-        }
-    }
-    return dpnode;
+    return dp_node_find(schema, id);
 }
 
 static __attribute__((unused)) OPERATE_RET dp_obj_equal_resp(dp_schema_t *schema, uint8_t *dpid, uint8_t num,
@@ -785,7 +885,7 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
         }
 
         case PROP_STR: {
-            dpvalid->len += 2 * strlen(dp->value.dp_str) + 15;
+            dpvalid->len += dp_json_str_output(NULL, dp->value.dp_str) + 15;
         } break;
 
         case PROP_ENUM: {
@@ -820,141 +920,294 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
     return OPRT_OK;
 }
 
-/**
- * @brief Outputs the JSON representation of a device property (DP) schema.
- *
- * This function takes a DP schema, input data, validation information, and
- * output data as parameters. It generates the JSON representation of the DP
- * schema based on the provided input data and validation information, and
- * stores the result in the output data structure.
- *
- * @param schema Pointer to the DP schema structure.
- * @param dpin Pointer to the input data structure.
- * @param dpvalid Pointer to the validation information structure.
- * @param dpout Pointer to the output data structure.
- * @return Integer value indicating the success or failure of the operation.
- */
-int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+/* writes the dps object of the valid dps to dpstr and, if dptimestr is not
+ * NULL, the object of their times to dptimestr, both 0 terminated */
+static int dp_rept_json_dps_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, char *dpstr,
+                                  char *dptimestr, uint16_t *time_len)
 {
     uint16_t i, j;
+    uint16_t pos = 0;
     uint16_t offset = 0;
     uint16_t time_offset = 0;
-    OPERATE_RET op_ret = OPRT_OK;
-    char *dpstr = NULL;
-    char *dptimestr = NULL;
-    bool is_need_time = false;
+    const char *enum_str = NULL;
 
-    dpstr = (char *)tal_malloc(dpvalid->len);
-    if (NULL == dpstr) {
-        PR_ERR("malloc err:%d", dpvalid->len);
-        return OPRT_MALLOC_FAILED;
-    }
-    // STAT type DP needs to assemble a timestamp
-    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
-        dptimestr = (char *)tal_malloc(dpvalid->timelen);
-        if (NULL == dptimestr) {
-            PR_ERR("malloc err:%d", dpvalid->timelen);
-            op_ret = OPRT_MALLOC_FAILED;
-            goto __err_exit;
-        }
-        is_need_time = true;
-    }
     dpstr[offset++] = '{';
-    if (is_need_time) {
+    if (dptimestr) {
         dptimestr[time_offset++] = '{';
     }
 
     for (i = 0; i < dpvalid->num; i++) {
         dp_obj_t *dp = NULL;
-        for (j = 0; j < dpin->dpscnt; j++) {
-            if (dpvalid->dpid[i] == dpin->dps[j].id) {
-                dp = &dpin->dps[j];
+        // dpid[] keeps the order of dps[], the search goes on from the last match
+        for (j = 0; j < dpin->dpscnt; j++, pos++) {
+            if (pos >= dpin->dpscnt) {
+                pos = 0;
+            }
+            if (dpvalid->dpid[i] == dpin->dps[pos].id) {
+                dp = &dpin->dps[pos++];
                 break;
             }
         }
         if (NULL == dp) {
             PR_DEBUG("dp not found");
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
-        // dp_obj_t  *dp     = &dpin->dps[dpvalid->dpid[i]];
         dp_node_t *dpnode = dp_node_find(schema, dp->id);
         if (NULL == dpnode) {
             PR_DEBUG("dp->id = %d not found", dp->id);
-            op_ret = OPRT_SVC_DP_ID_NOT_FOUND;
-            goto __err_exit;
+            return OPRT_SVC_DP_ID_NOT_FOUND;
         }
 
         if (dp->type != dpnode->desc.prop_tp) {
-            op_ret = OPRT_SVC_DP_TP_NOT_MATCH;
-            goto __err_exit;
+            return OPRT_SVC_DP_TP_NOT_MATCH;
         }
 
+        memcpy(dpstr + offset, dpnode->key, dpnode->key_len);
+        offset += dpnode->key_len;
         switch (dp->type) {
         case PROP_BOOL: {
             if (TRUE == dp->value.dp_bool) {
-                offset += sprintf(dpstr + offset, "\"%d\":true,", dp->id);
+                memcpy(dpstr + offset, "true", 4);
+                offset += 4;
             } else {
-                offset += sprintf(dpstr + offset, "\"%d\":false,", dp->id);
+                memcpy(dpstr + offset, "false", 5);
+                offset += 5;
             }
             break;
         }
 
         case PROP_VALUE: {
-            offset += sprintf(dpstr + offset, "\"%d\":%d,", dp->id, dp->value.dp_value);
+            offset += dp_json_int_output(dpstr + offset, dp->value.dp_value);
             break;
         }
 
         case PROP_BITMAP: {
-            offset += sprintf(dpstr + offset, "\"%d\":%" PRIu32 ",", dp->id, dp->value.dp_bitmap);
+            offset += dp_json_uint_output(dpstr + offset, dp->value.dp_bitmap);
             break;
         }
 
         case PROP_STR: {
-            cJSON *temp_str = cJSON_CreateString(dp->value.dp_str);
-            char *tmp_data = cJSON_PrintUnformatted(temp_str);
-            if (tmp_data) {
-                offset += sprintf(dpstr + offset, "\"%d\":%s,", dp->id, tmp_data);
-            }
-            tal_free(tmp_data);
-            cJSON_Delete(temp_str);
+            offset += dp_json_str_output(dpstr + offset, dp->value.dp_str);
             break;
         }
 
         case PROP_ENUM: {
-            offset +=
-                sprintf(dpstr + offset, "\"%d\":\"%s\",", dp->id, dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum]);
+            enum_str = dpnode->prop.prop_enum.pp_enum[dp->value.dp_enum];
+            dpstr[offset++] = '"';
+            memcpy(dpstr + offset, enum_str, strlen(enum_str));
+            offset += strlen(enum_str);
+            dpstr[offset++] = '"';
         } break;
         }
+        dpstr[offset++] = ',';
 
-        if (is_need_time && dp->time_stamp) {
-            time_offset += sprintf(dptimestr + time_offset, "\"%d\":%u,", dp->id, dp->time_stamp);
+        if (dptimestr && dp->time_stamp) {
+            memcpy(dptimestr + time_offset, dpnode->key, dpnode->key_len);
+            time_offset += dpnode->key_len;
+            time_offset += dp_json_uint_output(dptimestr + time_offset, dp->time_stamp);
+            dptimestr[time_offset++] = ',';
         }
     }
 
     dpstr[offset - 1] = '}';
     dpstr[offset] = 0;
 
-    dpout->dpsjson = dpstr;
+    if (dptimestr) {
+        if (time_offset > 1) {
+            time_offset--;
+        }
+        dptimestr[time_offset++] = '}';
+        dptimestr[time_offset] = 0;
+        *time_len = time_offset;
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Outputs the JSON representation of a device property (DP) schema.
+ *
+ * This function takes a DP schema, input data, validation information, and
+ * output data as parameters. It generates the JSON representation of the DP
+ * schema based on the provided input data and validation information, and
+ * stores the result in the output data structure.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpin Pointer to the input data structure.
+ * @param dpvalid Pointer to the validation information structure.
+ * @param dpout Pointer to the output data structure.
+ * @return Integer value indicating the success or failure of the operation.
+ */
+int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout)
+{
+    int op_ret = OPRT_OK;
+    char *dpstr = NULL;
+    char *dptimestr = NULL;
+    uint16_t time_len = 0;
+
+    dpstr = (char *)tal_malloc(dpvalid->len);
+    if (NULL == dpstr) {
+        PR_ERR("malloc err:%d", dpvalid->len);
+        return OPRT_MALLOC_FAILED;
+    }
+    // STAT type DP needs to assemble a timestamp
+    if ((T_STAT_REPT == dpin->rept_type) && dpvalid->timelen && dpout->timejson) {
+        dptimestr = (char *)tal_malloc(dpvalid->timelen);
+        if (NULL == dptimestr) {
+            PR_ERR("malloc err:%d", dpvalid->timelen);
+            tal_free(dpstr);
+            return OPRT_MALLOC_FAILED;
+        }
+    }
 
+    op_ret = dp_rept_json_dps_write(schema, dpin, dpvalid, dpstr, dptimestr, &time_len);
+    if (op_ret < 0) {
+        tal_free(dpstr);
+        tal_free(dptimestr);
+        return op_ret;
+    }
+
+    dpout->dpsjson = dpstr;
     PR_DEBUG("dp rept out: %s", dpstr);
 
-    if (is_need_time) {
-        dptimestr[time_offset - 1] = '}';
-        dptimestr[time_offset] = 0;
+    if (dptimestr) {
         PR_DEBUG("dptimestr:%s", dptimestr);
         dpout->timejson = dptimestr;
     }
 
     return OPRT_OK;
+}
 
-__err_exit:
-    tal_free(dpstr);
-    if (is_need_time) {
-        tal_free(dptimestr);
+/**
+ * @brief Returns the buffer size dp_rept_json_write needs.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpvalid The validation information from dp_rept_valid_check.
+ * @param flags DP_APPEND_HEADER_FLAG to wrap the dps with the devId.
+ * @return The size in bytes, including the terminating 0.
+ */
+uint32_t dp_rept_json_size(dp_schema_t *schema, dp_rept_valid_t *dpvalid, int flags)
+{
+    uint32_t size = dpvalid->len;
+
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        size += DP_REPT_HEADER_LEN + strlen(schema->devid);
     }
+    return size;
+}
 
-    return op_ret;
+/**
+ * @brief Writes the JSON of a DP report to a buffer of the caller.
+ *
+ * The same text as dp_rept_json_output, without time stamps, but nothing is
+ * allocated. With DP_APPEND_HEADER_FLAG the dps are wrapped as
+ * {"dps":{..},"devId":"xx"}, like dp_rept_json_append.
+ *
+ * @param schema Pointer to the DP schema structure.
+ * @param dpin Pointer to the input data structure.
+ * @param dpvalid The validation information from dp_rept_valid_check.
+ * @param flags DP_APPEND_HEADER_FLAG or 0.
+ * @param buf The buffer.
+ * @param size The size of buf, at least dp_rept_json_size.
+ * @return The length of the text, or a negative error code.
+ */
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, int flags, char *buf,
+                       uint32_t size)
+{
+    uint32_t offset = 0;
+    int len = 0;
+
+    if (NULL == schema || NULL == dpin || NULL == dpvalid || NULL == buf) {
+        return OPRT_INVALID_PARM;
+    }
+    if (size < dp_rept_json_size(schema, dpvalid, flags)) {
+        return OPRT_BUFFER_NOT_ENOUGH;
+    }
+
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        memcpy(buf, "{\"dps\":", 7);
+        offset = 7;
+    }
+    len = dp_rept_json_dps_write(schema, dpin, dpvalid, buf + offset, NULL, NULL);
+    if (len < 0) {
+        return len;
+    }
+    offset += len;
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        offset += sprintf(buf + offset, ",\"devId\":\"%s\"}", schema->devid);
+    }
+
+    return offset;
+}
+
+/**
+ * @brief Sets up a report buffer.
+ *
+ * @param arena The buffer.
+ * @param max The largest size the buffer grows to.
+ * @return OPRT_OK on success, or an error code.
+ */
+int dp_rept_arena_init(dp_rept_arena_t *arena, uint32_t max)
+{
+    memset(arena, 0, sizeof(dp_rept_arena_t));
+    arena->max = max;
+    return tal_mutex_create_init(&arena->mutex);
+}
+
+/**
+ * @brief Takes the report buffer for one report.
+ *
+ * The buffer stays with the caller until dp_rept_arena_unlock, and grows to
+ * size if needed.
+ *
+ * @param arena The buffer.
+ * @param size The size the report needs.
+ * @return The buffer, or NULL if size is above the limit of the arena or the
+ * buffer can not grow. The arena is not taken then.
+ */
+char *dp_rept_arena_lock(dp_rept_arena_t *arena, uint32_t size)
+{
+    char *buf = NULL;
+
+    if (NULL == arena->mutex || size > arena->max) {
+        return NULL;
+    }
+
+    tal_mutex_lock(arena->mutex);
+    if (size > arena->size) {
+        buf = tal_realloc(arena->buf, size);
+        if (NULL == buf) {
+            tal_mutex_unlock(arena->mutex);
+            return NULL;
+        }
+        arena->buf = buf;
+        arena->size = size;
+    }
+    return arena->buf;
+}
+
+/**
+ * @brief Gives back the report buffer taken by dp_rept_arena_lock.
+ *
+ * @param arena The buffer.
+ */
+void dp_rept_arena_unlock(dp_rept_arena_t *arena)
+{
+    tal_mutex_unlock(arena->mutex);
+}
+
+/**
+ * @brief Frees the report buffer.
+ *
+ * @param arena The buffer.
+ */
+void dp_rept_arena_deinit(dp_rept_arena_t *arena)
+{
+    if (arena->mutex) {
+        tal_mutex_release(arena->mutex);
+    }
+    tal_free(arena->buf);
+    memset(arena, 0, sizeof(dp_rept_arena_t));
 }
 
 // int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin,
@@ -993,56 +1246,159 @@ __err_exit:
 //     return op_ret;
 // }
 
-static int dp_obj_json_create(cJSON *root, dp_node_t *dpnode)
+/**
+ * @brief Writes "<id>":<value>, of the current value of dpnode.
+ *
+ * @param dpnode The dp.
+ * @param out The output, NULL to get the length only.
+ * @param room The space left in out.
+ * @return The length, 0 if the dp has no value or does not fit in room.
+ */
+static uint32_t dp_node_json_write(dp_node_t *dpnode, char *out, uint32_t room)
 {
-    int length = 0;
-
-    char dpid[10] = {0};
-    snprintf(dpid, 10, "%d", dpnode->desc.id);
+    char num[12];
+    const char *str = NULL;
+    bool quoted = false;
+    uint32_t len = 0;
 
     switch (dpnode->desc.prop_tp) {
     case PROP_BOOL: {
-        length += 10;
-        cJSON_AddBoolToObject(root, dpid, dpnode->prop.prop_bool.value);
+        str = dpnode->prop.prop_bool.value ? "true" : "false";
+        len = strlen(str);
         break;
     }
 
     case PROP_VALUE: {
-        length += 10;
-        cJSON_AddNumberToObject(root, dpid, dpnode->prop.prop_int.value);
+        len = dp_json_int_output(num, dpnode->prop.prop_int.value);
+        str = num;
         break;
     }
 
-    case PROP_STR: {
-        tal_mutex_lock(dpnode->prop.prop_str.dp_str_mutex);
-        if (dpnode->prop.prop_str.value) {
-            length += (10 + strlen(dpnode->prop.prop_str.value));
-            cJSON_AddStringToObject(root, dpid, dpnode->prop.prop_str.value);
-        }
-        tal_mutex_unlock(dpnode->prop.prop_str.dp_str_mutex);
+    case PROP_BITMAP: {
+        len = dp_json_uint_output(num, dpnode->prop.prop_bitmap.value);
+        str = num;
         break;
     }
 
-    case PROP_ENUM: {
-        int value = dpnode->prop.prop_enum.value;
-        length += (10 + strlen(dpnode->prop.prop_enum.pp_enum[value]));
-        cJSON_AddStringToObject(root, dpid, dpnode->prop.prop_enum.pp_enum[value]);
+    case PROP_STR: {
+        tal_mutex_lock(dpnode->prop.prop_str.dp_str_mutex);
+        str = dpnode->prop.prop_str.value;
+        quoted = true;
         break;
     }
 
-    case PROP_BITMAP: {
-        length += 10;
-        cJSON_AddNumberToObject(root, dpid, dpnode->prop.prop_bitmap.value);
+    case PROP_ENUM: {
+        str = dpnode->prop.prop_enum.pp_enum[dpnode->prop.prop_enum.value];
+        quoted = true;
         break;
     }
 
     default: {
         PR_ERR("dp type err:%d", dpnode->desc.prop_tp);
-        break;
+        return 0;
+    }
+    }
+
+    if (quoted && str) {
+        len = dp_json_str_output(NULL, str);
+    }
+    if (str) {
+        len += dpnode->key_len + 1;
+    }
+    if (out && len) {
+        if (len > room) {
+            len = 0;
+        } else {
+            memcpy(out, dpnode->key, dpnode->key_len);
+            if (quoted) {
+                dp_json_str_output(out + dpnode->key_len, str);
+            } else {
+                memcpy(out + dpnode->key_len, str, len - dpnode->key_len - 1);
+            }
+            out[len - 1] = ',';
+        }
+    }
+
+    if (PROP_STR == dpnode->desc.prop_tp) {
+        tal_mutex_unlock(dpnode->prop.prop_str.dp_str_mutex);
+    }
+
+    return len;
+}
+
+/**
+ * @brief Writes the dps object of the dps of schema to a new string.
+ *
+ * @param schema The schema.
+ * @param stat_local Skip the object dps the cloud already has.
+ * @param flags DP_APPEND_HEADER_FLAG to wrap the dps with the devId.
+ * @param dpvalid If not NULL, receives the ids of the dumped dps, at most
+ * dpid_max of them are dumped.
+ * @param dpid_max The size of dpvalid->dpid.
+ * @return The string, NULL if there is nothing to dump or on no memory.
+ */
+static char *dp_obj_json_dump(dp_schema_t *schema, bool stat_local, int flags, dp_rept_valid_t *dpvalid,
+                              uint8_t dpid_max)
+{
+    uint32_t size = 0;
+    uint32_t offset = 0;
+    uint32_t tail = 1; // the terminating 0
+    uint8_t num = 0;
+    char *out = NULL;
+    int i;
+
+    for (i = 0; i < schema->num && num < dpid_max; i++) {
+        dp_node_t *dpnode = &(schema->node[i]);
+        if (stat_local && T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
+            continue;
+        }
+        size += dp_node_json_write(dpnode, NULL, 0);
+        num++;
+    }
+    if (0 == size) {
+        PR_DEBUG("Nothing To Pack");
+        return NULL;
+    }
+    size += 2; // {} and the terminating 0 in place of the last ','
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        size += DP_REPT_HEADER_LEN + strlen(schema->devid);
+        tail += DP_REPT_HEADER_LEN - 7 + strlen(schema->devid);
+    }
+
+    out = tal_malloc(size);
+    if (NULL == out) {
+        PR_ERR("malloc err:%d", size);
+        return NULL;
     }
+
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        memcpy(out, "{\"dps\":", 7);
+        offset = 7;
+    }
+    out[offset++] = '{';
+    num = 0;
+    for (i = 0; i < schema->num && num < dpid_max; i++) {
+        dp_node_t *dpnode = &(schema->node[i]);
+        if (stat_local && T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
+            continue;
+        }
+        // a string dp may have grown since the size was taken, it is left out then
+        offset += dp_node_json_write(dpnode, out + offset, size - offset - tail);
+        num++;
+        if (dpvalid) {
+            dpvalid->dpid[dpvalid->num++] = dpnode->desc.id;
+        }
+    }
+    if (',' == out[offset - 1]) {
+        offset--;
+    }
+    out[offset++] = '}';
+    out[offset] = 0;
+    if (flags & DP_APPEND_HEADER_FLAG) {
+        sprintf(out + offset, ",\"devId\":\"%s\"}", schema->devid);
     }
 
-    return length;
+    return out;
 }
 
 /**
@@ -1067,19 +1423,18 @@ static int dp_obj_json_create(cJSON *root, dp_node_t *dpnode)
 int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char **outjson, int flags)
 {
     int i;
-    size_t length = 0;
     dp_schema_t *schema = dp_schema_find(devid);
     uint8_t dp_stat_local_num = 0;
 
+    if (NULL == schema) {
+        PR_ERR("schema err");
+        return OPRT_INVALID_PARM;
+    }
+
     for (i = 0; i < schema->num; i++) {
         dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
-        }
         if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD != dpnode->pv_stat) {
             dp_stat_local_num++;
-            continue;
         }
     }
 
@@ -1087,53 +1442,17 @@ int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char
         return OPRT_OK;
     }
 
-    cJSON *cjson = cJSON_CreateObject();
-    if (NULL == cjson) {
-        PR_ERR("json err");
-        return OPRT_MALLOC_FAILED;
-    }
-
     dp_rept_valid_t *dpvaild = tal_malloc(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dp_stat_local_num);
     if (NULL == dpvaild) {
-        cJSON_Delete(cjson);
         return OPRT_MALLOC_FAILED;
     }
     memset(dpvaild, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dp_stat_local_num);
     dpvaild->schema = schema;
 
-    for (i = 0; i < schema->num; i++) {
-        dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
-        }
-        if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
-            continue;
-        }
-        if (dpvaild->num < dp_stat_local_num) {
-            dpvaild->dpid[dpvaild->num++] = dpnode->desc.id;
-            length += dp_obj_json_create(cjson, dpnode);
-        }
-    }
-
-    if (length == 0) {
-        PR_DEBUG("Nothing To Pack");
-        cJSON_Delete(cjson);
-        return OPRT_SVC_DP_ID_NOT_FOUND;
-    }
-    char *jsonstr = cJSON_PrintUnformatted(cjson);
-    cJSON_Delete(cjson);
+    char *jsonstr = dp_obj_json_dump(schema, true, flags, dpvaild, dp_stat_local_num);
     if (NULL == jsonstr) {
         tal_free(dpvaild);
-        PR_ERR("Json err");
-        return OPRT_CR_CJSON_ERR;
-    }
-
-    if (flags & DP_APPEND_HEADER_FLAG) {
-        char *out = NULL;
-        dp_rept_json_append(schema, jsonstr, NULL, NULL, 0, &out);
-        tal_free(jsonstr);
-        jsonstr = out;
+        return OPRT_SVC_DP_ID_NOT_FOUND;
     }
 
     if (outjson) {
@@ -1166,56 +1485,13 @@ int dp_obj_dump_stat_local_json(char *devid, dp_rept_valid_t **outdpvalid, char
  */
 char *dp_obj_dump_all_json(char *devid, int flags)
 {
-    cJSON *cjson = cJSON_CreateObject();
-    if (NULL == cjson) {
-        PR_ERR("json err");
-        return NULL;
-    }
-
-    size_t length = 0;
     dp_schema_t *schema = dp_schema_find(devid);
     if (NULL == schema) {
-        cJSON_Delete(cjson);
         PR_ERR("schema err");
         return NULL;
     }
 
-    int i;
-
-    for (i = 0; i < schema->num; i++) {
-        dp_node_t *dpnode = &(schema->node[i]);
-        if (dpnode == NULL) {
-            PR_DEBUG("dpnode NULL");
-            break;
-        }
-        if (DP_DUMP_STAT_LOCAL_FLAG & flags) {
-            if (T_OBJ == dpnode->desc.type && PV_STAT_CLOUD == dpnode->pv_stat) {
-                continue;
-            }
-        }
-        length += dp_obj_json_create(cjson, dpnode);
-    } /* end of for */
-
-    if (length == 0) {
-        PR_DEBUG("Nothing To Pack");
-        cJSON_Delete(cjson);
-        return NULL;
-    }
-
-    char *tmp = cJSON_PrintUnformatted(cjson);
-    cJSON_Delete(cjson);
-    if (NULL == tmp) {
-        PR_ERR("Json err");
-        return NULL;
-    }
-
-    char *out = tmp;
-
-    if (flags & DP_APPEND_HEADER_FLAG) {
-        dp_rept_json_append(schema, out, NULL, NULL, 0, &out);
-    }
-
-    return out;
+    return dp_obj_json_dump(schema, (DP_DUMP_STAT_LOCAL_FLAG & flags) ? true : false, flags, NULL, 0xFF);
 }
 
 typedef struct {
@@ -1525,6 +1801,7 @@ int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out
     OPERATE_RET op_ret = OPRT_OK;
     dp_node_pos_t *nodepos = NULL;
     int nodenum;
+    int i;
 
     nodepos = tal_malloc(sizeof(dp_node_pos_t) * 255);
     if (NULL == nodepos) {
@@ -1565,11 +1842,21 @@ int dp_schema_create(char *devid, char *schema_json, dp_schema_t **dp_schema_out
     dp_schema->actv.preprocess = other_attr.preprocess;
     dp_schema->actv.attach_dp_if = TRUE;
     strncpy(dp_schema->devid, devid, DEV_ID_LEN);
+    dp_schema->devid_hash = dp_devid_hash(dp_schema->devid);
+    for (i = 0; i < nodenum; i++) {
+        dp_node_t *dpnode = &dp_schema->node[i];
+        dpnode->key_len = sprintf(dpnode->key, "\"%u\":", dpnode->desc.id);
+        if (0 == dp_schema->index[dpnode->desc.id]) {
+            dp_schema->index[dpnode->desc.id] = i + 1;
+        }
+    }
     if (dp_schema_out) {
         *dp_schema_out = dp_schema;
     }
     if (s_dsmgr.schema_num < DP_SCHEMA_NUM_MAX) {
-        s_dsmgr.schema_list[s_dsmgr.schema_num] = dp_schema;
+        dp_schema_t **bucket = &s_dsmgr.bucket[dp_schema->devid_hash & (DP_SCHEMA_BUCKET_NUM - 1)];
+        dp_schema->next = *bucket;
+        *bucket = dp_schema;
         s_dsmgr.schema_num++;
     }
     PR_DEBUG("create dp_schema Success ");
@@ -1596,19 +1883,17 @@ __exit:
  */
 int dp_schema_delete(char *devid)
 {
-    int i = 0;
+    uint32_t hash = dp_devid_hash(devid);
+    dp_schema_t **prev = NULL;
+    dp_schema_t *schema = NULL;
 
     PR_TRACE("try to delete schema devid %s", devid);
     dp_schema_mgr_t *dsmgr = &s_dsmgr;
-    for (i = 0; i < DP_SCHEMA_NUM_MAX; i++) {
-        if (NULL == dsmgr->schema_list[i]) {
-            continue;
-        }
-
-        if (0 == strcmp(devid, dsmgr->schema_list[i]->devid)) {
-            tal_mutex_release(dsmgr->schema_list[i]->mutex);
-            tal_free(dsmgr->schema_list[i]);
-            dsmgr->schema_list[i] = NULL;
+    for (prev = &dsmgr->bucket[hash & (DP_SCHEMA_BUCKET_NUM - 1)]; (schema = *prev) != NULL; prev = &schema->next) {
+        if (schema->devid_hash == hash && 0 == strcmp(devid, schema->devid)) {
+            *prev = schema->next;
+            tal_mutex_release(schema->mutex);
+            tal_free(schema);
             dsmgr->schema_num--;
             return OPRT_OK;
         }
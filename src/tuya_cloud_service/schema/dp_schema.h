@@ -296,6 +296,10 @@ typedef union {
 typedef struct {
     /** see dp_desc_t */
     dp_desc_t desc;
+    /** json key of the dp in reports, "<id>": */
+    char key[7];
+    /** length of key */
+    uint8_t key_len;
     /** see dp_prop_vaule_t */
     dp_prop_vaule_t prop;
     /** cache status, see dp_pv_stat_t */
@@ -322,7 +326,11 @@ typedef struct {
 
 // typedef struct dev_cntl_n_s {
 
-typedef struct {
+typedef struct dp_schema {
+    /** next schema in the same devid hash bucket */
+    struct dp_schema *next;
+    /** hash of devid */
+    uint32_t devid_hash;
     /** virtual id */
     char devid[DEV_ID_LEN + 1];
     /** device attribute, see DEV_ACTV_ATTR_S */
@@ -331,6 +339,8 @@ typedef struct {
     MUTEX_HANDLE mutex;
     /** count of dp */
     uint8_t num;
+    /** position + 1 in node of each dp id, 0 if the id is not in the schema */
+    uint8_t index[256];
     /** dp info */
     dp_node_t node[0];
 } dp_schema_t;
@@ -349,6 +359,9 @@ typedef struct {
 #define DP_DUMP_STAT_LOCAL_FLAG (1 << 1)
 #define DP_APPEND_HEADER_FLAG   (1 << 2)
 
+// length of the header DP_APPEND_HEADER_FLAG adds, {"dps": ,"devId":"<devid>"}
+#define DP_REPT_HEADER_LEN 19
+
 typedef struct {
     char *devid;
     dp_cmd_type_t cmd;
@@ -378,6 +391,17 @@ typedef struct {
     uint8_t dpid[0];
 } dp_rept_valid_t;
 
+/**
+ * @brief Buffer reused across DP reports
+ */
+typedef struct {
+    MUTEX_HANDLE mutex;
+    char *buf;
+    uint32_t size;
+    /** the buffer does not grow beyond this */
+    uint32_t max;
+} dp_rept_arena_t;
+
 typedef void (*dp_recv_cb_t)(dp_type_t type, void *dp_data, void *user_data);
 
 /**
@@ -485,6 +509,70 @@ int dp_rept_valid_check(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t
  */
 int dp_rept_json_output(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, dp_rept_out_t *dpout);
 
+/**
+ * @brief Returns the buffer size dp_rept_json_write needs.
+ *
+ * @param schema The DP schema structure.
+ * @param dpvalid The validation information from dp_rept_valid_check.
+ * @param flags DP_APPEND_HEADER_FLAG to wrap the dps with the devId.
+ * @return The size in bytes, including the terminating 0.
+ */
+uint32_t dp_rept_json_size(dp_schema_t *schema, dp_rept_valid_t *dpvalid, int flags);
+
+/**
+ * @brief Writes the JSON of a DP report to a buffer of the caller.
+ *
+ * The same text as dp_rept_json_output, without time stamps, but nothing is
+ * allocated. With DP_APPEND_HEADER_FLAG the dps are wrapped as
+ * {"dps":{..},"devId":"xx"}, like dp_rept_json_append.
+ *
+ * @param schema The DP schema structure.
+ * @param dpin The input data for the DP report.
+ * @param dpvalid The validation information from dp_rept_valid_check.
+ * @param flags DP_APPEND_HEADER_FLAG or 0.
+ * @param buf The buffer.
+ * @param size The size of buf, at least dp_rept_json_size.
+ * @return The length of the text, or a negative error code.
+ */
+int dp_rept_json_write(dp_schema_t *schema, dp_rept_in_t *dpin, dp_rept_valid_t *dpvalid, int flags, char *buf,
+                       uint32_t size);
+
+/**
+ * @brief Sets up a report buffer.
+ *
+ * @param arena The buffer.
+ * @param max The largest size the buffer grows to.
+ * @return OPRT_OK on success, or an error code.
+ */
+int dp_rept_arena_init(dp_rept_arena_t *arena, uint32_t max);
+
+/**
+ * @brief Takes the report buffer for one report.
+ *
+ * The buffer stays with the caller until dp_rept_arena_unlock, and grows to
+ * size if needed.
+ *
+ * @param arena The buffer.
+ * @param size The size the report needs.
+ * @return The buffer, or NULL if size is above the limit of the arena or the
+ * buffer can not grow. The arena is not taken then.
+ */
+char *dp_rept_arena_lock(dp_rept_arena_t *arena, uint32_t size);
+
+/**
+ * @brief Gives back the report buffer taken by dp_rept_arena_lock.
+ *
+ * @param arena The buffer.
+ */
+void dp_rept_arena_unlock(dp_rept_arena_t *arena);
+
+/**
+ * @brief Frees the report buffer.
+ *
+ * @param arena The buffer.
+ */
+void dp_rept_arena_deinit(dp_rept_arena_t *arena);
+
 /**
  * Appends a JSON string to the given data point schema.
  *
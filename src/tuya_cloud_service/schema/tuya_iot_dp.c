@@ -78,7 +78,11 @@ void tuya_iot_dp_sync_process(void *data)
         return;
     }
 
-    tuya_iot_dp_report_json_async(client, dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+    ret = tuya_iot_dp_report_json_async(client, dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+    if (OPRT_OK != ret) {
+        /* the report was not taken, cb is not called */
+        dp_sync_cb(ret, dpvalid);
+    }
     tal_free(dpsjson);
 }
 
@@ -234,7 +238,7 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     if (NULL == dpvalid) {
         return OPRT_MALLOC_FAILED;
     }
-    memset(dpvalid, 0, sizeof(sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt));
+    memset(dpvalid, 0, sizeof(dp_rept_valid_t) + sizeof(uint8_t) * dpscnt);
 
     PR_DEBUG("dp report: devid %s, dps 0x%08x, dpscnt %d, flags %d", devid ? devid : "null", dps, dpscnt, flags);
 
@@ -285,36 +289,53 @@ int tuya_iot_dp_obj_report(tuya_iot_client_t *client, const char *devid, dp_obj_
     }
 #endif
 
-    dp_rept_out_t dpout;
-
-    memset(&dpout, 0, sizeof(dpout));
+    /* the report is written to the reused buffer of the client, the LAN
+     * report with its header. Both channels are done with it on return. */
+    bool lan = tuya_lan_is_connected();
+    int json_flags = lan ? DP_APPEND_HEADER_FLAG : 0;
+    uint32_t size = dp_rept_json_size(schema, dpvalid, json_flags);
+    char *json = dp_rept_arena_lock(&client->dp_arena, size);
+    bool in_arena = (NULL != json);
+
+    if (!in_arena) {
+        json = tal_malloc(size);
+        if (NULL == json) {
+            tal_free(dpvalid);
+            return OPRT_MALLOC_FAILED;
+        }
+    }
 
-    ret = dp_rept_json_output(schema, &dpin, dpvalid, &dpout);
-    if (OPRT_OK != ret) {
+    ret = dp_rept_json_write(schema, &dpin, dpvalid, json_flags, json, size);
+    if (ret < 0) {
         PR_DEBUG("dp rept json output error %d", ret);
-        return ret;
+        tal_free(dpvalid);
+        goto __exit;
     }
+    PR_DEBUG("dp rept out: %s", json);
 
-    if (tuya_lan_is_connected()) {
-        char *out = NULL;
+    if (lan) {
         PR_DEBUG("lan channel report");
-        dp_rept_json_append(schema, dpout.dpsjson, NULL, NULL, 0, &out);
-        ret = tuya_lan_dp_report(out);
-        tal_free(out);
+        ret = tuya_lan_dp_report(json);
         tal_free(dpvalid);
         tuya_iot_dp_sync_start(client, 5);
     } else if (tuya_iot_is_connected()) {
         PR_DEBUG("mqtt channel report");
-        ret = tuya_iot_dp_report_json_with_notify(client, dpout.dpsjson, NULL, dp_sync_cb, dpvalid, 5000);
+        ret = tuya_iot_dp_report_json_with_notify(client, json, NULL, dp_sync_cb, dpvalid, 5000);
+        if (OPRT_OK != ret) {
+            /* not sent and not batched, e.g. behind a kept batch, cb is not called */
+            dp_sync_cb(ret, dpvalid);
+        }
     } else {
         PR_ERR("no channel for connect");
+        tal_free(dpvalid);
+        ret = OPRT_COM_ERROR;
     }
 
-    if (dpout.dpsjson) {
-        tal_free(dpout.dpsjson);
-    }
-    if (dpout.timejson) {
-        tal_free(dpout.timejson);
+__exit:
+    if (in_arena) {
+        dp_rept_arena_unlock(&client->dp_arena);
+    } else {
+        tal_free(json);
     }
 
     return ret;
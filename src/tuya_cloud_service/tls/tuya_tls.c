@@ -59,6 +59,23 @@ typedef struct {
 static tuya_tls_pre_conn_cb s_pre_conn_cb = NULL;
 static mbedtls_entropy_context ty_entropy;
 static mbedtls_ctr_drbg_context ty_ctr_drbg;
+static tuya_tls_stats_t s_tls_stats;
+
+#if defined(MBEDTLS_SSL_CLI_C) && (TUYA_TLS_SESSION_CACHE_NUM > 0)
+#define TUYA_TLS_SESSION_CACHE_ENABLE
+typedef struct {
+    char hostname[TLS_URL_LEN];
+    int port;
+    uint32_t ca_hash; // see __tuya_tls_session_ca_hash
+    uint32_t ca_size;
+    uint32_t stamp;   // 0 if the entry is empty
+    mbedtls_ssl_session session;
+} tuya_tls_session_t;
+
+static MUTEX_HANDLE s_session_mutex = NULL;
+static uint32_t s_session_stamp = 0;
+static tuya_tls_session_t s_session_cache[TUYA_TLS_SESSION_CACHE_NUM];
+#endif
 
 /* -------------------------------------------------------------------------- */
 /*                                  TLS Mutex                                 */
@@ -157,6 +174,137 @@ static void __tuya_tls_export_keys(void *p_expkey, mbedtls_ssl_key_export_type t
 }
 #endif
 
+/* -------------------------------------------------------------------------- */
+/*                              TLS Session cache                             */
+/* -------------------------------------------------------------------------- */
+/*
+ * The session of the last handshake with each host is kept, the next connect to
+ * the host offers it, so a server that still knows the session id or accepts
+ * the ticket skips the certificate exchange and the key agreement. A session is
+ * only offered to a connect with the same mode, verify flag and CA certificate
+ * as the one that verified the server, a resumed handshake verifies nothing.
+ */
+#ifdef TUYA_TLS_SESSION_CACHE_ENABLE
+// FNV-1a of the settings a session was verified with
+static uint32_t __tuya_tls_session_ca_hash(const tuya_tls_config_t *config)
+{
+    uint32_t hash = 2166136261u;
+    uint32_t i;
+
+    hash = (hash ^ (uint8_t)config->mode) * 16777619u;
+    hash = (hash ^ (uint8_t)config->verify) * 16777619u;
+    for (i = 0; config->ca_cert && i < (uint32_t)config->ca_cert_size; i++) {
+        hash = (hash ^ (uint8_t)config->ca_cert[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static tuya_tls_session_t *__tuya_tls_session_find(const char *hostname, int port, uint32_t ca_hash,
+                                                   uint32_t ca_size)
+{
+    int i;
+    for (i = 0; i < TUYA_TLS_SESSION_CACHE_NUM; i++) {
+        if (s_session_cache[i].stamp && s_session_cache[i].port == port && s_session_cache[i].ca_hash == ca_hash &&
+            s_session_cache[i].ca_size == ca_size && 0 == strcmp(s_session_cache[i].hostname, hostname)) {
+            return &s_session_cache[i];
+        }
+    }
+    return NULL;
+}
+
+static void __tuya_tls_session_clear(tuya_tls_session_t *entry)
+{
+    mbedtls_ssl_session_free(&entry->session);
+    entry->stamp = 0;
+}
+
+// offer the cached session of hostname:port, returns true if one is offered
+static bool __tuya_tls_session_load(mbedtls_ssl_context *ssl, const char *hostname, int port, uint32_t ca_hash,
+                                    uint32_t ca_size)
+{
+    bool loaded = false;
+
+    if (NULL == hostname || NULL == s_session_mutex) {
+        return false;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    tuya_tls_session_t *entry = __tuya_tls_session_find(hostname, port, ca_hash, ca_size);
+    if (entry && 0 == mbedtls_ssl_set_session(ssl, &entry->session)) {
+        entry->stamp = ++s_session_stamp;
+        loaded = true;
+    }
+    tal_mutex_unlock(s_session_mutex);
+
+    return loaded;
+}
+
+static void __tuya_tls_session_save(const mbedtls_ssl_context *ssl, const char *hostname, int port,
+                                    uint32_t ca_hash, uint32_t ca_size)
+{
+    int i;
+
+    if (NULL == hostname || NULL == s_session_mutex || strlen(hostname) >= TLS_URL_LEN) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    tuya_tls_session_t *entry = __tuya_tls_session_find(hostname, port, ca_hash, ca_size);
+    if (NULL == entry) {
+        // empty or least recently used
+        entry = &s_session_cache[0];
+        for (i = 1; i < TUYA_TLS_SESSION_CACHE_NUM && entry->stamp; i++) {
+            if (s_session_cache[i].stamp < entry->stamp) {
+                entry = &s_session_cache[i];
+            }
+        }
+    }
+    if (entry->stamp) {
+        __tuya_tls_session_clear(entry);
+    }
+
+    mbedtls_ssl_session_init(&entry->session);
+    if (0 == mbedtls_ssl_get_session(ssl, &entry->session)) {
+        strcpy(entry->hostname, hostname);
+        entry->port = port;
+        entry->ca_hash = ca_hash;
+        entry->ca_size = ca_size;
+        entry->stamp = ++s_session_stamp;
+    } else {
+        mbedtls_ssl_session_free(&entry->session);
+    }
+    tal_mutex_unlock(s_session_mutex);
+}
+
+static void __tuya_tls_session_drop(const char *hostname, int port, uint32_t ca_hash, uint32_t ca_size)
+{
+    if (NULL == hostname || NULL == s_session_mutex) {
+        return;
+    }
+
+    tal_mutex_lock(s_session_mutex);
+    tuya_tls_session_t *entry = __tuya_tls_session_find(hostname, port, ca_hash, ca_size);
+    if (entry) {
+        __tuya_tls_session_clear(entry);
+    }
+    tal_mutex_unlock(s_session_mutex);
+}
+#endif
+
+/**
+ * @brief Gets the handshake counters.
+ *
+ * @param[out] stats The counters since boot.
+ */
+void tuya_tls_stats_get(tuya_tls_stats_t *stats)
+{
+    if (stats) {
+        TAL_ENTER_CRITICAL();
+        *stats = s_tls_stats;
+        TAL_EXIT_CRITICAL();
+    }
+}
+
 /* -------------------------------------------------------------------------- */
 /*                                 TLS Randowm                                */
 /* -------------------------------------------------------------------------- */
@@ -425,6 +573,13 @@ OPERATE_RET tuya_tls_init(void)
     }
     mbedtls_ctr_drbg_set_prediction_resistance(&ty_ctr_drbg, MBEDTLS_CTR_DRBG_PR_OFF);
 
+#ifdef TUYA_TLS_SESSION_CACHE_ENABLE
+    if (NULL == s_session_mutex && OPRT_OK != tal_mutex_create_init(&s_session_mutex)) {
+        // connect without resumption
+        s_session_mutex = NULL;
+    }
+#endif
+
     PR_NOTICE("tuya_tls_init ok!");
 
     return OPRT_OK;
@@ -595,6 +750,9 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
 #else
     mbedtls_ssl_conf_max_frag_len(p_conf_ctx, MBEDTLS_SSL_MAX_FRAG_LEN_1024);
 #endif
+#endif
+#if defined(MBEDTLS_SSL_SESSION_TICKETS)
+    mbedtls_ssl_conf_session_tickets(p_conf_ctx, MBEDTLS_SSL_SESSION_TICKETS_ENABLED);
 #endif
     if (s_pre_conn_cb) {
         PR_DEBUG("s_pre_conn_cb  %08x", s_pre_conn_cb);
@@ -639,7 +797,21 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
     mbedtls_ssl_set_bio(p_ssl_ctx, tls_context, __tuya_tls_socket_send_cb, __tuya_tls_socket_recv_cb, NULL);
     PR_DEBUG("socket fd is set. set to inner send/recv to handshake");
 
+    bool resume = false;
+    unsigned char resume_master[48];
+#ifdef TUYA_TLS_SESSION_CACHE_ENABLE
+    uint32_t ca_hash = __tuya_tls_session_ca_hash(&tls_context->config);
+    uint32_t ca_size = tls_context->config.ca_cert ? tls_context->config.ca_cert_size : 0;
+    resume = __tuya_tls_session_load(p_ssl_ctx, hostname, port_num, ca_hash, ca_size);
+    if (resume) {
+        // a resumed handshake keeps the master secret, with session id or ticket alike
+        memcpy(resume_master, p_ssl_ctx->MBEDTLS_PRIVATE(session_negotiate)->MBEDTLS_PRIVATE(master),
+               sizeof(resume_master));
+    }
+#endif
+
     TIME_T cur_time = tal_time_get_posix();
+    SYS_TIME_T handshake_start = tal_system_get_millisecond();
 
     while ((op_ret = mbedtls_ssl_handshake(p_ssl_ctx)) != 0) {
         if (op_ret == MBEDTLS_ERR_X509_CERT_VERIFY_FAILED) {
@@ -675,9 +847,39 @@ OPERATE_RET tuya_tls_connect(tuya_tls_hander p_tls_handler, char *hostname, int
     }
 
     if (op_ret != OPRT_OK) {
+#ifdef TUYA_TLS_SESSION_CACHE_ENABLE
+        if (resume) {
+            __tuya_tls_session_drop(hostname, port_num, ca_hash, ca_size);
+        }
+#endif
+        mbedtls_platform_zeroize(resume_master, sizeof(resume_master));
         goto tuya_tls_connect_EXIT;
     }
 
+    uint32_t handshake_ms = (uint32_t)(tal_system_get_millisecond() - handshake_start);
+    bool resumed = resume && 0 == memcmp(resume_master, p_ssl_ctx->MBEDTLS_PRIVATE(session)->MBEDTLS_PRIVATE(master),
+                                         sizeof(resume_master));
+    // connects run on several threads at once
+    TAL_ENTER_CRITICAL();
+    s_tls_stats.handshake_cnt++;
+    s_tls_stats.handshake_ms_total += handshake_ms;
+    if (handshake_ms > s_tls_stats.handshake_ms_max) {
+        s_tls_stats.handshake_ms_max = handshake_ms;
+    }
+    if (resumed) {
+        s_tls_stats.resumed_cnt++;
+    }
+    TAL_EXIT_CRITICAL();
+    if (resumed) {
+        PR_DEBUG("tls session resumed, %u ms", handshake_ms);
+    } else {
+#ifdef TUYA_TLS_SESSION_CACHE_ENABLE
+        __tuya_tls_session_save(p_ssl_ctx, hostname, port_num, ca_hash, ca_size);
+#endif
+    }
+
+    mbedtls_platform_zeroize(resume_master, sizeof(resume_master));
+
     PR_DEBUG("handshake finish for %s. set send/recv to user set", (hostname ? hostname : ""));
     if (tls_context->config.f_send && tls_context->config.f_recv) {
         mbedtls_ssl_set_bio(p_ssl_ctx, tls_context->config.user_data, tls_context->config.f_send,
@@ -28,6 +28,11 @@
 extern "C" {
 #endif
 
+/* sessions kept for resumption, one per host:port, 0 to disable */
+#ifndef TUYA_TLS_SESSION_CACHE_NUM
+#define TUYA_TLS_SESSION_CACHE_NUM (2)
+#endif
+
 typedef void *tuya_tls_hander;
 
 typedef enum {
@@ -62,6 +67,13 @@ typedef enum {
  */
 typedef void (*tuya_tls_event_cb)(tuya_tls_event_t event, void *p_args);
 
+typedef struct {
+    uint32_t handshake_cnt;      // successful handshakes, resumed ones included
+    uint32_t resumed_cnt;        // handshakes that resumed a cached session
+    uint32_t handshake_ms_total; // time spent in successful handshakes
+    uint32_t handshake_ms_max;
+} tuya_tls_stats_t;
+
 typedef struct {
     tuya_tls_mode_t mode;
     char *hostname;
@@ -231,6 +243,8 @@ const tuya_tls_config_t *tuya_tls_psk_mode_config_get(void);
  */
 tuya_tls_event_cb tuya_cert_get_tls_event_cb(void);
 
+void tuya_tls_stats_get(tuya_tls_stats_t *stats);
+
 #ifdef __cplusplus
 }
 
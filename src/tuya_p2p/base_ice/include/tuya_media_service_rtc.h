@@ -165,6 +165,12 @@ typedef struct {
     tuya_p2p_rtc_frame_type_e frame_type;
 } tuya_p2p_rtc_frame_t;
 
+// One piece of the data sent by tuya_p2p_rtc_send_datav
+typedef struct {
+    const void *base;
+    uint32_t len;
+} tuya_p2p_rtc_iov_t;
+
 typedef enum rtc_state {
     RTC_STATE_GET_TOKEN,
     RTC_STATE_P2P_CONNECT,
@@ -401,6 +407,12 @@ int32_t tuya_p2p_rtc_recv_frame(int32_t handle, tuya_p2p_rtc_frame_t *frame);
 // TUYA_P2P_ERROR_TIME_OUT: send timeout
 // others: send failed, and connection has been disconnected
 int32_t tuya_p2p_rtc_send_data(int32_t handle, uint32_t channel_id, char *buf, int32_t len, int32_t timeout_ms);
+// Send data gathered from several pieces, as if they were one buffer
+// iov: pieces of the content to be sent, in order
+// iovcnt: number of pieces
+// the other parameters and the return value are the same as tuya_p2p_rtc_send_data
+int32_t tuya_p2p_rtc_send_datav(int32_t handle, uint32_t channel_id, const tuya_p2p_rtc_iov_t *iov, int32_t iovcnt,
+                                int32_t timeout_ms);
 // Receive data
 // handle: connection handle
 // channel_id: channel number
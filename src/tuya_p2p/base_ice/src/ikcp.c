@@ -170,18 +170,75 @@ void ikcp_allocator(void *(*new_malloc)(size_t), void (*new_free)(void *))
     ikcp_free_hook = new_free;
 }
 
-// allocate a new kcp segment
+// allocate a new kcp segment, segments up to the pool size are taken
+// from the pool and always get the full pool size, so any of them can
+// go back to the pool
 static IKCPSEG *ikcp_segment_new(ikcpcb *kcp, int size)
 {
-    return (IKCPSEG *)ikcp_malloc(sizeof(IKCPSEG) + size);
+    IKCPSEG *seg;
+    if (kcp->seg_pool_max > 0 && size <= (int)kcp->seg_pool_size) {
+        if (!iqueue_is_empty(&kcp->seg_pool)) {
+            seg = iqueue_entry(kcp->seg_pool.next, IKCPSEG, node);
+            iqueue_del(&seg->node);
+            kcp->nseg_pool--;
+            return seg;
+        }
+        size = (int)kcp->seg_pool_size;
+    }
+    seg = (IKCPSEG *)ikcp_malloc(sizeof(IKCPSEG) + size);
+    if (seg) {
+        seg->cap = size;
+    }
+    return seg;
 }
 
 // delete a segment
 static void ikcp_segment_delete(ikcpcb *kcp, IKCPSEG *seg)
 {
+    if (seg->cap == kcp->seg_pool_size && kcp->nseg_pool < kcp->seg_pool_max) {
+        iqueue_add(&seg->node, &kcp->seg_pool);
+        kcp->nseg_pool++;
+        return;
+    }
     ikcp_free(seg);
 }
 
+// release pooled segments until 'count' are left
+static void ikcp_segpool_trim(ikcpcb *kcp, IUINT32 count)
+{
+    while (kcp->nseg_pool > count) {
+        IKCPSEG *seg = iqueue_entry(kcp->seg_pool.next, IKCPSEG, node);
+        iqueue_del(&seg->node);
+        ikcp_free(seg);
+        kcp->nseg_pool--;
+    }
+}
+
+// allocate 'count' batch datagrams for 'mtu'
+static int ikcp_batch_alloc(ikcpcb *kcp, int count, int mtu)
+{
+    int stride = mtu + IKCP_OVERHEAD + IKCP_BATCH_TAIL;
+    ikcppkt *batch;
+    char *data;
+    int i;
+
+    batch = (ikcppkt *)ikcp_malloc(count * (sizeof(ikcppkt) + stride));
+    if (batch == NULL)
+        return -2;
+    data = (char *)(batch + count);
+    for (i = 0; i < count; i++) {
+        batch[i].buf = data + i * stride;
+        batch[i].len = 0;
+    }
+    if (kcp->batch) {
+        ikcp_free(kcp->batch);
+    }
+    kcp->batch = batch;
+    kcp->batch_max = count;
+    kcp->nbatch = 0;
+    return 0;
+}
+
 // write log
 void ikcp_log(ikcpcb *kcp, int mask, const char *fmt, ...)
 {
@@ -216,6 +273,36 @@ static int ikcp_output(ikcpcb *kcp, const void *data, int size)
     return kcp->output((const char *)data, size, kcp, kcp->user);
 }
 
+// output the collected batch
+static void ikcp_output_batch(ikcpcb *kcp)
+{
+    if (kcp->nbatch == 0)
+        return;
+    if (ikcp_canlog(kcp, IKCP_LOG_OUTPUT)) {
+        ikcp_log(kcp, IKCP_LOG_OUTPUT, "[RO] %d datagrams", kcp->nbatch);
+    }
+    kcp->output_batch(kcp->batch, kcp->nbatch, kcp, kcp->user);
+    kcp->nbatch = 0;
+}
+
+// the datagram in 'buffer' is complete, returns where to build the next
+// one: the same buffer for the plain output, the next batch datagram
+// otherwise, a full batch is output on the way
+static char *ikcp_output_next(ikcpcb *kcp, char *buffer, int size)
+{
+    if (kcp->output_batch == NULL) {
+        ikcp_output(kcp, buffer, size);
+        return buffer;
+    }
+    if (size > 0) {
+        kcp->batch[kcp->nbatch++].len = size;
+    }
+    if (kcp->nbatch >= kcp->batch_max) {
+        ikcp_output_batch(kcp);
+    }
+    return kcp->batch[kcp->nbatch].buf;
+}
+
 // output queue
 void ikcp_qprint(const char *name, const struct IQUEUEHEAD *head)
 {
@@ -294,6 +381,15 @@ ikcpcb *ikcp_create(IUINT32 conv, void *user)
     kcp->dead_link = IKCP_DEADLINK;
     kcp->output = NULL;
     kcp->writelog = NULL;
+    kcp->process_pkt = NULL;
+    iqueue_init(&kcp->seg_pool);
+    kcp->nseg_pool = 0;
+    kcp->seg_pool_max = 0;
+    kcp->seg_pool_size = kcp->mss;
+    kcp->batch = NULL;
+    kcp->nbatch = 0;
+    kcp->batch_max = 0;
+    kcp->output_batch = NULL;
 
     return kcp;
 }
@@ -332,6 +428,10 @@ void ikcp_release(ikcpcb *kcp)
         if (kcp->acklist) {
             ikcp_free(kcp->acklist);
         }
+        ikcp_segpool_trim(kcp, 0);
+        if (kcp->batch) {
+            ikcp_free(kcp->batch);
+        }
 
         kcp->nrcv_buf = 0;
         kcp->nsnd_buf = 0;
@@ -340,6 +440,7 @@ void ikcp_release(ikcpcb *kcp)
         kcp->ackcount = 0;
         kcp->buffer = NULL;
         kcp->acklist = NULL;
+        kcp->batch = NULL;
         ikcp_free(kcp);
     }
 }
@@ -693,7 +794,10 @@ static void ikcp_ack_push(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
         IUINT32 *acklist;
         size_t newblock;
 
-        for (newblock = 8; newblock < newsize; newblock <<= 1)
+        // a high bitrate stream can fill the whole receive window between
+        // two flushes, size the list for that at once instead of growing
+        // it from 8 with a copy per doubling
+        for (newblock = 8; newblock < newsize || newblock < kcp->rcv_wnd; newblock <<= 1)
             ;
         acklist = (IUINT32 *)ikcp_malloc(newblock * sizeof(IUINT32) * 2);
 
@@ -703,11 +807,7 @@ static void ikcp_ack_push(ikcpcb *kcp, IUINT32 sn, IUINT32 ts)
         }
 
         if (kcp->acklist != NULL) {
-            size_t x;
-            for (x = 0; x < kcp->ackcount; x++) {
-                acklist[x * 2 + 0] = kcp->acklist[x * 2 + 0];
-                acklist[x * 2 + 1] = kcp->acklist[x * 2 + 1];
-            }
+            memcpy(acklist, kcp->acklist, kcp->ackcount * sizeof(IUINT32) * 2);
             ikcp_free(kcp->acklist);
         }
 
@@ -987,7 +1087,7 @@ static int ikcp_wnd_unused(const ikcpcb *kcp)
 void ikcp_flush(ikcpcb *kcp)
 {
     IUINT32 current = kcp->current;
-    char *buffer = kcp->buffer;
+    char *buffer = (kcp->output_batch != NULL) ? kcp->batch[kcp->nbatch].buf : kcp->buffer;
     char *ptr = buffer;
     int count, size, i;
     IUINT32 resent, cwnd;
@@ -1016,7 +1116,7 @@ void ikcp_flush(ikcpcb *kcp)
     for (i = 0; i < count; i++) {
         size = (int)(ptr - buffer);
         if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-            ikcp_output(kcp, buffer, size);
+            buffer = ikcp_output_next(kcp, buffer, size);
             ptr = buffer;
         }
         ikcp_ack_get(kcp, i, &seg.sn, &seg.ts);
@@ -1051,7 +1151,7 @@ void ikcp_flush(ikcpcb *kcp)
         seg.cmd = IKCP_CMD_WASK;
         size = (int)(ptr - buffer);
         if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-            ikcp_output(kcp, buffer, size);
+            buffer = ikcp_output_next(kcp, buffer, size);
             ptr = buffer;
         }
         ptr = ikcp_encode_seg(ptr, &seg);
@@ -1062,7 +1162,7 @@ void ikcp_flush(ikcpcb *kcp)
         seg.cmd = IKCP_CMD_WINS;
         size = (int)(ptr - buffer);
         if (size + (int)IKCP_OVERHEAD > (int)kcp->mtu) {
-            ikcp_output(kcp, buffer, size);
+            buffer = ikcp_output_next(kcp, buffer, size);
             ptr = buffer;
         }
         ptr = ikcp_encode_seg(ptr, &seg);
@@ -1146,7 +1246,7 @@ void ikcp_flush(ikcpcb *kcp)
             need = IKCP_OVERHEAD + segment->len;
 
             if (size + need > (int)kcp->mtu) {
-                ikcp_output(kcp, buffer, size);
+                buffer = ikcp_output_next(kcp, buffer, size);
                 ptr = buffer;
             }
 
@@ -1166,7 +1266,10 @@ void ikcp_flush(ikcpcb *kcp)
     // flash remain segments
     size = (int)(ptr - buffer);
     if (size > 0) {
-        ikcp_output(kcp, buffer, size);
+        buffer = ikcp_output_next(kcp, buffer, size);
+    }
+    if (kcp->output_batch != NULL) {
+        ikcp_output_batch(kcp);
     }
 
     // update ssthresh
@@ -1281,10 +1384,17 @@ int ikcp_setmtu(ikcpcb *kcp, int mtu)
     buffer = (char *)ikcp_malloc((mtu + IKCP_OVERHEAD) * 3);
     if (buffer == NULL)
         return -2;
+    if (kcp->output_batch != NULL && ikcp_batch_alloc(kcp, kcp->batch_max, mtu) != 0) {
+        ikcp_free(buffer);
+        return -2;
+    }
     kcp->mtu = mtu;
     kcp->mss = kcp->mtu - IKCP_OVERHEAD;
     ikcp_free(kcp->buffer);
     kcp->buffer = buffer;
+    // pooled segments of the old size are freed, in flight ones when deleted
+    ikcp_segpool_trim(kcp, 0);
+    kcp->seg_pool_size = kcp->mss;
     return 0;
 }
 
@@ -1383,3 +1493,31 @@ void ikcp_setprocesspkt(ikcpcb *kcp, int (*process_pkt)(void *user, int length,
     kcp->process_pkt = process_pkt;
     return;
 }
+
+int ikcp_setsegpool(ikcpcb *kcp, int count)
+{
+    if (count < 0)
+        return -1;
+    kcp->seg_pool_max = count;
+    ikcp_segpool_trim(kcp, kcp->seg_pool_max);
+    return 0;
+}
+
+int ikcp_setoutputbatch(ikcpcb *kcp, int (*output_batch)(ikcppkt *pkts, int count, ikcpcb *kcp, void *user),
+                        int count)
+{
+    if (output_batch == NULL || count <= 0) {
+        if (kcp->batch) {
+            ikcp_free(kcp->batch);
+        }
+        kcp->batch = NULL;
+        kcp->nbatch = 0;
+        kcp->batch_max = 0;
+        kcp->output_batch = NULL;
+        return 0;
+    }
+    if (ikcp_batch_alloc(kcp, count, kcp->mtu) != 0)
+        return -2;
+    kcp->output_batch = output_batch;
+    return 0;
+}
@@ -269,9 +269,21 @@ struct IKCPSEG {
     IUINT32 fastack;
     IUINT32 xmit;
     IUINT32 prepend;
+    IUINT32 cap; // bytes allocated for data
     char data[1];
 };
 
+//---------------------------------------------------------------------
+// PKT: one datagram of a batch output, IKCP_BATCH_TAIL bytes after
+// buf + len may be written by the output (eg. a digest)
+//---------------------------------------------------------------------
+#define IKCP_BATCH_TAIL 64
+
+typedef struct IKCPPKT {
+    char *buf;
+    int len;
+} ikcppkt;
+
 //---------------------------------------------------------------------
 // IKCPCB
 //---------------------------------------------------------------------
@@ -303,6 +315,11 @@ struct IKCPCB {
     int (*output)(const char *buf, int len, struct IKCPCB *kcp, void *user);
     void (*writelog)(const char *log, struct IKCPCB *kcp, void *user);
     int (*process_pkt)(void *user, int length, const char *input, char *output);
+    struct IQUEUEHEAD seg_pool;
+    IUINT32 nseg_pool, seg_pool_max, seg_pool_size;
+    ikcppkt *batch;
+    int nbatch, batch_max;
+    int (*output_batch)(ikcppkt *pkts, int count, struct IKCPCB *kcp, void *user);
 };
 
 typedef struct IKCPCB ikcpcb;
@@ -399,6 +416,16 @@ IUINT32 ikcp_getsn(const void *ptr);
 
 void ikcp_setprocesspkt(ikcpcb *kcp, int (*process_pkt)(void *user, int length, const char *input, char *output));
 
+// keep up to 'count' freed segments of mss bytes for reuse instead of
+// returning them to the allocator, 0 releases the pool
+int ikcp_setsegpool(ikcpcb *kcp, int count);
+
+// collect the datagrams built by one ikcp_flush, up to 'count' of them,
+// and hand them to 'output_batch' in one call instead of one 'output'
+// call each, NULL restores the plain output
+int ikcp_setoutputbatch(ikcpcb *kcp, int (*output_batch)(ikcppkt *pkts, int count, ikcpcb *kcp, void *user),
+                        int count);
+
 #ifdef __cplusplus
 }
 #endif
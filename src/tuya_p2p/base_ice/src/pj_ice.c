@@ -579,3 +579,27 @@ bool pj_ice_session_sendto(pj_ice_session_t *pIceSession, void *pkt, uint32_t le
     }
     return true;
 }
+
+bool pj_ice_session_sendto_batch(pj_ice_session_t *pIceSession, const pj_ice_pkt_t *pkts, uint32_t count)
+{
+    pj_thread_register2();
+
+    // Register and look up the valid pair once for the whole batch
+    pj_status_t status = PJ_SUCCESS;
+    pj_ice_strans *ice_st = pIceSession->pIceSTransport;
+    unsigned comp_id = 1; // Component starts with ID 1
+    const pj_ice_sess_check *pIceSessCheck = pj_ice_strans_get_valid_pair(ice_st, comp_id);
+    if (pIceSessCheck == NULL) {
+        return false;
+    }
+    unsigned addr_len = pj_sockaddr_get_len(&pIceSessCheck->rcand->addr);
+    bool ok = true;
+    for (uint32_t i = 0; i < count; i++) {
+        status = pj_ice_strans_sendto2(ice_st, comp_id, pkts[i].buf, pkts[i].len, &pIceSessCheck->rcand->addr,
+                                       addr_len);
+        if (status != PJ_SUCCESS && status != PJ_EPENDING) {
+            ok = false;
+        }
+    }
+    return ok;
+}
@@ -53,6 +53,9 @@
 
 #define P2P_DEFAULT_FRAGEMENT_LEN 1300
 
+#define RTC_KCP_SEG_POOL     64 // Freed kcp segments kept per channel for reuse
+#define RTC_KCP_OUTPUT_BATCH 16 // kcp datagrams signed and sent together per flush
+
 typedef enum rtc_session_close_reason {
     RTC_SESSION_CLOSE_REASON_OK = 0,
     RTC_SESSION_CLOSE_REASON_ICE_FAILED = 1,
@@ -1235,48 +1238,97 @@ void rtc_process_kcp_data(tuya_p2p_rtc_session_t *rtc, const tuya_uv_buf_t *pkt)
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////////
 
-static int on_kcp_output(const char *buf, int len, ikcpcb *kcp, void *user_data)
+// Append the digest behind the kcp datagram, returns the length to send or -1
+static int rtc_kcp_output_sign(tuya_p2p_rtc_session_t *rtc, const char *buf, int len)
 {
-    (void)kcp;
-    if (user_data == NULL) {
-        return 0;
-    }
-    rtc_channel_t *chan = (rtc_channel_t *)user_data;
-    tuya_p2p_rtc_session_t *rtc = chan->rtc;
-
     int md_size = 0;
     if (rtc->cfg.security_level == TUYA_P2P_SECURITY_LEVEL_3) {
         int ret;
         ret = mbedtls_md_hmac_starts(&rtc->md_ctx, rtc->aes_key, sizeof(rtc->aes_key));
         if (ret != 0) {
-            return 0;
+            return -1;
         }
         ret = mbedtls_md_hmac_update(&rtc->md_ctx, (unsigned char *)buf, len);
         if (ret != 0) {
-            return 0;
+            return -1;
         }
         ret = mbedtls_md_hmac_finish(&rtc->md_ctx, (unsigned char *)buf + len);
         if (ret != 0) {
-            return 0;
+            return -1;
         }
         md_size = mbedtls_md_get_size(rtc->md_info);
     }
+    return len + md_size;
+}
 
-    ctx_session_channel_set_send_time(chan);
-    uint32_t r = (rand() % 99) + 1;
+static bool rtc_kcp_output_is_sent(const char *buf)
+{
     uint32_t channel_id = ikcp_getconv(buf);
     unsigned char cmd = ikcp_getcmd(buf);
-    uint32_t sn = ikcp_getsn(buf);
-    // tuya_p2p_log_trace("channel_id: %08x, sn: %d, cmd: %d\n", channel_id, sn, cmd);
+    // tuya_p2p_log_trace("channel_id: %08x, sn: %d, cmd: %d\n", channel_id, ikcp_getsn(buf), cmd);
 
-    if (cmd != KCP_CMD_PUSH || channel_id != RTC_CHANNEL_CMD) {
-        pj_ice_session_sendto(rtc->pIce, (void *)buf, len + md_size);
+    return (cmd != KCP_CMD_PUSH || channel_id != RTC_CHANNEL_CMD);
+}
+
+static int on_kcp_output(const char *buf, int len, ikcpcb *kcp, void *user_data)
+{
+    (void)kcp;
+    if (user_data == NULL) {
+        return 0;
+    }
+    rtc_channel_t *chan = (rtc_channel_t *)user_data;
+    tuya_p2p_rtc_session_t *rtc = chan->rtc;
+
+    int send_len = rtc_kcp_output_sign(rtc, buf, len);
+    if (send_len < 0) {
+        return 0;
+    }
+
+    ctx_session_channel_set_send_time(chan);
+    if (rtc_kcp_output_is_sent(buf)) {
+        pj_ice_session_sendto(rtc->pIce, (void *)buf, send_len);
     }
 
-    chan->socket_send_bytes += (len + md_size);
+    chan->socket_send_bytes += send_len;
     return len;
 }
 
+// All datagrams of one ikcp_flush, signed in place and sent in one pass over the ICE transport
+static int on_kcp_output_batch(ikcppkt *pkts, int count, ikcpcb *kcp, void *user_data)
+{
+    (void)kcp;
+    if (user_data == NULL) {
+        return 0;
+    }
+    rtc_channel_t *chan = (rtc_channel_t *)user_data;
+    tuya_p2p_rtc_session_t *rtc = chan->rtc;
+    pj_ice_pkt_t send_pkts[RTC_KCP_OUTPUT_BATCH];
+    uint32_t send_cnt = 0;
+
+    // kcp hands at most the batch size set in ikcp_setoutputbatch
+    if (count > RTC_KCP_OUTPUT_BATCH) {
+        count = RTC_KCP_OUTPUT_BATCH;
+    }
+    for (int i = 0; i < count; i++) {
+        int send_len = rtc_kcp_output_sign(rtc, pkts[i].buf, pkts[i].len);
+        if (send_len < 0) {
+            continue;
+        }
+        if (rtc_kcp_output_is_sent(pkts[i].buf)) {
+            send_pkts[send_cnt].buf = pkts[i].buf;
+            send_pkts[send_cnt].len = send_len;
+            send_cnt++;
+        }
+        chan->socket_send_bytes += send_len;
+    }
+
+    ctx_session_channel_set_send_time(chan);
+    if (send_cnt > 0) {
+        pj_ice_session_sendto_batch(rtc->pIce, send_pkts, send_cnt);
+    }
+    return count;
+}
+
 void rtc_ref_cnt_add(tuya_p2p_rtc_session_t *rtc) {
     pthread_mutex_lock(&rtc->ref_lock);
     rtc->ref_cnt++;
@@ -1497,6 +1549,8 @@ int tuya_p2p_rtc_channels_init(tuya_p2p_rtc_session_t *rtc)
         ikcp_nodelay(chan->kcp, 0, 10, 20, 1);
         ikcp_setmtu(chan->kcp, 1400);
         ikcp_setprocesspkt(chan->kcp, ctx_session_channel_process_pkt);
+        ikcp_setsegpool(chan->kcp, RTC_KCP_SEG_POOL);
+        ikcp_setoutputbatch(chan->kcp, on_kcp_output_batch, RTC_KCP_OUTPUT_BATCH);
         // ikcp_setwritelog(chan->kcp, ctx_session_kcp_writelog);
         // ikcp_setlogmask(chan->kcp, IKCP_LOG_RTT | IKCP_LOG_INPUT | IKCP_LOG_OUTPUT);
         // ikcp_setlogmask(chan->kcp, IKCP_LOG_RECV);
@@ -1562,16 +1616,22 @@ int32_t tuya_p2p_rtc_listen()
     return 123456; // Temporarily return a random integer value, to be changed later
 }
 
-int32_t tuya_p2p_rtc_dosend_data(tuya_p2p_rtc_session_t *rtc, uint32_t channel_id, char *buf, int32_t len,
-                                 int32_t timeout_ms)
+int32_t tuya_p2p_rtc_dosend_datav(tuya_p2p_rtc_session_t *rtc, uint32_t channel_id, const tuya_p2p_rtc_iov_t *iov,
+                                  int32_t iovcnt, int32_t timeout_ms)
 {
     if (rtc == NULL) {
         return TUYA_P2P_ERROR_SESSION_CLOSED_TIMEOUT;
     }
-    int remain = len;
+    int remain = 0;
     int already = 0;
     int rc = 0;
     uint64_t begin_time = 0;
+    int iov_idx = 0;
+    uint32_t iov_off = 0;
+
+    for (int i = 0; i < iovcnt; i++) {
+        remain += iov[i].len;
+    }
 
     while (remain > 0) {
         pthread_mutex_lock(&rtc->channel_lock);
@@ -1622,7 +1682,20 @@ int32_t tuya_p2p_rtc_dosend_data(tuya_p2p_rtc_session_t *rtc, uint32_t channel_i
         int buflen;
 
         buflen = current;
-        memcpy(decrypted, buf + already, buflen);
+        // the fragment is gathered from the pieces straight into the plain text buffer
+        for (int copied = 0; copied < buflen;) {
+            uint32_t n = iov[iov_idx].len - iov_off;
+            if (n > (uint32_t)(buflen - copied)) {
+                n = buflen - copied;
+            }
+            memcpy(decrypted + copied, (const char *)iov[iov_idx].base + iov_off, n);
+            copied += n;
+            iov_off += n;
+            if (iov_off == iov[iov_idx].len) {
+                iov_idx++;
+                iov_off = 0;
+            }
+        }
 
         padding_size -= (buflen % keylen);
         memset(&(decrypted[buflen]), padding_size, padding_size);
@@ -1682,6 +1755,14 @@ int32_t tuya_p2p_rtc_dosend_data(tuya_p2p_rtc_session_t *rtc, uint32_t channel_i
     }
 }
 
+int32_t tuya_p2p_rtc_dosend_data(tuya_p2p_rtc_session_t *rtc, uint32_t channel_id, char *buf, int32_t len,
+                                 int32_t timeout_ms)
+{
+    tuya_p2p_rtc_iov_t iov = {buf, (uint32_t)len};
+
+    return tuya_p2p_rtc_dosend_datav(rtc, channel_id, &iov, 1, timeout_ms);
+}
+
 int32_t tuya_p2p_rtc_send_data(int32_t handle, uint32_t channel_id, char *buf, int32_t len, int32_t timeout_ms)
 {
     tal_mutex_lock(g_p2p_session_mutex);
@@ -1696,6 +1777,24 @@ int32_t tuya_p2p_rtc_send_data(int32_t handle, uint32_t channel_id, char *buf, i
     return ret;
 }
 
+int32_t tuya_p2p_rtc_send_datav(int32_t handle, uint32_t channel_id, const tuya_p2p_rtc_iov_t *iov, int32_t iovcnt,
+                                int32_t timeout_ms)
+{
+    if (iov == NULL || iovcnt <= 0) {
+        return TUYA_P2P_ERROR_INVALID_PARAMETER;
+    }
+    tal_mutex_lock(g_p2p_session_mutex);
+    tuya_p2p_rtc_session_t *rtc = g_pRtcSession;
+    if (rtc == NULL) {
+        tal_mutex_unlock(g_p2p_session_mutex);
+        tuya_p2p_log_error("rtc session %08x send data: invalid session\n", handle);
+        return TUYA_P2P_ERROR_INVALID_SESSION_HANDLE;
+    }
+    int32_t ret = tuya_p2p_rtc_dosend_datav(rtc, channel_id, iov, iovcnt, timeout_ms);
+    tal_mutex_unlock(g_p2p_session_mutex);
+    return ret;
+}
+
 int32_t tuya_p2p_rtc_dorecv_data(tuya_p2p_rtc_session_t *rtc, uint32_t channel_id, char *buf, int32_t *len,
                                  int32_t timeout_ms)
 {
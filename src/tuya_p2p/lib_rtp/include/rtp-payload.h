@@ -19,6 +19,17 @@ struct rtp_payload_t {
 
     /// @return 0-ok, other-error
     int (*packet)(void *param, const void *packet, int bytes, uint32_t timestamp, int flags);
+
+    /// Optional, encoder only. If set, H264/H265 and the common (audio) encoders
+    /// call it instead of alloc/packet/free, with the RTP header (and FU header)
+    /// apart from the payload, which points into the input stream
+    /// @param[in] header RTP header and payload header
+    /// @param[in] hdrlen header length in bytes
+    /// @param[in] payload payload, not copied
+    /// @param[in] bytes payload length in bytes
+    /// @return 0-ok, other-error
+    int (*packetv)(void *param, const void *header, int hdrlen, const void *payload, int bytes, uint32_t timestamp,
+                   int flags);
 };
 
 /// Create RTP packet encoder
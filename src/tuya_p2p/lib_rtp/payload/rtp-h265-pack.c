@@ -75,13 +75,26 @@ static int rtp_h265_pack_nalu(struct rtp_encode_h265_t *packer, const uint8_t *n
 
     packer->pkt.payload = nalu;
     packer->pkt.payloadlen = bytes;
+    // packer->pkt.rtp.m = 1; // set marker flag
+    packer->pkt.rtp.m = ((*nalu >> 1) & 0x3f) < 32 ? mark : 0; // VCL only
+
+    if (packer->handler.packetv) {
+        uint8_t hdr[RTP_FIXED_HEADER];
+        n = rtp_packet_serialize_header(&packer->pkt, hdr, sizeof(hdr));
+        if (n != RTP_FIXED_HEADER) {
+            assert(0);
+            return -1;
+        }
+
+        ++packer->pkt.rtp.seq;
+        return packer->handler.packetv(packer->cbparam, hdr, n, nalu, bytes, packer->pkt.rtp.timestamp, 0);
+    }
+
     n = RTP_FIXED_HEADER + packer->pkt.payloadlen;
     rtp = (uint8_t *)packer->handler.alloc(packer->cbparam, n);
     if (!rtp)
         return -ENOMEM;
 
-    // packer->pkt.rtp.m = 1; // set marker flag
-    packer->pkt.rtp.m = ((*nalu >> 1) & 0x3f) < 32 ? mark : 0; // VCL only
     n = rtp_packet_serialize(&packer->pkt, rtp, n);
     if (n != RTP_FIXED_HEADER + packer->pkt.payloadlen) {
         assert(0);
@@ -123,12 +136,34 @@ static int rtp_h265_pack_fu(struct rtp_encode_h265_t *packer, const uint8_t *ptr
         }
 
         packer->pkt.payload = ptr;
+        packer->pkt.rtp.m = (FU_END & fu_header) ? mark : 0; // set marker flag
+
+        if (packer->handler.packetv) {
+            uint8_t hdr[RTP_FIXED_HEADER + N_FU_HEADER];
+            n = rtp_packet_serialize_header(&packer->pkt, hdr, sizeof(hdr));
+            if (n != RTP_FIXED_HEADER) {
+                assert(0);
+                return -1;
+            }
+
+            /*header + fu_header*/
+            hdr[n + 0] = (uint8_t)(nalu_header >> 8);
+            hdr[n + 1] = (uint8_t)(nalu_header & 0xFF);
+            hdr[n + 2] = fu_header;
+            r = packer->handler.packetv(packer->cbparam, hdr, n + N_FU_HEADER, packer->pkt.payload,
+                                        packer->pkt.payloadlen, packer->pkt.rtp.timestamp, 0);
+
+            bytes -= packer->pkt.payloadlen;
+            ptr += packer->pkt.payloadlen;
+            fu_header &= 0x3F; // clear flags
+            continue;
+        }
+
         n = RTP_FIXED_HEADER + N_FU_HEADER + packer->pkt.payloadlen;
         rtp = (uint8_t *)packer->handler.alloc(packer->cbparam, n);
         if (!rtp)
             return -ENOMEM;
 
-        packer->pkt.rtp.m = (FU_END & fu_header) ? mark : 0; // set marker flag
         n = rtp_packet_serialize_header(&packer->pkt, rtp, n);
         if (n != RTP_FIXED_HEADER) {
             assert(0);
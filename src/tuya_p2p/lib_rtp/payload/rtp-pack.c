@@ -71,6 +71,19 @@ int rtp_pack_input(void *p, const void *data, int bytes, uint32_t timestamp)
         ptr += packer->pkt.payloadlen;
         bytes -= packer->pkt.payloadlen;
 
+        if (packer->handler.packetv) {
+            uint8_t hdr[RTP_FIXED_HEADER];
+            n = rtp_packet_serialize_header(&packer->pkt, hdr, sizeof(hdr));
+            if (n != RTP_FIXED_HEADER) {
+                assert(0);
+                return -1;
+            }
+
+            r = packer->handler.packetv(packer->cbparam, hdr, n, packer->pkt.payload, packer->pkt.payloadlen,
+                                        packer->pkt.rtp.timestamp, 0);
+            continue;
+        }
+
         n = RTP_FIXED_HEADER + packer->pkt.payloadlen;
         rtp = (uint8_t *)packer->handler.alloc(packer->cbparam, n);
         if (!rtp)
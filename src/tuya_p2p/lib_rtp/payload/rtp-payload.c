@@ -109,7 +109,8 @@ int rtp_packet_getsize()
 static int rtp_payload_find(int payload, const char *encoding, struct rtp_payload_delegate_t *codec)
 {
     assert(payload >= 0 && payload <= 127);
-    if (payload >= RTP_PAYLOAD_DYNAMIC && encoding) {
+    // unassigned static payload types (e.g. 95 for H265) are found by name as well
+    if ((payload >= RTP_PAYLOAD_DYNAMIC || NULL == rtp_profile_find(payload)) && encoding) {
         if (0 == strcasecmp(encoding, "H264")) {
             // H.264 video (MPEG-4 Part 10) (RFC 6184)
             codec->encoder = rtp_h264_encode();
@@ -39,6 +39,18 @@ typedef struct tagMediaFrame {
     UINT64_T timestamp;    ///< timestamp is ms
 } MEDIA_FRAME;
 
+#ifndef P2P_MEDIA_CLIENT_MAX
+#define P2P_MEDIA_CLIENT_MAX (4) ///< viewers sharing one encoded live stream
+#endif
+
+typedef struct {
+    UINT_T frames_sent;    ///< frames handed to the transport
+    UINT_T frames_dropped; ///< frames dropped by queue overflow, I frame wait or a full send buffer
+    UINT_T queued;         ///< frames waiting in the viewer queue
+    UINT_T latency_avg_ms; ///< average time from put to sent
+    UINT_T latency_max_ms; ///< max time from put to sent
+} TUYA_P2P_CLIENT_STAT_T;
+
 typedef INT_T (*tuya_p2p_rtc_disconnect_cb_t)();
 typedef INT_T (*tuya_p2p_rtc_get_frame_cb_t)(MEDIA_FRAME *pMediaFrame);
 
@@ -77,6 +89,10 @@ OPERATE_RET tuya_p2p_rtc_register_get_video_frame_cb(tuya_p2p_rtc_get_frame_cb_t
 OPERATE_RET tuya_p2p_rtc_register_get_audio_frame_cb(tuya_p2p_rtc_get_frame_cb_t pCallback);
 INT_T OnGetVideoFrameCallback(MEDIA_FRAME *pMediaFrame);
 INT_T OnGetAudioFrameCallback(MEDIA_FRAME *pMediaFrame);
+// Push an encoded frame to all viewers, an alternative to the get frame callbacks
+OPERATE_RET tuya_p2p_rtc_put_media_frame(IN CONST MEDIA_FRAME *pMediaFrame);
+// client is the viewer slot, 0 ~ P2P_MEDIA_CLIENT_MAX - 1
+OPERATE_RET tuya_p2p_rtc_get_client_stat(IN INT_T client, OUT TUYA_P2P_CLIENT_STAT_T *pStat);
 
 // OPERATE_RET tuya_ipc_tranfser_init(IN CONST TUYA_IPC_P2P_VAR_T *p_var);
 // OPERATE_RET tuya_ipc_tranfser_quit(VOID);
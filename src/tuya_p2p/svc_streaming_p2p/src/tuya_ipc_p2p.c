@@ -10,6 +10,7 @@
 #include "tal_system.h"
 #include "tal_memory.h"
 #include "tal_thread.h"
+#include "tal_semaphore.h"
 #include "tuya_ipc_p2p.h"
 #include "tuya_ipc_p2p_error.h"
 #include "tuya_ipc_p2p_inner.h"
@@ -73,14 +74,28 @@ typedef struct P2P_CMD_PARSE_ {
 #define STACK_SIZE_P2P_DETECT     65536
 #define STACK_SIZE_P2P_LISTEN     131072
 
+#ifndef P2P_MEDIA_QUEUE_LEN
+#define P2P_MEDIA_QUEUE_LEN (32) // Frames queued per viewer, on overflow video skips to the next I frame
+#endif
+#define P2P_MEDIA_VIDEO_BUF_SIZE (300 * 1024) // Frame buffer handed to the get video frame callback
+#define P2P_MEDIA_AUDIO_BUF_SIZE (1280)       // Frame buffer handed to the get audio frame callback
+#define P2P_MEDIA_PULL_WAIT      (10)         // ms, pump wait before asking an idle get frame callback again
+#define P2P_MEDIA_STAT_LOG       (2000)       // Frames sent to a viewer between two stat logs
+
 typedef struct {
     INT_T client;
     INT_T channel;
-    CHAR_T *p_rtp_buff;                         // RTP data buffer, reference size MTU+100
     INT_T fix_len;                              // Supplementary private header data
     CHAR_T ext_head_buff[P2P_EXT_HEAD_MAX_LEN]; // According to extended video header protocol head+ext(8)+rtp_len
 } RTP_PACK_NAL_ARG_T;
 
+// RTP packetizer kept for the whole session, so frames are not packed by a new encoder each
+typedef struct {
+    VOID *encoder;          // Encoder from rtp_payload_encode_create
+    INT_T codec;            // TY_AV_CODEC_ID the encoder was created for
+    RTP_PACK_NAL_ARG_T arg; // Packet callback parameter of the encoder
+} P2P_RTP_PACKER_T;
+
 typedef enum {
     P2P_IDLE = 0,
     P2P_VIDEO = 0x1, // Start live stream request
@@ -107,15 +122,6 @@ typedef struct {
     /*******p2p server*******/
     P2P_CMD_E cmd; // Signal status information
     P2P_CMD_PARSE_T pb_resp_head;
-    CHAR_T *p_video_rtp_buff; // Video RTP data buffer, reference size MTU+100
-    CHAR_T *p_audio_rtp_buff; // Audio RTP data buffer, reference size MTU+100
-    USHORT_T video_seq_num;   // Video RTP packet sequence number
-    USHORT_T audio_seq_num;   // Audio RTP packet sequence number
-    BOOL_T key_frame;
-    UINT64_T v_pts;                                  // Video PTS
-    UINT64_T v_timestamp;                            // Video absolute time (ms)
-    UINT64_T a_pts;                                  // Audio PTS
-    UINT64_T a_timestamp;                            // Audio absolute time (ms)
     INT_T video_req_id;                              // Video request ID, used for preview, playback and other services
     INT_T audio_req_id;                              // Audio request ID
     TRANSFER_VIDEO_CLARITY_TYPE_INNER_E cur_clarity; // Current video clarity type
@@ -134,7 +140,53 @@ typedef struct {
     /******* p2p server*******/
 } P2P_SESSION_T;
 
+// Encoded frame shared by the queues of all viewers, freed when the last one has sent it
+typedef struct {
+    INT_T ref;
+    SYS_TIME_T put_time; // Time the frame was put, latency is measured from here
+    MEDIA_FRAME frame;   // data points right behind the node
+} P2P_MEDIA_NODE_T;
+
+// Session state of the frame being sent, copied under the pump lock so the send path never reads the session
+typedef struct {
+    INT_T session; // p2p connection handle
+    P2P_CMD_E cmd;
+    INT_T video_req_id;
+    INT_T audio_req_id;
+    TRANSFER_VIDEO_CLARITY_TYPE_INNER_E cur_clarity;
+    TRANS_IPC_AV_INFO_T av_Info;
+    BOOL_T key_frame;
+    UINT64_T pts;       // PTS of the frame
+    UINT64_T timestamp; // Absolute time of the frame (ms)
+    BOOL_T lost;        // The connection is down, the viewer is dropped
+} P2P_MEDIA_SEND_T;
+
+// Live stream state of one viewer
+typedef struct {
+    P2P_SESSION_T *pSession;       // Control session of the viewer, NULL when the slot is free
+    BOOL_T closing;                // Detached, the pump releases the slot
+    P2P_MEDIA_SEND_T send;         // Only the media send thread uses it
+    BOOL_T wait_key;               // Video frames are skipped until the next I frame
+    P2P_RTP_PACKER_T video_packer; // Video RTP packetizer
+    P2P_RTP_PACKER_T audio_packer; // Audio RTP packetizer
+    USHORT_T video_seq_num;        // Video RTP packet sequence number
+    USHORT_T audio_seq_num;        // Audio RTP packet sequence number
+    P2P_MEDIA_NODE_T *queue[P2P_MEDIA_QUEUE_LEN];
+    UINT_T head;
+    UINT_T count;
+    UINT64_T latency_sum; // ms, over all frames sent
+    TUYA_P2P_CLIENT_STAT_T stat;
+} P2P_MEDIA_CLIENT_T;
+
+// Producers put frames into the viewer queues and post sem, the media send thread drains them
+typedef struct {
+    MUTEX_HANDLE mutex; // Protects the clients and their queues
+    SEM_HANDLE sem;     // Posted on new frames and on stream state changes
+    P2P_MEDIA_CLIENT_T client[P2P_MEDIA_CLIENT_MAX];
+} P2P_MEDIA_PUMP_T;
+
 STATIC P2P_SESSION_T *sg_p2p_session = NULL;
+STATIC P2P_MEDIA_PUMP_T sg_media_pump;
 INT_T g_listen_start = 0;               // Flag variable to control listen thread start or stop
 THREAD_HANDLE g_listen_thrd_hdl = NULL; // Listen thread handle
 
@@ -142,10 +194,9 @@ OPERATE_RET p2p_deal_with_listen(INT_T session);
 OPERATE_RET p2p_get_userinfo(INT_T session, INT_T p2pType);
 IPC_STREAM_TYPE p2p_get_chn_idx(TRANSFER_VIDEO_CLARITY_TYPE_INNER_E cur_clarity);
 TRANSFER_VIDEO_CLARITY_TYPE p2p_clarity_trans(TRANSFER_VIDEO_CLARITY_TYPE_INNER_E type);
-INT_T p2p_prepare_video_send_resource(P2P_SESSION_T *pSession);
-INT_T p2p_release_video_send_resource(P2P_SESSION_T *pSession);
-INT_T p2p_prepare_audio_send_resource(P2P_SESSION_T *pSession);
-INT_T p2p_release_audio_send_resource(P2P_SESSION_T *pSession);
+INT_T p2p_media_client_attach(P2P_SESSION_T *pSession);
+INT_T p2p_media_client_detach(P2P_SESSION_T *pSession);
+STATIC VOID __p2p_media_pump_wakeup(VOID);
 INT_T __p2p_session_clear(P2P_SESSION_T *pSession);
 INT_T __p2p_session_all_stop(P2P_SESSION_T *pSession);
 INT_T __p2p_session_release_va(P2P_SESSION_T *pSession);
@@ -155,6 +206,8 @@ VOID __p2p_rtc_close(INT_T rtc_session, INT_T reason, P2P_SESSION_T* p2p_session
 void *rtp_alloc(void *param, int bytes);
 void rtp_free(void *param, void *packet);
 int rtp_pack_packet_handler(void *param, const void *packet, int bytes, uint32_t timestamp, int flags);
+int rtp_pack_packetv_handler(void *param, const void *header, int hdrlen, const void *payload, int bytes,
+                             uint32_t timestamp, int flags);
 
 void ctx_listen_thread_func(void *arg)
 {
@@ -248,16 +301,14 @@ OPERATE_RET p2p_deal_with_listen(INT_T session)
     }
 
     // Request session-related resources
-    if (OPRT_OK != (ret = p2p_prepare_video_send_resource(sg_p2p_session))) {
-        goto RET;
-    }
-    if (OPRT_OK != (ret = p2p_prepare_audio_send_resource(sg_p2p_session))) {
+    if (OPRT_OK != (ret = p2p_media_client_attach(sg_p2p_session))) {
         goto RET;
     }
 
     // Save connection information
     sg_p2p_session->session = session;
     sg_p2p_session->status = P2P_SESSION_RUNNING;
+    __p2p_media_pump_wakeup();
 
 RET:
     return ret;
@@ -430,86 +481,221 @@ TRANSFER_VIDEO_CLARITY_TYPE p2p_clarity_trans(TRANSFER_VIDEO_CLARITY_TYPE_INNER_
     return eVideoClarityHigh;
 }
 
-INT_T p2p_prepare_video_send_resource(P2P_SESSION_T *pSession)
+/***********************************************************
+ *  Function: __p2p_rtp_packer_setup
+ *  Note:Create the RTP encoder of a stream, or create it again when the codec changed
+ *  Input: packer packetizer, codec TY_AV_CODEC_ID, channel video/audio data channel, seq first sequence number
+ *  Output: none
+ *  Return:
+ ***********************************************************/
+STATIC OPERATE_RET __p2p_rtp_packer_setup(P2P_RTP_PACKER_T *packer, INT_T codec, INT_T channel, USHORT_T seq)
 {
-    if (pSession == NULL) {
-        PR_DEBUG("session is NULL");
-        return OPRT_INVALID_PARM;
-    }
+    INT_T payload = 0;
+    CHAR_T *codec_name = NULL;
+    UINT_T ssrc = (TUYA_VDATA_CHANNEL == channel) ? 10 : 11;
 
-    if (NULL != pSession->p_video_rtp_buff) {
+    if (NULL != packer->encoder && codec == packer->codec) {
         return OPRT_OK;
     }
 
-    pSession->p_video_rtp_buff = (CHAR_T *)Malloc(P2P_RTP_PACK_LEN);
-    if (NULL == pSession->p_video_rtp_buff) {
-        PR_ERR("session:[%d] video rtp buffer malloc failed", pSession->session);
+    if (TUYA_VDATA_CHANNEL == channel) {
+        if (TY_AV_CODEC_VIDEO_H265 == codec) {
+            codec_name = "H265";
+            payload = 95 /*H265_PAY_LOAD*/;
+        } else {
+            codec_name = "H264";
+            payload = 96 /*H264_PAY_LOAD*/;
+        }
+    } else {
+        if (TY_AV_CODEC_AUDIO_G711U == codec) {
+            codec_name = "PCMU";
+            payload = 0 /*RTP_PCMU_PAYLOAD*/;
+        } else if (TY_AV_CODEC_AUDIO_G711A == codec) {
+            codec_name = "PCMA";
+            payload = 8 /*RTP_PCMA_PAYLOAD*/;
+        } else {
+            codec_name = "PCM";
+            payload = 99 /*RTP_PCM_PAYLOAD*/;
+        }
+    }
+
+    if (NULL != packer->encoder) {
+        rtp_payload_encode_destroy(packer->encoder);
+        packer->encoder = NULL;
+    }
+
+    // With packetv the encoder hands over the RTP header and the payload apart,
+    // so the frame data is not copied into a packet buffer before sending
+    struct rtp_payload_t rtp_packer;
+    rtp_packer.alloc = rtp_alloc;
+    rtp_packer.free = rtp_free;
+    rtp_packer.packet = rtp_pack_packet_handler;
+    rtp_packer.packetv = rtp_pack_packetv_handler;
+    memset(&packer->arg, 0, sizeof(packer->arg));
+    packer->arg.channel = channel;
+    packer->encoder = rtp_payload_encode_create(payload, codec_name, seq, ssrc, &rtp_packer, &packer->arg);
+    if (NULL == packer->encoder) {
+        PR_ERR("rtp encoder %s create failed", codec_name);
         return OPRT_MALLOC_FAILED;
     }
-    memset(pSession->p_video_rtp_buff, 0x00, P2P_RTP_PACK_LEN);
+    packer->codec = codec;
 
-    PR_DEBUG("session:[%d] malloc video send buffer success", pSession->session);
     return OPRT_OK;
 }
 
-INT_T p2p_release_video_send_resource(P2P_SESSION_T *pSession)
+STATIC VOID __p2p_rtp_packer_release(P2P_RTP_PACKER_T *packer)
 {
-    if (pSession == NULL) {
-        PR_DEBUG("session is NULL");
-        return OPRT_INVALID_PARM;
+    if (NULL != packer->encoder) {
+        rtp_payload_encode_destroy(packer->encoder);
+        packer->encoder = NULL;
     }
+}
 
-    if (NULL == pSession->p_video_rtp_buff) {
-        return OPRT_OK;
+STATIC VOID __p2p_media_pump_wakeup(VOID)
+{
+    if (NULL != sg_media_pump.sem) {
+        tal_semaphore_post(sg_media_pump.sem);
     }
+}
 
-    Free(pSession->p_video_rtp_buff);
-    pSession->p_video_rtp_buff = NULL;
-
-    PR_DEBUG("session:[%d] release video send buffer success", pSession->session);
-    return OPRT_OK;
+STATIC VOID __p2p_media_node_unref(P2P_MEDIA_NODE_T *node)
+{
+    if (--node->ref <= 0) {
+        Free(node);
+    }
 }
 
-INT_T p2p_prepare_audio_send_resource(P2P_SESSION_T *pSession)
+/***********************************************************
+ *  Function: p2p_media_client_attach
+ *  Note:Give the session a viewer slot with its own RTP packetizers, frames put from now on are queued for it
+ *  Input: pSession session management
+ *  Output: none
+ *  Return:
+ ***********************************************************/
+INT_T p2p_media_client_attach(P2P_SESSION_T *pSession)
 {
+    P2P_MEDIA_CLIENT_T *pClient = NULL;
+    OPERATE_RET ret = OPRT_OK;
+    INT_T i;
+
     if (pSession == NULL) {
         PR_DEBUG("session is NULL");
         return OPRT_INVALID_PARM;
     }
 
-    if (NULL != pSession->p_audio_rtp_buff) {
-        return OPRT_OK;
+    tal_mutex_lock(sg_media_pump.mutex);
+    for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+        if (pSession == sg_media_pump.client[i].pSession && !sg_media_pump.client[i].closing) {
+            tal_mutex_unlock(sg_media_pump.mutex);
+            return OPRT_OK;
+        }
+        if (NULL == pClient && NULL == sg_media_pump.client[i].pSession) {
+            pClient = &sg_media_pump.client[i];
+        }
+    }
+    if (NULL == pClient) {
+        tal_mutex_unlock(sg_media_pump.mutex);
+        PR_ERR("session:[%d] no free media client, max %d", pSession->session, P2P_MEDIA_CLIENT_MAX);
+        return OPRT_EXCEED_UPPER_LIMIT;
     }
 
-    pSession->p_audio_rtp_buff = (CHAR_T *)Malloc(P2P_RTP_PACK_LEN);
-    if (NULL == pSession->p_audio_rtp_buff) {
-        PR_ERR("session:[%d] audio rtp buffer malloc failed", pSession->session);
-        return OPRT_MALLOC_FAILED;
+    memset(pClient, 0, sizeof(P2P_MEDIA_CLIENT_T));
+    ret = __p2p_rtp_packer_setup(&pClient->video_packer, pSession->av_Info.video_codec[0], TUYA_VDATA_CHANNEL, 0);
+    if (OPRT_OK == ret) {
+        ret = __p2p_rtp_packer_setup(&pClient->audio_packer, pSession->av_Info.audio_codec, TUYA_ADATA_CHANNEL, 0);
     }
-    memset(pSession->p_audio_rtp_buff, 0x00, P2P_RTP_PACK_LEN);
+    if (OPRT_OK != ret) {
+        __p2p_rtp_packer_release(&pClient->video_packer);
+        tal_mutex_unlock(sg_media_pump.mutex);
+        PR_ERR("session:[%d] rtp packer create failed", pSession->session);
+        return ret;
+    }
+    // A viewer joining a running stream starts at an I frame
+    pClient->wait_key = TRUE;
+    pClient->pSession = pSession;
+    tal_mutex_unlock(sg_media_pump.mutex);
 
-    PR_DEBUG("session:[%d] malloc audio send buffer success", pSession->session);
+    PR_DEBUG("session:[%d] attached as media client %d", pSession->session, (INT_T)(pClient - sg_media_pump.client));
     return OPRT_OK;
 }
 
-INT_T p2p_release_audio_send_resource(P2P_SESSION_T *pSession)
+/***********************************************************
+ *  Function: p2p_media_client_detach
+ *  Note:Stop queuing frames for the session, the media send thread drops what is left and releases the slot
+ *  Input: pSession session management
+ *  Output: none
+ *  Return:
+ ***********************************************************/
+INT_T p2p_media_client_detach(P2P_SESSION_T *pSession)
 {
+    INT_T i;
+
     if (pSession == NULL) {
         PR_DEBUG("session is NULL");
         return OPRT_INVALID_PARM;
     }
 
-    if (NULL == pSession->p_audio_rtp_buff) {
-        return OPRT_OK;
+    tal_mutex_lock(sg_media_pump.mutex);
+    for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+        if (pSession == sg_media_pump.client[i].pSession) {
+            sg_media_pump.client[i].closing = TRUE;
+        }
     }
+    tal_mutex_unlock(sg_media_pump.mutex);
+    __p2p_media_pump_wakeup();
 
-    Free(pSession->p_audio_rtp_buff);
-    pSession->p_audio_rtp_buff = NULL;
-
-    PR_DEBUG("session:[%d] release audio send buffer success", pSession->session);
     return OPRT_OK;
 }
 
+// Free the slots of detached viewers, only the media send thread touches the packetizers
+STATIC VOID __p2p_media_client_reap(VOID)
+{
+    P2P_MEDIA_CLIENT_T *pClient = NULL;
+    INT_T i;
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+        pClient = &sg_media_pump.client[i];
+        if (NULL == pClient->pSession || !pClient->closing) {
+            continue;
+        }
+        while (pClient->count > 0) {
+            __p2p_media_node_unref(pClient->queue[pClient->head]);
+            pClient->head = (pClient->head + 1) % P2P_MEDIA_QUEUE_LEN;
+            pClient->count--;
+        }
+        __p2p_rtp_packer_release(&pClient->video_packer);
+        __p2p_rtp_packer_release(&pClient->audio_packer);
+        PR_DEBUG("media client %d released, sent %u dropped %u latency max %u ms", i, pClient->stat.frames_sent,
+                 pClient->stat.frames_dropped, pClient->stat.latency_max_ms);
+        memset(pClient, 0, sizeof(P2P_MEDIA_CLIENT_T));
+    }
+    tal_mutex_unlock(sg_media_pump.mutex);
+}
+
+// P2P_VIDEO/P2P_AUDIO the running viewers want
+STATIC P2P_CMD_E __p2p_media_client_want(P2P_MEDIA_CLIENT_T *pClient)
+{
+    if (NULL == pClient->pSession || pClient->closing || P2P_SESSION_RUNNING != pClient->pSession->status) {
+        return P2P_IDLE;
+    }
+    return pClient->pSession->cmd & (P2P_VIDEO | P2P_AUDIO);
+}
+
+STATIC P2P_CMD_E __p2p_media_wanted(VOID)
+{
+    P2P_CMD_E want = P2P_IDLE;
+    INT_T i;
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+        want |= __p2p_media_client_want(&sg_media_pump.client[i]);
+    }
+    tal_mutex_unlock(sg_media_pump.mutex);
+
+    return want;
+}
+
 OPERATE_RET p2p_send_rtp_data(INT_T client, INT_T channel, CHAR_T *buff, INT_T length)
 {
     if (channel < TUYA_VDATA_CHANNEL || channel > TUYA_ADATA_CHANNEL) {
@@ -529,6 +715,36 @@ OPERATE_RET p2p_send_rtp_data(INT_T client, INT_T channel, CHAR_T *buff, INT_T l
     return OPRT_OK;
 }
 
+STATIC OPERATE_RET __p2p_send_rtp_datav(INT_T client, INT_T channel, CONST tuya_p2p_rtc_iov_t *iov, INT_T iovcnt)
+{
+    if (channel < TUYA_VDATA_CHANNEL || channel > TUYA_ADATA_CHANNEL) {
+        PR_ERR("input errorclient[%d]channel[%d]", client, channel);
+        return OPRT_INVALID_PARM;
+    }
+    P2P_MEDIA_SEND_T *pSend = &sg_media_pump.client[client].send;
+    INT_T ret = 0;
+    INT_T length = 0;
+    INT_T i;
+    // Send data
+    if ((0 == (P2P_VIDEO & pSend->cmd)) && (0 == (P2P_PB_VIDEO & pSend->cmd)) && (0 == (P2P_AUDIO & pSend->cmd)) &&
+        (0 == (P2P_PB_AUDIO & pSend->cmd))) {
+        return OPRT_OK;
+    }
+    for (i = 0; i < iovcnt; i++) {
+        length += iov[i].len;
+    }
+    ret = tuya_p2p_rtc_send_datav(pSend->session, channel, iov, iovcnt, -1);
+    if (ret == length) {
+        return OPRT_OK;
+    }
+    PR_ERR("Write data failed [%d][%d]", ret, length);
+    // Any error but a timeout means the connection is gone
+    if (ret < 0 && TUYA_P2P_ERROR_TIME_OUT != ret) {
+        pSend->lost = TRUE;
+    }
+    return OPRT_COM_ERROR;
+}
+
 /***********************************************************
  *  Function: __p2p_ext_protocol_pack
  *  Note:Transport extension protocol packet assembly
@@ -544,41 +760,37 @@ STATIC VOID __p2p_ext_protocol_pack(INT_T client, INT_T type, CHAR_T *p_result,
     }
 
     INT_T fix_len = 0; // 20180428 supplementary header data
-    UINT64_T tmpTime;
-    INT_T ipcChan = client;
-    IPC_STREAM_E curClirtyChn = p2p_get_chn_idx(sg_p2p_session->cur_clarity);
+    P2P_MEDIA_SEND_T *pSend = &sg_media_pump.client[client].send;
+    IPC_STREAM_E curClirtyChn = p2p_get_chn_idx(pSend->cur_clarity);
     C2C_AV_TRANS_FIXED_HEADER *pav_Info = (C2C_AV_TRANS_FIXED_HEADER *)p_result;
 
     if (0 == type) {
-        tmpTime = sg_p2p_session->v_timestamp;
-        pav_Info->request_id = sg_p2p_session->video_req_id;
-        if (TRUE == sg_p2p_session->key_frame) {
+        pav_Info->request_id = pSend->video_req_id;
+        if (TRUE == pSend->key_frame) {
             fix_len = sizeof(C2C_AV_TRANS_FIXED_HEADER) + EXT_PROTOCOL_V0_LEN;
             pav_Info->extension_length = 8;
             *(BYTE_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER)] = TY_EXT_VIDEO_PARAM;
             *(BYTE_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 1] = 0;
             *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 2] =
-                (SHORT_T)sg_p2p_session->av_Info.width[curClirtyChn];
+                (SHORT_T)pSend->av_Info.width[curClirtyChn];
             *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 4] =
-                (SHORT_T)sg_p2p_session->av_Info.height[curClirtyChn];
-            *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 6] =
-                (SHORT_T)sg_p2p_session->av_Info.fps[curClirtyChn];
+                (SHORT_T)pSend->av_Info.height[curClirtyChn];
+            *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 6] = (SHORT_T)pSend->av_Info.fps[curClirtyChn];
         } else {
             fix_len = sizeof(C2C_AV_TRANS_FIXED_HEADER) + 4;
             pav_Info->extension_length = 0;
         }
     } else {
-        tmpTime = sg_p2p_session->a_timestamp;
-        pav_Info->request_id = sg_p2p_session->audio_req_id;
+        pav_Info->request_id = pSend->audio_req_id;
         fix_len = sizeof(C2C_AV_TRANS_FIXED_HEADER) + EXT_PROTOCOL_V0_LEN;
         pav_Info->extension_length = 8;
         *(BYTE_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER)] = TY_EXT_AUDIO_PARAM;
         *(BYTE_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 1] = 0;
-        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 2] = (SHORT_T)sg_p2p_session->av_Info.audio_sample;
-        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 4] = (SHORT_T)sg_p2p_session->av_Info.audio_channel;
-        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 6] = (SHORT_T)sg_p2p_session->av_Info.audio_databits;
+        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 2] = (SHORT_T)pSend->av_Info.audio_sample;
+        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 4] = (SHORT_T)pSend->av_Info.audio_channel;
+        *(SHORT_T *)&p_result[sizeof(C2C_AV_TRANS_FIXED_HEADER) + 6] = (SHORT_T)pSend->av_Info.audio_databits;
     }
-    pav_Info->time_ms = tmpTime;
+    pav_Info->time_ms = pSend->timestamp;
     *p_result_len = fix_len;
 
     return;
@@ -590,7 +802,7 @@ STATIC OPERATE_RET __p2p_check_free_buffer_size(INT_T client, INT_T channel, INT
     INT_T sendFreeSize = 0;
     INT_T writeSize = 0;
 
-    ret = tuya_p2p_rtc_check_buffer(sg_p2p_session->session, channel, (uint32_t *)&writeSize, NULL,
+    ret = tuya_p2p_rtc_check_buffer(sg_media_pump.client[client].send.session, channel, (uint32_t *)&writeSize, NULL,
                                     (uint32_t *)&sendFreeSize);
     if (OPRT_OK != ret) {
         return ret;
@@ -602,7 +814,7 @@ STATIC OPERATE_RET __p2p_check_free_buffer_size(INT_T client, INT_T channel, INT
         STATIC INT_T retry_sum = 0; // Total retry count when buffer is full
         if (retry_sum % 100 == 0) {
             PR_ERR("Check_Buffer not enough writeSize[%d] sendFreeSize[%d] len[%d] session[%d] channel[%d]", writeSize,
-                   sendFreeSize, len, sg_p2p_session->session, channel);
+                   sendFreeSize, len, sg_media_pump.client[client].send.session, channel);
         }
         retry_sum++;
         ret = OPRT_RESOURCE_NOT_READY;
@@ -610,6 +822,44 @@ STATIC OPERATE_RET __p2p_check_free_buffer_size(INT_T client, INT_T channel, INT
     return ret;
 }
 
+/***********************************************************
+ *  Function: __p2p_rtp_packer_input
+ *  Note:Pack one frame into RTP with the viewer packetizer of the stream and send
+ *  Input: client channel number, packer packetizer, codec TY_AV_CODEC_ID, type 0/1 video/audio,
+ *         pData data header address, len data length, timestamp RTP timestamp
+ *  Output: p_seq next RTP sequence number
+ *  Return:
+ ***********************************************************/
+STATIC OPERATE_RET __p2p_rtp_packer_input(INT_T client, P2P_RTP_PACKER_T *packer, INT_T codec, INT_T type,
+                                          USHORT_T *p_seq, CHAR_T *pData, INT_T len, UINT_T timestamp)
+{
+    INT_T channel = (0 == type) ? TUYA_VDATA_CHANNEL : TUYA_ADATA_CHANNEL;
+
+    if (NULL == packer->encoder) {
+        PR_ERR("%s rtp packer is NULL", (0 == type) ? "video" : "audio");
+        return OPRT_INVALID_PARM;
+    }
+
+    // The codec of the stream changed, the new encoder goes on with the sequence number
+    OPERATE_RET ret = __p2p_rtp_packer_setup(packer, codec, channel, *p_seq);
+    if (OPRT_OK != ret) {
+        return ret;
+    }
+
+    packer->arg.client = client;
+    memset(packer->arg.ext_head_buff, 0, P2P_EXT_HEAD_MAX_LEN);
+    __p2p_ext_protocol_pack(client, type, packer->arg.ext_head_buff, &packer->arg.fix_len);
+
+    uint32_t rtp_timestamp = timestamp;
+    ret = rtp_payload_encode_input(packer->encoder, pData, len, rtp_timestamp);
+    if (OPRT_OK != ret) {
+        PR_ERR("rtp_payload_encode_input codec %d error:%d", codec, ret);
+    }
+    rtp_payload_encode_getinfo(packer->encoder, p_seq, &rtp_timestamp);
+
+    return ret;
+}
+
 /***********************************************************
  *  Function: __p2p_pack_h265_rtp_and_send
  *  Note:IPC stream data assembly RTP and send
@@ -629,35 +879,9 @@ STATIC OPERATE_RET __p2p_pack_h265_rtp_and_send(INT_T client, CHAR_T *pData, INT
         return ret;
     }
 
-    if (NULL == sg_p2p_session->p_video_rtp_buff) {
-        PR_ERR("video rtp buffer is NULL");
-        return OPRT_INVALID_PARM;
-    }
-
-    RTP_PACK_NAL_ARG_T rtp_pack_nal_arg;
-    rtp_pack_nal_arg.client = client;
-    rtp_pack_nal_arg.channel = TUYA_VDATA_CHANNEL;
-    rtp_pack_nal_arg.p_rtp_buff = sg_p2p_session->p_video_rtp_buff;
-    memset(rtp_pack_nal_arg.ext_head_buff, 0, P2P_EXT_HEAD_MAX_LEN);
-    __p2p_ext_protocol_pack(client, 0, rtp_pack_nal_arg.ext_head_buff, &rtp_pack_nal_arg.fix_len);
-
-    void *pRtpDelegate = NULL;
-    struct rtp_payload_t rtp_packer;
-    rtp_packer.alloc = rtp_alloc;
-    rtp_packer.free = rtp_free;
-    rtp_packer.packet = rtp_pack_packet_handler;
-    uint16_t seq = sg_p2p_session->video_seq_num;
-    uint32_t ssrc = 10;
-    uint32_t timestamp = (UINT_T)sg_p2p_session->v_pts;
-    pRtpDelegate = rtp_payload_encode_create(/*H265_PAY_LOAD*/ 95, "H265", seq, ssrc, &rtp_packer, &rtp_pack_nal_arg);
-    ret = rtp_payload_encode_input(pRtpDelegate, pData, len, timestamp);
-    if (OPRT_OK != ret) {
-        PR_ERR("rtp_payload_encode_input h264 error:%d", ret);
-    }
-    rtp_payload_encode_getinfo(pRtpDelegate, &sg_p2p_session->video_seq_num, &timestamp);
-    rtp_payload_encode_destroy(pRtpDelegate);
-
-    return ret;
+    P2P_MEDIA_CLIENT_T *pClient = &sg_media_pump.client[client];
+    return __p2p_rtp_packer_input(client, &pClient->video_packer, TY_AV_CODEC_VIDEO_H265, 0, &pClient->video_seq_num,
+                                  pData, len, (UINT_T)pClient->send.pts);
 }
 
 /***********************************************************
@@ -686,35 +910,9 @@ STATIC OPERATE_RET __p2p_pack_h264_rtp_and_send(INT_T client, CHAR_T *pData, INT
         return ret;
     }
 
-    if (NULL == sg_p2p_session->p_video_rtp_buff) {
-        PR_ERR("video rtp buffer is NULL");
-        return OPRT_INVALID_PARM;
-    }
-
-    RTP_PACK_NAL_ARG_T rtp_pack_nal_arg;
-    rtp_pack_nal_arg.client = client;
-    rtp_pack_nal_arg.channel = TUYA_VDATA_CHANNEL;
-    rtp_pack_nal_arg.p_rtp_buff = sg_p2p_session->p_video_rtp_buff;
-    memset(rtp_pack_nal_arg.ext_head_buff, 0, P2P_EXT_HEAD_MAX_LEN);
-    __p2p_ext_protocol_pack(client, 0, rtp_pack_nal_arg.ext_head_buff, &rtp_pack_nal_arg.fix_len);
-
-    void *pRtpDelegate = NULL;
-    struct rtp_payload_t rtp_packer;
-    rtp_packer.alloc = rtp_alloc;
-    rtp_packer.free = rtp_free;
-    rtp_packer.packet = rtp_pack_packet_handler;
-    uint16_t seq = sg_p2p_session->video_seq_num;
-    uint32_t ssrc = 10;
-    uint32_t timestamp = (UINT_T)sg_p2p_session->v_pts;
-    pRtpDelegate = rtp_payload_encode_create(/*H264_PAY_LOAD*/ 96, "H264", seq, ssrc, &rtp_packer, &rtp_pack_nal_arg);
-    ret = rtp_payload_encode_input(pRtpDelegate, pData, len, timestamp);
-    if (OPRT_OK != ret) {
-        PR_ERR("rtp_payload_encode_input h264 error:%d", ret);
-    }
-    rtp_payload_encode_getinfo(pRtpDelegate, &sg_p2p_session->video_seq_num, &timestamp);
-    rtp_payload_encode_destroy(pRtpDelegate);
-
-    return ret;
+    P2P_MEDIA_CLIENT_T *pClient = &sg_media_pump.client[client];
+    return __p2p_rtp_packer_input(client, &pClient->video_packer, TY_AV_CODEC_VIDEO_H264, 0, &pClient->video_seq_num,
+                                  pData, len, (UINT_T)pClient->send.pts);
 }
 
 /***********************************************************
@@ -813,47 +1011,9 @@ STATIC OPERATE_RET __p2p_pack_g711_rtp_and_send(INT_T client, CHAR_T *pData, INT
         return ret;
     }
 
-    if (NULL == sg_p2p_session->p_audio_rtp_buff) {
-        PR_ERR("audio rtp buffer is NULL");
-        return OPRT_INVALID_PARM;
-    }
-
-    RTP_PACK_NAL_ARG_T rtp_pack_nal_arg;
-    rtp_pack_nal_arg.client = client;
-    rtp_pack_nal_arg.channel = TUYA_ADATA_CHANNEL;
-    rtp_pack_nal_arg.p_rtp_buff = sg_p2p_session->p_audio_rtp_buff;
-    memset(rtp_pack_nal_arg.ext_head_buff, 0, P2P_EXT_HEAD_MAX_LEN);
-    __p2p_ext_protocol_pack(client, 1, rtp_pack_nal_arg.ext_head_buff, &rtp_pack_nal_arg.fix_len);
-
-    void *pRtpDelegate = NULL;
-    struct rtp_payload_t rtp_packer;
-    rtp_packer.alloc = rtp_alloc;
-    rtp_packer.free = rtp_free;
-    rtp_packer.packet = rtp_pack_packet_handler;
-    uint16_t seq = sg_p2p_session->audio_seq_num;
-    uint32_t ssrc = 11;
-    uint32_t timestamp = (UINT_T)sg_p2p_session->a_pts;
-    int payload = 0;
-    char *codec_name = NULL;
-    if (TY_AV_CODEC_AUDIO_G711U == mode) {
-        codec_name = "PCMU";
-        payload = 0 /*RTP_PCMU_PAYLOAD*/;
-    } else if (TY_AV_CODEC_AUDIO_G711A == mode) {
-        codec_name = "PCMA";
-        payload = 8 /*RTP_PCMA_PAYLOAD*/;
-    } else {
-        codec_name = "PCM";
-        payload = 99 /*RTP_PCM_PAYLOAD*/;
-    }
-    pRtpDelegate = rtp_payload_encode_create(payload, codec_name, seq, ssrc, &rtp_packer, &rtp_pack_nal_arg);
-    ret = rtp_payload_encode_input(pRtpDelegate, pData, len, timestamp);
-    if (OPRT_OK != ret) {
-        PR_ERR("rtp_payload_encode_input h264 error:%d", ret);
-    }
-    rtp_payload_encode_getinfo(pRtpDelegate, &sg_p2p_session->audio_seq_num, &timestamp);
-    rtp_payload_encode_destroy(pRtpDelegate);
-
-    return ret;
+    P2P_MEDIA_CLIENT_T *pClient = &sg_media_pump.client[client];
+    return __p2p_rtp_packer_input(client, &pClient->audio_packer, mode, 1, &pClient->audio_seq_num, pData, len,
+                                  (UINT_T)pClient->send.pts);
 }
 
 /////////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -877,12 +1037,160 @@ OPERATE_RET tuya_ipc_init_trans_av_info(TRANS_IPC_AV_INFO_T *av_info)
 OPERATE_RET tuya_p2p_rtc_register_get_video_frame_cb(tuya_p2p_rtc_get_frame_cb_t pCallback)
 {
     sg_p2p_session->on_get_video_frame_callback = pCallback;
+    __p2p_media_pump_wakeup();
     return OPRT_OK;
 }
 
 OPERATE_RET tuya_p2p_rtc_register_get_audio_frame_cb(tuya_p2p_rtc_get_frame_cb_t pCallback)
 {
     sg_p2p_session->on_get_audio_frame_callback = pCallback;
+    __p2p_media_pump_wakeup();
+    return OPRT_OK;
+}
+
+// Queue the node for one viewer, called with sg_media_pump.mutex held
+STATIC VOID __p2p_media_client_enqueue(P2P_MEDIA_CLIENT_T *pClient, P2P_MEDIA_NODE_T *node, P2P_CMD_E want)
+{
+    if (0 == (want & __p2p_media_client_want(pClient))) {
+        return;
+    }
+
+    if (P2P_VIDEO == want) {
+        if (eVideoIFrame == node->frame.type) {
+            pClient->wait_key = FALSE;
+        } else if (pClient->wait_key) {
+            pClient->stat.frames_dropped++;
+            return;
+        }
+    }
+
+    if (pClient->count >= P2P_MEDIA_QUEUE_LEN) {
+        // The viewer can not keep up, P frames after a dropped frame are useless
+        pClient->stat.frames_dropped++;
+        if (P2P_VIDEO == want) {
+            pClient->wait_key = TRUE;
+        }
+        return;
+    }
+
+    pClient->queue[(pClient->head + pClient->count) % P2P_MEDIA_QUEUE_LEN] = node;
+    pClient->count++;
+    node->ref++;
+}
+
+// Drop the queued video frames in front of the next queued I frame, called with sg_media_pump.mutex held after
+// a video frame of the viewer was lost
+STATIC VOID __p2p_media_client_purge_video(P2P_MEDIA_CLIENT_T *pClient)
+{
+    P2P_MEDIA_NODE_T *node = NULL;
+    BOOL_T key_found = FALSE;
+    UINT_T kept = 0;
+    UINT_T i;
+
+    for (i = 0; i < pClient->count; i++) {
+        node = pClient->queue[(pClient->head + i) % P2P_MEDIA_QUEUE_LEN];
+        if (!key_found && eAudioFrame != node->frame.type) {
+            if (eVideoIFrame == node->frame.type) {
+                key_found = TRUE;
+            } else {
+                pClient->stat.frames_dropped++;
+                __p2p_media_node_unref(node);
+                continue;
+            }
+        }
+        pClient->queue[(pClient->head + kept) % P2P_MEDIA_QUEUE_LEN] = node;
+        kept++;
+    }
+    pClient->count = kept;
+    // Without a queued I frame the frames put from now on are skipped until one comes
+    pClient->wait_key = !key_found;
+}
+
+// Copy the frame once and queue it for every viewer that wants it, *pQueued tells whether any viewer took it
+STATIC OPERATE_RET __p2p_media_frame_put(CONST MEDIA_FRAME *pMediaFrame, BOOL_T *pQueued)
+{
+    P2P_MEDIA_NODE_T *node = NULL;
+    P2P_CMD_E want;
+    INT_T i;
+
+    *pQueued = FALSE;
+
+    if (NULL == pMediaFrame || NULL == pMediaFrame->data || 0 == pMediaFrame->size ||
+        pMediaFrame->type >= eCmdFrame) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == sg_media_pump.mutex) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    want = (eAudioFrame == pMediaFrame->type) ? P2P_AUDIO : P2P_VIDEO;
+    if (0 == (want & __p2p_media_wanted())) {
+        return OPRT_OK;
+    }
+
+    node = (P2P_MEDIA_NODE_T *)Malloc(sizeof(P2P_MEDIA_NODE_T) + pMediaFrame->size);
+    if (NULL == node) {
+        return OPRT_MALLOC_FAILED;
+    }
+    node->ref = 0;
+    node->put_time = tal_system_get_millisecond();
+    node->frame = *pMediaFrame;
+    node->frame.data = (UCHAR_T *)(node + 1);
+    memcpy(node->frame.data, pMediaFrame->data, pMediaFrame->size);
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+        __p2p_media_client_enqueue(&sg_media_pump.client[i], node, want);
+    }
+    if (0 == node->ref) {
+        Free(node);
+        node = NULL;
+    }
+    tal_mutex_unlock(sg_media_pump.mutex);
+
+    if (NULL != node) {
+        *pQueued = TRUE;
+        __p2p_media_pump_wakeup();
+    }
+    return OPRT_OK;
+}
+
+/***********************************************************
+ *  Function: tuya_p2p_rtc_put_media_frame
+ *  Note:Queue an encoded frame for every viewer of the stream, the frame is copied once and shared by all of them
+ *  Input: pMediaFrame frame, eAudioFrame goes to the audio channel, the others to the video channel
+ *  Output: none
+ *  Return:
+ ***********************************************************/
+OPERATE_RET tuya_p2p_rtc_put_media_frame(IN CONST MEDIA_FRAME *pMediaFrame)
+{
+    BOOL_T queued;
+
+    return __p2p_media_frame_put(pMediaFrame, &queued);
+}
+
+OPERATE_RET tuya_p2p_rtc_get_client_stat(IN INT_T client, OUT TUYA_P2P_CLIENT_STAT_T *pStat)
+{
+    P2P_MEDIA_CLIENT_T *pClient = NULL;
+
+    if (client < 0 || client >= P2P_MEDIA_CLIENT_MAX || NULL == pStat) {
+        return OPRT_INVALID_PARM;
+    }
+    if (NULL == sg_media_pump.mutex) {
+        return OPRT_RESOURCE_NOT_READY;
+    }
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    pClient = &sg_media_pump.client[client];
+    if (NULL == pClient->pSession || pClient->closing) {
+        tal_mutex_unlock(sg_media_pump.mutex);
+        return OPRT_NOT_FOUND;
+    }
+    *pStat = pClient->stat;
+    pStat->queued = pClient->count;
+    pStat->latency_avg_ms = pClient->stat.frames_sent ? (UINT_T)(pClient->latency_sum / pClient->stat.frames_sent) : 0;
+    tal_mutex_unlock(sg_media_pump.mutex);
+
     return OPRT_OK;
 }
 
@@ -904,6 +1212,7 @@ STATIC INT_T __p2p_session_trans_video_start(P2P_SESSION_T *pSession)
     // Wait for previous data transmission to end
     PR_DEBUG("session[%d]video video_start wait_concurr_idle", pSession->session);
     pSession->cmd |= P2P_VIDEO;
+    __p2p_media_pump_wakeup();
     PR_DEBUG("session[%d] video start success", pSession->session);
     return OPRT_OK;
 }
@@ -922,6 +1231,7 @@ STATIC INT_T __p2p_session_trans_video_stop(P2P_SESSION_T *pSession)
         return OPRT_INVALID_PARM;
     }
     pSession->cmd &= ~P2P_VIDEO;
+    __p2p_media_pump_wakeup();
     PR_DEBUG("session[%d] video stop success", pSession->session);
     return OPRT_OK;
 }
@@ -942,6 +1252,7 @@ STATIC INT_T __p2p_session_trans_audio_start(P2P_SESSION_T *pSession)
 
     PR_DEBUG("session[%d] send audio start to dev", pSession->session);
     pSession->cmd |= P2P_AUDIO;
+    __p2p_media_pump_wakeup();
     PR_DEBUG("session:[%d] audio start success", pSession->session);
     return OPRT_OK;
 }
@@ -960,6 +1271,7 @@ STATIC INT_T __p2p_session_trans_audio_stop(P2P_SESSION_T *pSession)
         return OPRT_INVALID_PARM;
     }
     pSession->cmd &= ~P2P_AUDIO;
+    __p2p_media_pump_wakeup();
     PR_DEBUG("session:[%d] audio stop success", pSession->session);
     return OPRT_OK;
 }
@@ -1333,111 +1645,183 @@ STATIC void __p2p_cmd_recv_proc(PVOID_T pArg)
 }
 
 /***********************************************************
- *  Function: __p2p_video_send_proc
- *  Note:Video data transmission thread
- *  Input:
+ *  Function: __p2p_media_frame_send
+ *  Note:Pack one queued frame into RTP and send it to the viewer
+ *  Input: client viewer slot, pMediaFrame frame
  *  Output: none
  *  Return:
  ***********************************************************/
-STATIC void __p2p_media_send_proc(PVOID_T pArg)
+STATIC OPERATE_RET __p2p_media_frame_send(INT_T client, MEDIA_FRAME *pMediaFrame)
 {
-    INT_T index = 0;
-    UINT_T runCnt = 0;
-    P2P_SESSION_T *pSession = NULL;
-    OPERATE_RET op_ret = -1;
+    P2P_MEDIA_SEND_T *pSend = &sg_media_pump.client[client].send;
     TY_AV_CODEC_ID type;
-    type = sg_p2p_session->av_Info.audio_codec;
-    // type = TY_AV_CODEC_AUDIO_PCM;
-
-    PR_DEBUG("into p2p video send");
 
-    while (tal_thread_get_state(sg_p2p_session->video_send_proc_thread) == THREAD_STATE_RUNNING) {
-        if (runCnt % 2000 == 0) {
-            PR_DEBUG("media send proc alive [%d]", runCnt);
+    pSend->pts = (pMediaFrame->pts == 0) ? pMediaFrame->timestamp * 1000 : pMediaFrame->pts;
+    pSend->timestamp = pMediaFrame->timestamp;
+    if (eAudioFrame != pMediaFrame->type) {
+        pSend->key_frame = (eVideoIFrame == pMediaFrame->type) ? TRUE : FALSE;
+        if (TY_AV_CODEC_VIDEO_H265 != pSend->av_Info.video_codec[0]) {
+            return __p2p_pack_h264_rtp_and_send(client, (CHAR_T *)pMediaFrame->data, pMediaFrame->size);
         }
-        runCnt++;
+        return __p2p_pack_h265_rtp_and_send(client, (CHAR_T *)pMediaFrame->data, pMediaFrame->size);
+    }
 
-        if (P2P_SESSION_IDLE == sg_p2p_session->status) {
-            tal_system_sleep(5);
-            continue;
+    type = pSend->av_Info.audio_codec;
+    if (TY_AV_CODEC_AUDIO_G711A == type || TY_AV_CODEC_AUDIO_G711U == type || TY_AV_CODEC_AUDIO_PCM == type) {
+        return __p2p_pack_g711_rtp_and_send(client, (CHAR_T *)pMediaFrame->data, pMediaFrame->size, type);
+    }
+    // TY_AV_CODEC_AUDIO_AAC_ADTS, see __p2p_pack_aac_rtp_and_send
+    return OPRT_NOT_SUPPORTED;
+}
+
+/***********************************************************
+ *  Function: __p2p_media_client_send
+ *  Note:Send the oldest queued frame of the viewer
+ *  Input: client viewer slot
+ *  Output: none
+ *  Return: TRUE a frame was taken from the queue
+ ***********************************************************/
+STATIC BOOL_T __p2p_media_client_send(INT_T client)
+{
+    P2P_MEDIA_CLIENT_T *pClient = &sg_media_pump.client[client];
+    P2P_SESSION_T *pSession = NULL;
+    P2P_MEDIA_NODE_T *node = NULL;
+    OPERATE_RET op_ret;
+    UINT_T latency;
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    if (NULL == pClient->pSession || pClient->closing || 0 == pClient->count) {
+        tal_mutex_unlock(sg_media_pump.mutex);
+        return FALSE;
+    }
+    node = pClient->queue[pClient->head];
+    pClient->head = (pClient->head + 1) % P2P_MEDIA_QUEUE_LEN;
+    pClient->count--;
+    // The session is reset after it is detached, which waits for this lock
+    pSession = pClient->pSession;
+    pClient->send.session = pSession->session;
+    pClient->send.cmd = pSession->cmd;
+    pClient->send.video_req_id = pSession->video_req_id;
+    pClient->send.audio_req_id = pSession->audio_req_id;
+    pClient->send.cur_clarity = pSession->cur_clarity;
+    pClient->send.av_Info = pSession->av_Info;
+    pClient->send.lost = FALSE;
+    tal_mutex_unlock(sg_media_pump.mutex);
+
+    // The slot stays valid while sending, only this thread frees it
+    op_ret = __p2p_media_frame_send(client, &node->frame);
+    latency = (UINT_T)(tal_system_get_millisecond() - node->put_time);
+
+    tal_mutex_lock(sg_media_pump.mutex);
+    if (pClient->send.lost) {
+        // Nothing gets through any more, release the slot instead of queuing for a dead viewer
+        PR_ERR("media client %d session %d lost, dropped", client, pClient->send.session);
+        pClient->closing = TRUE;
+        pClient->stat.frames_dropped++;
+    } else if (OPRT_OK == op_ret) {
+        pClient->stat.frames_sent++;
+        pClient->latency_sum += latency;
+        if (latency > pClient->stat.latency_max_ms) {
+            pClient->stat.latency_max_ms = latency;
+        }
+        if (pClient->stat.frames_sent % P2P_MEDIA_STAT_LOG == 0) {
+            PR_DEBUG("media client %d sent %u dropped %u queued %u latency avg %u max %u ms", client,
+                     pClient->stat.frames_sent, pClient->stat.frames_dropped, pClient->count,
+                     (UINT_T)(pClient->latency_sum / pClient->stat.frames_sent), pClient->stat.latency_max_ms);
         }
+    } else {
+        // Send buffer full or bad frame, the queued P frames refer to it and the viewer needs a new I frame
+        pClient->stat.frames_dropped++;
+        if (eAudioFrame != node->frame.type) {
+            __p2p_media_client_purge_video(pClient);
+        }
+    }
+    __p2p_media_node_unref(node);
+    tal_mutex_unlock(sg_media_pump.mutex);
 
-        pSession = sg_p2p_session;
-        tal_mutex_lock(pSession->cmutex);
-        INT_T status = pSession->status;
-        P2P_CMD_E cmd = pSession->cmd;
+    return TRUE;
+}
 
-        if (P2P_SESSION_CLOSING == pSession->status) {
-            tal_mutex_unlock(pSession->cmutex);
-            tal_system_sleep(5);
-            continue;
+/***********************************************************
+ *  Function: __p2p_media_pull
+ *  Note:Get a frame from a registered get frame callback and put it to the viewers
+ *  Input: cb get frame callback, pMediaFrame frame buffer, size buffer size, want P2P_VIDEO/P2P_AUDIO
+ *  Output: none
+ *  Return: TRUE the callback gave a frame that was queued to a viewer
+ ***********************************************************/
+STATIC BOOL_T __p2p_media_pull(tuya_p2p_rtc_get_frame_cb_t cb, MEDIA_FRAME *pMediaFrame, UINT_T size,
+                               P2P_CMD_E want)
+{
+    BOOL_T queued = FALSE;
+
+    if (NULL == pMediaFrame->data) {
+        return FALSE;
+    }
+    pMediaFrame->size = size;
+    if (OPRT_OK != cb(pMediaFrame)) {
+        return FALSE;
+    }
+    // Audio callbacks do not have to fill in the type
+    if (P2P_AUDIO == want) {
+        pMediaFrame->type = eAudioFrame;
+    }
+    // A callback that returns OK without a new frame must not keep the thread from waiting
+    if (OPRT_OK != __p2p_media_frame_put(pMediaFrame, &queued)) {
+        return FALSE;
+    }
+    return queued;
+}
+
+/***********************************************************
+ *  Function: __p2p_media_send_proc
+ *  Note:Media data transmission thread, sleeps on the pump semaphore until a frame is put or the stream state
+ *       changes, then drains the viewer queues one frame per viewer in turn
+ *  Input:
+ *  Output: none
+ *  Return:
+ ***********************************************************/
+STATIC void __p2p_media_send_proc(PVOID_T pArg)
+{
+    tuya_p2p_rtc_get_frame_cb_t video_cb = NULL;
+    tuya_p2p_rtc_get_frame_cb_t audio_cb = NULL;
+    P2P_CMD_E want;
+    BOOL_T busy;
+    INT_T i;
+
+    PR_DEBUG("into p2p media send");
+
+    while (tal_thread_get_state(sg_p2p_session->video_send_proc_thread) == THREAD_STATE_RUNNING) {
+        __p2p_media_client_reap();
+
+        want = __p2p_media_wanted();
+        video_cb = (P2P_VIDEO & want) ? sg_p2p_session->on_get_video_frame_callback : NULL;
+        audio_cb = (P2P_AUDIO & want) ? sg_p2p_session->on_get_audio_frame_callback : NULL;
+
+        // Frame sources registered as callbacks can not post, ask them here
+        busy = FALSE;
+        if (NULL != video_cb) {
+            busy |= __p2p_media_pull(video_cb, &sg_p2p_session->media_frame, P2P_MEDIA_VIDEO_BUF_SIZE, P2P_VIDEO);
         }
-        if (P2P_SESSION_RUNNING != status) {
-            tal_mutex_unlock(pSession->cmutex);
-            continue;
+        if (NULL != audio_cb) {
+            busy |= __p2p_media_pull(audio_cb, &sg_p2p_session->media_audio_frame, P2P_MEDIA_AUDIO_BUF_SIZE,
+                                     P2P_AUDIO);
         }
 
-        // The judgment when both are not opened should be placed at the end, otherwise it will appear: users close
-        // audio and video at the same time, but do not release resources This judgment cannot be omitted, otherwise
-        // thread idle running will occur
-        if (!(P2P_VIDEO & cmd) && !(P2P_AUDIO & cmd)) {
-            // pSession->p2p_buff_stat.live_video = P2P_BUFF_IDLE;
-            // pSession->p2p_buff_stat.live_audio = P2P_BUFF_IDLE;
-            tal_mutex_unlock(pSession->cmutex);
-            tal_system_sleep(5);
+        for (i = 0; i < P2P_MEDIA_CLIENT_MAX; i++) {
+            busy |= __p2p_media_client_send(i);
+        }
+        if (busy) {
             continue;
         }
-        tal_mutex_unlock(pSession->cmutex);
 
-        if (P2P_VIDEO & cmd) {
-            if (sg_p2p_session->on_get_video_frame_callback == NULL) {
-                tal_system_sleep(10);
-                continue;
-            }
-            MEDIA_FRAME *pMediaFrame = &sg_p2p_session->media_frame;
-            op_ret = sg_p2p_session->on_get_video_frame_callback(pMediaFrame); // OnGetVideoFrameCallback(pMediaFrame)
-            if (op_ret == OPRT_OK) {
-                pSession->v_pts = (pMediaFrame->pts == 0) ? pMediaFrame->timestamp * 1000 : pMediaFrame->pts;
-                pSession->v_timestamp = pMediaFrame->timestamp;
-                if (eVideoIFrame == pMediaFrame->type) {
-                    pSession->key_frame = TRUE;
-                } else {
-                    pSession->key_frame = FALSE;
-                }
-                if (TY_AV_CODEC_VIDEO_H265 != sg_p2p_session->av_Info.video_codec[0]) {
-                    op_ret = __p2p_pack_h264_rtp_and_send(index, (CHAR_T *)pMediaFrame->data, pMediaFrame->size);
-                } else {
-                    op_ret = __p2p_pack_h265_rtp_and_send(index, (CHAR_T *)pMediaFrame->data, pMediaFrame->size);
-                }
-            } else {
-                // Buffer has no data yet
-                tal_system_sleep(10);
-            }
-        }
-        if (P2P_AUDIO & cmd) {
-            if (sg_p2p_session->on_get_audio_frame_callback == NULL) {
-                tal_system_sleep(10);
-                continue;
-            }
-            MEDIA_FRAME *pMediaFrame = &sg_p2p_session->media_audio_frame;
-            op_ret = sg_p2p_session->on_get_audio_frame_callback(pMediaFrame); // OnGetAudioFrameCallback(pMediaFrame)
-            if (op_ret == OPRT_OK) {
-                pSession->a_pts = (pMediaFrame->pts == 0) ? pMediaFrame->timestamp * 1000 : pMediaFrame->pts;
-                pSession->a_timestamp = pMediaFrame->timestamp;
-                if (TY_AV_CODEC_AUDIO_AAC_ADTS == type) {
-                    // op_ret = __p2p_pack_aac_rtp_and_send((CHAR_T *)node_a.data, node_a.size,index);
-                } else if (TY_AV_CODEC_AUDIO_G711A == type || TY_AV_CODEC_AUDIO_G711U == type ||
-                           TY_AV_CODEC_AUDIO_PCM == type) {
-                    op_ret = __p2p_pack_g711_rtp_and_send(index, (CHAR_T *)pMediaFrame->data, pMediaFrame->size, type);
-                }
-            } else {
-                // Buffer has no data yet
-                tal_system_sleep(10);
-            }
+        if (NULL != video_cb || NULL != audio_cb) {
+            tal_semaphore_wait(sg_media_pump.sem, P2P_MEDIA_PULL_WAIT);
+        } else {
+            tal_semaphore_wait_forever(sg_media_pump.sem);
         }
     } // while
 
-    PR_ERR("video send task exit");
+    PR_ERR("media send task exit");
     return;
 }
 
@@ -1472,6 +1856,7 @@ INT_T __p2p_session_all_stop(P2P_SESSION_T *pSession)
         pSession->cmd &= ~P2P_PB_VIDEO;
     }
     tal_mutex_unlock(pSession->cmutex);
+    __p2p_media_pump_wakeup();
     return OPRT_OK;
 }
 
@@ -1479,28 +1864,14 @@ INT_T __p2p_session_release_va(P2P_SESSION_T *pSession)
 {
     // All functions closed
     PR_DEBUG("release va session[%d]", pSession->session);
+    p2p_media_client_detach(pSession);
     tal_mutex_lock(pSession->cmutex);
-    if (pSession->p_video_rtp_buff) {
-        Free(pSession->p_video_rtp_buff);
-        pSession->p_video_rtp_buff = NULL;
-    }
-    if (pSession->p_audio_rtp_buff) {
-        Free(pSession->p_audio_rtp_buff);
-        pSession->p_audio_rtp_buff = NULL;
-    }
     // memset(&pSession->session, 0x00, sizeof(P2P_SESSION_T) - OFFSET(P2P_SESSION_T, session));//Clear variables
     // outside the lock memset(&pSession->str_P2p_auth, 0, sizeof(pSession->str_P2p_auth));
     pSession->cur_clarity = TY_VIDEO_CLARITY_INNER_HIGH;
     pSession->status = P2P_SESSION_IDLE;
     pSession->cmd = P2P_IDLE;
     memset(&pSession->pb_resp_head, 0, sizeof(pSession->pb_resp_head));
-    pSession->video_seq_num = 0;
-    pSession->audio_seq_num = 0;
-    pSession->key_frame = false;
-    pSession->v_pts = 0;
-    pSession->v_timestamp = 0;
-    pSession->a_pts = 0;
-    pSession->a_timestamp = 0;
     pSession->video_req_id = 0;
     pSession->audio_req_id = 0;
     // if (pSession->media_frame.data != NULL) {
@@ -1540,6 +1911,18 @@ OPERATE_RET p2p_init(IN CONST TUYA_IPC_P2P_VAR_T *p_var)
 
     sg_p2p_session->cur_clarity = TY_VIDEO_CLARITY_INNER_HIGH;
 
+    memset(&sg_media_pump, 0, sizeof(sg_media_pump));
+    ret = tal_mutex_create_init(&sg_media_pump.mutex);
+    if (ret != OPRT_OK) {
+        PR_ERR("create media pump mutex failed");
+        goto RET;
+    }
+    ret = tal_semaphore_create_init(&sg_media_pump.sem, 0, 1);
+    if (ret != OPRT_OK) {
+        PR_ERR("create media pump sem failed");
+        goto RET;
+    }
+
     // Start media-related threads
     THREAD_CFG_T thrd_param = {STACK_SIZE_P2P_MEDIA_RECV, THREAD_PRIO_2, NULL};
     thrd_param.stackDepth = STACK_SIZE_P2P_CMD_RECV;
@@ -1560,7 +1943,7 @@ OPERATE_RET p2p_init(IN CONST TUYA_IPC_P2P_VAR_T *p_var)
     }
 
     // Initialize
-    int bufSize = 300 * 1024; // MAX_MEDIA_FRAME_SIZE
+    int bufSize = P2P_MEDIA_VIDEO_BUF_SIZE; // MAX_MEDIA_FRAME_SIZE
     // memset(&sg_p2p_session->tal_video_frame, 0, sizeof(sg_p2p_session->tal_video_frame));
     // sg_p2p_session->tal_video_frame.pbuf = (char*)malloc(bufSize);
     // sg_p2p_session->tal_video_frame.buf_size = bufSize;
@@ -1569,7 +1952,7 @@ OPERATE_RET p2p_init(IN CONST TUYA_IPC_P2P_VAR_T *p_var)
     sg_p2p_session->media_frame.data = (UCHAR_T *)malloc(bufSize);
     sg_p2p_session->media_frame.size = bufSize;
 
-    bufSize = 1280;
+    bufSize = P2P_MEDIA_AUDIO_BUF_SIZE;
     // memset(&sg_p2p_session->tal_audio_frame, 0, sizeof(sg_p2p_session->tal_audio_frame));
     // sg_p2p_session->tal_audio_frame.pbuf = (char*)malloc(bufSize);
     // sg_p2p_session->tal_audio_frame.buf_size = bufSize;
@@ -1586,12 +1969,6 @@ OPERATE_RET p2p_init(IN CONST TUYA_IPC_P2P_VAR_T *p_var)
     return OPRT_OK;
 
 RET:
-    if (NULL != sg_p2p_session->p_video_rtp_buff) {
-        p2p_release_video_send_resource(sg_p2p_session);
-    }
-    if (NULL != sg_p2p_session->p_audio_rtp_buff) {
-        p2p_release_audio_send_resource(sg_p2p_session);
-    }
     __p2p_thread_exit(sg_p2p_session->cmd_recv_proc_thread);
     return ret;
 }
@@ -1710,14 +2087,24 @@ void rtp_free(void *param, void *packet)
 
 int rtp_pack_packet_handler(void *param, const void *packet, int bytes, uint32_t timestamp, int flags)
 {
-    //return 0;
-    CHAR_T *buf = (CHAR_T *)packet;
-    INT_T len = bytes;
+    return rtp_pack_packetv_handler(param, packet, bytes, NULL, 0, timestamp, flags);
+}
+
+int rtp_pack_packetv_handler(void *param, const void *header, int hdrlen, const void *payload, int bytes,
+                             uint32_t timestamp, int flags)
+{
     RTP_PACK_NAL_ARG_T *nal_arg = (RTP_PACK_NAL_ARG_T *)param;
-    memcpy(nal_arg->p_rtp_buff, nal_arg->ext_head_buff, nal_arg->fix_len);
-    *(INT_T *)&nal_arg->p_rtp_buff[nal_arg->fix_len - 4] = len;
-    memcpy(nal_arg->p_rtp_buff + nal_arg->fix_len, buf, len);
-    return p2p_send_rtp_data(nal_arg->client, nal_arg->channel, nal_arg->p_rtp_buff, len + nal_arg->fix_len);
+    tuya_p2p_rtc_iov_t iov[3];
+
+    // Ext header, RTP header and the payload, which stays in the frame buffer
+    *(INT_T *)&nal_arg->ext_head_buff[nal_arg->fix_len - 4] = hdrlen + bytes;
+    iov[0].base = nal_arg->ext_head_buff;
+    iov[0].len = nal_arg->fix_len;
+    iov[1].base = header;
+    iov[1].len = hdrlen;
+    iov[2].base = payload;
+    iov[2].len = bytes;
+    return __p2p_send_rtp_datav(nal_arg->client, nal_arg->channel, iov, (bytes > 0) ? 3 : 2);
 }
 
 ////////////////////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,265 @@
+#!/usr/bin/env python3
+"""
+Binary log decoder
+Rebuilds the text of tal_log binary records (PR_BIN_xxx, or PR_xxx built with
+ENABLE_LOG_BINARY) from the ELF of the firmware that wrote them.
+
+Support modes:
+- Text mode (default): read a serial capture, lines carrying "!B:<base64>" are
+  decoded, all other lines are printed unchanged
+- Raw mode (--raw): read concatenated binary records, as stored by an output
+  set with tal_log_bin_output_set, e.g. a flash dump
+
+Usage:
+    python3 tools/log_decode.py -e app.elf uart.log
+    python3 tools/log_decode.py -e app.elf --raw log_dump.bin
+"""
+
+import sys
+import re
+import struct
+import base64
+import argparse
+
+SITE_BASE_SYMBOL = "tal_log_site_base"
+SITE_MAGIC = 0x54534c47
+BIN_MAGIC = 0xB1
+BIN_TRUNC = 0x80
+BIN_HDR_LEN = 12
+BIN_LINE_HEAD = "!B:"
+LEVEL_STR = ["E", "W", "N", "I", "D", "T"]
+
+# flags width .precision length conversion
+CONV_RE = re.compile(r"%([-+ #0]*)(\*|\d+)?(?:\.(\*|\d*))?(hh|h|ll|l|q|j|z|t|L)?([diouxXcpeEfFgGaAsn%])?")
+
+
+class ElfImage:
+    """Minimal ELF reader, symbols and the content of allocated sections"""
+
+    def __init__(self, path):
+        with open(path, "rb") as f:
+            self.data = f.read()
+        if self.data[:4] != b"\x7fELF":
+            raise ValueError("%s is not an ELF file" % path)
+        self.is64 = self.data[4] == 2
+        self.endian = "<" if self.data[5] == 1 else ">"
+        self.ptr_size = 8 if self.is64 else 4
+        self.sections = []
+        self.symbols = {}
+        self._parse_sections()
+
+    def _unpack(self, fmt, offset):
+        return struct.unpack_from(self.endian + fmt, self.data, offset)
+
+    def _parse_sections(self):
+        if self.is64:
+            shoff, = self._unpack("Q", 0x28)
+            shentsize, shnum = self._unpack("HH", 0x3A)
+            shfmt = "IIQQQQIIQQ"
+        else:
+            shoff, = self._unpack("I", 0x20)
+            shentsize, shnum = self._unpack("HH", 0x2E)
+            shfmt = "IIIIIIIIII"
+
+        headers = [self._unpack(shfmt, shoff + i * shentsize) for i in range(shnum)]
+        for sh in headers:
+            _, sh_type, sh_flags, sh_addr, sh_offset, sh_size, sh_link, _, _, sh_entsize = sh
+            # SHF_ALLOC and not SHT_NOBITS
+            if (sh_flags & 0x2) and sh_type != 8 and sh_addr:
+                self.sections.append((sh_addr, sh_size, sh_offset))
+            # SHT_SYMTAB
+            if sh_type == 2:
+                self._parse_symbols(sh_offset, sh_size, sh_entsize, headers[sh_link][4])
+
+    def _parse_symbols(self, offset, size, entsize, stroff):
+        for pos in range(offset, offset + size, entsize):
+            if self.is64:
+                name, _, _, _, value, _ = self._unpack("IBBHQQ", pos)
+            else:
+                name, value, _, _, _, _ = self._unpack("IIIBBH", pos)
+            if name:
+                self.symbols[self._cstr_at(stroff + name)] = value
+
+    def _cstr_at(self, offset):
+        end = self.data.index(b"\x00", offset)
+        return self.data[offset:end].decode("utf-8", "replace")
+
+    def offset_of(self, addr):
+        for sh_addr, sh_size, sh_offset in self.sections:
+            if sh_addr <= addr < sh_addr + sh_size:
+                return sh_offset + addr - sh_addr
+        raise KeyError("address 0x%x is not in the image" % addr)
+
+    def read(self, addr, fmt):
+        return self._unpack(fmt, self.offset_of(addr))
+
+    def read_str(self, addr):
+        return self._cstr_at(self.offset_of(addr))
+
+
+class LogDecoder:
+    def __init__(self, elf):
+        self.elf = elf
+        self.sites = {}
+        if SITE_BASE_SYMBOL not in elf.symbols:
+            raise ValueError("symbol %s not found, is the ELF stripped?" % SITE_BASE_SYMBOL)
+        self.base = elf.symbols[SITE_BASE_SYMBOL]
+
+    def site(self, offset):
+        """file, line and fmt of the log site at offset to tal_log_site_base"""
+        if offset not in self.sites:
+            ptr = "Q" if self.elf.is64 else "I"
+            magic, line, file_ptr, fmt_ptr = self.elf.read(self.base + offset, "II" + ptr + ptr)
+            if magic != SITE_MAGIC:
+                raise KeyError("no log site at offset %d" % offset)
+            self.sites[offset] = (self.elf.read_str(file_ptr), line, self.elf.read_str(fmt_ptr))
+        return self.sites[offset]
+
+    def _int_fmt(self, length, signed):
+        e = self.elf
+        if length in ("ll", "q", "j"):
+            size = 8
+        elif length == "l":
+            size = e.ptr_size
+        elif length in ("z", "t"):
+            size = e.ptr_size
+        else:
+            size = 4
+        code = {4: "i", 8: "q"}[size]
+        return code if signed else code.upper()
+
+    def format(self, fmt, args):
+        """walk fmt the same way as __log_bin_args_encode and format each conversion"""
+        out = []
+        pos = 0
+        last = 0
+        truncated = False
+        endian = self.elf.endian
+
+        def take(code):
+            nonlocal pos
+            size = struct.calcsize(code)
+            if pos + size > len(args):
+                raise IndexError
+            val, = struct.unpack_from(endian + code, args, pos)
+            pos += size
+            return val
+
+        for m in CONV_RE.finditer(fmt):
+            out.append(fmt[last:m.start()])
+            last = m.end()
+            flags, width, prec, length, conv = m.groups()
+            if conv == "%":
+                out.append("%")
+                continue
+            if conv is None:
+                out.append(m.group(0))
+                break
+            try:
+                if width == "*":
+                    width = str(take("i"))
+                if prec == "*":
+                    prec = take("i")
+                    prec = str(prec) if prec >= 0 else None
+                spec = "%" + flags + (width or "") + ("." + prec if prec is not None else "")
+                if conv in "di":
+                    out.append((spec + "d") % take(self._int_fmt(length, True)))
+                elif conv in "ouxX":
+                    out.append((spec + conv.replace("u", "d")) % take(self._int_fmt(length, False)))
+                elif conv == "c":
+                    out.append((spec + "c") % chr(take("i") & 0xFF))
+                elif conv == "p":
+                    out.append((spec + "s") % ("0x%x" % take("Q" if self.elf.is64 else "I")))
+                elif conv in "eEfFgGaA":
+                    val = take("d")
+                    out.append((spec + conv) % val if conv not in "aA" else float.hex(val))
+                elif conv == "s":
+                    if pos >= len(args):
+                        raise IndexError
+                    n = args[pos]
+                    if pos + 1 + n > len(args):
+                        raise IndexError
+                    out.append((spec + "s") % args[pos + 1:pos + 1 + n].decode("utf-8", "replace"))
+                    pos += 1 + n
+            except IndexError:
+                truncated = True
+                out.append("<?>")
+        out.append(fmt[last:])
+        return "".join(out), truncated
+
+    def decode(self, rec):
+        """text of one record, rec starts with the record header"""
+        magic, level, length, time_ms, offset = struct.unpack_from(self.elf.endian + "BBHIi", rec, 0)
+        if magic != BIN_MAGIC or length < BIN_HDR_LEN or length > len(rec):
+            raise ValueError("bad record")
+        trunc = bool(level & BIN_TRUNC)
+        level &= ~BIN_TRUNC
+        file, line, fmt = self.site(offset)
+        text, short = self.format(fmt, rec[BIN_HDR_LEN:length])
+        if trunc or short:
+            text += " <truncated>"
+        file = re.split(r"[\\/]", file)[-1]
+        level_str = LEVEL_STR[level] if level < len(LEVEL_STR) else str(level)
+        return "[%u.%03u ty %s][%s:%u] %s" % (time_ms // 1000, time_ms % 1000, level_str, file, line, text.rstrip("\r\n"))
+
+
+def decode_text(decoder, stream, out):
+    for raw_line in stream:
+        line = raw_line.decode("utf-8", "replace").rstrip("\r\n")
+        idx = line.find(BIN_LINE_HEAD)
+        if idx < 0:
+            out.write(line + "\n")
+            continue
+        payload = line[idx + len(BIN_LINE_HEAD):].strip()
+        try:
+            text = decoder.decode(base64.b64decode(payload))
+        except Exception as e:
+            text = "<undecodable record: %s> %s" % (e, payload)
+        out.write(line[:idx] + text + "\n")
+
+
+def decode_raw(decoder, data, out):
+    pos = 0
+    while pos + BIN_HDR_LEN <= len(data):
+        if data[pos] != BIN_MAGIC:
+            # resync after garbage or an erased flash area
+            pos += 1
+            continue
+        length, = struct.unpack_from(decoder.elf.endian + "H", data, pos + 2)
+        if length < BIN_HDR_LEN:
+            pos += 1
+            continue
+        try:
+            out.write(decoder.decode(data[pos:pos + length]) + "\n")
+            pos += length
+        except (ValueError, KeyError, struct.error):
+            pos += 1
+
+
+def main():
+    parser = argparse.ArgumentParser(description="Decode tal_log binary records")
+    parser.add_argument("-e", "--elf", required=True, help="ELF of the firmware that wrote the log")
+    parser.add_argument("--raw", action="store_true", help="input is concatenated binary records")
+    parser.add_argument("input", nargs="?", help="log file, stdin if omitted")
+    args = parser.parse_args()
+
+    try:
+        decoder = LogDecoder(ElfImage(args.elf))
+    except (OSError, ValueError) as e:
+        print("Error: %s" % e, file=sys.stderr)
+        return 1
+
+    stream = open(args.input, "rb") if args.input else sys.stdin.buffer
+    try:
+        if args.raw:
+            decode_raw(decoder, stream.read(), sys.stdout)
+        else:
+            decode_text(decoder, stream, sys.stdout)
+    finally:
+        if args.input:
+            stream.close()
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -32,6 +32,20 @@ typedef BOOL_T (*TRAVERSE_CB)(void *item, void *ctx);
  */
 OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle);
 
+/**
+ * @brief create and initialize a lock-free single-producer/single-consumer queue (FIFO)
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[out] handle the queue handle
+ *
+ * @note tuya_queue_input may be called from one producer (task or ISR) while one
+ * consumer dequeues, neither takes a lock. tuya_queue_input_instant is not supported.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_spsc(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle);
+
 /**
  * @brief enqueue, append to the tail
  *
@@ -104,6 +118,22 @@ OPERATE_RET tuya_queue_clear(TUYA_QUEUE_HANDLE handle);
  */
 OPERATE_RET tuya_queue_get_batch(TUYA_QUEUE_HANDLE handle, const uint32_t start, void *items, const uint32_t num);
 
+/**
+ * @brief get items in place from start postion, not dequeue
+ *
+ * @param[in] handle the queue handle
+ * @param[in] start the start postion
+ * @param[out] items pointer to the first item inside the queue
+ * @param[inout] num in: the max item counts, out: the item counts stored
+ * contiguously at items
+ *
+ * @note the items are not copied, they stay valid until removed by
+ * tuya_queue_delete_batch or tuya_queue_output. Only the consumer may call it.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_get_batch_ref(TUYA_QUEUE_HANDLE handle, const uint32_t start, void **items, uint32_t *num);
+
 /**
  * @brief delete the item from the queue position
  *
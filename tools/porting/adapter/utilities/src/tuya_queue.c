@@ -11,7 +11,6 @@
 #include "tkl_system.h"
 #include "tkl_memory.h"
 
-#include "tuya_list.h"
 #include "tuya_queue.h"
 
 #if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS == OPERATING_SYSTEM)
@@ -28,13 +27,16 @@
 #define QUEUE_UNLOCK(queue)       tkl_mutex_unlock(queue->mutex)
 #endif
 
-typedef enum { POLICY_SEND_TO_BACK, POLICY_SEND_TO_FRONT, POLICY_MAX } ENQUEUE_POLICY_E;
+// lock-free ring publishes the slot before moving the index
+#define QUEUE_MEMORY_BARRIER() __sync_synchronize()
 
-typedef struct {
-    LIST_HEAD node;
-    uint8_t data[];
-} QUEUE_ITEM_T;
+typedef enum { POLICY_SEND_TO_BACK, POLICY_SEND_TO_FRONT, POLICY_MAX } ENQUEUE_POLICY_E;
 
+/**
+ * @brief fixed-slot ring, one slot is kept empty so that head == tail means
+ * empty without a shared counter. head is owned by the consumer and tail by
+ * the producer, which makes the single-producer/single-consumer mode lock-free.
+ */
 typedef struct {
 #if defined(OPERATING_SYSTEM) && (SYSTEM_NON_OS != OPERATING_SYSTEM)
     TKL_MUTEX_HANDLE mutex;
@@ -42,11 +44,52 @@ typedef struct {
 
     uint32_t item_size;
     uint32_t queue_len;
-    uint32_t queue_free;
+    uint32_t slot_num;
+    BOOL_T spsc;
 
-    LIST_HEAD head;
+    volatile uint32_t head;
+    volatile uint32_t tail;
+    uint8_t *slots;
 } TUYA_QUEUE_T;
 
+#define QUEUE_SLOT(queue, index) ((queue)->slots + (index) * (queue)->item_size)
+#define QUEUE_USED(queue, head, tail)                                                                                  \
+    (((tail) + (queue)->slot_num - (head)) % (queue)->slot_num)
+
+static OPERATE_RET __spsc_enqueue(TUYA_QUEUE_T *queue, const void *item)
+{
+    uint32_t tail = queue->tail;
+    uint32_t next = (tail + 1) % queue->slot_num;
+
+    if (next == queue->head) {
+        return OPRT_EXCEED_UPPER_LIMIT;
+    }
+
+    memcpy(QUEUE_SLOT(queue, tail), item, queue->item_size);
+    QUEUE_MEMORY_BARRIER();
+    queue->tail = next;
+
+    return OPRT_OK;
+}
+
+static OPERATE_RET __spsc_dequeue(TUYA_QUEUE_T *queue, const void *item)
+{
+    uint32_t head = queue->head;
+
+    if (head == queue->tail) {
+        return OPRT_NOT_FOUND;
+    }
+
+    QUEUE_MEMORY_BARRIER();
+    if (item) {
+        memcpy((void *)item, QUEUE_SLOT(queue, head), queue->item_size);
+    }
+    QUEUE_MEMORY_BARRIER();
+    queue->head = (head + 1) % queue->slot_num;
+
+    return OPRT_OK;
+}
+
 static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE_POLICY_E policy)
 {
     OPERATE_RET op_ret = OPRT_OK;
@@ -57,24 +100,23 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
-    QUEUE_ITEM_T *queue_item = (QUEUE_ITEM_T *)tkl_system_malloc(sizeof(QUEUE_ITEM_T) + queue->item_size);
-    if (NULL == queue_item) {
-        return OPRT_MALLOC_FAILED;
+    if (queue->spsc) {
+        if (POLICY_SEND_TO_BACK != policy) {
+            return OPRT_NOT_SUPPORTED;
+        }
+        return __spsc_enqueue(queue, item);
     }
 
-    INIT_LIST_HEAD(&(queue_item->node));
-    memcpy(queue_item->data, (void *)item, queue->item_size);
-
     QUEUE_LOCK(queue);
-    if (queue->queue_free > 0) {
+    if (QUEUE_USED(queue, queue->head, queue->tail) < queue->queue_len) {
         if (POLICY_SEND_TO_BACK == policy) {
-            tuya_list_add_tail(&(queue_item->node), &(queue->head));
+            memcpy(QUEUE_SLOT(queue, queue->tail), item, queue->item_size);
+            queue->tail = (queue->tail + 1) % queue->slot_num;
         } else if (POLICY_SEND_TO_FRONT == policy) {
-            tuya_list_add(&(queue_item->node), &(queue->head));
+            queue->head = (queue->head + queue->slot_num - 1) % queue->slot_num;
+            memcpy(QUEUE_SLOT(queue, queue->head), item, queue->item_size);
         }
-        queue->queue_free--;
     } else {
-        tkl_system_free(queue_item);
         op_ret = OPRT_EXCEED_UPPER_LIMIT;
     }
     QUEUE_UNLOCK(queue);
@@ -82,18 +124,8 @@ static OPERATE_RET __enqueue(TUYA_QUEUE_HANDLE handle, const void *item, ENQUEUE
     return op_ret;
 }
 
-/**
- * @brief create and initialize a queue (FIFO)
- *
- * @param[in] queue_len the maximum number of items that the queue can contain.
- * @param[in] item_size the number of bytes each item in the queue will require.
- * @param[out] handle the queue handle
- *
- * @note items are queued by copy, not by reference. Each item on the queue must be the same size.
- *
- * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
- */
-OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle)
+static OPERATE_RET __queue_create(const uint32_t queue_len, const uint32_t item_size, BOOL_T spsc,
+                                  TUYA_QUEUE_HANDLE *handle)
 {
     OPERATE_RET op_ret = OPRT_OK;
     TUYA_QUEUE_T *queue = NULL;
@@ -102,7 +134,8 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
         return OPRT_INVALID_PARM;
     }
 
-    queue = (TUYA_QUEUE_T *)tkl_system_malloc(sizeof(TUYA_QUEUE_T));
+    // all slots are allocated here, enqueue and dequeue never touch the heap
+    queue = (TUYA_QUEUE_T *)tkl_system_malloc(sizeof(TUYA_QUEUE_T) + (queue_len + 1) * item_size);
     if (!queue) {
         return OPRT_MALLOC_FAILED;
     }
@@ -115,14 +148,50 @@ OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size
 
     queue->item_size = item_size;
     queue->queue_len = queue_len;
-    queue->queue_free = queue_len;
-    INIT_LIST_HEAD(&(queue->head));
+    queue->slot_num = queue_len + 1;
+    queue->spsc = spsc;
+    queue->head = 0;
+    queue->tail = 0;
+    queue->slots = (uint8_t *)(queue + 1);
 
     *handle = (TUYA_QUEUE_HANDLE)queue;
 
     return OPRT_OK;
 }
 
+/**
+ * @brief create and initialize a queue (FIFO)
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[out] handle the queue handle
+ *
+ * @note items are queued by copy, not by reference. Each item on the queue must be the same size.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle)
+{
+    return __queue_create(queue_len, item_size, FALSE, handle);
+}
+
+/**
+ * @brief create and initialize a lock-free single-producer/single-consumer queue (FIFO)
+ *
+ * @param[in] queue_len the maximum number of items that the queue can contain.
+ * @param[in] item_size the number of bytes each item in the queue will require.
+ * @param[out] handle the queue handle
+ *
+ * @note tuya_queue_input may be called from one producer (task or ISR) while one
+ * consumer dequeues, neither takes a lock. tuya_queue_input_instant is not supported.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_create_spsc(const uint32_t queue_len, const uint32_t item_size, TUYA_QUEUE_HANDLE *handle)
+{
+    return __queue_create(queue_len, item_size, TRUE, handle);
+}
+
 /**
  * @brief enqueue
  *
@@ -167,15 +236,16 @@ OPERATE_RET tuya_queue_output(TUYA_QUEUE_HANDLE handle, const void *item)
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
+    if (queue->spsc) {
+        return __spsc_dequeue(queue, item);
+    }
+
     QUEUE_LOCK(queue);
-    if (queue->queue_free < queue->queue_len) {
-        QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
+    if (queue->head != queue->tail) {
         if (item) {
-            memcpy((void *)item, queue_item->data, queue->item_size);
+            memcpy((void *)item, QUEUE_SLOT(queue, queue->head), queue->item_size);
         }
-        tuya_list_del(&(queue_item->node));
-        tkl_system_free(queue_item);
-        queue->queue_free++;
+        queue->head = (queue->head + 1) % queue->slot_num;
     } else {
         op_ret = OPRT_NOT_FOUND;
     }
@@ -203,9 +273,9 @@ OPERATE_RET tuya_queue_peek(TUYA_QUEUE_HANDLE handle, const void *item)
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
     QUEUE_LOCK(queue);
-    if (queue->queue_free < queue->queue_len) {
-        QUEUE_ITEM_T *queue_item = tuya_list_entry(queue->head.next, QUEUE_ITEM_T, node);
-        memcpy((void *)item, queue_item->data, queue->item_size);
+    if (queue->head != queue->tail) {
+        QUEUE_MEMORY_BARRIER();
+        memcpy((void *)item, QUEUE_SLOT(queue, queue->head), queue->item_size);
     } else {
         op_ret = OPRT_NOT_FOUND;
     }
@@ -228,14 +298,14 @@ OPERATE_RET tuya_queue_traverse(TUYA_QUEUE_HANDLE handle, TRAVERSE_CB cb, void *
     }
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
-    struct tuya_list_head *p = NULL;
-    QUEUE_ITEM_T *queue_item = NULL;
+    uint32_t index = 0;
+    uint32_t tail = 0;
 
     QUEUE_LOCK(queue);
-    tuya_list_for_each(p, &(queue->head))
-    {
-        queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
-        if (!cb(queue_item->data, ctx)) {
+    tail = queue->tail;
+    QUEUE_MEMORY_BARRIER();
+    for (index = queue->head; index != tail; index = (index + 1) % queue->slot_num) {
+        if (!cb(QUEUE_SLOT(queue, index), ctx)) {
             break;
         }
     }
@@ -258,18 +328,9 @@ OPERATE_RET tuya_queue_clear(TUYA_QUEUE_HANDLE handle)
     }
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
-    struct tuya_list_head *p = NULL;
-    struct tuya_list_head *n = NULL;
-    QUEUE_ITEM_T *queue_item = NULL;
 
     QUEUE_LOCK(queue);
-    tuya_list_for_each_safe(p, n, &(queue->head))
-    {
-        queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
-        tuya_list_del(&queue_item->node);
-        tkl_system_free(queue_item);
-    }
-    queue->queue_free = queue->queue_len;
+    queue->head = queue->tail;
     QUEUE_UNLOCK(queue);
 
     return OPRT_OK;
@@ -292,34 +353,73 @@ OPERATE_RET tuya_queue_get_batch(TUYA_QUEUE_HANDLE handle, const uint32_t start,
     }
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
-    struct tuya_list_head *p = NULL;
-    QUEUE_ITEM_T *queue_item = NULL;
+    OPERATE_RET op_ret = OPRT_OK;
     uint32_t index = 0;
     uint32_t count = 0;
 
     QUEUE_LOCK(queue);
-    tuya_list_for_each(p, &(queue->head))
-    {
-        if (index < start) {
-            index++;
-            continue;
+    if (QUEUE_USED(queue, queue->head, queue->tail) < start + num) {
+        op_ret = OPRT_NOT_FOUND;
+    } else {
+        QUEUE_MEMORY_BARRIER();
+        index = (queue->head + start) % queue->slot_num;
+        for (count = 0; count < num; count++) {
+            memcpy((uint8_t *)items + count * queue->item_size, QUEUE_SLOT(queue, index), queue->item_size);
+            index = (index + 1) % queue->slot_num;
         }
+    }
+    QUEUE_UNLOCK(queue);
 
-        if (count >= num) {
-            break;
-        }
+    return op_ret;
+}
 
-        queue_item = tuya_list_entry(p, QUEUE_ITEM_T, node);
-        memcpy((uint8_t *)items + count * queue->item_size, queue_item->data, queue->item_size);
-        count++;
+/**
+ * @brief get items in place from start postion, not dequeue
+ *
+ * @param[in] handle the queue handle
+ * @param[in] start the start postion
+ * @param[out] items pointer to the first item inside the queue
+ * @param[inout] num in: the max item counts, out: the item counts stored
+ * contiguously at items
+ *
+ * @note the items are not copied, they stay valid until removed by
+ * tuya_queue_delete_batch or tuya_queue_output. Only the consumer may call it.
+ *
+ * @return OPRT_OK on success. Others on error, please refer to tuya_error_code.h
+ */
+OPERATE_RET tuya_queue_get_batch_ref(TUYA_QUEUE_HANDLE handle, const uint32_t start, void **items, uint32_t *num)
+{
+    if (NULL == handle || NULL == items || NULL == num || 0 == *num) {
+        return OPRT_INVALID_PARM;
     }
-    QUEUE_UNLOCK(queue);
 
-    if (index != start || count != num) {
-        return OPRT_NOT_FOUND;
+    TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
+    OPERATE_RET op_ret = OPRT_OK;
+    uint32_t used = 0;
+    uint32_t index = 0;
+    uint32_t count = 0;
+
+    QUEUE_LOCK(queue);
+    used = QUEUE_USED(queue, queue->head, queue->tail);
+    if (used <= start) {
+        op_ret = OPRT_NOT_FOUND;
+    } else {
+        QUEUE_MEMORY_BARRIER();
+        index = (queue->head + start) % queue->slot_num;
+        count = used - start;
+        // stop at the end of the slot array
+        if (count > queue->slot_num - index) {
+            count = queue->slot_num - index;
+        }
+        if (count > *num) {
+            count = *num;
+        }
+        *items = QUEUE_SLOT(queue, index);
+        *num = count;
     }
+    QUEUE_UNLOCK(queue);
 
-    return OPRT_OK;
+    return op_ret;
 }
 
 /**
@@ -333,15 +433,24 @@ OPERATE_RET tuya_queue_get_batch(TUYA_QUEUE_HANDLE handle, const uint32_t start,
 OPERATE_RET tuya_queue_delete_batch(TUYA_QUEUE_HANDLE handle, const uint32_t num)
 {
     OPERATE_RET op_ret = OPRT_OK;
-    uint32_t count = num;
 
     if (NULL == handle || 0 == num) {
         return OPRT_INVALID_PARM;
     }
 
-    while ((count-- > 0) && (OPRT_OK == op_ret)) {
-        op_ret = tuya_queue_output(handle, NULL);
+    TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
+    uint32_t used = 0;
+    uint32_t count = num;
+
+    QUEUE_LOCK(queue);
+    used = QUEUE_USED(queue, queue->head, queue->tail);
+    if (count > used) {
+        count = used;
+        op_ret = OPRT_NOT_FOUND;
     }
+    QUEUE_MEMORY_BARRIER();
+    queue->head = (queue->head + count) % queue->slot_num;
+    QUEUE_UNLOCK(queue);
 
     return op_ret;
 }
@@ -361,7 +470,7 @@ uint32_t tuya_queue_get_free_num(TUYA_QUEUE_HANDLE handle)
 
     TUYA_QUEUE_T *queue = (TUYA_QUEUE_T *)handle;
 
-    return queue->queue_free;
+    return queue->queue_len - QUEUE_USED(queue, queue->head, queue->tail);
 }
 
 /**
@@ -381,7 +490,7 @@ uint32_t tuya_queue_get_used_num(TUYA_QUEUE_HANDLE handle)
     uint32_t used_num = 0;
 
     QUEUE_LOCK(queue);
-    used_num = queue->queue_len - queue->queue_free;
+    used_num = QUEUE_USED(queue, queue->head, queue->tail);
     QUEUE_UNLOCK(queue);
 
     return used_num;